@@ -0,0 +1,409 @@
+/**************************************************************************
+MODULE:    Batch
+CONTAINS:  Batch engine executing command files with precise timing.
+           Commands are precompiled into an operation array, delays are
+           scheduled against absolute deadlines on a monotonic clock so
+           the time taken by reads and writes does not add up.
+COPYRIGHT: Embedded Systems Academy, Inc. 2008-2017.
+DISCLAIM:  Read and understand our disclaimer before using this code!
+           www.esacademy.com/disclaim.htm
+           This software was written in accordance to the guidelines at
+           www.esacademy.com/software/softwarestyleguide.pdf
+LICENSE:   Free to use with licensed CANopenIA chips, modules or devices
+           like CANgineBerry, CANgineXXX and 447izer
+VERSION:   1.10, EmSA 10-NOV-17
+           $LastChangedDate: 2014-01-11 17:30:59 +0100 (Sa, 11 Jan 2014) $
+           $LastChangedRevision: 1702 $
+***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#ifndef WIN32
+#include <poll.h>
+#endif
+#include "Batch.h"
+#include "Timer.h"
+
+/**************************************************************************
+LOCAL DEFINES
+***************************************************************************/
+
+// initial number of operations allocated
+#define INITIAL_OPS 64
+
+
+/**************************************************************************
+DOES:    Constructor - creates an empty batch
+**************************************************************************/
+BATCH::BATCH
+  (
+  void
+  )
+{
+  Ops = NULL;
+  Remaining = NULL;
+  Count = 0;
+  ErrorLine = 0;
+  Device = NULL;
+  StopRequested = FALSE;
+  memset(&Stats, 0, sizeof(Stats));
+}
+
+
+/**************************************************************************
+DOES:    Destructor - releases the operations
+**************************************************************************/
+BATCH::~BATCH
+  (
+  void
+  )
+{
+  free(Ops);
+  free(Remaining);
+}
+
+
+/**************************************************************************
+DOES:    Loads and compiles a command file
+RETURNS: TRUE for success, FALSE for error, see GetErrorLine()
+**************************************************************************/
+bool BATCH::Load
+  (
+  const char *FileName                                     // command file
+  )
+{
+  FILE *File;
+  char *Text;
+  long Length;
+  bool Result;
+
+  ErrorLine = 0;
+  File = fopen(FileName, "rb");
+  if (File == NULL)
+  {
+    fprintf(stderr, "ERROR: %d opening %s: %s\n", errno, FileName, strerror(errno));
+    return FALSE;
+  }
+
+  fseek(File, 0, SEEK_END);
+  Length = ftell(File);
+  fseek(File, 0, SEEK_SET);
+  Text = (char *)malloc(Length + 1);
+  if ((Text == NULL) || (fread(Text, 1, Length, File) != (size_t)Length))
+  {
+    fprintf(stderr, "ERROR: reading %s\n", FileName);
+    free(Text);
+    fclose(File);
+    return FALSE;
+  }
+  fclose(File);
+  Text[Length] = 0;
+
+  Result = Compile(Text);
+  free(Text);
+  return Result;
+}
+
+
+/**************************************************************************
+DOES:    Compiles commands, one or more per line, replacing the previous
+         operations. Loops must be closed by a matching end.
+RETURNS: TRUE for success, FALSE for error, see GetErrorLine()
+**************************************************************************/
+bool BATCH::Compile
+  (
+  const char *Text                                         // zero terminated commands
+  )
+{
+  unsigned long Loops[BATCH_MAX_NESTING];
+  unsigned long Nesting = 0;
+  unsigned long Capacity = 0;
+  unsigned long Line = 1;
+  const char *Pos;
+  BATCH_OP *NewOps;
+  COMMAND Command;
+
+  Count = 0;
+  ErrorLine = 0;
+
+  for (;;)
+  {
+    Pos = Text;
+    if (!CMD_Parse(&Text, &Command))
+    {
+      // report the line the bad command starts on
+      while ((*Pos == ' ') || (*Pos == '\t') || (*Pos == '\r') || (*Pos == '\n'))
+      {
+        if (*Pos++ == '\n') Line++;
+      }
+      ErrorLine = Line;
+      return FALSE;
+    }
+    for (; Pos < Text; Pos++)
+    {
+      if (*Pos == '\n') Line++;
+    }
+    if (Command.Type == CMD_NONE) break;
+
+    if (Count == Capacity)
+    {
+      Capacity = Capacity ? Capacity * 2 : INITIAL_OPS;
+      NewOps = (BATCH_OP *)realloc(Ops, Capacity * sizeof(BATCH_OP));
+      if (NewOps == NULL)
+      {
+        ErrorLine = Line;
+        return FALSE;
+      }
+      Ops = NewOps;
+    }
+    Ops[Count].Command = Command;
+    Ops[Count].Line = Line;
+    Ops[Count].Jump = 0;
+
+    // link loops with their end
+    if (Command.Type == CMD_LOOP)
+    {
+      if (Nesting == BATCH_MAX_NESTING)
+      {
+        ErrorLine = Line;
+        return FALSE;
+      }
+      Loops[Nesting++] = Count;
+    }
+    else if (Command.Type == CMD_END)
+    {
+      if (Nesting == 0)
+      {
+        ErrorLine = Line;
+        return FALSE;
+      }
+      Nesting--;
+      Ops[Count].Jump = Loops[Nesting];
+      Ops[Loops[Nesting]].Jump = Count + 1;
+    }
+    Count++;
+  }
+
+  if (Nesting != 0)
+  {
+    ErrorLine = Ops[Loops[Nesting - 1]].Line;
+    return FALSE;
+  }
+
+  free(Remaining);
+  Remaining = (UNSIGNED32 *)calloc(Count ? Count : 1, sizeof(UNSIGNED32));
+  return Remaining != NULL;
+}
+
+
+/**************************************************************************
+DOES:    Call-back function, tracks node and device states while running
+RETURNS: Nothing
+**************************************************************************/
+void BATCH::DataCallback
+  (
+  unsigned char NodeID,                                    // node id
+  int Index,                                               // index
+  unsigned char Subindex,                                  // subindex
+  unsigned long DataLength,                                // length of data
+  unsigned char *Data,                                     // data
+  void *Param                                              // batch
+  )
+{
+  BATCH *Batch = (BATCH *)Param;
+
+  if (DataLength < 1) return;
+  if ((Index == 0x5F00) && (Subindex == 0x02))
+  { // own NMT state
+    Batch->NodeStatus[0] = Data[0];
+  }
+  else if (Index == 0x5F04)
+  { // node status, highest bit set for own node id
+    Batch->NodeStatus[Subindex & 0x7F] = Data[0];
+  }
+}
+
+
+/**************************************************************************
+DOES:    Handles data from the device until there is no more data or the
+         given time is reached
+RETURNS: Nothing
+**************************************************************************/
+void BATCH::Service
+  (
+  uint64_t Until                                           // monotonic time in us
+  )
+{
+#ifdef WIN32
+  uint64_t Now = Timer::GetMicroseconds();
+
+  // the serial port can not be waited for, its reads return at once with
+  // the data received so far, so it is polled once per millisecond
+  if (Until <= Now) return;
+  Device->Process();
+  if (Until > Timer::GetMicroseconds() + 1000) Timer::Sleep(1);
+#else
+  struct pollfd Fd;
+  struct timespec Timeout;
+  uint64_t Now = Timer::GetMicroseconds();
+
+  if (Until <= Now) return;
+  Timeout.tv_sec = (Until - Now) / 1000000;
+  Timeout.tv_nsec = ((Until - Now) % 1000000) * 1000;
+
+  Fd.fd = Device->GetHandle();
+  Fd.events = POLLIN;
+  if (ppoll(&Fd, 1, &Timeout, NULL) <= 0) return;
+
+  // handle everything the device sent, without waiting for more
+  do
+  {
+    Device->Process();
+  } while (poll(&Fd, 1, 0) > 0);
+#endif // !WIN32
+}
+
+
+/**************************************************************************
+DOES:    Waits for a deadline, handling data from the device meanwhile.
+         The last BATCH_SPIN_TIME microseconds are busy waited.
+RETURNS: Monotonic time in us when the wait ended
+**************************************************************************/
+uint64_t BATCH::WaitUntil
+  (
+  uint64_t Deadline                                        // monotonic time in us
+  )
+{
+  uint64_t Now;
+
+  for (;;)
+  {
+    Now = Timer::GetMicroseconds();
+    if (Now >= Deadline) return Now;
+    if (Deadline - Now > BATCH_SPIN_TIME)
+    {
+      Service(Deadline - BATCH_SPIN_TIME);
+    }
+  }
+}
+
+
+/**************************************************************************
+DOES:    Waits until a node or the device reports a status. The status last
+         reported since the start of the run counts.
+RETURNS: ERROR_NOERROR for success or ERROR_NORESPONSE on timeout
+**************************************************************************/
+unsigned long BATCH::WaitForStatus
+  (
+  const COMMAND *Command                                   // wait-for-status command
+  )
+{
+  uint64_t Until = Timer::GetMicroseconds() + (uint64_t)Command->Delay * 1000;
+
+  while (NodeStatus[Command->NodeID] != Command->Status)
+  {
+    if (StopRequested || (Timer::GetMicroseconds() >= Until)) return ERROR_NORESPONSE;
+    Service(Until);
+  }
+  return ERROR_NOERROR;
+}
+
+
+/**************************************************************************
+DOES:    Executes all operations. Registers its own data callback with
+         the device for the duration of the run to track node states.
+RETURNS: ERROR_NOERROR for success or the error of the first failed
+         operation, see GetErrorLine()
+**************************************************************************/
+unsigned long BATCH::Run
+  (
+  SerialProtocol *Dev,                                     // device to access
+  bool StopOnError,                                        // TRUE to abort on first error
+  BATCHRESULTCALLBACK Callback,                            // result callback or NULL
+  void *Param                                              // arbitrary callback parameter
+  )
+{
+  UNSIGNED8 Data[MAX_WRITE_LENGTH];
+  unsigned long DataLength;
+  unsigned long Result;
+  unsigned long FirstError = ERROR_NOERROR;
+  unsigned long Pc = 0;
+  uint64_t Start;
+  uint64_t Deadline;
+  uint64_t Now;
+  const BATCH_OP *Op;
+
+  Device = Dev;
+  StopRequested = FALSE;
+  ErrorLine = 0;
+  memset(&Stats, 0, sizeof(Stats));
+  memset(NodeStatus, BATCH_STATUS_UNKNOWN, sizeof(NodeStatus));
+  Device->RegisterDataCallback((DATACALLBACK *)DataCallback, this);
+
+  Start = Timer::GetMicroseconds();
+  Deadline = Start;
+
+  while ((Pc < Count) && !StopRequested)
+  {
+    Op = &Ops[Pc];
+    switch (Op->Command.Type)
+    {
+      case CMD_LOOP:
+        // loop 0 repeats until stopped
+        Remaining[Pc] = Op->Command.Count;
+        Pc++;
+        continue;
+
+      case CMD_END:
+        if ((Ops[Op->Jump].Command.Count == 0) || (--Remaining[Op->Jump] > 0)) Pc = Op->Jump + 1;
+        else Pc++;
+        continue;
+
+      case CMD_DELAY:
+        // relative to the previous deadline, not to the end of the
+        // previous operation
+        Deadline += (uint64_t)Op->Command.Delay * 1000;
+        Now = WaitUntil(Deadline);
+        Stats.Deadlines++;
+        Stats.TotalLateness += Now - Deadline;
+        if (Now - Deadline > Stats.MaxLateness) Stats.MaxLateness = (UNSIGNED32)(Now - Deadline);
+        Pc++;
+        continue;
+
+      case CMD_WAITSTATUS:
+        DataLength = 0;
+        Result = WaitForStatus(&Op->Command);
+        // unknown time waited, following delays start from here
+        Deadline = Timer::GetMicroseconds();
+        break;
+
+      default:
+        Result = CMD_Execute(Device, &Op->Command, &DataLength, Data);
+        break;
+    }
+
+    Stats.Operations++;
+    if (Callback) Callback(Op, Result, DataLength, Data, Param);
+    if (Result != ERROR_NOERROR)
+    {
+      Stats.Errors++;
+      if (FirstError == ERROR_NOERROR)
+      {
+        FirstError = Result;
+        ErrorLine = Op->Line;
+      }
+      if (StopOnError) break;
+    }
+    Pc++;
+  }
+
+  Stats.Duration = Timer::GetMicroseconds() - Start;
+  Device->RegisterDataCallback(NULL, NULL);
+  Device = NULL;
+
+  return FirstError;
+}
+
+/*----------------------- END OF FILE ----------------------------------*/
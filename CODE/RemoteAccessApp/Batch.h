@@ -0,0 +1,149 @@
+/**************************************************************************
+MODULE:    Batch
+CONTAINS:  Batch engine executing command files with precise timing.
+           Commands are precompiled into an operation array, delays are
+           scheduled against absolute deadlines on a monotonic clock so
+           the time taken by reads and writes does not add up.
+COPYRIGHT: Embedded Systems Academy, Inc. 2008-2017.
+DISCLAIM:  Read and understand our disclaimer before using this code!
+           www.esacademy.com/disclaim.htm
+           This software was written in accordance to the guidelines at
+           www.esacademy.com/software/softwarestyleguide.pdf
+LICENSE:   Free to use with licensed CANopenIA chips, modules or devices
+           like CANgineBerry, CANgineXXX and 447izer
+VERSION:   1.10, EmSA 10-NOV-17
+           $LastChangedDate: 2014-01-11 17:30:59 +0100 (Sa, 11 Jan 2014) $
+           $LastChangedRevision: 1702 $
+***************************************************************************/
+#pragma once
+
+#ifndef _BATCH_H
+#define _BATCH_H
+
+#include <stdint.h>
+#include "global.h"
+#include "SerialProtocol.h"
+#include "Command.h"
+
+/**************************************************************************
+GLOBAL DEFINES
+***************************************************************************/
+
+// max nesting depth of loops
+#define BATCH_MAX_NESTING 16
+
+// time before a deadline in microseconds that is busy waited instead of
+// sleeping, covers the wake up latency of the operating system
+#define BATCH_SPIN_TIME 500
+
+// status of a node that did not report one yet
+#define BATCH_STATUS_UNKNOWN 0xFF
+
+/**************************************************************************
+GLOBAL TYPES AND FUNCTIONS
+***************************************************************************/
+
+// Single precompiled operation
+typedef struct
+{
+  COMMAND Command;
+  unsigned long Line;                         // line in command file
+  unsigned long Jump;                         // loop: operation after end, end: loop
+} BATCH_OP;
+
+// Timing and result statistics of a run
+typedef struct
+{
+  unsigned long Operations;                   // reads, writes and waits executed
+  unsigned long Errors;                       // operations that failed
+  unsigned long Deadlines;                    // delays completed
+  UNSIGNED32 MaxLateness;                     // microseconds a delay ended late, worst case
+  uint64_t TotalLateness;                     // sum of all delays
+  uint64_t Duration;                          // microseconds of whole run
+} BATCH_STATS;
+
+// Called after every read, write or wait
+typedef void (*BATCHRESULTCALLBACK)(
+  const BATCH_OP *Op,                         // executed operation
+  unsigned long Result,                       // ERROR_xxx
+  unsigned long Length,                       // length of data read
+  const UNSIGNED8 *Data,                      // data read
+  void *Param                                 // parameter given to Run()
+  );
+
+class BATCH
+{
+  public:
+    /**************************************************************************
+    DOES:    Constructor - creates an empty batch
+    **************************************************************************/
+    BATCH(void);
+    /**************************************************************************
+    DOES:    Destructor - releases the operations
+    **************************************************************************/
+    ~BATCH(void);
+    /**************************************************************************
+    DOES:    Loads and compiles a command file
+    RETURNS: TRUE for success, FALSE for error, see GetErrorLine()
+    **************************************************************************/
+    bool Load(const char *FileName);
+    /**************************************************************************
+    DOES:    Compiles commands, one or more per line, replacing the previous
+             operations. Loops must be closed by a matching end.
+    RETURNS: TRUE for success, FALSE for error, see GetErrorLine()
+    **************************************************************************/
+    bool Compile(const char *Text);
+    /**************************************************************************
+    DOES:    Executes all operations. Registers its own data callback with
+             the device for the duration of the run to track node states.
+    RETURNS: ERROR_NOERROR for success or the error of the first failed
+             operation, see GetErrorLine()
+    **************************************************************************/
+    unsigned long Run(
+      SerialProtocol *Dev,                    // device to access
+      bool StopOnError,                       // TRUE to abort on first error
+      BATCHRESULTCALLBACK Callback,           // result callback or NULL
+      void *Param                             // arbitrary callback parameter
+      );
+    /**************************************************************************
+    DOES:    Requests a running batch to stop after the current operation,
+             may be called from a signal handler
+    RETURNS: Nothing
+    **************************************************************************/
+    void Stop(void) { StopRequested = TRUE; }
+    /**************************************************************************
+    DOES:    Gets the operations
+    RETURNS: Number of operations / operation
+    **************************************************************************/
+    unsigned long GetOpCount(void) const { return Count; }
+    const BATCH_OP *GetOp(unsigned long Position) const { return &Ops[Position]; }
+    /**************************************************************************
+    DOES:    Gets the line of the last compile error or first failed operation
+    RETURNS: Line number, 0 if none
+    **************************************************************************/
+    unsigned long GetErrorLine(void) const { return ErrorLine; }
+    /**************************************************************************
+    DOES:    Gets the statistics of the last run
+    RETURNS: Statistics
+    **************************************************************************/
+    const BATCH_STATS *GetStats(void) const { return &Stats; }
+
+  private:
+    void Service(uint64_t Until);
+    uint64_t WaitUntil(uint64_t Deadline);
+    unsigned long WaitForStatus(const COMMAND *Command);
+    static void DataCallback(unsigned char NodeID, int Index, unsigned char Subindex, unsigned long DataLength, unsigned char *Data, void *Param);
+
+    BATCH_OP *Ops;
+    UNSIGNED32 *Remaining;                    // loop iterations left, per loop operation
+    unsigned long Count;
+    unsigned long ErrorLine;
+    SerialProtocol *Device;                   // device while running
+    volatile bool StopRequested;
+    UNSIGNED8 NodeStatus[128];                // last status reported, [0] is the device itself
+    BATCH_STATS Stats;
+};
+
+#endif // _BATCH_H
+
+/*----------------------- END OF FILE ----------------------------------*/
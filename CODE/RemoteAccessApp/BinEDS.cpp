@@ -0,0 +1,802 @@
+/**************************************************************************
+MODULE:    BinEDS
+CONTAINS:  Reader and writer for binary CANopenIA configuration files
+           (".bin", POCM format version 2.00) as loaded by COIAUpdater
+COPYRIGHT: Embedded Systems Academy, Inc. 2008-2017.
+DISCLAIM:  Read and understand our disclaimer before using this code!
+           www.esacademy.com/disclaim.htm
+           This software was written in accordance to the guidelines at
+           www.esacademy.com/software/softwarestyleguide.pdf
+LICENSE:   Free to use with licensed CANopenIA chips, modules or devices
+           like CANgineBerry, CANgineXXX and 447izer
+VERSION:   1.10, EmSA 10-NOV-17
+           $LastChangedDate: 2014-01-11 17:30:59 +0100 (Sa, 11 Jan 2014) $
+           $LastChangedRevision: 1702 $
+***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#ifndef WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#include "BinEDS.h"
+#include "CRC.h"
+
+/**************************************************************************
+LOCAL DEFINES
+***************************************************************************/
+
+// tables start on this boundary, the gap is filled with zeros
+#define TABLE_ALIGNMENT 4
+// highest number of PDOs of each direction
+#define MAX_PDOS 512
+
+// classification of EDS entries in the image
+#define KIND_NONE     0
+#define KIND_SDOREPLY 1
+#define KIND_ODENTRY  2
+#define KIND_GENERIC  3
+
+/**************************************************************************
+DOES:    Stores a value of up to 8 bytes in little-endian format
+RETURNS: Nothing
+**************************************************************************/
+static void StoreValue(
+  uint64_t Value,               // value to store
+  UNSIGNED8 *Loc,               // destination
+  unsigned long Size            // number of bytes to store
+  )
+{
+  unsigned long b;
+
+  for (b = 0; (b < Size) && (b < 8); b++)
+  {
+    Loc[b] = (UNSIGNED8)(Value >> (8 * b));
+  }
+}
+
+/**************************************************************************
+DOES:    Gets the size of an entry in the process image
+RETURNS: Size in bytes
+**************************************************************************/
+static UNSIGNED16 GetImageSize(
+  const EDS_ENTRY *Entry        // entry of the EDS
+  )
+{
+  if ((Entry->Index == BINEDS_CHIPID_INDEX) && (Entry->Subindex == BINEDS_CHIPID_SUBINDEX) && (Entry->Size == 0))
+  {
+    return BINEDS_CHIPID_SIZE;
+  }
+  return Entry->Size;
+}
+
+/**************************************************************************
+DOES:    Checks if an index is a PDO communication parameter, these are
+         listed in the SDO reply table as well as in the process image
+RETURNS: TRUE if index is 1400h to 15FFh or 1800h to 19FFh
+**************************************************************************/
+static bool IsPDOParameter(
+  UNSIGNED16 Index              // index of od entry
+  )
+{
+  return ((Index >= 0x1400) && (Index <= 0x15FF)) || ((Index >= 0x1800) && (Index <= 0x19FF));
+}
+
+/**************************************************************************
+DOES:    Gets the default value of an object for the node being configured
+RETURNS: Default value, 0 if the entry has none, Default if the entry does
+         not exist
+**************************************************************************/
+static UNSIGNED32 GetObjectDefault(
+  const EDS *Eds,               // parsed device description
+  UNSIGNED16 Index,             // index of od entry
+  UNSIGNED8 Subindex,           // subindex of od entry
+  UNSIGNED8 NodeID,             // node id, used for $NODEID
+  UNSIGNED32 Default            // value if the entry does not exist
+  )
+{
+  const EDS_ENTRY *Entry = Eds->Find(Index, Subindex);
+
+  if (!Entry)
+  {
+    return Default;
+  }
+  if (!(Entry->Flags & EDS_FLAG_DEFAULT) || (Entry->Flags & EDS_FLAG_STRING))
+  {
+    return 0;
+  }
+  return (UNSIGNED32)EDS::GetDefault(Entry, NodeID);
+}
+
+/**************************************************************************
+DOES:    Constructor - creates an empty configuration
+**************************************************************************/
+BINEDS::BINEDS(
+  void
+  )
+{
+  Image = NULL;
+  Length = 0;
+  Buffer = NULL;
+  Mapping = NULL;
+#ifdef WIN32
+  File = INVALID_HANDLE_VALUE;
+  MappingHandle = NULL;
+#endif
+  memset(&Header, 0, sizeof(Header));
+  memset(Tables, 0, sizeof(Tables));
+}
+
+/**************************************************************************
+DOES:    Destructor - unmaps or releases the image
+**************************************************************************/
+BINEDS::~BINEDS(
+  void
+  )
+{
+  Close();
+}
+
+/**************************************************************************
+DOES:    Unmaps or releases the current image
+RETURNS: Nothing
+**************************************************************************/
+void BINEDS::Close(
+  void
+  )
+{
+#ifdef WIN32
+  if (Mapping) UnmapViewOfFile(Mapping);
+  if (MappingHandle) CloseHandle(MappingHandle);
+  if (File != INVALID_HANDLE_VALUE) CloseHandle(File);
+  MappingHandle = NULL;
+  File = INVALID_HANDLE_VALUE;
+#else
+  if (Mapping) munmap(Mapping, Length);
+#endif
+  Mapping = NULL;
+  free(Buffer);
+  Buffer = NULL;
+  Image = NULL;
+  Length = 0;
+  memset(&Header, 0, sizeof(Header));
+  memset(Tables, 0, sizeof(Tables));
+}
+
+/**************************************************************************
+DOES:    Memory maps a configuration file and checks it
+RETURNS: TRUE for success, FALSE for error
+**************************************************************************/
+bool BINEDS::Open(
+  const char *FileName          // name of configuration file
+  )
+{
+  Close();
+
+#ifdef WIN32
+  LARGE_INTEGER Size;
+
+  File = CreateFileA(FileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (File == INVALID_HANDLE_VALUE)
+  {
+    fprintf(stderr, "ERROR: %lu opening %s\n", GetLastError(), FileName);
+    return FALSE;
+  }
+  if (!GetFileSizeEx(File, &Size) || (Size.QuadPart == 0))
+  {
+    Close();
+    return FALSE;
+  }
+  MappingHandle = CreateFileMapping(File, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (MappingHandle)
+  {
+    Mapping = MapViewOfFile(MappingHandle, FILE_MAP_READ, 0, 0, 0);
+  }
+  if (!Mapping)
+  {
+    fprintf(stderr, "ERROR: %lu mapping %s\n", GetLastError(), FileName);
+    Close();
+    return FALSE;
+  }
+  Length = (unsigned long)Size.QuadPart;
+#else
+  struct stat st;
+  int fd = open(FileName, O_RDONLY);
+
+  if (fd < 0)
+  {
+    fprintf(stderr, "ERROR: %d opening %s: %s\n", errno, FileName, strerror(errno));
+    return FALSE;
+  }
+  if ((fstat(fd, &st) != 0) || (st.st_size == 0))
+  {
+    close(fd);
+    return FALSE;
+  }
+  Mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // the mapping stays valid after the descriptor is closed
+  close(fd);
+  if (Mapping == MAP_FAILED)
+  {
+    fprintf(stderr, "ERROR: %d mapping %s: %s\n", errno, FileName, strerror(errno));
+    Mapping = NULL;
+    return FALSE;
+  }
+  Length = (unsigned long)st.st_size;
+#endif
+
+  Image = (const UNSIGNED8 *)Mapping;
+  if (!Check())
+  {
+    fprintf(stderr, "ERROR: %s is not a valid configuration file\n", FileName);
+    Close();
+    return FALSE;
+  }
+  return TRUE;
+}
+
+/**************************************************************************
+DOES:    Uses a configuration image in memory, the image is not copied
+         and must remain valid while in use
+RETURNS: TRUE for success, FALSE if image is not a valid configuration
+**************************************************************************/
+bool BINEDS::Attach(
+  const UNSIGNED8 *NewImage,    // configuration image
+  unsigned long NewLength       // length of image in bytes
+  )
+{
+  Close();
+  Image = NewImage;
+  Length = NewLength;
+  if (!Check())
+  {
+    Close();
+    return FALSE;
+  }
+  return TRUE;
+}
+
+/**************************************************************************
+DOES:    Counts records of a table up to its end marker (all bytes 0xFF)
+RETURNS: Number of records, excluding the end marker
+**************************************************************************/
+unsigned long BINEDS::CountRecords(
+  unsigned long Offset,         // offset of table in image
+  unsigned long RecordSize      // size of one record
+  ) const
+{
+  unsigned long Records = 0;
+  unsigned long b;
+
+  while (Offset + RecordSize <= Length - BINEDS_TRAILER_SIZE)
+  {
+    for (b = 0; b < RecordSize; b++)
+    {
+      if (Image[Offset + b] != 0xFF) break;
+    }
+    if (b == RecordSize)
+    {
+      return Records;
+    }
+    Records++;
+    Offset += RecordSize;
+  }
+
+  // no end marker, table is truncated
+  return 0;
+}
+
+/**************************************************************************
+DOES:    Checks header, offsets and CRC of the image and builds the views
+RETURNS: TRUE if valid
+**************************************************************************/
+bool BINEDS::Check(
+  void
+  )
+{
+  static const unsigned long RecordSizes[BINEDS_TABLES] = {
+    BINEDS_SDOREPLY_SIZE, BINEDS_ODENTRY_SIZE, BINEDS_GENERIC_SIZE, 1, 1, 1,
+    BINEDS_RPDO_SIZE, BINEDS_TPDO_SIZE
+  };
+  CRC crc;
+  unsigned long b;
+  unsigned long Offset;
+  unsigned short CRCValue;
+
+  if (Length < BINEDS_HEADER_SIZE + BINEDS_OFFSETS_SIZE + BINEDS_TRAILER_SIZE)
+  {
+    return FALSE;
+  }
+  if (memcmp(&Image[4], "POCM", 4) != 0)
+  {
+    return FALSE;
+  }
+
+  Header.Major = GET_U16(&Image[0]);
+  Header.Minor = GET_U16(&Image[2]);
+  Header.Func = GET_U32(&Image[8]);
+  Header.Baudrate = GET_U16(&Image[12]);
+  Header.NodeID = Image[14];
+  Header.NrOfRPDO = GET_U16(&Image[16]);
+  Header.NrOfTPDO = GET_U16(&Image[18]);
+  Header.PISize = GET_U32(&Image[20]);
+  memcpy(Header.IDString, &Image[32], BINEDS_IDSTRING_LENGTH);
+  Header.IDString[BINEDS_IDSTRING_LENGTH] = 0;
+  if (Header.Major != BINEDS_VERSION_MAJOR)
+  {
+    return FALSE;
+  }
+
+  // CRC over everything but the CRC itself, stored low byte first
+  for (b = 0; b < Length - 2; b++) crc.Add(Image[b]);
+  CRCValue = crc.Finalize();
+  if (CRCValue != (unsigned short)(GET_U16(&Image[Length - 2])))
+  {
+    return FALSE;
+  }
+
+  for (b = 0; b < BINEDS_TABLES; b++)
+  {
+    Offset = GET_U32(&Image[BINEDS_HEADER_SIZE + (b * 4)]);
+    if (Offset > Length - BINEDS_TRAILER_SIZE)
+    {
+      return FALSE;
+    }
+    Tables[b].Data = &Image[Offset];
+    Tables[b].RecordSize = RecordSizes[b];
+    if ((b == BINEDS_TABLE_PIDEFAULT) ||
+        (((b == BINEDS_TABLE_PIMAX) || (b == BINEDS_TABLE_PIMIN)) && (Header.Func & BINEDS_FUNC_PIMINMAX)))
+    {
+      if (Offset + Header.PISize > Length - BINEDS_TRAILER_SIZE)
+      {
+        return FALSE;
+      }
+      Tables[b].Count = Header.PISize;
+    }
+    else if ((b == BINEDS_TABLE_PIMAX) || (b == BINEDS_TABLE_PIMIN))
+    {
+      Tables[b].Count = 0;
+    }
+    else
+    {
+      Tables[b].Count = CountRecords(Offset, RecordSizes[b]);
+    }
+  }
+
+  return TRUE;
+}
+
+/**************************************************************************
+DOES:    Gets a view of a table, no data is copied
+RETURNS: View, Count is 0 if table is empty or image is not loaded
+**************************************************************************/
+BINEDS_VIEW BINEDS::GetTable(
+  int Table                     // BINEDS_TABLE_xxx
+  ) const
+{
+  BINEDS_VIEW Empty = { NULL, 0, 1 };
+
+  if ((Table < 0) || (Table >= BINEDS_TABLES) || !Image)
+  {
+    return Empty;
+  }
+  return Tables[Table];
+}
+
+/**************************************************************************
+DOES:    Decode a single record of a table view
+RETURNS: Nothing
+**************************************************************************/
+void BINEDS::GetSDOReply(
+  const BINEDS_VIEW *View,      // view of BINEDS_TABLE_SDOREPLY
+  unsigned long Record,         // record number
+  BINEDS_SDOREPLY *Reply        // location to store decoded record
+  )
+{
+  const UNSIGNED8 *Rec = View->Data + (Record * BINEDS_SDOREPLY_SIZE);
+
+  Reply->Command = Rec[0];
+  Reply->Index = GET_U16(&Rec[1]);
+  Reply->Subindex = Rec[3];
+  Reply->Data = &Rec[4];
+}
+
+void BINEDS::GetODEntry(
+  const BINEDS_VIEW *View,      // view of BINEDS_TABLE_ODENTRY
+  unsigned long Record,         // record number
+  BINEDS_ODENTRY *Entry         // location to store decoded record
+  )
+{
+  const UNSIGNED8 *Rec = View->Data + (Record * BINEDS_ODENTRY_SIZE);
+
+  Entry->Index = GET_U16(&Rec[0]);
+  Entry->Subindex = Rec[2];
+  Entry->DSAT = Rec[3];
+  Entry->Offset = GET_U16(&Rec[4]);
+}
+
+void BINEDS::GetGeneric(
+  const BINEDS_VIEW *View,      // view of BINEDS_TABLE_GENERIC
+  unsigned long Record,         // record number
+  BINEDS_GENERIC *Entry         // location to store decoded record
+  )
+{
+  const UNSIGNED8 *Rec = View->Data + (Record * BINEDS_GENERIC_SIZE);
+
+  Entry->Index = GET_U16(&Rec[0]);
+  Entry->Subindex = Rec[2];
+  Entry->Access = Rec[3];
+  Entry->Size = GET_U16(&Rec[4]);
+  Entry->Offset = GET_U16(&Rec[6]);
+}
+
+void BINEDS::GetPDO(
+  const BINEDS_VIEW *View,      // view of BINEDS_TABLE_RPDO or BINEDS_TABLE_TPDO
+  unsigned long Record,         // record number
+  BINEDS_PDO *Pdo               // location to store decoded record
+  )
+{
+  const UNSIGNED8 *Rec = View->Data + (Record * View->RecordSize);
+
+  Pdo->Number = Rec[0];
+  Pdo->TransType = Rec[1];
+  Pdo->Length = Rec[2];
+  Pdo->COBID = GET_U32(&Rec[4]);
+  Pdo->Offset = GET_U32(&Rec[8]);
+  Pdo->EventTime = 0;
+  Pdo->InhibitTime = 0;
+  if (View->RecordSize == BINEDS_TPDO_SIZE)
+  {
+    Pdo->EventTime = GET_U16(&Rec[12]);
+    Pdo->InhibitTime = GET_U16(&Rec[14]);
+  }
+}
+
+/**************************************************************************
+DOES:    Generates a configuration image from an EDS for a node
+         Constant entries become SDO replies, entries of up to 4 bytes are
+         placed in the OD entry table, all others in the generic table.
+         PDO mappable entries are placed first in the process image.
+RETURNS: TRUE for success, FALSE for error
+**************************************************************************/
+bool BINEDS::Generate(
+  const EDS *Eds,               // parsed device description
+  UNSIGNED8 NodeID,             // node id, used for $NODEID
+  UNSIGNED16 Baudrate,          // CAN bitrate in kbps
+  UNSIGNED32 Func,              // BINEDS_FUNC_xxx
+  const char *IDString          // identification, truncated to 96 chars
+  )
+{
+  unsigned long Count = Eds->GetEntryCount();
+  const EDS_DEVICEINFO *Info = Eds->GetDeviceInfo();
+  const EDS_ENTRY *Entry;
+  const EDS_ENTRY *Mapped;
+  UNSIGNED8 *Kind;
+  UNSIGNED16 *PIOffset;
+  UNSIGNED8 *Buf;
+  UNSIGNED8 *Rec;
+  unsigned long e;
+  unsigned long Pass;
+  unsigned long PISize = 0;
+  unsigned long Records[BINEDS_TABLES];
+  unsigned long MaxLength;
+  unsigned long Pos;
+  unsigned long PDOBase;
+  unsigned long Mappings;
+  unsigned long m;
+  unsigned long t;
+  UNSIGNED32 Map;
+  UNSIGNED32 COBID;
+  UNSIGNED8 PDOLength;
+  UNSIGNED32 PDOOffset;
+  bool HavePI;
+  CRC crc;
+  unsigned short CRCValue;
+
+  Close();
+
+  Kind = (UNSIGNED8 *)calloc(Count + 1, 1);
+  PIOffset = (UNSIGNED16 *)calloc(Count + 1, sizeof(UNSIGNED16));
+  if (!Kind || !PIOffset)
+  {
+    free(Kind);
+    free(PIOffset);
+    return FALSE;
+  }
+
+  // classify entries, data type definitions below 1000h are not objects
+  memset(Records, 0, sizeof(Records));
+  for (e = 0; e < Count; e++)
+  {
+    Entry = Eds->GetEntry(e);
+    if (Entry->Index < 0x1000)
+      Kind[e] = KIND_NONE;
+    else if ((Entry->Flags & EDS_FLAG_CONST) && !(Entry->Flags & EDS_FLAG_STRING) &&
+             (Entry->Size >= 1) && (Entry->Size <= 4) && EDS::GetTypeSize(Entry->DataType))
+      Kind[e] = KIND_SDOREPLY;
+    else if ((Entry->Size >= 1) && (Entry->Size <= 4) && EDS::GetTypeSize(Entry->DataType))
+      Kind[e] = KIND_ODENTRY;
+    else
+      Kind[e] = KIND_GENERIC;
+  }
+
+  // process image: RPDO mappable entries, TPDO mappable entries, then all
+  // remaining entries in index order
+  for (Pass = 0; Pass < 3; Pass++)
+  {
+    for (e = 0; e < Count; e++)
+    {
+      Entry = Eds->GetEntry(e);
+      if ((Kind[e] != KIND_ODENTRY) && (Kind[e] != KIND_GENERIC)) continue;
+      if ((Pass == 0) && !((Kind[e] == KIND_ODENTRY) && (Entry->Access & WMAP))) continue;
+      if ((Pass == 1) && !((Kind[e] == KIND_ODENTRY) && ((Entry->Access & (RMAP | WMAP)) == RMAP))) continue;
+      if ((Pass == 2) && (Kind[e] == KIND_ODENTRY) && (Entry->Access & (RMAP | WMAP))) continue;
+
+      Records[(Kind[e] == KIND_ODENTRY) ? BINEDS_TABLE_ODENTRY : BINEDS_TABLE_GENERIC]++;
+      if (Entry->Index == BINEDS_DIAGNOSTICS_INDEX) continue;
+      PIOffset[e] = (UNSIGNED16)PISize;
+      PISize += GetImageSize(Entry);
+    }
+  }
+  if (PISize > 0xFFFF)
+  {
+    fprintf(stderr, "ERROR: process image of %lu bytes too large\n", PISize);
+    free(Kind);
+    free(PIOffset);
+    return FALSE;
+  }
+  for (e = 0; e < Count; e++)
+  {
+    if ((Kind[e] == KIND_SDOREPLY) || ((Kind[e] == KIND_ODENTRY) && IsPDOParameter(Eds->GetEntry(e)->Index)))
+    {
+      Records[BINEDS_TABLE_SDOREPLY]++;
+    }
+  }
+  for (e = 1; e <= 7; e++)
+  {
+    if (Info->DummyUsage & (1 << e)) Records[BINEDS_TABLE_SDOREPLY]++;
+  }
+  for (e = 0; e < MAX_PDOS; e++)
+  {
+    if (Eds->Find((UNSIGNED16)(0x1400 + e), 1)) Records[BINEDS_TABLE_RPDO]++;
+    if (Eds->Find((UNSIGNED16)(0x1800 + e), 1)) Records[BINEDS_TABLE_TPDO]++;
+  }
+
+  // worst case size including alignment of every table
+  MaxLength = BINEDS_HEADER_SIZE + BINEDS_OFFSETS_SIZE + BINEDS_TRAILER_SIZE + (BINEDS_TABLES * TABLE_ALIGNMENT) +
+              ((Records[BINEDS_TABLE_SDOREPLY] + 1) * BINEDS_SDOREPLY_SIZE) +
+              ((Records[BINEDS_TABLE_ODENTRY] + 1) * BINEDS_ODENTRY_SIZE) +
+              ((Records[BINEDS_TABLE_GENERIC] + 1) * BINEDS_GENERIC_SIZE) +
+              (3 * PISize) +
+              ((Records[BINEDS_TABLE_RPDO] + 1) * BINEDS_RPDO_SIZE) +
+              ((Records[BINEDS_TABLE_TPDO] + 1) * BINEDS_TPDO_SIZE);
+  Buf = (UNSIGNED8 *)calloc(MaxLength, 1);
+  if (!Buf)
+  {
+    free(Kind);
+    free(PIOffset);
+    return FALSE;
+  }
+
+  // header
+  STORE_U16(BINEDS_VERSION_MAJOR, &Buf[0]);
+  STORE_U16(BINEDS_VERSION_MINOR, &Buf[2]);
+  memcpy(&Buf[4], "POCM", 4);
+  STORE_U32(Func, &Buf[8]);
+  STORE_U16(Baudrate, &Buf[12]);
+  Buf[14] = NodeID;
+  STORE_U16(Records[BINEDS_TABLE_RPDO], &Buf[16]);
+  STORE_U16(Records[BINEDS_TABLE_TPDO], &Buf[18]);
+  STORE_U32(PISize, &Buf[20]);
+  if (IDString) strncpy((char *)&Buf[32], IDString, BINEDS_IDSTRING_LENGTH);
+  Pos = BINEDS_HEADER_SIZE + BINEDS_OFFSETS_SIZE;
+
+  for (t = 0; t < BINEDS_TABLES; t++)
+  {
+    Pos = (Pos + TABLE_ALIGNMENT - 1) & ~(unsigned long)(TABLE_ALIGNMENT - 1);
+    STORE_U32(Pos, &Buf[BINEDS_HEADER_SIZE + (t * 4)]);
+
+    switch (t)
+    {
+      case BINEDS_TABLE_SDOREPLY:
+        // dummy objects read as zero of their type size
+        for (e = 1; e <= 7; e++)
+        {
+          if (!(Info->DummyUsage & (1 << e))) continue;
+          Rec = &Buf[Pos];
+          Rec[0] = (UNSIGNED8)(0x43 | ((4 - EDS::GetTypeSize((UNSIGNED16)e)) << 2));
+          STORE_U16(e, &Rec[1]);
+          Pos += BINEDS_SDOREPLY_SIZE;
+        }
+        for (e = 0; e < Count; e++)
+        {
+          Entry = Eds->GetEntry(e);
+          if (!((Kind[e] == KIND_SDOREPLY) || ((Kind[e] == KIND_ODENTRY) && IsPDOParameter(Entry->Index)))) continue;
+          Rec = &Buf[Pos];
+          // expedited upload response with size indicated
+          Rec[0] = (UNSIGNED8)(0x43 | ((4 - Entry->Size) << 2));
+          STORE_U16(Entry->Index, &Rec[1]);
+          Rec[3] = Entry->Subindex;
+          if (Entry->Flags & EDS_FLAG_DEFAULT) StoreValue(EDS::GetDefault(Entry, NodeID), &Rec[4], Entry->Size);
+          Pos += BINEDS_SDOREPLY_SIZE;
+        }
+        memset(&Buf[Pos], 0xFF, BINEDS_SDOREPLY_SIZE);
+        Pos += BINEDS_SDOREPLY_SIZE;
+        break;
+
+      case BINEDS_TABLE_ODENTRY:
+        // same order as the process image
+        for (Pass = 0; Pass < 3; Pass++)
+        {
+          for (e = 0; e < Count; e++)
+          {
+            Entry = Eds->GetEntry(e);
+            if (Kind[e] != KIND_ODENTRY) continue;
+            if ((Pass == 0) && !(Entry->Access & WMAP)) continue;
+            if ((Pass == 1) && ((Entry->Access & (RMAP | WMAP)) != RMAP)) continue;
+            if ((Pass == 2) && (Entry->Access & (RMAP | WMAP))) continue;
+            Rec = &Buf[Pos];
+            STORE_U16(Entry->Index, &Rec[0]);
+            Rec[2] = Entry->Subindex;
+            // like COIAUpdater, only RPDO mapping is marked, TPDO contents
+            // are given by the PDO table
+            Rec[3] = (UNSIGNED8)((Entry->Access & (ODRD | ODWR | WMAP)) | Entry->Size);
+            STORE_U16(PIOffset[e], &Rec[4]);
+            Pos += BINEDS_ODENTRY_SIZE;
+          }
+        }
+        memset(&Buf[Pos], 0xFF, BINEDS_ODENTRY_SIZE);
+        Pos += BINEDS_ODENTRY_SIZE;
+        break;
+
+      case BINEDS_TABLE_GENERIC:
+        for (e = 0; e < Count; e++)
+        {
+          if (Kind[e] != KIND_GENERIC) continue;
+          Entry = Eds->GetEntry(e);
+          Rec = &Buf[Pos];
+          STORE_U16(Entry->Index, &Rec[0]);
+          Rec[2] = Entry->Subindex;
+          Rec[3] = Entry->Access & (ODRD | ODWR | WMAP);
+          STORE_U16(GetImageSize(Entry), &Rec[4]);
+          STORE_U16(PIOffset[e], &Rec[6]);
+          Pos += BINEDS_GENERIC_SIZE;
+        }
+        memset(&Buf[Pos], 0xFF, BINEDS_GENERIC_SIZE);
+        Pos += BINEDS_GENERIC_SIZE;
+        break;
+
+      case BINEDS_TABLE_PIDEFAULT:
+      case BINEDS_TABLE_PIMAX:
+      case BINEDS_TABLE_PIMIN:
+        if ((t != BINEDS_TABLE_PIDEFAULT) && !(Func & BINEDS_FUNC_PIMINMAX))
+        {
+          break;
+        }
+        for (e = 0; e < Count; e++)
+        {
+          Entry = Eds->GetEntry(e);
+          HavePI = ((Kind[e] == KIND_ODENTRY) || (Kind[e] == KIND_GENERIC)) && (Entry->Index != BINEDS_DIAGNOSTICS_INDEX);
+          if (!HavePI) continue;
+          Rec = &Buf[Pos + PIOffset[e]];
+          // the COB-ID of a PDO is set from the SDO reply table
+          if ((t == BINEDS_TABLE_PIDEFAULT) && IsPDOParameter(Entry->Index) && (Entry->Subindex == 1))
+          {
+            continue;
+          }
+          if (t == BINEDS_TABLE_PIDEFAULT)
+          {
+            if (Entry->Flags & EDS_FLAG_STRING)
+              strncpy((char *)Rec, Eds->GetString((UNSIGNED32)Entry->Default), Entry->Size);
+            else if (Entry->Flags & EDS_FLAG_DEFAULT)
+              StoreValue(EDS::GetDefault(Entry, NodeID), Rec, Entry->Size);
+          }
+          else if ((t == BINEDS_TABLE_PIMAX) && (Entry->Flags & EDS_FLAG_HIGHLIMIT))
+          {
+            StoreValue(Entry->HighLimit, Rec, Entry->Size);
+          }
+          else if ((t == BINEDS_TABLE_PIMIN) && (Entry->Flags & EDS_FLAG_LOWLIMIT))
+          {
+            StoreValue(Entry->LowLimit, Rec, Entry->Size);
+          }
+        }
+        Pos += PISize;
+        break;
+
+      case BINEDS_TABLE_RPDO:
+      case BINEDS_TABLE_TPDO:
+        PDOBase = (t == BINEDS_TABLE_RPDO) ? 0x1400 : 0x1800;
+        for (e = 0; e < MAX_PDOS; e++)
+        {
+          if (!Eds->Find((UNSIGNED16)(PDOBase + e), 1)) continue;
+
+          COBID = GetObjectDefault(Eds, (UNSIGNED16)(PDOBase + e), 1, NodeID, 0x80000000UL);
+          Rec = &Buf[Pos];
+          Rec[0] = (UNSIGNED8)(e + 1);
+          Rec[1] = (UNSIGNED8)GetObjectDefault(Eds, (UNSIGNED16)(PDOBase + e), 2, NodeID, 255);
+
+          // mapped data must be consecutive in the process image, the PDO
+          // points to the first mapped entry
+          PDOLength = 0;
+          PDOOffset = 0;
+          Mappings = GetObjectDefault(Eds, (UNSIGNED16)(PDOBase + 0x200 + e), 0, NodeID, 0);
+          for (m = 1; (m <= Mappings) && (m <= 64); m++)
+          {
+            Map = GetObjectDefault(Eds, (UNSIGNED16)(PDOBase + 0x200 + e), (UNSIGNED8)m, NodeID, 0);
+            Mapped = Eds->Find((UNSIGNED16)(Map >> 16), (UNSIGNED8)(Map >> 8));
+            if (Mapped && (m == 1) && (Mapped->Index >= 0x1000))
+            {
+              PDOOffset = PIOffset[Mapped - Eds->GetEntry(0)];
+            }
+            PDOLength = (UNSIGNED8)(PDOLength + ((Map & 0xFF) / 8));
+          }
+          Rec[2] = PDOLength;
+          STORE_U32(COBID, &Rec[4]);
+          STORE_U32(PDOOffset, &Rec[8]);
+          if (t == BINEDS_TABLE_TPDO)
+          {
+            STORE_U16(GetObjectDefault(Eds, (UNSIGNED16)(PDOBase + e), 5, NodeID, 0), &Rec[12]);
+            // inhibit time is given in 100us, stored in ms
+            STORE_U16(GetObjectDefault(Eds, (UNSIGNED16)(PDOBase + e), 3, NodeID, 0) / 10, &Rec[14]);
+            Pos += BINEDS_TPDO_SIZE;
+          }
+          else
+          {
+            Pos += BINEDS_RPDO_SIZE;
+          }
+        }
+        memset(&Buf[Pos], 0xFF, (t == BINEDS_TABLE_TPDO) ? BINEDS_TPDO_SIZE : BINEDS_RPDO_SIZE);
+        Pos += (t == BINEDS_TABLE_TPDO) ? BINEDS_TPDO_SIZE : BINEDS_RPDO_SIZE;
+        break;
+    }
+  }
+
+  // trailer: reserved word, CRC over everything before the CRC
+  Pos += 4;
+  for (e = 0; e < Pos; e++) crc.Add(Buf[e]);
+  CRCValue = crc.Finalize();
+  Buf[Pos++] = CRCValue & 0xFF;
+  Buf[Pos++] = (CRCValue >> 8) & 0xFF;
+
+  free(Kind);
+  free(PIOffset);
+
+  Buffer = Buf;
+  Image = Buf;
+  Length = Pos;
+  return Check();
+}
+
+/**************************************************************************
+DOES:    Writes the current image to a file
+RETURNS: TRUE for success, FALSE for error
+**************************************************************************/
+bool BINEDS::Save(
+  const char *FileName          // name of file to create
+  ) const
+{
+  FILE *fp;
+  bool Result;
+
+  if (!Image)
+  {
+    return FALSE;
+  }
+
+  fp = fopen(FileName, "wb");
+  if (!fp)
+  {
+    fprintf(stderr, "ERROR: %d creating %s: %s\n", errno, FileName, strerror(errno));
+    return FALSE;
+  }
+  Result = (fwrite(Image, 1, Length, fp) == Length);
+  if (fclose(fp) != 0) Result = FALSE;
+  return Result;
+}
+
+/*----------------------- END OF FILE ----------------------------------*/
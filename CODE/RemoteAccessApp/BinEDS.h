@@ -0,0 +1,218 @@
+/**************************************************************************
+MODULE:    BinEDS
+CONTAINS:  Reader and writer for binary CANopenIA configuration files
+           (".bin", POCM format version 2.00) as loaded by COIAUpdater
+COPYRIGHT: Embedded Systems Academy, Inc. 2008-2017.
+DISCLAIM:  Read and understand our disclaimer before using this code!
+           www.esacademy.com/disclaim.htm
+           This software was written in accordance to the guidelines at
+           www.esacademy.com/software/softwarestyleguide.pdf
+LICENSE:   Free to use with licensed CANopenIA chips, modules or devices
+           like CANgineBerry, CANgineXXX and 447izer
+VERSION:   1.10, EmSA 10-NOV-17
+           $LastChangedDate: 2014-01-11 17:30:59 +0100 (Sa, 11 Jan 2014) $
+           $LastChangedRevision: 1702 $
+***************************************************************************/
+#pragma once
+
+#ifndef _BINEDS_H
+#define _BINEDS_H
+
+#include "global.h"
+#include "EDS.h"
+
+/**************************************************************************
+GLOBAL DEFINES
+***************************************************************************/
+
+// tables, in order of the offset list following the header
+#define BINEDS_TABLE_SDOREPLY  0 // constant entries as expedited SDO responses
+#define BINEDS_TABLE_ODENTRY   1 // entries of up to 4 bytes in the process image
+#define BINEDS_TABLE_GENERIC   2 // all other entries in the process image
+#define BINEDS_TABLE_PIDEFAULT 3 // process image default values
+#define BINEDS_TABLE_PIMAX     4 // process image high limits
+#define BINEDS_TABLE_PIMIN     5 // process image low limits
+#define BINEDS_TABLE_RPDO      6 // receive PDO configuration
+#define BINEDS_TABLE_TPDO      7 // transmit PDO configuration
+#define BINEDS_TABLES          8
+
+// functionality flags in header
+#define BINEDS_FUNC_LSS        (1UL << 0)
+#define BINEDS_FUNC_AUTOSTART  (1UL << 1)
+#define BINEDS_FUNC_BOOTUPMGR  (1UL << 2)
+#define BINEDS_FUNC_MANAGER    (1UL << 3)
+#define BINEDS_FUNC_PIMINMAX   (1UL << 4)
+#define BINEDS_FUNC_HWCONFIG   (1UL << 5)
+
+// sizes of fixed parts and records in bytes
+#define BINEDS_HEADER_SIZE     128
+#define BINEDS_OFFSETS_SIZE    (BINEDS_TABLES * 4)
+#define BINEDS_TRAILER_SIZE    6
+#define BINEDS_IDSTRING_LENGTH 96
+#define BINEDS_SDOREPLY_SIZE   8
+#define BINEDS_ODENTRY_SIZE    6
+#define BINEDS_GENERIC_SIZE    8
+#define BINEDS_RPDO_SIZE       12
+#define BINEDS_TPDO_SIZE       16
+
+// format version written and accepted
+#define BINEDS_VERSION_MAJOR   2
+#define BINEDS_VERSION_MINOR   0
+
+// object provided by the firmware itself, never stored in the process image
+#define BINEDS_DIAGNOSTICS_INDEX 0x5FF5
+// chip id [5F00h,05h], a domain in the EDS with a fixed size in the image
+#define BINEDS_CHIPID_INDEX    0x5F00
+#define BINEDS_CHIPID_SUBINDEX 0x05
+#define BINEDS_CHIPID_SIZE     12
+
+/**************************************************************************
+GLOBAL TYPES AND FUNCTIONS
+***************************************************************************/
+
+// Header fields
+typedef struct
+{
+  UNSIGNED16 Major;
+  UNSIGNED16 Minor;
+  UNSIGNED32 Func;                            // BINEDS_FUNC_xxx
+  UNSIGNED16 Baudrate;                        // kbps
+  UNSIGNED8 NodeID;
+  UNSIGNED16 NrOfRPDO;
+  UNSIGNED16 NrOfTPDO;
+  UNSIGNED32 PISize;                          // process image size in bytes
+  char IDString[BINEDS_IDSTRING_LENGTH + 1];
+} BINEDS_HEADER;
+
+// Zero-copy view of one table, records point into the file
+typedef struct
+{
+  const UNSIGNED8 *Data;                      // first record
+  unsigned long Count;                        // number of records, bytes for PI tables
+  unsigned long RecordSize;                   // size of one record, 1 for PI tables
+} BINEDS_VIEW;
+
+// Decoded records
+typedef struct
+{
+  UNSIGNED8 Command;                          // SDO response command byte
+  UNSIGNED16 Index;
+  UNSIGNED8 Subindex;
+  const UNSIGNED8 *Data;                      // 4 data bytes
+} BINEDS_SDOREPLY;
+
+typedef struct
+{
+  UNSIGNED16 Index;
+  UNSIGNED8 Subindex;
+  UNSIGNED8 DSAT;                             // size in bits 0-3, ODRD, ODWR, RMAP, WMAP
+  UNSIGNED16 Offset;                          // process image offset
+} BINEDS_ODENTRY;
+
+typedef struct
+{
+  UNSIGNED16 Index;
+  UNSIGNED8 Subindex;
+  UNSIGNED8 Access;                           // ODRD, ODWR, RMAP, WMAP
+  UNSIGNED16 Size;
+  UNSIGNED16 Offset;                          // process image offset
+} BINEDS_GENERIC;
+
+typedef struct
+{
+  UNSIGNED8 Number;                           // PDO number, 1 based
+  UNSIGNED8 TransType;
+  UNSIGNED8 Length;                           // bytes of process image mapped
+  UNSIGNED32 COBID;
+  UNSIGNED32 Offset;                          // process image offset
+  UNSIGNED16 EventTime;                       // TPDO only
+  UNSIGNED16 InhibitTime;                     // TPDO only
+} BINEDS_PDO;
+
+class BINEDS
+{
+  public:
+    /**************************************************************************
+    DOES:    Constructor - creates an empty configuration
+    **************************************************************************/
+    BINEDS(void);
+    /**************************************************************************
+    DOES:    Destructor - unmaps or releases the image
+    **************************************************************************/
+    ~BINEDS(void);
+    /**************************************************************************
+    DOES:    Memory maps a configuration file and checks it
+    RETURNS: TRUE for success, FALSE for error
+    **************************************************************************/
+    bool Open(const char *FileName);
+    /**************************************************************************
+    DOES:    Uses a configuration image in memory, the image is not copied
+             and must remain valid while in use
+    RETURNS: TRUE for success, FALSE if image is not a valid configuration
+    **************************************************************************/
+    bool Attach(const UNSIGNED8 *Image, unsigned long Length);
+    /**************************************************************************
+    DOES:    Generates a configuration image from an EDS for a node
+    RETURNS: TRUE for success, FALSE for error
+    **************************************************************************/
+    bool Generate(
+      const EDS *Eds,                         // parsed device description
+      UNSIGNED8 NodeID,                       // node id, used for $NODEID
+      UNSIGNED16 Baudrate,                    // CAN bitrate in kbps
+      UNSIGNED32 Func,                        // BINEDS_FUNC_xxx
+      const char *IDString                    // identification, truncated to 96 chars
+      );
+    /**************************************************************************
+    DOES:    Writes the current image to a file
+    RETURNS: TRUE for success, FALSE for error
+    **************************************************************************/
+    bool Save(const char *FileName) const;
+    /**************************************************************************
+    DOES:    Unmaps or releases the current image
+    RETURNS: Nothing
+    **************************************************************************/
+    void Close(void);
+    /**************************************************************************
+    DOES:    Gets the raw image
+    RETURNS: Image or NULL, length in bytes
+    **************************************************************************/
+    const UNSIGNED8 *GetImage(void) const { return Image; }
+    unsigned long GetLength(void) const { return Length; }
+    /**************************************************************************
+    DOES:    Gets the decoded header
+    RETURNS: Header
+    **************************************************************************/
+    const BINEDS_HEADER *GetHeader(void) const { return &Header; }
+    /**************************************************************************
+    DOES:    Gets a view of a table, no data is copied
+    RETURNS: View, Count is 0 if table is empty or image is not loaded
+    **************************************************************************/
+    BINEDS_VIEW GetTable(int Table) const;
+    /**************************************************************************
+    DOES:    Decode a single record of a table view
+    RETURNS: Nothing
+    **************************************************************************/
+    static void GetSDOReply(const BINEDS_VIEW *View, unsigned long Record, BINEDS_SDOREPLY *Reply);
+    static void GetODEntry(const BINEDS_VIEW *View, unsigned long Record, BINEDS_ODENTRY *Entry);
+    static void GetGeneric(const BINEDS_VIEW *View, unsigned long Record, BINEDS_GENERIC *Entry);
+    static void GetPDO(const BINEDS_VIEW *View, unsigned long Record, BINEDS_PDO *Pdo);
+
+  private:
+    bool Check(void);
+    unsigned long CountRecords(unsigned long Offset, unsigned long RecordSize) const;
+
+    const UNSIGNED8 *Image;
+    unsigned long Length;
+    UNSIGNED8 *Buffer;                        // generated image, owned
+    void *Mapping;                            // mapped file
+#ifdef WIN32
+    HANDLE File;
+    HANDLE MappingHandle;
+#endif
+    BINEDS_HEADER Header;
+    BINEDS_VIEW Tables[BINEDS_TABLES];
+};
+
+#endif // _BINEDS_H
+
+/*----------------------- END OF FILE ----------------------------------*/
@@ -0,0 +1,360 @@
+/**************************************************************************
+MODULE:    Command
+CONTAINS:  Parser and executor for coia style commands, e.g.
+           "--node-write 3,0x6200,1,1,0x55 --delay 25 -r 0x5F00,2"
+COPYRIGHT: Embedded Systems Academy, Inc. 2008-2017.
+DISCLAIM:  Read and understand our disclaimer before using this code!
+           www.esacademy.com/disclaim.htm
+           This software was written in accordance to the guidelines at
+           www.esacademy.com/software/softwarestyleguide.pdf
+LICENSE:   Free to use with licensed CANopenIA chips, modules or devices
+           like CANgineBerry, CANgineXXX and 447izer
+VERSION:   1.10, EmSA 10-NOV-17
+           $LastChangedDate: 2014-01-11 17:30:59 +0100 (Sa, 11 Jan 2014) $
+           $LastChangedRevision: 1702 $
+***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Command.h"
+
+/**************************************************************************
+LOCAL DEFINES
+***************************************************************************/
+
+// max number of comma separated fields of a command
+#define MAX_FIELDS 5
+
+// command names and the number of fields they take, names are matched
+// with leading dashes removed
+typedef struct
+{
+  const char *Name;
+  UNSIGNED8 Type;
+  UNSIGNED8 Fields;
+} CMD_NAME;
+
+static const CMD_NAME CommandNames[] =
+{
+  { "r",               CMD_READ,       2 },
+  { "read",            CMD_READ,       2 },
+  { "w",               CMD_WRITE,      4 },
+  { "write",           CMD_WRITE,      4 },
+  { "node-read",       CMD_NODEREAD,   3 },
+  { "node-write",      CMD_NODEWRITE,  5 },
+  { "delay",           CMD_DELAY,      1 },
+  { "loop",            CMD_LOOP,       1 },
+  { "end",             CMD_END,        0 },
+  { "wait-for-status", CMD_WAITSTATUS, 3 },
+};
+
+#define NUM_COMMAND_NAMES (sizeof(CommandNames) / sizeof(CommandNames[0]))
+
+
+/**************************************************************************
+DOES:    Skips white space and comments
+RETURNS: Next character to parse
+**************************************************************************/
+static const char *SkipSpace
+  (
+  const char *Pos
+  )
+{
+  for (;;)
+  {
+    while ((*Pos == ' ') || (*Pos == '\t') || (*Pos == '\r') || (*Pos == '\n')) Pos++;
+    if (*Pos != '#') return Pos;
+    while ((*Pos != 0) && (*Pos != '\n')) Pos++;
+  }
+}
+
+
+/**************************************************************************
+DOES:    Gets the end of a word
+RETURNS: First white space or terminating character after the word
+**************************************************************************/
+static const char *WordEnd
+  (
+  const char *Pos
+  )
+{
+  while ((*Pos != 0) && (*Pos != ' ') && (*Pos != '\t') && (*Pos != '\r') && (*Pos != '\n') && (*Pos != '#')) Pos++;
+  return Pos;
+}
+
+
+/**************************************************************************
+DOES:    Parses a number of the given length
+RETURNS: TRUE for success, FALSE for syntax errors or values that are
+         out of range
+**************************************************************************/
+static bool ParseNumber
+  (
+  const char *Start,                                       // first character
+  const char *End,                                         // character after number
+  unsigned long Max,                                       // highest value allowed
+  unsigned long *Value                                     // location to store value
+  )
+{
+  char Buffer[24];
+  char *Stop;
+
+  if ((End <= Start) || ((unsigned long)(End - Start) >= sizeof(Buffer))) return FALSE;
+  memcpy(Buffer, Start, End - Start);
+  Buffer[End - Start] = 0;
+  if (Buffer[0] == '-') return FALSE;
+  *Value = strtoul(Buffer, &Stop, 0);
+  return (*Stop == 0) && (*Value <= Max);
+}
+
+
+/**************************************************************************
+DOES:    Parses the value of a write command
+RETURNS: TRUE for success, FALSE for syntax errors
+**************************************************************************/
+static bool ParseValue
+  (
+  const char *Start,                                       // first character
+  const char *End,                                         // character after value
+  COMMAND *Command                                         // Length set, Data filled
+  )
+{
+  unsigned long Value;
+  unsigned long b;
+  int Digit;
+
+  if (Command->Length <= 4)
+  {
+    if (!ParseNumber(Start, End, 0xFFFFFFFFul >> ((4 - Command->Length) * 8), &Value)) return FALSE;
+    for (b = 0; b < Command->Length; b++)
+    {
+      Command->Data[b] = (UNSIGNED8)(Value >> (b * 8));
+    }
+    return TRUE;
+  }
+
+  // longer values are hex strings, one byte after the other
+  if (((End - Start) > 2) && (Start[0] == '0') && ((Start[1] == 'x') || (Start[1] == 'X'))) Start += 2;
+  if ((unsigned long)(End - Start) != (unsigned long)Command->Length * 2) return FALSE;
+  for (b = 0; b < (unsigned long)Command->Length * 2; b++)
+  {
+    if ((Start[b] >= '0') && (Start[b] <= '9')) Digit = Start[b] - '0';
+    else if ((Start[b] >= 'a') && (Start[b] <= 'f')) Digit = Start[b] - 'a' + 10;
+    else if ((Start[b] >= 'A') && (Start[b] <= 'F')) Digit = Start[b] - 'A' + 10;
+    else return FALSE;
+    if (b & 1) Command->Data[b / 2] |= (UNSIGNED8)Digit;
+    else Command->Data[b / 2] = (UNSIGNED8)(Digit << 4);
+  }
+  return TRUE;
+}
+
+
+/**************************************************************************
+DOES:    Parses the next command from a text. Leading dashes of the command
+         names are optional, text from '#' to the end of the line is ignored.
+         Values with a length of up to 4 bytes are numbers stored little
+         endian, longer values are hex strings in memory order.
+RETURNS: TRUE for success with Text advanced past the command and Type
+         set to CMD_NONE at the end of the text, FALSE for syntax errors
+**************************************************************************/
+bool CMD_Parse
+  (
+  const char **Text,                                       // text to parse, advanced
+  COMMAND *Command                                         // filled with parsed command
+  )
+{
+  const char *Pos;
+  const char *End;
+  const char *Field[MAX_FIELDS + 1];
+  const CMD_NAME *Name = NULL;
+  unsigned long Value;
+  unsigned long n;
+  unsigned long f;
+
+  memset(Command, 0, sizeof(COMMAND));
+
+  Pos = SkipSpace(*Text);
+  if (*Pos == 0)
+  {
+    *Text = Pos;
+    Command->Type = CMD_NONE;
+    return TRUE;
+  }
+
+  // command name
+  End = WordEnd(Pos);
+  while ((Pos < End) && (*Pos == '-')) Pos++;
+  for (n = 0; n < NUM_COMMAND_NAMES; n++)
+  {
+    if ((strlen(CommandNames[n].Name) == (unsigned long)(End - Pos)) && (memcmp(CommandNames[n].Name, Pos, End - Pos) == 0))
+    {
+      Name = &CommandNames[n];
+      break;
+    }
+  }
+  if (Name == NULL) return FALSE;
+  Command->Type = Name->Type;
+  if (Name->Fields == 0)
+  {
+    *Text = End;
+    return TRUE;
+  }
+
+  // parameters, a single word of comma separated fields
+  Pos = SkipSpace(End);
+  End = WordEnd(Pos);
+  Field[0] = Pos;
+  for (f = 1; f <= MAX_FIELDS; f++)
+  {
+    while ((Pos < End) && (*Pos != ',')) Pos++;
+    Field[f] = Pos + 1;
+    if (Pos == End) break;
+    Pos++;
+  }
+  if (f != Name->Fields) return FALSE;
+  *Text = End;
+
+  f = 0;
+  switch (Command->Type)
+  {
+    case CMD_DELAY:
+      if (!ParseNumber(Field[0], Field[1] - 1, 0xFFFFFFFFul, &Value)) return FALSE;
+      Command->Delay = Value;
+      return TRUE;
+
+    case CMD_LOOP:
+      if (!ParseNumber(Field[0], Field[1] - 1, 0xFFFFFFFFul, &Value)) return FALSE;
+      Command->Count = Value;
+      return TRUE;
+
+    case CMD_WAITSTATUS:
+      // node 0 is the device itself
+      if (!ParseNumber(Field[0], Field[1] - 1, 127, &Value)) return FALSE;
+      Command->NodeID = (UNSIGNED8)Value;
+      if (!ParseNumber(Field[1], Field[2] - 1, 0xFF, &Value)) return FALSE;
+      Command->Status = (UNSIGNED8)Value;
+      if (!ParseNumber(Field[2], Field[3] - 1, 0xFFFFFFFFul, &Value)) return FALSE;
+      Command->Delay = Value;
+      return TRUE;
+
+    case CMD_NODEREAD:
+    case CMD_NODEWRITE:
+      if (!ParseNumber(Field[0], Field[1] - 1, 127, &Value) || (Value == 0)) return FALSE;
+      Command->NodeID = (UNSIGNED8)Value;
+      f++;
+      break;
+  }
+
+  if (!ParseNumber(Field[f], Field[f + 1] - 1, 0xFFFF, &Value)) return FALSE;
+  Command->Index = (UNSIGNED16)Value;
+  f++;
+  if (!ParseNumber(Field[f], Field[f + 1] - 1, 0xFF, &Value)) return FALSE;
+  Command->Subindex = (UNSIGNED8)Value;
+  f++;
+
+  if ((Command->Type == CMD_WRITE) || (Command->Type == CMD_NODEWRITE))
+  {
+    if (!ParseNumber(Field[f], Field[f + 1] - 1, MAX_WRITE_LENGTH, &Value) || (Value == 0)) return FALSE;
+    Command->Length = (UNSIGNED8)Value;
+    f++;
+    if (!ParseValue(Field[f], Field[f + 1] - 1, Command)) return FALSE;
+  }
+
+  return TRUE;
+}
+
+
+/**************************************************************************
+DOES:    Executes a read, write or delay command. Blocks until the
+         response is received or the delay has passed.
+RETURNS: ERROR_NOERROR for success or error code for failure,
+         ERROR_NOTSUPPORTED for loops and waits, see Batch
+**************************************************************************/
+unsigned long CMD_Execute
+  (
+  SerialProtocol *Device,                                  // device to access
+  const COMMAND *Command,                                  // command to execute
+  unsigned long *Length,                                   // length of data read
+  UNSIGNED8 *Data                                          // location for data read, MAX_WRITE_LENGTH
+  )
+{
+  *Length = 0;
+
+  switch (Command->Type)
+  {
+    case CMD_READ:
+      return Device->ReadLocalOD(Command->Index, Command->Subindex, Length, Data);
+
+    case CMD_WRITE:
+      return Device->WriteLocalOD(Command->Index, Command->Subindex, Command->Length, (unsigned char *)Command->Data);
+
+    case CMD_NODEREAD:
+      return Device->ReadRemoteOD(Command->NodeID, Command->Index, Command->Subindex, Length, Data);
+
+    case CMD_NODEWRITE:
+      return Device->WriteRemoteOD(Command->NodeID, Command->Index, Command->Subindex, Command->Length, (unsigned char *)Command->Data);
+
+    case CMD_DELAY:
+      Timer::Sleep(Command->Delay);
+      return ERROR_NOERROR;
+  }
+
+  return ERROR_NOTSUPPORTED;
+}
+
+
+/**************************************************************************
+DOES:    Formats the result of a command as "OK", "OK len,value" for reads
+         or "ERROR code" with the node error appended for ERROR_NODEERROR
+RETURNS: Length of the text, not including the zero termination
+**************************************************************************/
+int CMD_FormatResult
+  (
+  char *Buffer,                                            // location to store text
+  unsigned long BufferSize,                                // size of buffer
+  const COMMAND *Command,                                  // executed command
+  unsigned long Result,                                    // result of CMD_Execute()
+  unsigned long Length,                                    // length of data read
+  const UNSIGNED8 *Data,                                   // data read
+  unsigned short NodeError                                 // last node error of device
+  )
+{
+  unsigned long Value;
+  unsigned long b;
+  int Pos;
+
+  if (Result != ERROR_NOERROR)
+  {
+    if (Result == ERROR_NODEERROR)
+    {
+      return snprintf(Buffer, BufferSize, "ERROR 0x%8.8lX node 0x%4.4X", Result, NodeError);
+    }
+    return snprintf(Buffer, BufferSize, "ERROR 0x%8.8lX", Result);
+  }
+
+  if ((Command->Type != CMD_READ) && (Command->Type != CMD_NODEREAD))
+  {
+    return snprintf(Buffer, BufferSize, "OK");
+  }
+
+  // same representation as the value of a write command
+  if (Length <= 4)
+  {
+    Value = 0;
+    for (b = 0; b < Length; b++)
+    {
+      Value |= (unsigned long)Data[b] << (b * 8);
+    }
+    return snprintf(Buffer, BufferSize, "OK %lu,0x%0*lX", Length, (int)(Length * 2), Value);
+  }
+
+  Pos = snprintf(Buffer, BufferSize, "OK %lu,0x", Length);
+  for (b = 0; (b < Length) && ((unsigned long)Pos + 2 < BufferSize); b++)
+  {
+    Pos += snprintf(Buffer + Pos, BufferSize - Pos, "%2.2X", Data[b]);
+  }
+  return Pos;
+}
+
+/*----------------------- END OF FILE ----------------------------------*/
@@ -0,0 +1,104 @@
+/**************************************************************************
+MODULE:    Command
+CONTAINS:  Parser and executor for coia style commands, e.g.
+           "--node-write 3,0x6200,1,1,0x55 --delay 25 -r 0x5F00,2"
+COPYRIGHT: Embedded Systems Academy, Inc. 2008-2017.
+DISCLAIM:  Read and understand our disclaimer before using this code!
+           www.esacademy.com/disclaim.htm
+           This software was written in accordance to the guidelines at
+           www.esacademy.com/software/softwarestyleguide.pdf
+LICENSE:   Free to use with licensed CANopenIA chips, modules or devices
+           like CANgineBerry, CANgineXXX and 447izer
+VERSION:   1.10, EmSA 10-NOV-17
+           $LastChangedDate: 2014-01-11 17:30:59 +0100 (Sa, 11 Jan 2014) $
+           $LastChangedRevision: 1702 $
+***************************************************************************/
+#pragma once
+
+#ifndef _COMMAND_H
+#define _COMMAND_H
+
+#include "global.h"
+#include "SerialProtocol.h"
+
+/**************************************************************************
+GLOBAL DEFINES
+***************************************************************************/
+
+// command types
+#define CMD_NONE       0 // no more commands in text
+#define CMD_READ       1 // read idx,sub           (-r, --read)
+#define CMD_WRITE      2 // write idx,sub,len,val  (-w, --write)
+#define CMD_NODEREAD   3 // node-read node,idx,sub
+#define CMD_NODEWRITE  4 // node-write node,idx,sub,len,val
+#define CMD_DELAY      5 // delay ms
+#define CMD_LOOP       6 // loop count, repeats up to matching end, 0 for endless
+#define CMD_END        7 // end
+#define CMD_WAITSTATUS 8 // wait-for-status node,status,timeout
+
+// max length of a formatted result, "ERROR 0x00001000 node 0x0000" or
+// "OK 31,<62 hex digits>"
+#define CMD_MAX_RESULT_LENGTH (8 + 2 * MAX_WRITE_LENGTH)
+
+/**************************************************************************
+GLOBAL TYPES AND FUNCTIONS
+***************************************************************************/
+
+// Single parsed command
+typedef struct
+{
+  UNSIGNED8 Type;                             // CMD_xxx
+  UNSIGNED8 NodeID;                           // remote node, node-read/-write
+  UNSIGNED16 Index;
+  UNSIGNED8 Subindex;
+  UNSIGNED8 Length;                           // data length, writes only
+  UNSIGNED32 Delay;                           // milliseconds, delay and wait timeout
+  UNSIGNED32 Count;                           // loop count, 0 for endless
+  UNSIGNED8 Status;                           // NODESTATUS_xxx to wait for
+  UNSIGNED8 Data[MAX_WRITE_LENGTH];           // data to write
+} COMMAND;
+
+/**************************************************************************
+DOES:    Parses the next command from a text. Leading dashes of the command
+         names are optional, text from '#' to the end of the line is ignored.
+         Values with a length of up to 4 bytes are numbers stored little
+         endian, longer values are hex strings in memory order.
+RETURNS: TRUE for success with Text advanced past the command and Type
+         set to CMD_NONE at the end of the text, FALSE for syntax errors
+**************************************************************************/
+bool CMD_Parse(
+  const char **Text,                          // text to parse, advanced
+  COMMAND *Command                            // filled with parsed command
+  );
+
+/**************************************************************************
+DOES:    Executes a read, write or delay command. Blocks until the
+         response is received or the delay has passed.
+RETURNS: ERROR_NOERROR for success or error code for failure,
+         ERROR_NOTSUPPORTED for loops and waits, see Batch
+**************************************************************************/
+unsigned long CMD_Execute(
+  SerialProtocol *Device,                     // device to access
+  const COMMAND *Command,                     // command to execute
+  unsigned long *Length,                      // length of data read
+  UNSIGNED8 *Data                             // location for data read, MAX_WRITE_LENGTH
+  );
+
+/**************************************************************************
+DOES:    Formats the result of a command as "OK", "OK len,value" for reads
+         or "ERROR code" with the node error appended for ERROR_NODEERROR
+RETURNS: Length of the text, not including the zero termination
+**************************************************************************/
+int CMD_FormatResult(
+  char *Buffer,                               // location to store text
+  unsigned long BufferSize,                   // size of buffer
+  const COMMAND *Command,                     // executed command
+  unsigned long Result,                       // result of CMD_Execute()
+  unsigned long Length,                       // length of data read
+  const UNSIGNED8 *Data,                      // data read
+  unsigned short NodeError                    // last node error of device
+  );
+
+#endif // _COMMAND_H
+
+/*----------------------- END OF FILE ----------------------------------*/
@@ -0,0 +1,852 @@
+/**************************************************************************
+MODULE:    DataLog
+CONTAINS:  Compressed log of process data. The protocol adds samples to a
+           ring without locks or I/O. The writer thread collects the
+           samples of each series until a block is full or old, encodes
+           it and writes the encoded blocks with one write of up to
+           DATALOG_WRITE_SIZE.
+COPYRIGHT: Embedded Systems Academy, Inc. 2008-2017.
+DISCLAIM:  Read and understand our disclaimer before using this code!
+           www.esacademy.com/disclaim.htm
+           This software was written in accordance to the guidelines at
+           www.esacademy.com/software/softwarestyleguide.pdf
+LICENSE:   Free to use with licensed CANopenIA chips, modules or devices
+           like CANgineBerry, CANgineXXX and 447izer
+VERSION:   1.10, EmSA 10-NOV-17
+           $LastChangedDate: 2014-01-11 17:30:59 +0100 (Sa, 11 Jan 2014) $
+           $LastChangedRevision: 1702 $
+***************************************************************************/
+
+#include <string.h>
+#include <chrono>
+#ifdef WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+#include "DataLog.h"
+#include "Timer.h"
+
+/**************************************************************************
+LOCAL DEFINES
+***************************************************************************/
+
+// milliseconds the writer thread waits between two looks at the ring
+#define WRITER_INTERVAL 10
+
+// max bytes of the encoded samples of a block, 145 bits per sample at most
+#define MAX_ENCODED (DATALOG_BLOCK_SAMPLES * 19)
+
+// bytes searched at once for the next block after damaged data
+#define RESYNC_CHUNK 65536
+
+// key of a series
+#define SERIES_KEY(NodeID, Index, Subindex) (((uint32_t)(NodeID) << 24) | ((uint32_t)(Index) << 8) | (Subindex))
+
+/**************************************************************************
+LOCAL TYPES
+***************************************************************************/
+
+// bits written from the most significant one of each byte
+typedef struct
+{
+  unsigned char *Data;
+  unsigned long Bits;
+} BITS;
+
+
+/**************************************************************************
+DOES:    Appends bits to a bit stream
+RETURNS: Nothing
+**************************************************************************/
+static void PutBits
+  (
+  BITS *Out,                                               // bit stream
+  uint64_t Value,                                          // bits to append, in the lowest bits
+  unsigned int Count                                       // number of bits, 1 to 64
+  )
+{
+  unsigned int Free;
+  unsigned int n;
+
+  while (Count)
+  {
+    Free = 8 - (Out->Bits & 7);
+    n = (Count < Free) ? Count : Free;
+    if (Free == 8) Out->Data[Out->Bits >> 3] = 0;
+    Out->Data[Out->Bits >> 3] |= (unsigned char)(((Value >> (Count - n)) & ((1U << n) - 1)) << (Free - n));
+    Out->Bits += n;
+    Count -= n;
+  }
+}
+
+
+/**************************************************************************
+DOES:    Maps signed to unsigned values, small magnitudes to small values
+RETURNS: Zigzag coded value
+**************************************************************************/
+static uint64_t ZigZag
+  (
+  uint64_t Value                                           // two's complement value
+  )
+{
+  return (Value << 1) ^ (uint64_t)((int64_t)Value >> 63);
+}
+
+
+/**************************************************************************
+DOES:    Counts the zero bits above the highest bit set
+RETURNS: 0 to 63, the value must not be 0
+**************************************************************************/
+static unsigned int LeadingZeros
+  (
+  uint64_t Value                                           // value, not 0
+  )
+{
+#if defined(__GNUC__)
+  return __builtin_clzll(Value);
+#else
+  unsigned int n = 0;
+
+  while ((Value & 0x8000000000000000ULL) == 0)
+  {
+    Value <<= 1;
+    n++;
+  }
+  return n;
+#endif
+}
+
+
+/**************************************************************************
+DOES:    Counts the zero bits below the lowest bit set
+RETURNS: 0 to 63, the value must not be 0
+**************************************************************************/
+static unsigned int TrailingZeros
+  (
+  uint64_t Value                                           // value, not 0
+  )
+{
+#if defined(__GNUC__)
+  return __builtin_ctzll(Value);
+#else
+  unsigned int n = 0;
+
+  while ((Value & 1) == 0)
+  {
+    Value >>= 1;
+    n++;
+  }
+  return n;
+#endif
+}
+
+
+/**************************************************************************
+DOES:    Appends the times of a block from the second one on as delta of
+         delta
+RETURNS: Nothing
+**************************************************************************/
+static void EncodeTimes
+  (
+  BITS *Out,                                               // bit stream
+  const uint64_t *Times,                                   // times of the samples
+  unsigned int Count                                       // number of samples
+  )
+{
+  uint64_t Delta = 0;
+  uint64_t Next;
+  uint64_t Z;
+  unsigned int s;
+
+  for (s = 1; s < Count; s++)
+  {
+    Next = Times[s] - Times[s - 1];
+    Z = ZigZag(Next - Delta);
+    Delta = Next;
+    if (Z == 0) PutBits(Out, 0x0, 1);
+    else if (Z < (1ULL << 7)) { PutBits(Out, 0x2, 2); PutBits(Out, Z, 7); }
+    else if (Z < (1ULL << 12)) { PutBits(Out, 0x6, 3); PutBits(Out, Z, 12); }
+    else if (Z < (1ULL << 20)) { PutBits(Out, 0xE, 4); PutBits(Out, Z, 20); }
+    else { PutBits(Out, 0xF, 4); PutBits(Out, Z, 64); }
+  }
+}
+
+
+/**************************************************************************
+DOES:    Appends the values of a block from the second one on, XORed
+         with the previous value
+RETURNS: Nothing
+**************************************************************************/
+static void EncodeXor
+  (
+  BITS *Out,                                               // bit stream
+  const uint64_t *Values,                                  // values of the samples
+  unsigned int Count                                       // number of samples
+  )
+{
+  unsigned int Lead = 64;                                  // none yet
+  unsigned int Trail = 0;
+  unsigned int NewLead;
+  unsigned int NewTrail;
+  uint64_t X;
+  unsigned int s;
+
+  for (s = 1; s < Count; s++)
+  {
+    X = Values[s] ^ Values[s - 1];
+    if (X == 0)
+    {
+      PutBits(Out, 0x0, 1);
+      continue;
+    }
+    NewLead = LeadingZeros(X);
+    if (NewLead > 31) NewLead = 31;
+    NewTrail = TrailingZeros(X);
+    if ((Lead < 64) && (NewLead >= Lead) && (NewTrail >= Trail))
+    { // fits into the bits of the last value stored
+      PutBits(Out, 0x2, 2);
+      PutBits(Out, X >> Trail, 64 - Lead - Trail);
+    }
+    else
+    {
+      Lead = NewLead;
+      Trail = NewTrail;
+      PutBits(Out, 0x3, 2);
+      PutBits(Out, Lead, 5);
+      PutBits(Out, 64 - Lead - Trail - 1, 6);
+      PutBits(Out, X >> Trail, 64 - Lead - Trail);
+    }
+  }
+}
+
+
+/**************************************************************************
+DOES:    Appends the values of a block from the second one on as delta of
+         delta
+RETURNS: Nothing
+**************************************************************************/
+static void EncodeDelta
+  (
+  BITS *Out,                                               // bit stream
+  const uint64_t *Values,                                  // values of the samples
+  unsigned int Count                                       // number of samples
+  )
+{
+  uint64_t Delta = 0;
+  uint64_t Next;
+  uint64_t Z;
+  unsigned int s;
+
+  for (s = 1; s < Count; s++)
+  {
+    Next = Values[s] - Values[s - 1];
+    Z = ZigZag(Next - Delta);
+    Delta = Next;
+    if (Z == 0) PutBits(Out, 0x0, 1);
+    else if (Z < (1ULL << 8)) { PutBits(Out, 0x2, 2); PutBits(Out, Z, 8); }
+    else if (Z < (1ULL << 16)) { PutBits(Out, 0x6, 3); PutBits(Out, Z, 16); }
+    else if (Z < (1ULL << 32)) { PutBits(Out, 0xE, 4); PutBits(Out, Z, 32); }
+    else { PutBits(Out, 0xF, 4); PutBits(Out, Z, 64); }
+  }
+}
+
+
+/**************************************************************************
+DOES:    Stores a value little endian
+RETURNS: Nothing
+**************************************************************************/
+static void StoreLE
+  (
+  unsigned char *Location,                                 // location to store the value
+  uint64_t Value,                                          // value to store
+  unsigned int Bytes                                       // number of bytes
+  )
+{
+  unsigned int b;
+
+  for (b = 0; b < Bytes; b++) Location[b] = (unsigned char)(Value >> (8 * b));
+}
+
+
+/**************************************************************************
+DOES:    Loads a little endian value
+RETURNS: Value
+**************************************************************************/
+static uint64_t LoadLE
+  (
+  const unsigned char *Location,                           // location of the value
+  unsigned int Bytes                                       // number of bytes
+  )
+{
+  uint64_t Value = 0;
+
+  while (Bytes--) Value = (Value << 8) | Location[Bytes];
+  return Value;
+}
+
+
+/**************************************************************************
+DOES:    Checks whether a valid block or the end of the file follows a
+         block, less than a header at the end counts as the end
+RETURNS: TRUE if so, else FALSE
+**************************************************************************/
+static bool IsBlockEnd
+  (
+  FILE *File,                                              // log file
+  long Position,                                           // end of the block
+  long Size                                                // length of the file
+  )
+{
+  unsigned char Header[DATALOG_BLOCK_HEADER];
+
+  if (Position + DATALOG_BLOCK_HEADER > Size) return TRUE;
+  if ((fseek(File, Position, SEEK_SET) != 0) || (fread(Header, 1, sizeof(Header), File) != sizeof(Header))) return FALSE;
+  return DATALOG::CheckBlock(Header) != 0;
+}
+
+
+/**************************************************************************
+DOES:    Searches the next valid block of a log file after damaged data
+RETURNS: Position of the block, -1 if there is none
+**************************************************************************/
+static long FindNextBlock
+  (
+  FILE *File,                                              // log file
+  long From,                                               // first position to check
+  long Size                                                // length of the file
+  )
+{
+  unsigned char *Chunk = new unsigned char[RESYNC_CHUNK + DATALOG_BLOCK_HEADER];
+  unsigned long Length;
+  long Found = -1;
+  long Base;
+  size_t Got;
+  size_t i;
+
+  for (Base = From; (Found < 0) && (Base + DATALOG_BLOCK_HEADER <= Size); Base += RESYNC_CHUNK)
+  {
+    if (fseek(File, Base, SEEK_SET) != 0) break;
+    Got = fread(Chunk, 1, RESYNC_CHUNK + DATALOG_BLOCK_HEADER, File);
+    for (i = 0; (i < RESYNC_CHUNK) && (i + DATALOG_BLOCK_HEADER <= Got); i++)
+    {
+      Length = DATALOG::CheckBlock(&Chunk[i]);
+      if (Length && (Base + (long)i + (long)Length <= Size) && IsBlockEnd(File, Base + (long)i + (long)Length, Size))
+      {
+        Found = Base + (long)i;
+        break;
+      }
+    }
+  }
+  delete[] Chunk;
+  return Found;
+}
+
+
+/**************************************************************************
+DOES:    Finds the end of the last complete block of a log file. Damaged
+         data between blocks is skipped.
+RETURNS: Position after the last complete block
+**************************************************************************/
+static long FindLogEnd
+  (
+  FILE *File,                                              // log file
+  long Size                                                // length of the file
+  )
+{
+  unsigned char Header[DATALOG_BLOCK_HEADER];
+  unsigned long Length;
+  long Position = DATALOG_MAGIC_LENGTH;
+  long End = Position;
+
+  while (Position + DATALOG_BLOCK_HEADER <= Size)
+  {
+    if ((fseek(File, Position, SEEK_SET) != 0) || (fread(Header, 1, sizeof(Header), File) != sizeof(Header))) break;
+    Length = DATALOG::CheckBlock(Header);
+    if (Length && (Position + (long)Length <= Size))
+    {
+      Position += Length;
+      End = Position;
+      continue;
+    }
+    Position = FindNextBlock(File, Position + 1, Size);
+    if (Position < 0) break;
+  }
+  return End;
+}
+
+
+/**************************************************************************
+DOES:    Checks the header of a block
+RETURNS: Length of the block with its header, 0 if not a valid header
+**************************************************************************/
+unsigned long DATALOG::CheckBlock
+  (
+  const unsigned char *Block                               // DATALOG_BLOCK_HEADER bytes
+  )
+{
+  unsigned long Count = (unsigned long)LoadLE(&Block[10], 2);
+  unsigned long Length = (unsigned long)LoadLE(&Block[12], 2);
+
+  if ((LoadLE(&Block[0], 2) != DATALOG_BLOCK_MAGIC) ||
+      (Block[6] < 1) || (Block[6] > 8) ||
+      (Block[7] > DATALOG_TYPE_REAL) || (Block[8] > DATALOG_ENC_DELTA) || (Block[9] != 0) ||
+      (Count < 1) || (Count > DATALOG_BLOCK_SAMPLES) || (Length > MAX_ENCODED) ||
+      ((Count == 1) && (Length != 0)) ||
+      (LoadLE(&Block[14], 8) > LoadLE(&Block[22], 8)))
+  {
+    return 0;
+  }
+  return DATALOG_BLOCK_HEADER + Length;
+}
+
+
+/**************************************************************************
+DOES:    Constructor - creates a log without a file
+**************************************************************************/
+DATALOG::DATALOG
+  (
+  void
+  )
+{
+  Ring = new SAMPLE[DATALOG_RING_SIZE];
+  Head = 0;
+  Tail = 0;
+  memset(Series, 0, sizeof(Series));
+  NumSeries = 0;
+  NumTypes = 0;
+  Buffer = new unsigned char[DATALOG_WRITE_SIZE];
+  BufferLength = 0;
+  BufferTime = 0;
+  FlushTime = DATALOG_FLUSH_TIME * 1000ULL;
+  Encoded[0] = new unsigned char[MAX_ENCODED];
+  Encoded[1] = new unsigned char[MAX_ENCODED];
+  File = NULL;
+  StopRequested = FALSE;
+  STATS_Set(&Stats.Samples, 0);
+  STATS_Set(&Stats.Lost, 0);
+  STATS_Set(&Stats.Skipped, 0);
+  STATS_Set(&Stats.Blocks, 0);
+  STATS_Set(&Stats.RawBytes, 0);
+  STATS_Set(&Stats.Bytes, 0);
+  STATS_Set(&Stats.Writes, 0);
+  STATS_Set(&Stats.WriteErrors, 0);
+  STATS_Set(&Stats.Truncated, 0);
+  FileLength = 0;
+}
+
+
+/**************************************************************************
+DOES:    Destructor - writes the open blocks and closes the file
+**************************************************************************/
+DATALOG::~DATALOG
+  (
+  void
+  )
+{
+  Close();
+  delete[] Ring;
+  delete[] Buffer;
+  delete[] Encoded[0];
+  delete[] Encoded[1];
+}
+
+
+/**************************************************************************
+DOES:    Opens the log file, blocks are appended to an existing log, and
+         starts the thread writing to it
+RETURNS: TRUE for success, FALSE for error
+**************************************************************************/
+bool DATALOG::Open
+  (
+  const char *FileName                                     // log file to create or append to
+  )
+{
+  char Magic[DATALOG_MAGIC_LENGTH];
+  long Size = 0;
+  long End;
+  int Result;
+
+  Close();
+
+  // only add to a log, never to another file
+  File = fopen(FileName, "r+b");
+  if (File != NULL)
+  {
+    fseek(File, 0, SEEK_END);
+    Size = ftell(File);
+    fseek(File, 0, SEEK_SET);
+    if ((Size > 0) && ((fread(Magic, 1, sizeof(Magic), File) != sizeof(Magic)) || memcmp(Magic, DATALOG_MAGIC, sizeof(Magic))))
+    {
+      fprintf(stderr, "ERROR: %s is not a process data log\n", FileName);
+      fclose(File);
+      File = NULL;
+      return FALSE;
+    }
+    // new blocks must not follow a block cut off by a power failure
+    End = (Size > 0) ? FindLogEnd(File, Size) : 0;
+    if (End < Size)
+    {
+      fflush(File);
+#ifdef WIN32
+      Result = _chsize_s(_fileno(File), End);
+#else
+      Result = ftruncate(fileno(File), End);
+#endif
+      if (Result != 0)
+      {
+        fprintf(stderr, "ERROR: can not remove the damaged end of %s\n", FileName);
+        fclose(File);
+        File = NULL;
+        return FALSE;
+      }
+      STATS_Add(&Stats.Truncated, Size - End);
+      Size = End;
+    }
+    fclose(File);
+  }
+
+  File = fopen(FileName, "ab");
+  if (File == NULL)
+  {
+    fprintf(stderr, "ERROR: can not create %s\n", FileName);
+    return FALSE;
+  }
+  // the buffer is written with single writes
+  setvbuf(File, NULL, _IONBF, 0);
+  FileLength = Size;
+  if (Size <= 0)
+  {
+    memcpy(Buffer, DATALOG_MAGIC, DATALOG_MAGIC_LENGTH);
+    BufferLength = DATALOG_MAGIC_LENGTH;
+    BufferTime = Timer::GetMicroseconds();
+  }
+
+  StopRequested = FALSE;
+  Writer = std::thread(&DATALOG::Run, this);
+  return TRUE;
+}
+
+
+/**************************************************************************
+DOES:    Stops the thread, writes the open blocks and closes the file
+RETURNS: Nothing
+**************************************************************************/
+void DATALOG::Close
+  (
+  void
+  )
+{
+  unsigned int s;
+
+  if (File == NULL) return;
+
+  StopRequested = TRUE;
+  if (Writer.joinable()) Writer.join();
+  Drain();
+  for (s = 0; s < DATALOG_MAX_SERIES; s++)
+  {
+    if (Series[s] == NULL) continue;
+    CloseBlock(Series[s]);
+    delete Series[s];
+    Series[s] = NULL;
+  }
+  NumSeries = 0;
+  WriteBuffer();
+  fclose(File);
+  File = NULL;
+}
+
+
+/**************************************************************************
+DOES:    Sets how the values of an od entry are interpreted by readers,
+         DATALOG_TYPE_UNSIGNED if not set. Only before Open.
+RETURNS: TRUE for success, FALSE if too many types are set
+**************************************************************************/
+bool DATALOG::SetType
+  (
+  UNSIGNED8 NodeID,                                        // node id
+  UNSIGNED16 Index,                                        // index of od entry
+  UNSIGNED8 Subindex,                                      // subindex of od entry
+  UNSIGNED8 Type                                           // DATALOG_TYPE_xxx
+  )
+{
+  uint32_t Key = SERIES_KEY(NodeID, Index, Subindex);
+  unsigned int t;
+
+  for (t = 0; t < NumTypes; t++)
+  {
+    if (TypeKeys[t] == Key) break;
+  }
+  if (t == DATALOG_MAX_TYPES) return FALSE;
+  TypeKeys[t] = Key;
+  Types[t] = Type;
+  if (t == NumTypes) NumTypes++;
+  return TRUE;
+}
+
+
+/**************************************************************************
+DOES:    Takes data written by the device, to be called from the data
+         call-back. Values of up to 8 bytes are logged, samples are lost
+         if the ring is full, the protocol never waits for the file.
+RETURNS: TRUE if the sample was added, else FALSE
+**************************************************************************/
+bool DATALOG::HandleData
+  (
+  UNSIGNED8 NodeID,                                        // node id the data is from
+  int Index,                                               // index of od entry written
+  unsigned char Subindex,                                  // subindex of od entry written
+  unsigned long DataLength,                                // length of data written
+  const unsigned char *Data                                // data written
+  )
+{
+  unsigned long Position = Head.load(std::memory_order_relaxed);
+  SAMPLE *Sample;
+  unsigned long b;
+
+  if (File == NULL) return FALSE;
+  if ((DataLength == 0) || (DataLength > 8))
+  {
+    STATS_Add(&Stats.Skipped, 1);
+    return FALSE;
+  }
+  if (Position - Tail.load(std::memory_order_acquire) >= DATALOG_RING_SIZE)
+  {
+    STATS_Add(&Stats.Lost, 1);
+    return FALSE;
+  }
+
+  Sample = &Ring[Position & (DATALOG_RING_SIZE - 1)];
+  Sample->Time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+  Sample->Value = 0;
+  for (b = 0; b < DataLength; b++) Sample->Value |= (uint64_t)Data[b] << (8 * b);
+  Sample->Index = (UNSIGNED16)Index;
+  Sample->NodeID = NodeID;
+  Sample->Subindex = Subindex;
+  Sample->Length = (UNSIGNED8)DataLength;
+  STATS_Add(&Stats.Samples, 1);
+  STATS_Add(&Stats.RawBytes, 13 + DataLength);
+
+  // the sample becomes visible to the writer with the new head
+  Head.store(Position + 1, std::memory_order_release);
+  return TRUE;
+}
+
+
+/**************************************************************************
+DOES:    Finds the series of a sample, creates it when first seen
+RETURNS: Series or NULL if there are too many
+**************************************************************************/
+DATALOG::SERIES *DATALOG::FindSeries
+  (
+  const SAMPLE *Sample                                     // sample of the series
+  )
+{
+  uint32_t Key = SERIES_KEY(Sample->NodeID, Sample->Index, Sample->Subindex);
+  unsigned int Slot = ((Key * 2654435761U) >> 16) & (DATALOG_MAX_SERIES - 1);
+  unsigned int Probe;
+  unsigned int t;
+
+  for (Probe = 0; Probe < DATALOG_MAX_SERIES; Probe++, Slot = (Slot + 1) & (DATALOG_MAX_SERIES - 1))
+  {
+    if (Series[Slot] == NULL) break;
+    if (Series[Slot]->Key == Key) return Series[Slot];
+  }
+  if (Probe == DATALOG_MAX_SERIES) return NULL;
+
+  Series[Slot] = new SERIES;
+  Series[Slot]->Key = Key;
+  Series[Slot]->Length = Sample->Length;
+  Series[Slot]->Type = DATALOG_TYPE_UNSIGNED;
+  Series[Slot]->Count = 0;
+  for (t = 0; t < NumTypes; t++)
+  {
+    if (TypeKeys[t] == Key) Series[Slot]->Type = Types[t];
+  }
+  NumSeries++;
+  return Series[Slot];
+}
+
+
+/**************************************************************************
+DOES:    Adds a sample to the block of its series, closes full blocks
+RETURNS: Nothing
+**************************************************************************/
+void DATALOG::AddSample
+  (
+  const SAMPLE *Sample                                     // sample to add
+  )
+{
+  SERIES *S = FindSeries(Sample);
+
+  if (S == NULL)
+  {
+    STATS_Add(&Stats.Skipped, 1);
+    return;
+  }
+  // all values of a block have the same length
+  if (S->Count && (S->Length != Sample->Length)) CloseBlock(S);
+  S->Length = Sample->Length;
+  S->Times[S->Count] = Sample->Time;
+  S->Values[S->Count] = Sample->Value;
+  if (++S->Count == DATALOG_BLOCK_SAMPLES) CloseBlock(S);
+}
+
+
+/**************************************************************************
+DOES:    Encodes the open block of a series into the write buffer, with
+         the shorter encoding of the values
+RETURNS: Nothing
+**************************************************************************/
+void DATALOG::CloseBlock
+  (
+  SERIES *S                                                // series of the block
+  )
+{
+  BITS Xor;
+  BITS Delta;
+  BITS *Best;
+  unsigned char *Block;
+  unsigned long Length;
+
+  if (S->Count == 0) return;
+
+  // the times are the same for both encodings
+  Xor.Data = Encoded[0];
+  Xor.Bits = 0;
+  EncodeTimes(&Xor, S->Times, S->Count);
+  Delta.Data = Encoded[1];
+  Delta.Bits = Xor.Bits;
+  memcpy(Delta.Data, Xor.Data, (Xor.Bits + 7) >> 3);
+  EncodeXor(&Xor, S->Values, S->Count);
+  EncodeDelta(&Delta, S->Values, S->Count);
+  Best = (Delta.Bits < Xor.Bits) ? &Delta : &Xor;
+  Length = (Best->Bits + 7) >> 3;
+
+  if (BufferLength + DATALOG_BLOCK_HEADER + Length > DATALOG_WRITE_SIZE) WriteBuffer();
+  if (BufferLength == 0) BufferTime = Timer::GetMicroseconds();
+  Block = &Buffer[BufferLength];
+  StoreLE(&Block[0], DATALOG_BLOCK_MAGIC, 2);
+  Block[2] = (unsigned char)(S->Key >> 24);
+  Block[3] = (unsigned char)S->Key;
+  StoreLE(&Block[4], (S->Key >> 8) & 0xFFFF, 2);
+  Block[6] = S->Length;
+  Block[7] = S->Type;
+  Block[8] = (Best == &Delta) ? DATALOG_ENC_DELTA : DATALOG_ENC_XOR;
+  Block[9] = 0;
+  StoreLE(&Block[10], S->Count, 2);
+  StoreLE(&Block[12], Length, 2);
+  StoreLE(&Block[14], S->Times[0], 8);
+  StoreLE(&Block[22], S->Times[S->Count - 1], 8);
+  StoreLE(&Block[30], S->Values[0], 8);
+  memcpy(&Block[DATALOG_BLOCK_HEADER], Best->Data, Length);
+  BufferLength += DATALOG_BLOCK_HEADER + Length;
+
+  STATS_Add(&Stats.Blocks, 1);
+  S->Count = 0;
+}
+
+
+/**************************************************************************
+DOES:    Closes the blocks whose first sample waited the flush time and
+         writes them at once
+RETURNS: Nothing
+**************************************************************************/
+void DATALOG::CloseOldBlocks
+  (
+  uint64_t Now                                             // us since 1970
+  )
+{
+  bool Closed = FALSE;
+  unsigned int s;
+
+  for (s = 0; s < DATALOG_MAX_SERIES; s++)
+  {
+    if ((Series[s] == NULL) || (Series[s]->Count == 0)) continue;
+    if (Now - Series[s]->Times[0] < FlushTime) continue;
+    CloseBlock(Series[s]);
+    Closed = TRUE;
+  }
+  if (Closed) WriteBuffer();
+}
+
+
+/**************************************************************************
+DOES:    Writes the encoded blocks to the file with a single write
+RETURNS: Nothing
+**************************************************************************/
+void DATALOG::WriteBuffer
+  (
+  void
+  )
+{
+  if (BufferLength == 0) return;
+  STATS_Add(&Stats.Writes, 1);
+  if (fwrite(Buffer, 1, BufferLength, File) == BufferLength)
+  {
+    STATS_Add(&Stats.Bytes, BufferLength);
+    FileLength += BufferLength;
+    BufferLength = 0;
+    return;
+  }
+
+  // a part of the buffer may have been written, it must not stay in front
+  // of the next blocks. Readers skip it if it can not be removed.
+  STATS_Add(&Stats.WriteErrors, 1);
+  clearerr(File);
+#ifdef WIN32
+  if (_chsize_s(_fileno(File), FileLength) != 0) {}
+#else
+  if (ftruncate(fileno(File), FileLength) != 0) {}
+#endif
+  // a new log still needs its header
+  BufferLength = (FileLength == 0) ? DATALOG_MAGIC_LENGTH : 0;
+}
+
+
+/**************************************************************************
+DOES:    Adds all samples of the ring to their blocks
+RETURNS: Nothing
+**************************************************************************/
+void DATALOG::Drain
+  (
+  void
+  )
+{
+  unsigned long Position = Tail.load(std::memory_order_relaxed);
+  unsigned long End = Head.load(std::memory_order_acquire);
+
+  while (Position != End)
+  {
+    AddSample(&Ring[Position & (DATALOG_RING_SIZE - 1)]);
+    Position++;
+    // make the sample free for the protocol
+    Tail.store(Position, std::memory_order_release);
+  }
+}
+
+
+/**************************************************************************
+DOES:    Writer thread, drains the ring until stopped. Blocks and the
+         write buffer are written when full or after the flush time.
+RETURNS: Nothing
+**************************************************************************/
+void DATALOG::Run
+  (
+  void
+  )
+{
+  while (!StopRequested)
+  {
+    Drain();
+    CloseOldBlocks(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+    if (BufferLength && (Timer::GetMicroseconds() - BufferTime >= FlushTime)) WriteBuffer();
+    if (Head.load(std::memory_order_relaxed) == Tail.load(std::memory_order_relaxed))
+    {
+      Timer::Sleep(WRITER_INTERVAL);
+    }
+  }
+}
+
+/*----------------------- END OF FILE ----------------------------------*/
@@ -0,0 +1,248 @@
+/**************************************************************************
+MODULE:    DataLog
+CONTAINS:  Compressed log of the process data written by the CANopenIA
+           device. Values are grouped by series, one per node, index and
+           subindex, and stored in blocks of up to DATALOG_BLOCK_SAMPLES.
+           The times of a block are encoded as delta of delta, the values
+           either XORed with the previous value or as delta of delta,
+           whichever is shorter. A thread encodes the blocks and writes
+           them with large sequential writes, the protocol only adds the
+           samples to a ring.
+           File format, all values little endian:
+             header  "COIALOG1"
+             block   2 bytes  DATALOG_BLOCK_MAGIC
+                     1 byte   node id
+                     1 byte   subindex
+                     2 bytes  index
+                     1 byte   value length, 1 to 8
+                     1 byte   DATALOG_TYPE_xxx
+                     1 byte   DATALOG_ENC_xxx
+                     1 byte   0
+                     2 bytes  number of samples, at least 1
+                     2 bytes  length of the encoded samples
+                     8 bytes  time of the first sample, microseconds
+                              since 1970 UTC
+                     8 bytes  time of the last sample
+                     8 bytes  value of the first sample
+                     data     the further samples, bits from the most
+                              significant one of each byte: the times of
+                              all samples, then the values of all samples
+           Times as delta of delta D to the previous delta, zigzag coded:
+             '0' for D = 0, '10' and 7 bits, '110' and 12 bits,
+             '1110' and 20 bits, '1111' and 64 bits
+           Values for DATALOG_ENC_XOR, X the value XOR the previous one:
+             '0' for X = 0, '10' and the bits of X between the leading
+             and trailing zeros of the last '11', '11' and 5 bits leading
+             zeros, 6 bits number of bits - 1 and the bits
+           Values for DATALOG_ENC_DELTA, delta of delta zigzag coded:
+             '0' for 0, '10' and 8 bits, '110' and 16 bits, '1110' and
+             32 bits, '1111' and 64 bits
+COPYRIGHT: Embedded Systems Academy, Inc. 2008-2017.
+DISCLAIM:  Read and understand our disclaimer before using this code!
+           www.esacademy.com/disclaim.htm
+           This software was written in accordance to the guidelines at
+           www.esacademy.com/software/softwarestyleguide.pdf
+LICENSE:   Free to use with licensed CANopenIA chips, modules or devices
+           like CANgineBerry, CANgineXXX and 447izer
+VERSION:   1.10, EmSA 10-NOV-17
+           $LastChangedDate: 2014-01-11 17:30:59 +0100 (Sa, 11 Jan 2014) $
+           $LastChangedRevision: 1702 $
+***************************************************************************/
+#pragma once
+
+#ifndef _DATALOG_H
+#define _DATALOG_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+#include "global.h"
+#include "Statistics.h"
+
+/**************************************************************************
+GLOBAL DEFINES
+***************************************************************************/
+
+// start of a log file
+#define DATALOG_MAGIC        "COIALOG1"
+#define DATALOG_MAGIC_LENGTH 8
+
+// start of a block and bytes before its encoded samples
+#define DATALOG_BLOCK_MAGIC  0xB10C
+#define DATALOG_BLOCK_HEADER 38
+
+// max samples of a block, the encoded samples of a full block always fit
+// into the 16 bit length
+#define DATALOG_BLOCK_SAMPLES 512
+
+// max number of series, a power of 2. Data of further series is skipped.
+#define DATALOG_MAX_SERIES 1024
+
+// samples waiting for the writer, power of 2
+#define DATALOG_RING_SIZE 8192
+
+// bytes collected before a write to the file
+#define DATALOG_WRITE_SIZE 262144
+
+// default time in milliseconds after which blocks are closed and written
+// even if not full, the data lost at a power failure
+#define DATALOG_FLUSH_TIME 10000
+
+// value types, tell how a reader interprets the values
+#define DATALOG_TYPE_UNSIGNED 0
+#define DATALOG_TYPE_SIGNED   1
+#define DATALOG_TYPE_REAL     2   // REAL32 or REAL64 by the value length
+
+// encodings of the values of a block
+#define DATALOG_ENC_XOR   0
+#define DATALOG_ENC_DELTA 1
+
+// max types set with SetType
+#define DATALOG_MAX_TYPES 256
+
+/**************************************************************************
+GLOBAL TYPES AND FUNCTIONS
+***************************************************************************/
+
+// counters of the log
+typedef struct
+{
+  STATS_COUNTER Samples;                    // samples added
+  STATS_COUNTER Lost;                       // samples lost, ring full
+  STATS_COUNTER Skipped;                    // samples longer than 8 bytes or of too many series
+  STATS_COUNTER Blocks;                     // blocks written
+  STATS_COUNTER RawBytes;                   // bytes of the samples as time, key, length and data
+  STATS_COUNTER Bytes;                      // bytes written to the file
+  STATS_COUNTER Writes;                     // writes to the file
+  STATS_COUNTER WriteErrors;                // writes that failed, their blocks are dropped
+  STATS_COUNTER Truncated;                  // bytes of a damaged end of the log removed at Open
+} DATALOG_STATS;
+
+class DATALOG
+{
+  // a sample added by the protocol
+  typedef struct
+  {
+    uint64_t Time;                          // us since 1970
+    uint64_t Value;                         // value, little endian bytes
+    UNSIGNED16 Index;
+    UNSIGNED8 NodeID;
+    UNSIGNED8 Subindex;
+    UNSIGNED8 Length;
+  } SAMPLE;
+
+  // a series and the samples of its open block, only used by the writer
+  typedef struct
+  {
+    uint32_t Key;                           // node id, index and subindex
+    UNSIGNED8 Length;                       // value length of the block
+    UNSIGNED8 Type;                         // DATALOG_TYPE_xxx
+    unsigned int Count;                     // samples in the block
+    uint64_t Times[DATALOG_BLOCK_SAMPLES];
+    uint64_t Values[DATALOG_BLOCK_SAMPLES];
+  } SERIES;
+
+  public:
+    /**************************************************************************
+    DOES:    Constructor - creates a log without a file
+    **************************************************************************/
+    DATALOG(void);
+    /**************************************************************************
+    DOES:    Destructor - writes the open blocks and closes the file
+    **************************************************************************/
+    ~DATALOG(void);
+    /**************************************************************************
+    DOES:    Opens the log file, blocks are appended to an existing log,
+             and starts the thread writing to it. A block not completely
+             written at the end of an existing log, e.g. after a power
+             failure, is removed first.
+    RETURNS: TRUE for success, FALSE for error
+    **************************************************************************/
+    bool Open(const char *FileName);
+    /**************************************************************************
+    DOES:    Stops the thread, writes the open blocks and closes the file
+    RETURNS: Nothing
+    **************************************************************************/
+    void Close(void);
+    /**************************************************************************
+    DOES:    Sets how the values of an od entry are interpreted by readers,
+             DATALOG_TYPE_UNSIGNED if not set. Only before Open.
+    RETURNS: TRUE for success, FALSE if too many types are set
+    **************************************************************************/
+    bool SetType(
+      UNSIGNED8 NodeID,           // node id
+      UNSIGNED16 Index,           // index of od entry
+      UNSIGNED8 Subindex,         // subindex of od entry
+      UNSIGNED8 Type              // DATALOG_TYPE_xxx
+      );
+    /**************************************************************************
+    DOES:    Sets the time after which blocks are written even if not full.
+             Only before Open.
+    RETURNS: Nothing
+    **************************************************************************/
+    void SetFlushTime(unsigned long Milliseconds) { FlushTime = Milliseconds * 1000ULL; }
+    /**************************************************************************
+    DOES:    Takes data written by the device, to be called from the data
+             call-back. Must only be called by one thread, never blocks.
+    RETURNS: TRUE if the sample was added, else FALSE
+    **************************************************************************/
+    bool HandleData(
+      UNSIGNED8 NodeID,           // node id the data is from
+      int Index,                  // index of od entry written
+      unsigned char Subindex,     // subindex of od entry written
+      unsigned long DataLength,   // length of data written
+      const unsigned char *Data   // data written
+      );
+    /**************************************************************************
+    DOES:    Gets the counters of the log, may be called from any thread
+    RETURNS: Counters
+    **************************************************************************/
+    const DATALOG_STATS *GetStatistics(void) const { return &Stats; }
+    /**************************************************************************
+    DOES:    Checks the header of a block, e.g. to find the next block after
+             damaged data
+    RETURNS: Length of the block with its header, 0 if not a valid header
+    **************************************************************************/
+    static unsigned long CheckBlock(
+      const unsigned char *Block  // DATALOG_BLOCK_HEADER bytes
+      );
+
+  private:
+    SERIES *FindSeries(const SAMPLE *Sample);
+    void AddSample(const SAMPLE *Sample);
+    void CloseBlock(SERIES *Series);
+    void CloseOldBlocks(uint64_t Now);
+    void WriteBuffer(void);
+    void Drain(void);
+    void Run(void);
+
+    // single producer, single consumer ring
+    SAMPLE *Ring;
+    std::atomic<unsigned long> Head;          // next sample to fill, by the protocol
+    std::atomic<unsigned long> Tail;          // next sample to take, by the thread
+
+    // series by hash of their key, allocated when first seen
+    SERIES *Series[DATALOG_MAX_SERIES];
+    unsigned int NumSeries;
+    uint32_t TypeKeys[DATALOG_MAX_TYPES];
+    UNSIGNED8 Types[DATALOG_MAX_TYPES];
+    unsigned int NumTypes;
+
+    // encoded blocks not yet written
+    unsigned char *Buffer;
+    unsigned long BufferLength;
+    uint64_t BufferTime;                      // us, first block added to the buffer
+    uint64_t FlushTime;                       // us a sample waits at most for the file
+    unsigned char *Encoded[2];                // samples of a block by both encodings
+
+    FILE *File;
+    long FileLength;                          // bytes written to the file
+    std::thread Writer;
+    std::atomic<bool> StopRequested;
+    DATALOG_STATS Stats;
+};
+
+#endif // _DATALOG_H
+
+/*----------------------- END OF FILE ----------------------------------*/
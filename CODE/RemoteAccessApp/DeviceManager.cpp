@@ -0,0 +1,678 @@
+/**************************************************************************
+MODULE:    DeviceManager
+CONTAINS:  Drives several CANopenIA devices, each on its own serial port,
+           from one event loop or from a few threads with one shard of the
+           devices each. A shard waits with poll() for all its devices at
+           once and only sends requests that do not block, so that a slow
+           device does not hold up the others.
+COPYRIGHT: Embedded Systems Academy, Inc. 2008-2017.
+DISCLAIM:  Read and understand our disclaimer before using this code!
+           www.esacademy.com/disclaim.htm
+           This software was written in accordance to the guidelines at
+           www.esacademy.com/software/softwarestyleguide.pdf
+LICENSE:   Free to use with licensed CANopenIA chips, modules or devices
+           like CANgineBerry, CANgineXXX and 447izer
+VERSION:   1.10, EmSA 10-NOV-17
+           $LastChangedDate: 2014-01-11 17:30:59 +0100 (Sa, 11 Jan 2014) $
+           $LastChangedRevision: 1702 $
+***************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <unistd.h>
+#include "DeviceManager.h"
+#include "Timer.h"
+
+/**************************************************************************
+LOCAL DEFINES
+***************************************************************************/
+
+// poll entries of a shard: wake pipe, then port and event handle of each
+// device
+#define MAX_FDS (1 + 2 * DEVMGR_MAX_DEVICES)
+
+
+/**************************************************************************
+DOES:    Constructor - creates a manager without devices
+**************************************************************************/
+DEVICEMANAGER::DEVICEMANAGER
+  (
+  void
+  )
+{
+  NumDevices = 0;
+  NumShards = 0;
+  NumThreads = 0;
+  Running = FALSE;
+  LowLatency = FALSE;
+  Backend = SERIAL_BACKEND_SYSCALL;
+  DataCallback = NULL;
+  DataCallbackParam = NULL;
+  pthread_mutex_init(&DoneLock, NULL);
+  pthread_cond_init(&Done, NULL);
+}
+
+
+/**************************************************************************
+DOES:    Destructor - stops the shards, disconnects all devices
+**************************************************************************/
+DEVICEMANAGER::~DEVICEMANAGER
+  (
+  void
+  )
+{
+  int d;
+
+  Stop();
+  for (d = 0; d < NumDevices; d++)
+  {
+    Devices[d].Protocol->Disconnect();
+    delete Devices[d].Protocol;
+  }
+  pthread_cond_destroy(&Done);
+  pthread_mutex_destroy(&DoneLock);
+}
+
+
+/**************************************************************************
+DOES:    Connects to a device, before Start
+RETURNS: Port number used to address the device, -1 for error
+**************************************************************************/
+int DEVICEMANAGER::AddDevice
+  (
+  char *PortName,                                          // serial port of the device
+  unsigned long Baudrate                                   // serial baud rate to use (bps)
+  )
+{
+  DEVICE *Device;
+
+  if (Running || (NumDevices >= DEVMGR_MAX_DEVICES))
+  {
+    fprintf(stderr, "ERROR: no more devices can be added\n");
+    return -1;
+  }
+
+  Device = &Devices[NumDevices];
+  memset(Device, 0, sizeof(DEVICE));
+  Device->Manager = this;
+  Device->Port = NumDevices;
+  Device->Protocol = new SerialProtocol();
+  Device->Protocol->SetLowLatency(LowLatency);
+  Device->Protocol->SetBackend(Backend);
+  if (!Device->Protocol->Connect(PortName, Baudrate))
+  {
+    fprintf(stderr, "ERROR: connecting to %s\n", PortName);
+    delete Device->Protocol;
+    return -1;
+  }
+  // the shard waits for all devices, Process must not wait for one
+  Device->Protocol->SetProcessWait(0);
+  Device->Protocol->RegisterDataCallback((DATACALLBACK *)DataReceived, Device);
+
+  return NumDevices++;
+}
+
+
+/**************************************************************************
+DOES:    Gets the protocol of a device
+RETURNS: Protocol or NULL if there is no such port
+**************************************************************************/
+SerialProtocol *DEVICEMANAGER::GetDevice
+  (
+  int Port                                                 // returned by AddDevice
+  )
+{
+  if ((Port < 0) || (Port >= NumDevices)) return NULL;
+  return Devices[Port].Protocol;
+}
+
+
+/**************************************************************************
+DOES:    Registers a call-back for process data written to the devices
+RETURNS: Nothing
+**************************************************************************/
+void DEVICEMANAGER::RegisterDataCallback
+  (
+  DEVMGR_DATACALLBACK Callback,                            // new callback function or NULL to disable
+  void *Param                                              // arbitrary callback parameter
+  )
+{
+  DataCallback = Callback;
+  DataCallbackParam = Param;
+}
+
+
+/**************************************************************************
+DOES:    Starts running the devices, with 0 shards by calls of Poll, else
+         by threads pinned to one processor each
+RETURNS: TRUE for success, FALSE for error
+**************************************************************************/
+bool DEVICEMANAGER::Start
+  (
+  unsigned int ThreadCount                                 // number of threads, 0 for Poll
+  )
+{
+  SHARD *Shard;
+  unsigned int s;
+  long Processors;
+  int d;
+
+  if (Running || (NumDevices == 0)) return FALSE;
+  if (ThreadCount > DEVMGR_MAX_SHARDS) ThreadCount = DEVMGR_MAX_SHARDS;
+  if (ThreadCount > (unsigned int)NumDevices) ThreadCount = NumDevices;
+
+  NumShards = ThreadCount ? ThreadCount : 1;
+  for (s = 0; s < NumShards; s++)
+  {
+    Shard = &Shards[s];
+    Shard->Manager = this;
+    Shard->Number = s;
+    Shard->IdleTime = 0;
+    pthread_mutex_init(&Shard->Lock, NULL);
+    if (pipe(Shard->Wake) != 0)
+    {
+      fprintf(stderr, "ERROR: %d creating pipe\n", errno);
+      // release the shards created so far, like Stop
+      pthread_mutex_destroy(&Shard->Lock);
+      while (s--)
+      {
+        close(Shards[s].Wake[0]);
+        close(Shards[s].Wake[1]);
+        pthread_mutex_destroy(&Shards[s].Lock);
+      }
+      NumShards = 0;
+      return FALSE;
+    }
+    fcntl(Shard->Wake[0], F_SETFL, O_NONBLOCK);
+    fcntl(Shard->Wake[1], F_SETFL, O_NONBLOCK);
+  }
+  for (d = 0; d < NumDevices; d++) Devices[d].Shard = d % NumShards;
+  Running = TRUE;
+
+  Processors = sysconf(_SC_NPROCESSORS_ONLN);
+  for (NumThreads = 0; NumThreads < ThreadCount; NumThreads++)
+  {
+    Shard = &Shards[NumThreads];
+    if (pthread_create(&Shard->Thread, NULL, ShardThread, Shard) != 0)
+    {
+      fprintf(stderr, "ERROR: creating shard thread\n");
+      Stop();
+      return FALSE;
+    }
+#ifdef CPU_SET
+    // a shard stays with the caches of its processor
+    if (Processors > 1)
+    {
+      cpu_set_t Set;
+      CPU_ZERO(&Set);
+      CPU_SET(NumThreads % Processors, &Set);
+      if (pthread_setaffinity_np(Shard->Thread, sizeof(Set), &Set) != 0)
+      {
+        fprintf(stderr, "WARNING: shard %u not pinned to a processor\n", NumThreads);
+      }
+    }
+#endif
+  }
+
+  return TRUE;
+}
+
+
+/**************************************************************************
+DOES:    Stops the threads, requests not completed fail with
+         ERROR_TRANSFERABORTED
+RETURNS: Nothing
+**************************************************************************/
+void DEVICEMANAGER::Stop
+  (
+  void
+  )
+{
+  unsigned int s;
+  int d;
+  char Byte = 0;
+
+  if (!Running) return;
+
+  Running = FALSE;
+  for (s = 0; s < NumThreads; s++)
+  {
+    if (write(Shards[s].Wake[1], &Byte, 1) < 0) {}
+    pthread_join(Shards[s].Thread, NULL);
+  }
+  NumThreads = 0;
+
+  for (d = 0; d < NumDevices; d++) FailDevice(&Devices[d], ERROR_TRANSFERABORTED);
+  for (s = 0; s < NumShards; s++)
+  {
+    close(Shards[s].Wake[0]);
+    close(Shards[s].Wake[1]);
+    pthread_mutex_destroy(&Shards[s].Lock);
+  }
+  NumShards = 0;
+}
+
+
+/**************************************************************************
+DOES:    Runs all devices once, waits for data up to the timeout
+RETURNS: Nothing
+**************************************************************************/
+void DEVICEMANAGER::Poll
+  (
+  unsigned long Timeout                                    // max milliseconds to wait for data
+  )
+{
+  if (!Running || NumThreads) return;
+  RunShard(&Shards[0], (int)Timeout);
+}
+
+
+/**************************************************************************
+DOES:    Queues a request for its device, the shard of the device is woken
+         up to send it
+RETURNS: TRUE if queued, FALSE if there is no such port
+**************************************************************************/
+bool DEVICEMANAGER::Submit
+  (
+  DEVMGR_REQUEST *Request                                  // request, kept until completed
+  )
+{
+  DEVICE *Device;
+  SHARD *Shard;
+  char Byte = 0;
+
+  if (!Running || (Request->Port < 0) || (Request->Port >= NumDevices)) return FALSE;
+
+  Device = &Devices[Request->Port];
+  Shard = &Shards[Device->Shard];
+  Request->Result = ERROR_PENDING;
+  Request->Next = NULL;
+
+  pthread_mutex_lock(&Shard->Lock);
+  if (Device->Tail) Device->Tail->Next = Request;
+  else Device->Head = Request;
+  Device->Tail = Request;
+  pthread_mutex_unlock(&Shard->Lock);
+
+  // a full pipe wakes the shard as well
+  if (write(Shard->Wake[1], &Byte, 1) < 0) {}
+  return TRUE;
+}
+
+
+/**************************************************************************
+DOES:    Reads an object dictionary entry of a device or a remote node,
+         blocks until done
+RETURNS: ERROR_NOERROR for success or error code for failure
+**************************************************************************/
+unsigned long DEVICEMANAGER::Read
+  (
+  int Port,                                                // returned by AddDevice
+  unsigned char NodeID,                                    // node id of remote node, 0 for the device
+  unsigned short Index,                                    // index of od entry to read
+  unsigned char Subindex,                                  // subindex of od entry to read
+  unsigned long *DataLength,                               // location to store length of data read
+  unsigned char *Data                                      // location to store data read (must hold at least MAX_PACKET_LENGTH bytes)
+  )
+{
+  DEVMGR_REQUEST Request;
+  unsigned long result;
+
+  Request.Port = Port;
+  Request.NodeID = NodeID;
+  Request.Index = Index;
+  Request.Subindex = Subindex;
+  Request.Write = FALSE;
+  Request.DataLength = 0;
+  result = Execute(&Request);
+  if (result == ERROR_NOERROR)
+  {
+    *DataLength = Request.DataLength;
+    memcpy(Data, Request.Data, Request.DataLength);
+  }
+
+  return result;
+}
+
+
+/**************************************************************************
+DOES:    Writes an object dictionary entry of a device or a remote node,
+         blocks until done
+RETURNS: ERROR_NOERROR for success or error code for failure
+**************************************************************************/
+unsigned long DEVICEMANAGER::Write
+  (
+  int Port,                                                // returned by AddDevice
+  unsigned char NodeID,                                    // node id of remote node, 0 for the device
+  unsigned short Index,                                    // index of od entry to write
+  unsigned char Subindex,                                  // subindex of od entry to write
+  unsigned long DataLength,                                // length of data to write
+  unsigned char *Data                                      // location of data to write
+  )
+{
+  DEVMGR_REQUEST Request;
+
+  // don't allow write of too much data
+  if (DataLength > MAX_PACKET_LENGTH)
+  {
+    return ERROR_NORESOURCES;
+  }
+
+  Request.Port = Port;
+  Request.NodeID = NodeID;
+  Request.Index = Index;
+  Request.Subindex = Subindex;
+  Request.Write = TRUE;
+  Request.DataLength = DataLength;
+  memcpy(Request.Data, Data, DataLength);
+  return Execute(&Request);
+}
+
+
+/**************************************************************************
+DOES:    Submits a request and waits for its completion. With threads
+         the caller sleeps, else it runs the devices meanwhile.
+RETURNS: Result of the request
+**************************************************************************/
+unsigned long DEVICEMANAGER::Execute
+  (
+  DEVMGR_REQUEST *Request                                  // request to run
+  )
+{
+  Request->Callback = NULL;
+  Request->Param = NULL;
+  if (!Submit(Request))
+  {
+    return ERROR_NORESOURCES;
+  }
+
+  if (NumThreads == 0)
+  {
+    while (Request->Result == ERROR_PENDING) RunShard(&Shards[0], DEVMGR_BUSY_WAIT);
+    return Request->Result;
+  }
+
+  pthread_mutex_lock(&DoneLock);
+  while (Request->Result == ERROR_PENDING) pthread_cond_wait(&Done, &DoneLock);
+  pthread_mutex_unlock(&DoneLock);
+
+  return Request->Result;
+}
+
+
+/**************************************************************************
+DOES:    Sets the result of a request and tells its submitter
+RETURNS: Nothing
+**************************************************************************/
+void DEVICEMANAGER::Complete
+  (
+  DEVMGR_REQUEST *Request,                                 // request completed
+  unsigned long Result                                     // ERROR_xxx
+  )
+{
+  if (Request->Callback)
+  {
+    Request->Result = Result;
+    Request->Callback(Request);
+    return;
+  }
+
+  // a blocking caller may release the request as soon as it sees the result
+  pthread_mutex_lock(&DoneLock);
+  Request->Result = Result;
+  pthread_cond_broadcast(&Done);
+  pthread_mutex_unlock(&DoneLock);
+}
+
+
+/**************************************************************************
+DOES:    Completes the request sent and all waiting requests of a device
+RETURNS: Nothing
+**************************************************************************/
+void DEVICEMANAGER::FailDevice
+  (
+  DEVICE *Device,                                          // device that cannot complete requests
+  unsigned long Result                                     // ERROR_xxx of the requests
+  )
+{
+  SHARD *Shard = &Shards[Device->Shard];
+  DEVMGR_REQUEST *Request;
+  DEVMGR_REQUEST *Next;
+
+  if (Device->Active)
+  {
+    Request = Device->Active;
+    Device->Active = NULL;
+    Complete(Request, Result);
+  }
+
+  pthread_mutex_lock(&Shard->Lock);
+  Request = Device->Head;
+  Device->Head = NULL;
+  Device->Tail = NULL;
+  pthread_mutex_unlock(&Shard->Lock);
+
+  while (Request)
+  {
+    Next = Request->Next;
+    Complete(Request, Result);
+    Request = Next;
+  }
+}
+
+
+/**************************************************************************
+DOES:    Sends the next waiting request of each idle device of a shard
+RETURNS: Nothing
+**************************************************************************/
+void DEVICEMANAGER::StartRequests
+  (
+  SHARD *Shard                                             // shard to run
+  )
+{
+  DEVICE *Device;
+  DEVMGR_REQUEST *Request;
+  unsigned long result;
+  int d;
+
+  for (d = Shard->Number; d < NumDevices; d += NumShards)
+  {
+    Device = &Devices[d];
+    while (!Device->Active)
+    {
+      pthread_mutex_lock(&Shard->Lock);
+      Request = Device->Head;
+      if (Request)
+      {
+        Device->Head = Request->Next;
+        if (!Device->Head) Device->Tail = NULL;
+      }
+      pthread_mutex_unlock(&Shard->Lock);
+      if (!Request) break;
+
+      if (Device->Failed)
+      {
+        Complete(Request, ERROR_TX);
+        continue;
+      }
+      result = Device->Protocol->StartRequest(Request->NodeID, Request->Index, Request->Subindex,
+        Request->Write, Request->DataLength, Request->Data);
+      if (result == ERROR_NOERROR) Device->Active = Request;
+      else Complete(Request, result);
+    }
+  }
+}
+
+
+/**************************************************************************
+DOES:    Completes the requests of a shard that got their response or
+         timed out
+RETURNS: Nothing
+**************************************************************************/
+void DEVICEMANAGER::CheckRequests
+  (
+  SHARD *Shard                                             // shard to run
+  )
+{
+  DEVICE *Device;
+  DEVMGR_REQUEST *Request;
+  unsigned long result;
+  int d;
+
+  for (d = Shard->Number; d < NumDevices; d += NumShards)
+  {
+    Device = &Devices[d];
+    Request = Device->Active;
+    if (!Request) continue;
+
+    result = Device->Protocol->GetRequestResult(&Request->DataLength, Request->Data);
+    if (result != ERROR_PENDING)
+    {
+      Device->Active = NULL;
+      Complete(Request, result);
+    }
+  }
+}
+
+
+/**************************************************************************
+DOES:    Runs the devices of a shard once: sends waiting requests, waits
+         for data from any device, processes the devices that got data and
+         completes the requests answered
+RETURNS: Nothing
+**************************************************************************/
+void DEVICEMANAGER::RunShard
+  (
+  SHARD *Shard,                                            // shard to run
+  int Timeout                                              // max milliseconds to wait for data
+  )
+{
+  struct pollfd Fds[MAX_FDS];
+  int FdDevice[MAX_FDS];
+  DEVICE *Device;
+  char Bytes[64];
+  bool Pending = FALSE;
+  int NumFds;
+  uint64_t Now;
+  int Ready;
+  int f;
+  int d;
+  int n;
+
+  StartRequests(Shard);
+
+  Fds[0].fd = Shard->Wake[0];
+  Fds[0].events = POLLIN;
+  NumFds = 1;
+  for (d = Shard->Number; d < NumDevices; d += NumShards)
+  {
+    Device = &Devices[d];
+    if (Device->Failed) continue;
+    if (Device->Active) Pending = TRUE;
+    Fds[NumFds].fd = Device->Protocol->GetHandle();
+    Fds[NumFds].events = POLLIN;
+    FdDevice[NumFds++] = d;
+    if (Device->Protocol->GetEventHandle() != Device->Protocol->GetHandle())
+    {
+      Fds[NumFds].fd = Device->Protocol->GetEventHandle();
+      Fds[NumFds].events = POLLIN;
+      FdDevice[NumFds++] = d;
+    }
+  }
+  // response timeouts are checked by Process and GetRequestResult
+  if (Pending && (Timeout > DEVMGR_BUSY_WAIT)) Timeout = DEVMGR_BUSY_WAIT;
+
+  Ready = poll(Fds, NumFds, Timeout);
+  if (Ready < 0) return;
+  if (Fds[0].revents & POLLIN)
+  {
+    while (read(Shard->Wake[0], Bytes, sizeof(Bytes)) > 0) {}
+  }
+
+  for (f = 1; f < NumFds; f++)
+  {
+    Device = &Devices[FdDevice[f]];
+    if (Fds[f].revents & (POLLHUP | POLLERR | POLLNVAL))
+    {
+      // the device is gone, e.g. unplugged
+      if ((Fds[f].fd == Device->Protocol->GetHandle()) && !Device->Failed)
+      {
+        fprintf(stderr, "ERROR: lost connection to the device on port %d\n", Device->Port);
+        Device->Failed = TRUE;
+        FailDevice(Device, ERROR_TX);
+      }
+      continue;
+    }
+    if (!(Fds[f].revents & POLLIN)) continue;
+    // both handles of a device may be readable, process it once
+    if ((f + 1 < NumFds) && (FdDevice[f + 1] == FdDevice[f])) Fds[f + 1].revents &= ~POLLIN;
+
+    // handle everything the device sent, bytes read ahead by the backend
+    // do not make the handles readable again
+    n = 0;
+    do
+    {
+      Device->Protocol->Process();
+    } while ((++n < DEVMGR_DRAIN) && Device->Protocol->IsDataAvailable());
+  }
+
+  // packet timeouts and SDO clients of devices without data
+  Now = Timer::GetMicroseconds();
+  if (Now >= Shard->IdleTime)
+  {
+    Shard->IdleTime = Now + DEVMGR_IDLE_WAIT * 1000UL;
+    for (d = Shard->Number; d < NumDevices; d += NumShards)
+    {
+      if (!Devices[d].Failed) Devices[d].Protocol->Process();
+    }
+  }
+
+  CheckRequests(Shard);
+}
+
+
+/**************************************************************************
+DOES:    Runs the devices of a shard until stopped
+RETURNS: NULL
+**************************************************************************/
+void *DEVICEMANAGER::ShardThread
+  (
+  void *Param                                              // shard to run
+  )
+{
+  SHARD *Shard = (SHARD *)Param;
+
+  while (Shard->Manager->Running) Shard->Manager->RunShard(Shard, DEVMGR_IDLE_WAIT);
+  return NULL;
+}
+
+
+/**************************************************************************
+DOES:    Call-back of the devices for process data, passes it on with the
+         port number
+RETURNS: Nothing
+**************************************************************************/
+void DEVICEMANAGER::DataReceived
+  (
+  unsigned char NodeID,                                    // node id of node that sent the data
+  int Index,                                               // index of od entry
+  unsigned char Subindex,                                  // subindex of od entry
+  unsigned long DataLength,                                // length of data
+  unsigned char *Data,                                     // data
+  void *Param                                              // device
+  )
+{
+  DEVICE *Device = (DEVICE *)Param;
+  DEVICEMANAGER *Manager = Device->Manager;
+
+  if (Manager->DataCallback)
+  {
+    Manager->DataCallback(Device->Port, NodeID, Index, Subindex, DataLength, Data, Manager->DataCallbackParam);
+  }
+}
+
+/*----------------------- END OF FILE ----------------------------------*/
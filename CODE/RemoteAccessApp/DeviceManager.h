@@ -0,0 +1,233 @@
+/**************************************************************************
+MODULE:    DeviceManager
+CONTAINS:  Drives several CANopenIA devices, each on its own serial port,
+           from one event loop or from a few threads with one shard of the
+           devices each. Requests are addressed by port number, node id,
+           index and subindex and complete with a call-back or block the
+           calling thread.
+COPYRIGHT: Embedded Systems Academy, Inc. 2008-2017.
+DISCLAIM:  Read and understand our disclaimer before using this code!
+           www.esacademy.com/disclaim.htm
+           This software was written in accordance to the guidelines at
+           www.esacademy.com/software/softwarestyleguide.pdf
+LICENSE:   Free to use with licensed CANopenIA chips, modules or devices
+           like CANgineBerry, CANgineXXX and 447izer
+VERSION:   1.10, EmSA 10-NOV-17
+           $LastChangedDate: 2014-01-11 17:30:59 +0100 (Sa, 11 Jan 2014) $
+           $LastChangedRevision: 1702 $
+***************************************************************************/
+#pragma once
+
+#ifndef _DEVICEMANAGER_H
+#define _DEVICEMANAGER_H
+
+#include <pthread.h>
+#include "global.h"
+#include "SerialProtocol.h"
+
+/**************************************************************************
+GLOBAL DEFINES
+***************************************************************************/
+
+// max number of devices and of threads running them
+#define DEVMGR_MAX_DEVICES 32
+#define DEVMGR_MAX_SHARDS  16
+
+// milliseconds a shard waits for data while no request is pending. All
+// devices are processed this often, for packet timeouts and SDO clients.
+#define DEVMGR_IDLE_WAIT 10
+
+// milliseconds a shard waits for data while requests are pending, their
+// timeouts are checked this often
+#define DEVMGR_BUSY_WAIT 1
+
+// max Process calls per device when it got data, so that one busy device
+// cannot hold up the others of its shard
+#define DEVMGR_DRAIN 16
+
+/**************************************************************************
+GLOBAL TYPES AND FUNCTIONS
+***************************************************************************/
+
+struct _DevMgrRequest;
+
+// called by the thread of the device when a request completed, the
+// request may be reused or released by the call-back
+typedef void (*DEVMGR_CALLBACK)(struct _DevMgrRequest *Request);
+
+// called by the thread of the device for process data written to it
+typedef void (*DEVMGR_DATACALLBACK)(int Port, unsigned char NodeID, int Index, unsigned char Subindex, unsigned long DataLength, unsigned char *Data, void *Param);
+
+// a read or write of an object dictionary entry, of the device itself or of
+// a remote node. Data is limited to what fits in a packet.
+typedef struct _DevMgrRequest
+{
+  int Port;                                 // returned by AddDevice
+  unsigned char NodeID;                     // node id of remote node, 0 for the device
+  unsigned short Index;
+  unsigned char Subindex;
+  bool Write;                               // TRUE to write, FALSE to read
+  unsigned long DataLength;                 // data to write, filled with length of data read
+  unsigned char Data[MAX_PACKET_LENGTH];
+  volatile unsigned long Result;            // ERROR_xxx, ERROR_PENDING until completed
+  DEVMGR_CALLBACK Callback;                 // NULL for Read and Write
+  void *Param;                              // for the call-back
+  struct _DevMgrRequest *Next;              // used by the device manager
+} DEVMGR_REQUEST;
+
+class DEVICEMANAGER
+{
+  // a connected device, run by one shard
+  typedef struct
+  {
+    DEVICEMANAGER *Manager;
+    SerialProtocol *Protocol;
+    int Port;
+    unsigned int Shard;
+    bool Failed;                            // port hung up, requests fail
+    DEVMGR_REQUEST *Head;                   // requests waiting, locked by the shard
+    DEVMGR_REQUEST *Tail;
+    DEVMGR_REQUEST *Active;                 // request sent, only used by the shard
+  } DEVICE;
+
+  // devices run by one thread, or by Poll
+  typedef struct
+  {
+    DEVICEMANAGER *Manager;
+    unsigned int Number;
+    pthread_t Thread;
+    pthread_mutex_t Lock;                   // request queues of its devices
+    HANDLE Wake[2];                         // pipe written by Submit
+    uint64_t IdleTime;                      // microseconds, next Process of all devices
+  } SHARD;
+
+  public:
+    /**************************************************************************
+    DOES:    Constructor - creates a manager without devices
+    **************************************************************************/
+    DEVICEMANAGER(void);
+    /**************************************************************************
+    DOES:    Destructor - stops the shards, disconnects all devices
+    **************************************************************************/
+    ~DEVICEMANAGER(void);
+    /**************************************************************************
+    DOES:    Selects the low latency mode and the I/O backend of the serial
+             ports for the next AddDevice, see SerialProtocol
+    RETURNS: Nothing
+    **************************************************************************/
+    void SetLowLatency(bool On) { LowLatency = On; }
+    void SetBackend(int NewBackend) { Backend = NewBackend; }
+    /**************************************************************************
+    DOES:    Connects to a device, before Start
+    RETURNS: Port number used to address the device, -1 for error
+    **************************************************************************/
+    int AddDevice(
+      char *PortName,             // serial port of the device
+      unsigned long Baudrate      // serial baud rate to use (bps)
+      );
+    /**************************************************************************
+    DOES:    Gets the protocol of a device, e.g. for its counters or
+             timeouts. Requests must go through the manager.
+    RETURNS: Protocol or NULL if there is no such port
+    **************************************************************************/
+    SerialProtocol *GetDevice(int Port);
+    /**************************************************************************
+    DOES:    Gets the number of devices added
+    RETURNS: Number of devices
+    **************************************************************************/
+    int GetDeviceCount(void) const { return NumDevices; }
+    /**************************************************************************
+    DOES:    Registers a call-back for process data written to the devices,
+             before Start
+    RETURNS: Nothing
+    **************************************************************************/
+    void RegisterDataCallback(DEVMGR_DATACALLBACK Callback, void *Param);
+    /**************************************************************************
+    DOES:    Starts running the devices. With 0 shards the caller runs all
+             devices by calling Poll, else the devices are spread over
+             threads, each pinned to its own processor if possible.
+    RETURNS: TRUE for success, FALSE for error
+    **************************************************************************/
+    bool Start(
+      unsigned int ThreadCount    // number of threads, 0 for Poll
+      );
+    /**************************************************************************
+    DOES:    Stops the threads, requests not completed fail with
+             ERROR_TRANSFERABORTED
+    RETURNS: Nothing
+    **************************************************************************/
+    void Stop(void);
+    /**************************************************************************
+    DOES:    Runs all devices once, waits for data up to the timeout. Only
+             when started with 0 shards.
+    RETURNS: Nothing
+    **************************************************************************/
+    void Poll(
+      unsigned long Timeout       // max milliseconds to wait for data
+      );
+    /**************************************************************************
+    DOES:    Queues a request for its device and returns, the call-back is
+             called on completion. Requests of a device are sent one after
+             the other, requests of different devices in parallel. May be
+             called from any thread.
+    RETURNS: TRUE if queued, FALSE if there is no such port
+    **************************************************************************/
+    bool Submit(
+      DEVMGR_REQUEST *Request     // request, kept until completed
+      );
+    /**************************************************************************
+    DOES:    Reads an object dictionary entry of a device or a remote node,
+             blocks until done. Must not be called from call-backs.
+    RETURNS: ERROR_NOERROR for success or error code for failure
+    **************************************************************************/
+    unsigned long Read(
+      int Port,                   // returned by AddDevice
+      unsigned char NodeID,       // node id of remote node, 0 for the device
+      unsigned short Index,       // index of od entry to read
+      unsigned char Subindex,     // subindex of od entry to read
+      unsigned long *DataLength,  // location to store length of data read
+      unsigned char *Data         // location to store data read (must hold at least MAX_PACKET_LENGTH bytes)
+      );
+    /**************************************************************************
+    DOES:    Writes an object dictionary entry of a device or a remote node,
+             blocks until done. Must not be called from call-backs.
+    RETURNS: ERROR_NOERROR for success or error code for failure
+    **************************************************************************/
+    unsigned long Write(
+      int Port,                   // returned by AddDevice
+      unsigned char NodeID,       // node id of remote node, 0 for the device
+      unsigned short Index,       // index of od entry to write
+      unsigned char Subindex,     // subindex of od entry to write
+      unsigned long DataLength,   // length of data to write
+      unsigned char *Data         // location of data to write
+      );
+
+  private:
+    unsigned long Execute(DEVMGR_REQUEST *Request);
+    void RunShard(SHARD *Shard, int Timeout);
+    void StartRequests(SHARD *Shard);
+    void CheckRequests(SHARD *Shard);
+    void Complete(DEVMGR_REQUEST *Request, unsigned long Result);
+    void FailDevice(DEVICE *Device, unsigned long Result);
+    static void *ShardThread(void *Param);
+    static void DataReceived(unsigned char NodeID, int Index, unsigned char Subindex, unsigned long DataLength, unsigned char *Data, void *Param);
+
+    DEVICE Devices[DEVMGR_MAX_DEVICES];
+    int NumDevices;
+    SHARD Shards[DEVMGR_MAX_SHARDS];
+    unsigned int NumShards;                 // shards of the devices, 1 for Poll
+    unsigned int NumThreads;                // 0 while Poll runs the devices
+    volatile bool Running;
+    bool LowLatency;
+    int Backend;
+    DEVMGR_DATACALLBACK DataCallback;
+    void *DataCallbackParam;
+
+    // completion of the blocking Read and Write
+    pthread_mutex_t DoneLock;
+    pthread_cond_t Done;
+};
+
+#endif // _DEVICEMANAGER_H
+
+/*----------------------- END OF FILE ----------------------------------*/
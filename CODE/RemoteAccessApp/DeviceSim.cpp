@@ -0,0 +1,1272 @@
+/**************************************************************************
+MODULE:    DeviceSim
+CONTAINS:  Simulated CANopenIA device on a pseudo terminal. Implements the
+           device side of the serial protocol, a local object dictionary
+           and a network of simulated remote nodes on a virtual CAN bus.
+COPYRIGHT: Embedded Systems Academy, Inc. 2008-2017.
+DISCLAIM:  Read and understand our disclaimer before using this code!
+           www.esacademy.com/disclaim.htm
+           This software was written in accordance to the guidelines at
+           www.esacademy.com/software/softwarestyleguide.pdf
+LICENSE:   Free to use with licensed CANopenIA chips, modules or devices
+           like CANgineBerry, CANgineXXX and 447izer
+VERSION:   1.10, EmSA 10-NOV-17
+           $LastChangedDate: 2014-01-11 17:30:59 +0100 (Sa, 11 Jan 2014) $
+           $LastChangedRevision: 1702 $
+***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "DeviceSim.h"
+#include "CRC.h"
+#include "Timer.h"
+
+/**************************************************************************
+LOCAL DEFINES
+***************************************************************************/
+
+// start of header
+#define SOH 0x11
+
+// NMT commands [5F0A,01]
+#define NMT_OPERATIONAL    1
+#define NMT_STOP           2
+#define NMT_PREOPERATIONAL 128
+#define NMT_RESETAPP       129
+#define NMT_RESETCOM       130
+
+// milliseconds to wait for the host to take more data
+#define TX_TIMEOUT 100
+
+/**************************************************************************
+MODULE VARIABLES
+***************************************************************************/
+
+// states reported by the device itself while booting
+static const UNSIGNED8 OwnBootSequence[] = {
+  NODESTATUS_PREOP, NODESTATUS_OPERATIONAL
+};
+
+// states reported for a remote node while it boots and is scanned
+static const UNSIGNED8 NodeBootSequence[] = {
+  NODESTATUS_BOOT, NODESTATUS_SCANSTARTED, NODESTATUS_SCANCOMPLETE,
+  NODESTATUS_HBACTIVE, NODESTATUS_OPERATIONAL
+};
+
+
+/**************************************************************************
+DOES:    Constructor - creates a device with node id 1, an empty local
+         object dictionary and no remote nodes
+**************************************************************************/
+DEVICESIM::DEVICESIM
+  (
+  void
+  )
+{
+  Master = INVALID_HANDLE_VALUE;
+  Slave = INVALID_HANDLE_VALUE;
+  PortName[0] = 0;
+  LinkName[0] = 0;
+  Verbose = FALSE;
+  HostConnected = FALSE;
+  ReceiveState = STATE_START;
+
+  OwnNodeID = 1;
+  HwStatus = HWSTATUS_NONE;
+  LastNMTCommand = 0;
+  GenericCan = 0;
+  Local.Init(&EmptyDictionary, OwnNodeID);
+
+  memset(Nodes, 0, sizeof(Nodes));
+  memset(NodeStatus, NODESTATUS_BOOT, sizeof(NodeStatus));
+  memset(NmtState, NODESTATUS_BOOT, sizeof(NmtState));
+  memset(BootStep, DEVICESIM_BOOTED, sizeof(BootStep));
+  memset(ProcessData, 0, sizeof(ProcessData));
+  memset(ProcessDataInterval, 0, sizeof(ProcessDataInterval));
+  memset(ProcessDataTime, 0, sizeof(ProcessDataTime));
+  memset(HeartbeatDefault, 0, sizeof(HeartbeatDefault));
+  memset(HeartbeatTime, 0, sizeof(HeartbeatTime));
+  memset(HeartbeatNext, 0, sizeof(HeartbeatNext));
+  memset(HeartbeatSeen, 0, sizeof(HeartbeatSeen));
+  memset(HeartbeatState, DEVICESIM_HB_IDLE, sizeof(HeartbeatState));
+
+  PacketsSent = 0;
+  PacketsDropped = 0;
+  ProcessDataCount = 0;
+  HeartbeatCount = 0;
+  HeartbeatLostCount = 0;
+  SdoTimeoutCount = 0;
+
+  XState = DEVICESIM_XSDO_IDLE;
+}
+
+
+/**************************************************************************
+DOES:    Destructor - closes the pseudo terminal, releases all nodes
+**************************************************************************/
+DEVICESIM::~DEVICESIM
+  (
+  void
+  )
+{
+  int NodeID;
+
+  Close();
+  for (NodeID = 1; NodeID <= DEVICESIM_MAX_NODES; NodeID++)
+  {
+    delete Nodes[NodeID];
+  }
+}
+
+
+/**************************************************************************
+DOES:    Creates the pseudo terminal. Hosts connect to the slave side,
+         optionally through a symbolic link that replaces any existing
+         link of that name.
+RETURNS: TRUE for success, FALSE for error
+**************************************************************************/
+bool DEVICESIM::Open
+  (
+  const char *Link                                         // symbolic link to create or NULL
+  )
+{
+  struct termios tty;
+  struct stat Status;
+  char *Name;
+
+  Master = posix_openpt(O_RDWR | O_NOCTTY);
+  if ((Master < 0) || (grantpt(Master) != 0) || (unlockpt(Master) != 0) || ((Name = ptsname(Master)) == NULL))
+  {
+    fprintf(stderr, "ERROR: %d creating pseudo terminal: %s\n", errno, strerror(errno));
+    Close();
+    return FALSE;
+  }
+  strncpy(PortName, Name, sizeof(PortName) - 1);
+  PortName[sizeof(PortName) - 1] = 0;
+
+  // without an open slave reads from the master fail, so keep one open
+  // and make it raw until the host applies its own settings
+  Slave = open(PortName, O_RDWR | O_NOCTTY);
+  if ((Slave < 0) || (tcgetattr(Slave, &tty) != 0))
+  {
+    fprintf(stderr, "ERROR: %d opening %s: %s\n", errno, PortName, strerror(errno));
+    Close();
+    return FALSE;
+  }
+  cfmakeraw(&tty);
+  tcsetattr(Slave, TCSANOW, &tty);
+
+  // a host that does not read must not block the simulation
+  fcntl(Master, F_SETFL, fcntl(Master, F_GETFL) | O_NONBLOCK);
+
+  if (Link != NULL)
+  {
+    // only links are replaced, never regular files
+    if ((lstat(Link, &Status) == 0) && S_ISLNK(Status.st_mode)) unlink(Link);
+    if (symlink(PortName, Link) != 0)
+    {
+      fprintf(stderr, "ERROR: %d creating %s: %s\n", errno, Link, strerror(errno));
+      Close();
+      return FALSE;
+    }
+    strncpy(LinkName, Link, sizeof(LinkName) - 1);
+    LinkName[sizeof(LinkName) - 1] = 0;
+  }
+
+  return TRUE;
+}
+
+
+/**************************************************************************
+DOES:    Closes the pseudo terminal and removes the link
+RETURNS: Nothing
+**************************************************************************/
+void DEVICESIM::Close
+  (
+  void
+  )
+{
+  if (LinkName[0])
+  {
+    unlink(LinkName);
+    LinkName[0] = 0;
+  }
+  if (Slave >= 0) close(Slave);
+  if (Master >= 0) close(Master);
+  Slave = INVALID_HANDLE_VALUE;
+  Master = INVALID_HANDLE_VALUE;
+  PortName[0] = 0;
+}
+
+
+/**************************************************************************
+DOES:    Sets node id and object dictionary of the device itself. The
+         status objects 5F00h, 5F04h, the NMT command 5F0Ah and the
+         generic CAN messages 5F0Ch are always simulated, whether in the
+         dictionary or not.
+RETURNS: TRUE for success, FALSE for error
+**************************************************************************/
+bool DEVICESIM::SetLocalNode
+  (
+  const EDS *Dictionary,                                   // object dictionary or NULL for none
+  UNSIGNED8 NodeID                                         // own node id, 1 to 127
+  )
+{
+  if ((NodeID < 1) || (NodeID > DEVICESIM_MAX_NODES)) return FALSE;
+  OwnNodeID = NodeID;
+  return Local.Init(Dictionary ? Dictionary : &EmptyDictionary, NodeID);
+}
+
+
+/**************************************************************************
+DOES:    Adds a remote node to the network, replacing a node with the
+         same id
+RETURNS: TRUE for success, FALSE for error
+**************************************************************************/
+bool DEVICESIM::AddNode
+  (
+  const EDS *Dictionary,                                   // object dictionary of the node
+  UNSIGNED8 NodeID                                         // node id, 1 to 127
+  )
+{
+  const EDS_ENTRY *Entry;
+  unsigned long Position;
+
+  if ((NodeID < 1) || (NodeID > DEVICESIM_MAX_NODES)) return FALSE;
+
+  delete Nodes[NodeID];
+  Nodes[NodeID] = new SIMNODE();
+  if (!Nodes[NodeID]->Init(Dictionary, NodeID))
+  {
+    delete Nodes[NodeID];
+    Nodes[NodeID] = NULL;
+    return FALSE;
+  }
+
+  // first numeric application object that can be sent in a PDO
+  ProcessData[NodeID] = NULL;
+  for (Position = 0; Position < Dictionary->GetEntryCount(); Position++)
+  {
+    Entry = Dictionary->GetEntry(Position);
+    if ((Entry->Index >= 0x6000) && (Entry->Access & RMAP) && !(Entry->Flags & EDS_FLAG_CONST) &&
+        (Entry->Size >= 1) && (Entry->Size <= 4) && (EDS::GetTypeSize(Entry->DataType) != 0))
+    {
+      ProcessData[NodeID] = Entry;
+      break;
+    }
+  }
+  ProcessDataInterval[NodeID] = 0;
+  HeartbeatDefault[NodeID] = 0;
+  UpdateHeartbeatTime(NodeID);
+  return TRUE;
+}
+
+
+/**************************************************************************
+DOES:    Sets how a node behaves on the bus
+RETURNS: TRUE for success, FALSE if there is no such node
+**************************************************************************/
+bool DEVICESIM::ConfigureNode
+  (
+  UNSIGNED8 NodeID,                                        // node id of a node added before
+  const SIMLINK *Link,                                     // latency, jitter and loss of frames
+  UNSIGNED32 Interval,                                     // milliseconds between PDOs, 0 for none
+  UNSIGNED16 Heartbeat                                     // milliseconds, 0 to keep the EDS default
+  )
+{
+  UNSIGNED8 Data[2];
+
+  if ((NodeID < 1) || (NodeID > DEVICESIM_MAX_NODES) || (Nodes[NodeID] == NULL)) return FALSE;
+
+  Bus.SetLink(NodeID, Link);
+  ProcessDataInterval[NodeID] = Interval * 1000;
+  // spread the nodes over the interval instead of sending all PDOs at once
+  ProcessDataTime[NodeID] = Timer::GetMicroseconds() + (uint64_t)ProcessDataInterval[NodeID] * NodeID / (DEVICESIM_MAX_NODES + 1);
+
+  HeartbeatDefault[NodeID] = Heartbeat;
+  if (Heartbeat)
+  {
+    STORE_U16(Heartbeat, Data);
+    Nodes[NodeID]->Write(0x1017, 0x00, 2, Data, FALSE);
+  }
+  UpdateHeartbeatTime(NodeID);
+  return TRUE;
+}
+
+
+/**************************************************************************
+DOES:    Lets a node take program downloads as its bootloader would
+RETURNS: TRUE for success, FALSE if there is no such node
+**************************************************************************/
+bool DEVICESIM::EnableProgramDownload
+  (
+  UNSIGNED8 NodeID,                                        // node id of a node added before
+  unsigned long Capacity                                   // max bytes of each program
+  )
+{
+  if ((NodeID < 1) || (NodeID > DEVICESIM_MAX_NODES) || (Nodes[NodeID] == NULL)) return FALSE;
+  return Nodes[NodeID]->EnableProgramDownload(Capacity);
+}
+
+
+/**************************************************************************
+DOES:    Reads the producer heartbeat time of a node from [1017h], after
+         it was added, reset or written to
+RETURNS: Nothing
+**************************************************************************/
+void DEVICESIM::UpdateHeartbeatTime
+  (
+  UNSIGNED8 NodeID                                         // node id
+  )
+{
+  const UNSIGNED8 *Data;
+  unsigned long Length;
+
+  HeartbeatTime[NodeID] = 0;
+  if (Nodes[NodeID]->Read(0x1017, 0x00, &Length, &Data) != 0) return;
+  if (Length == 2) HeartbeatTime[NodeID] = (UNSIGNED32)GET_U16(Data) * 1000;
+  if (HeartbeatTime[NodeID] == 0) HeartbeatState[NodeID] = DEVICESIM_HB_IDLE;
+}
+
+
+/**************************************************************************
+DOES:    Requests an entry from the host with an extended SDO upload
+         once the host is connected
+RETURNS: Nothing
+**************************************************************************/
+void DEVICESIM::RequestExtendedRead
+  (
+  UNSIGNED8 Server,                                        // SDO server of the host, 0 to 16
+  UNSIGNED16 Index,                                        // index of od entry to read
+  UNSIGNED8 Subindex                                       // subindex of od entry to read
+  )
+{
+  XServer = Server;
+  XIndex = Index;
+  XSubindex = Subindex;
+  XState = DEVICESIM_XSDO_PENDING;
+}
+
+
+/**************************************************************************
+DOES:    Frames and transmits a packet to the host. Waits up to TX_TIMEOUT
+         if the terminal is full, before any host connected packets that
+         do not fit are dropped.
+RETURNS: TRUE for success, FALSE if the packet was dropped
+**************************************************************************/
+bool DEVICESIM::SendPacket
+  (
+  const UNSIGNED8 *Data,                                   // packet data, first byte is the command
+  unsigned long Length                                     // length of packet data
+  )
+{
+  UNSIGNED8 Buffer[MAX_PACKET_LENGTH + 4];
+  unsigned short CRCValue;
+  struct pollfd Fd;
+  unsigned long Pos = 0;
+  unsigned long b;
+  ssize_t Written;
+  CRC crc;
+
+  if ((Master < 0) || (Length > MAX_PACKET_LENGTH)) return FALSE;
+
+  Buffer[0] = SOH;
+  Buffer[1] = (UNSIGNED8)Length;
+  crc.Add(Buffer[1]);
+  for (b = 0; b < Length; b++)
+  {
+    Buffer[2 + b] = Data[b];
+    crc.Add(Data[b]);
+  }
+  CRCValue = crc.Finalize();
+  Buffer[2 + Length] = CRCValue & 0xFF;
+  Buffer[3 + Length] = (CRCValue >> 8) & 0xFF;
+
+  Fd.fd = Master;
+  Fd.events = POLLOUT;
+  while (Pos < Length + 4)
+  {
+    Written = write(Master, &Buffer[Pos], Length + 4 - Pos);
+    if (Written > 0)
+    {
+      Pos += Written;
+    }
+    else if ((Written < 0) && (errno != EAGAIN) && (errno != EINTR))
+    {
+      PacketsDropped++;
+      return FALSE;
+    }
+    else if ((Pos == 0) && !HostConnected)
+    { // nobody reads the terminal, drop whole packets
+      PacketsDropped++;
+      return FALSE;
+    }
+    else if (poll(&Fd, 1, TX_TIMEOUT) <= 0)
+    { // until the host sends again packets are dropped without waiting
+      fprintf(stderr, "WARNING: host not reading, packet %s\n", Pos ? "truncated" : "dropped");
+      HostConnected = FALSE;
+      PacketsDropped++;
+      return FALSE;
+    }
+  }
+  PacketsSent++;
+  return TRUE;
+}
+
+
+/**************************************************************************
+DOES:    Runs the receive state machine for one byte from the host
+RETURNS: TRUE if a complete packet with valid CRC was received
+**************************************************************************/
+bool DEVICESIM::ReceiveByte
+  (
+  UNSIGNED8 Byte                                           // byte received
+  )
+{
+  unsigned long b;
+
+  switch (ReceiveState)
+  {
+    case STATE_START:
+      if (Byte == SOH) ReceiveState = STATE_LENGTH;
+      break;
+
+    case STATE_LENGTH:
+      IncomingPacket.Length = Byte;
+      BytesRemaining = Byte;
+      IncomingCRC = 0x0000;
+      if (Byte > MAX_PACKET_LENGTH) ReceiveState = STATE_START;
+      else if (Byte == 0) ReceiveState = STATE_CHECKL;
+      else ReceiveState = STATE_DATA;
+      break;
+
+    case STATE_DATA:
+      IncomingPacket.Data[IncomingPacket.Length - BytesRemaining] = Byte;
+      if (--BytesRemaining == 0) ReceiveState = STATE_CHECKL;
+      break;
+
+    case STATE_CHECKL:
+      IncomingCRC = Byte;
+      ReceiveState = STATE_CHECKH;
+      break;
+
+    case STATE_CHECKH:
+      IncomingCRC |= (unsigned short)Byte << 8;
+      ReceiveState = STATE_START;
+      {
+        CRC crc;
+
+        crc.Add((UNSIGNED8)IncomingPacket.Length);
+        for (b = 0; b < IncomingPacket.Length; b++) crc.Add(IncomingPacket.Data[b]);
+        if (crc.Finalize() != IncomingCRC)
+        {
+          fprintf(stderr, "WARNING: CRC error in packet from host\n");
+          return FALSE;
+        }
+      }
+      // short commands read zeros instead of stale data
+      memset(&IncomingPacket.Data[IncomingPacket.Length], 0, MAX_PACKET_LENGTH - IncomingPacket.Length);
+      return IncomingPacket.Length > 0;
+  }
+  return FALSE;
+}
+
+
+/**************************************************************************
+DOES:    Sends a data indication ('D') to the host
+RETURNS: Nothing
+**************************************************************************/
+void DEVICESIM::SendIndication
+  (
+  UNSIGNED8 NodeID,                                        // node the data is from
+  UNSIGNED16 Index,                                        // index of od entry
+  UNSIGNED8 Subindex,                                      // subindex of od entry
+  unsigned long Length,                                    // length of data
+  const UNSIGNED8 *Data                                    // data
+  )
+{
+  UNSIGNED8 Packet[MAX_PACKET_LENGTH];
+
+  if (Length > MAX_PACKET_LENGTH - 5) Length = MAX_PACKET_LENGTH - 5;
+  Packet[0] = 'D';
+  Packet[1] = NodeID;
+  STORE_U16(Index, &Packet[2]);
+  Packet[4] = Subindex;
+  memcpy(&Packet[5], Data, Length);
+  SendPacket(Packet, 5 + Length);
+}
+
+
+/**************************************************************************
+DOES:    Changes the status of the device itself (node id 0) or of a
+         remote node and reports it in 5F00h,02h or 5F04h
+RETURNS: Nothing
+**************************************************************************/
+void DEVICESIM::SetNodeStatus
+  (
+  UNSIGNED8 NodeID,                                        // node id, 0 for the device
+  UNSIGNED8 Status                                         // NODESTATUS_xxx
+  )
+{
+  NodeStatus[NodeID] = Status;
+  if ((Status == NODESTATUS_BOOT) || (Status == NODESTATUS_STOPPED) ||
+      (Status == NODESTATUS_OPERATIONAL) || (Status == NODESTATUS_PREOP))
+  {
+    NmtState[NodeID] = Status;
+  }
+  if (Verbose) printf("Node %u status 0x%2.2X\n", NodeID ? NodeID : OwnNodeID, Status);
+  if (NodeID == 0)
+  {
+    SendIndication(OwnNodeID, 0x5F00, 0x02, 1, &Status);
+  }
+  else
+  {
+    SendIndication(OwnNodeID, 0x5F04, NodeID, 1, &Status);
+  }
+}
+
+
+/**************************************************************************
+DOES:    Starts the boot sequence of the device (node id 0) or a node
+RETURNS: Nothing
+**************************************************************************/
+void DEVICESIM::StartBoot
+  (
+  UNSIGNED8 NodeID,                                        // node id, 0 for the device
+  uint64_t Time                                            // monotonic time of first step
+  )
+{
+  BootStep[NodeID] = 0;
+  BootTime[NodeID] = Time;
+  // the consumer waits for the first heartbeat after the boot-up
+  HeartbeatState[NodeID] = DEVICESIM_HB_IDLE;
+}
+
+
+/**************************************************************************
+DOES:    Boots the device and all remote nodes, reports their states
+RETURNS: Nothing
+**************************************************************************/
+void DEVICESIM::Start
+  (
+  void
+  )
+{
+  uint64_t Now = Timer::GetMicroseconds();
+  int NodeID;
+
+  HwStatus = HWSTATUS_INITALIZING;
+  SendIndication(OwnNodeID, 0x5F00, 0x01, 1, &OwnNodeID);
+  SendIndication(OwnNodeID, 0x5F00, 0x03, 1, &HwStatus);
+  StartBoot(0, Now);
+
+  // remote nodes boot once the device is operational
+  for (NodeID = 1; NodeID <= DEVICESIM_MAX_NODES; NodeID++)
+  {
+    if (Nodes[NodeID]) StartBoot(NodeID, Now + sizeof(OwnBootSequence) * DEVICESIM_STEP_TIME);
+  }
+}
+
+
+/**************************************************************************
+DOES:    Runs an NMT reset of a node, restores its default values and the
+         configured heartbeat time
+RETURNS: Nothing
+**************************************************************************/
+void DEVICESIM::ResetNode
+  (
+  UNSIGNED8 NodeID,                                        // node id
+  bool Communication                                       // TRUE for communication reset
+  )
+{
+  UNSIGNED8 Data[2];
+
+  Nodes[NodeID]->Reset(Communication);
+  if (HeartbeatDefault[NodeID])
+  {
+    STORE_U16(HeartbeatDefault[NodeID], Data);
+    Nodes[NodeID]->Write(0x1017, 0x00, 2, Data, FALSE);
+  }
+  UpdateHeartbeatTime(NodeID);
+}
+
+
+/**************************************************************************
+DOES:    Gets the time the heartbeat consumer reports a node as lost, two
+         heartbeat periods after the last heartbeat plus the worst delay
+RETURNS: Monotonic time in us
+**************************************************************************/
+uint64_t DEVICESIM::GetHeartbeatDeadline
+  (
+  UNSIGNED8 NodeID                                         // node id
+  )
+{
+  const SIMLINK *Link = Bus.GetLink(NodeID);
+
+  return HeartbeatSeen[NodeID] + (uint64_t)HeartbeatTime[NodeID] * DEVICESIM_HB_MISSED + Link->Latency + Link->Jitter;
+}
+
+
+/**************************************************************************
+DOES:    Transfers the frames of SDO requests and responses between the
+         device and a node
+RETURNS: TRUE with the time the last response arrived, FALSE with the
+         time a frame was lost
+**************************************************************************/
+bool DEVICESIM::Exchange
+  (
+  UNSIGNED8 NodeID,                                        // node id of the SDO server
+  unsigned long Count,                                     // number of requests, each confirmed
+  uint64_t *Time                                           // in: time of first request, out: see above
+  )
+{
+  while (Count--)
+  {
+    if (!Bus.Transmit(NodeID, 8, *Time, Time) || !Bus.Transmit(NodeID, 8, *Time, Time)) return FALSE;
+  }
+  return TRUE;
+}
+
+
+/**************************************************************************
+DOES:    Queues a packet for the host until the frames causing it arrived
+RETURNS: Nothing
+**************************************************************************/
+void DEVICESIM::SendDelayed
+  (
+  uint64_t Time,                                           // monotonic time to send in us
+  UNSIGNED8 NodeID,                                        // node the packet is from
+  const UNSIGNED8 *Data,                                   // packet data, first byte is the command
+  unsigned long Length                                     // length of packet data
+  )
+{
+  if (!Bus.Schedule(Time, SIMBUS_EVENT_PACKET, NodeID, Data, Length)) PacketsDropped++;
+}
+
+
+/**************************************************************************
+DOES:    Produces a PDO of a node, increments its process data object
+RETURNS: Nothing
+**************************************************************************/
+void DEVICESIM::ProduceProcessData
+  (
+  UNSIGNED8 NodeID,                                        // node id
+  uint64_t Now                                             // monotonic time in us
+  )
+{
+  const EDS_ENTRY *Entry = ProcessData[NodeID];
+  const UNSIGNED8 *Value;
+  unsigned long Length;
+  UNSIGNED8 Packet[5 + 4];
+  uint64_t Arrival;
+  unsigned int b;
+
+  if (Nodes[NodeID]->Read(Entry->Index, Entry->Subindex, &Length, &Value) != 0) return;
+
+  // increment as little endian number
+  memcpy(&Packet[5], Value, Length);
+  for (b = 0; (b < Length) && (++Packet[5 + b] == 0); b++);
+  Nodes[NodeID]->Write(Entry->Index, Entry->Subindex, Length, &Packet[5], FALSE);
+  ProcessDataCount++;
+
+  if (!Bus.Transmit(NodeID, (UNSIGNED8)Length, Now, &Arrival)) return;
+  Packet[0] = 'D';
+  Packet[1] = NodeID;
+  STORE_U16(Entry->Index, &Packet[2]);
+  Packet[4] = Entry->Subindex;
+  SendDelayed(Arrival, NodeID, Packet, 5 + Length);
+}
+
+
+/**************************************************************************
+DOES:    Handles an event that arrived over the bus
+RETURNS: Nothing
+**************************************************************************/
+void DEVICESIM::HandleEvent
+  (
+  const SIMBUS_EVENT *Event                                // event arrived
+  )
+{
+  UNSIGNED8 NodeID = Event->NodeID;
+
+  switch (Event->Type)
+  {
+    case SIMBUS_EVENT_PACKET:
+      SendPacket(Event->Data, Event->Length);
+      break;
+
+    case SIMBUS_EVENT_HEARTBEAT:
+      // heartbeats sent before a reset are ignored
+      if ((BootStep[NodeID] != DEVICESIM_BOOTED) || (HeartbeatTime[NodeID] == 0)) break;
+      HeartbeatSeen[NodeID] = Event->Due;
+      if (HeartbeatState[NodeID] == DEVICESIM_HB_LOST)
+      {
+        SetNodeStatus(NodeID, NODESTATUS_HBACTIVE);
+        SetNodeStatus(NodeID, Event->Data[0]);
+      }
+      HeartbeatState[NodeID] = DEVICESIM_HB_ACTIVE;
+      break;
+  }
+}
+
+
+/**************************************************************************
+DOES:    Gets the time of the next timed event
+RETURNS: Monotonic time in us, at most the limit
+**************************************************************************/
+uint64_t DEVICESIM::GetNextTime
+  (
+  uint64_t Limit                                           // latest time of interest
+  )
+{
+  uint64_t Next = Limit;
+  uint64_t Due;
+  int NodeID;
+
+  for (NodeID = 0; NodeID <= DEVICESIM_MAX_NODES; NodeID++)
+  {
+    if (BootStep[NodeID] != DEVICESIM_BOOTED)
+    {
+      if (BootTime[NodeID] < Next) Next = BootTime[NodeID];
+      continue;
+    }
+    if ((NodeID == 0) || (Nodes[NodeID] == NULL)) continue;
+
+    if (ProcessDataInterval[NodeID] && ProcessData[NodeID] && HostConnected &&
+        (NmtState[NodeID] == NODESTATUS_OPERATIONAL) && (ProcessDataTime[NodeID] < Next))
+    {
+      Next = ProcessDataTime[NodeID];
+    }
+    if (HeartbeatTime[NodeID])
+    {
+      if (HeartbeatNext[NodeID] < Next) Next = HeartbeatNext[NodeID];
+      if ((HeartbeatState[NodeID] == DEVICESIM_HB_ACTIVE) && ((Due = GetHeartbeatDeadline((UNSIGNED8)NodeID)) < Next)) Next = Due;
+    }
+  }
+  if (Bus.GetNextTime(&Due) && (Due < Next)) Next = Due;
+  if ((XState != DEVICESIM_XSDO_IDLE) && (XState != DEVICESIM_XSDO_PENDING) && (XTimeout < Next)) Next = XTimeout;
+  return Next;
+}
+
+
+/**************************************************************************
+DOES:    Runs boot sequences, delivers events arrived over the bus,
+         produces process data and heartbeats, runs the heartbeat consumer
+         and the extended SDO timeout
+RETURNS: Nothing
+**************************************************************************/
+void DEVICESIM::RunTimers
+  (
+  uint64_t Now                                             // monotonic time in us
+  )
+{
+  SIMBUS_EVENT Event;
+  UNSIGNED8 Packet[10];
+  uint64_t Arrival;
+  int NodeID;
+
+  for (NodeID = 0; NodeID <= DEVICESIM_MAX_NODES; NodeID++)
+  {
+    if ((BootStep[NodeID] == DEVICESIM_BOOTED) || (Now < BootTime[NodeID])) continue;
+    if (NodeID == 0)
+    {
+      SetNodeStatus(0, OwnBootSequence[BootStep[0]]);
+      if (++BootStep[0] == sizeof(OwnBootSequence)) BootStep[0] = DEVICESIM_BOOTED;
+    }
+    else
+    {
+      SetNodeStatus(NodeID, NodeBootSequence[BootStep[NodeID]]);
+      if (++BootStep[NodeID] == sizeof(NodeBootSequence))
+      { // heartbeats start once booted
+        BootStep[NodeID] = DEVICESIM_BOOTED;
+        HeartbeatNext[NodeID] = BootTime[NodeID];
+      }
+    }
+    BootTime[NodeID] += DEVICESIM_STEP_TIME;
+  }
+
+  while (Bus.GetEvent(Now, &Event)) HandleEvent(&Event);
+
+  for (NodeID = 1; NodeID <= DEVICESIM_MAX_NODES; NodeID++)
+  {
+    if ((Nodes[NodeID] == NULL) || (BootStep[NodeID] != DEVICESIM_BOOTED)) continue;
+
+    // process data is only produced while a host listens, so it does not
+    // pile up in the terminal
+    if (ProcessDataInterval[NodeID] && ProcessData[NodeID] && HostConnected &&
+        (NmtState[NodeID] == NODESTATUS_OPERATIONAL) && (Now >= ProcessDataTime[NodeID]))
+    {
+      ProduceProcessData((UNSIGNED8)NodeID, Now);
+      ProcessDataTime[NodeID] += ProcessDataInterval[NodeID];
+      if (ProcessDataTime[NodeID] < Now) ProcessDataTime[NodeID] = Now + ProcessDataInterval[NodeID];
+    }
+
+    if (HeartbeatTime[NodeID] == 0) continue;
+    if (Now >= HeartbeatNext[NodeID])
+    {
+      HeartbeatCount++;
+      if (Bus.Transmit((UNSIGNED8)NodeID, 1, Now, &Arrival))
+      {
+        Bus.Schedule(Arrival, SIMBUS_EVENT_HEARTBEAT, (UNSIGNED8)NodeID, &NmtState[NodeID], 1);
+      }
+      HeartbeatNext[NodeID] += HeartbeatTime[NodeID];
+      if (HeartbeatNext[NodeID] < Now) HeartbeatNext[NodeID] = Now + HeartbeatTime[NodeID];
+    }
+    if ((HeartbeatState[NodeID] == DEVICESIM_HB_ACTIVE) && (Now >= GetHeartbeatDeadline((UNSIGNED8)NodeID)))
+    {
+      HeartbeatState[NodeID] = DEVICESIM_HB_LOST;
+      HeartbeatLostCount++;
+      SetNodeStatus((UNSIGNED8)NodeID, NODESTATUS_HBLOST);
+    }
+  }
+
+  if ((XState == DEVICESIM_XSDO_PENDING) && HostConnected)
+  { // upload initiate
+    memset(Packet, 0, sizeof(Packet));
+    Packet[0] = 'F';
+    Packet[1] = XServer;
+    Packet[2] = 0x40;
+    STORE_U16(XIndex, &Packet[3]);
+    Packet[5] = XSubindex;
+    SendPacket(Packet, sizeof(Packet));
+    XTimeout = Now + DEVICESIM_XSDO_TIMEOUT;
+    XState = DEVICESIM_XSDO_INIT;
+  }
+  else if ((XState != DEVICESIM_XSDO_IDLE) && (XState != DEVICESIM_XSDO_PENDING) && (Now >= XTimeout))
+  {
+    printf("Extended read %4.4X,%2.2X from server %u: no response\n", XIndex, XSubindex, XServer);
+    XState = DEVICESIM_XSDO_IDLE;
+  }
+}
+
+
+/**************************************************************************
+DOES:    Handles the host response ('G') to an extended SDO request
+RETURNS: Nothing
+**************************************************************************/
+void DEVICESIM::HandleExtendedResponse
+  (
+  const UNSIGNED8 *Response                                // 8 bytes of SDO response
+  )
+{
+  UNSIGNED8 Packet[10];
+  unsigned long Length;
+  unsigned long b;
+
+  if (Response[0] == 0x80)
+  {
+    printf("Extended read %4.4X,%2.2X from server %u: abort 0x%8.8lX\n", XIndex, XSubindex, XServer, (unsigned long)(GET_U32(&Response[4])));
+    XState = DEVICESIM_XSDO_IDLE;
+    return;
+  }
+
+  if ((XState == DEVICESIM_XSDO_INIT) && ((Response[0] & 0xE0) == 0x40))
+  {
+    if (Response[0] & 0x02)
+    { // expedited
+      XLength = (Response[0] & 0x01) ? 4 - ((Response[0] >> 2) & 0x03) : 4;
+      memcpy(XBuffer, &Response[4], XLength);
+    }
+    else
+    { // segmented, request first segment
+      XLength = 0;
+      XToggle = 0;
+      XState = DEVICESIM_XSDO_SEGMENT;
+    }
+  }
+  else if ((XState == DEVICESIM_XSDO_SEGMENT) && ((Response[0] & 0xE0) == 0x00) && ((Response[0] & 0x10) == XToggle))
+  {
+    Length = 7 - ((Response[0] >> 1) & 0x07);
+    if (XLength + Length > sizeof(XBuffer)) Length = sizeof(XBuffer) - XLength;
+    memcpy(&XBuffer[XLength], &Response[1], Length);
+    XLength += Length;
+    XToggle ^= 0x10;
+    if (Response[0] & 0x01) XState = DEVICESIM_XSDO_INIT;
+  }
+  else
+  {
+    printf("Extended read %4.4X,%2.2X from server %u: unexpected response 0x%2.2X\n", XIndex, XSubindex, XServer, Response[0]);
+    XState = DEVICESIM_XSDO_IDLE;
+    return;
+  }
+
+  if (XState == DEVICESIM_XSDO_SEGMENT)
+  { // request next segment
+    memset(Packet, 0, sizeof(Packet));
+    Packet[0] = 'F';
+    Packet[1] = XServer;
+    Packet[2] = 0x60 | XToggle;
+    SendPacket(Packet, sizeof(Packet));
+    XTimeout = Timer::GetMicroseconds() + DEVICESIM_XSDO_TIMEOUT;
+    return;
+  }
+
+  printf("Extended read %4.4X,%2.2X from server %u: %lu bytes", XIndex, XSubindex, XServer, XLength);
+  for (b = 0; b < XLength; b++) printf(" %2.2X", XBuffer[b]);
+  printf("\n");
+  XState = DEVICESIM_XSDO_IDLE;
+}
+
+
+/**************************************************************************
+DOES:    Reads from the local object dictionary, status objects are
+         simulated
+RETURNS: 0 for success, else SDO abort code
+**************************************************************************/
+UNSIGNED32 DEVICESIM::ReadLocal
+  (
+  UNSIGNED16 Index,                                        // index of od entry
+  UNSIGNED8 Subindex,                                      // subindex of od entry
+  unsigned long *Length,                                   // location to store length of value
+  const UNSIGNED8 **Data                                   // location to store pointer to value
+  )
+{
+  if ((Index == 0x5F00) && (Subindex >= 0x01) && (Subindex <= 0x03))
+  {
+    Scratch[0] = (Subindex == 0x01) ? OwnNodeID : (Subindex == 0x02) ? NodeStatus[0] : HwStatus;
+    *Length = 1;
+  }
+  else if ((Index == 0x5F04) && ((Subindex & 0x7F) >= 1))
+  { // highest bit is set for own node id
+    Scratch[0] = ((Subindex & 0x7F) == OwnNodeID) ? NodeStatus[0] : NodeStatus[Subindex & 0x7F];
+    *Length = 1;
+  }
+  else if ((Index == 0x5F0A) && (Subindex == 0x01))
+  {
+    STORE_U16(LastNMTCommand, Scratch);
+    *Length = 2;
+  }
+  else if ((Index == 0x5F01) && (Subindex == 0x0B))
+  {
+    Scratch[0] = GenericCan;
+    *Length = 1;
+  }
+  else
+  {
+    return Local.Read(Index, Subindex, Length, Data);
+  }
+  *Data = Scratch;
+  return 0;
+}
+
+
+/**************************************************************************
+DOES:    Writes to the local object dictionary, as the host application
+         may write to entries that are read only for the network
+RETURNS: 0 for success, else SDO abort code
+**************************************************************************/
+UNSIGNED32 DEVICESIM::WriteLocal
+  (
+  UNSIGNED16 Index,                                        // index of od entry
+  UNSIGNED8 Subindex,                                      // subindex of od entry
+  unsigned long Length,                                    // length of data
+  const UNSIGNED8 *Data                                    // data to write
+  )
+{
+  if (((Index == 0x5F00) && (Subindex >= 0x01) && (Subindex <= 0x03)) || ((Index == 0x5F04) && (Subindex != 0)))
+  {
+    return SDO_ABORT_READONLY;
+  }
+
+  if ((Index == 0x5F0A) && (Subindex == 0x01))
+  { // NMT command to a node, 0 for all nodes
+    if (Length != 2) return SDO_ABORT_TYPEMISMATCH;
+    LastNMTCommand = GET_U16(Data);
+    return NMTCommand(Data[0], Data[1]);
+  }
+
+  if ((Index == 0x5F01) && (Subindex == 0x01))
+  { // reset of the device itself
+    if (Length != 1) return SDO_ABORT_TYPEMISMATCH;
+    if ((Data[0] != RESET_APPLICATION) && (Data[0] != RESET_COMMUNICATION)) return SDO_ABORT_VALUE_RANGE;
+    SetNodeStatus(0, (Data[0] == RESET_APPLICATION) ? NODESTATUS_RESETAPP : NODESTATUS_RESETCOM);
+    Local.Reset(Data[0] == RESET_COMMUNICATION);
+    StartBoot(0, Timer::GetMicroseconds() + DEVICESIM_STEP_TIME);
+    return 0;
+  }
+
+  if ((Index == 0x5F01) && (Subindex == 0x0B))
+  { // generic CAN messages for transmit and receive
+    if (Length != 1) return SDO_ABORT_TYPEMISMATCH;
+    GenericCan = Data[0];
+    return 0;
+  }
+
+  if (Index == 0x5F0C)
+  { // generic CAN message, CAN length as subindex and CAN ID before the
+    // data. A device on the bus echoes it, received if enabled.
+    if ((Subindex > 8) || (Length != 2UL + Subindex)) return SDO_ABORT_TYPEMISMATCH;
+    if ((GenericCan & 0x0F) == 0) return SDO_ABORT_NOTRANSFERCTRL;
+    if (GenericCan & 0xF0) SendIndication(0, 0x5F0C, Subindex, Length, Data);
+    return 0;
+  }
+
+  return Local.Write(Index, Subindex, Length, Data, FALSE);
+}
+
+
+/**************************************************************************
+DOES:    Executes an NMT command for one or all remote nodes
+RETURNS: 0 for success, else SDO abort code
+**************************************************************************/
+UNSIGNED32 DEVICESIM::NMTCommand
+  (
+  UNSIGNED8 Command,                                       // NMT command
+  UNSIGNED8 NodeID                                         // node id, 0 for all nodes
+  )
+{
+  uint64_t Now = Timer::GetMicroseconds();
+  int Node;
+
+  if ((Command != NMT_OPERATIONAL) && (Command != NMT_STOP) && (Command != NMT_PREOPERATIONAL) &&
+      (Command != NMT_RESETAPP) && (Command != NMT_RESETCOM))
+  {
+    return SDO_ABORT_VALUE_RANGE;
+  }
+  if (NodeID > DEVICESIM_MAX_NODES) return SDO_ABORT_VALUE_RANGE;
+
+  for (Node = 1; Node <= DEVICESIM_MAX_NODES; Node++)
+  {
+    if ((Nodes[Node] == NULL) || ((NodeID != 0) && (Node != NodeID))) continue;
+
+    BootStep[Node] = DEVICESIM_BOOTED;
+    switch (Command)
+    {
+      case NMT_OPERATIONAL:
+        SetNodeStatus((UNSIGNED8)Node, NODESTATUS_OPERATIONAL);
+        break;
+      case NMT_STOP:
+        SetNodeStatus((UNSIGNED8)Node, NODESTATUS_STOPPED);
+        break;
+      case NMT_PREOPERATIONAL:
+        SetNodeStatus((UNSIGNED8)Node, NODESTATUS_PREOP);
+        break;
+      default:
+        // resets restore default values and boot the node again
+        ResetNode((UNSIGNED8)Node, Command == NMT_RESETCOM);
+        StartBoot((UNSIGNED8)Node, Now + DEVICESIM_STEP_TIME);
+        break;
+    }
+  }
+  return 0;
+}
+
+
+/**************************************************************************
+DOES:    Maps an SDO abort code to the error bits of a response
+RETURNS: ERROR_xxx
+**************************************************************************/
+unsigned short DEVICESIM::AbortToError
+  (
+  UNSIGNED32 Code                                          // SDO abort code, 0 for success
+  )
+{
+  switch (Code)
+  {
+    case 0:
+      return ERROR_NOERROR;
+    case SDO_ABORT_NOT_EXISTS:
+    case SDO_ABORT_UNKNOWNSUB:
+      return ERROR_ODENTRYNOTFOUND;
+    case SDO_ABORT_TYPEMISMATCH:
+    case SDO_ABORT_DATATOBIG:
+      return ERROR_INVALIDCOMMANDLENGTH;
+    case SDO_ABORT_READONLY:
+    case SDO_ABORT_WRITEONLY:
+    case SDO_ABORT_UNSUPPORTED:
+      return ERROR_NOTSUPPORTED;
+    default:
+      return ERROR_UNKNOWN;
+  }
+}
+
+
+/**************************************************************************
+DOES:    Handles a packet received from the host
+RETURNS: Nothing
+**************************************************************************/
+void DEVICESIM::HandlePacket
+  (
+  void
+  )
+{
+  UNSIGNED8 *Request = IncomingPacket.Data;
+  UNSIGNED8 Response[MAX_PACKET_LENGTH];
+  UNSIGNED8 Responses[SIMNODE_MAX_RESPONSES][8];
+  SIMNODE *Node;
+  const UNSIGNED8 *Data;
+  unsigned long Length = IncomingPacket.Length;
+  unsigned long DataLength = 0;
+  unsigned short Error;
+  unsigned int Count;
+  unsigned int r;
+  uint64_t Time = Timer::GetMicroseconds();
+
+  HostConnected = TRUE;
+  if (Verbose)
+  {
+    printf("RX %c", Request[0]);
+    for (r = 1; r < Length; r++) printf(" %2.2X", Request[r]);
+    printf("\n");
+  }
+
+  switch (Request[0])
+  {
+    // local read: idx(2) sub -> idx(2) sub err(2) data
+    case 'R':
+      Error = (Length != 4) ? ERROR_INVALIDCOMMANDLENGTH : AbortToError(ReadLocal(GET_U16(&Request[1]), Request[3], &DataLength, &Data));
+      if ((Error == ERROR_NOERROR) && (DataLength > MAX_PACKET_LENGTH - 6)) Error = ERROR_RXBUFFERTOOSMALL;
+      if (Error != ERROR_NOERROR) DataLength = 0;
+      memcpy(Response, Request, 4);
+      STORE_U16(Error, &Response[4]);
+      if (DataLength) memcpy(&Response[6], Data, DataLength);
+      SendPacket(Response, 6 + DataLength);
+      break;
+
+    // local write: idx(2) sub data -> idx(2) sub err(2)
+    case 'W':
+      Error = (Length < 5) ? ERROR_INVALIDCOMMANDLENGTH : AbortToError(WriteLocal(GET_U16(&Request[1]), Request[3], Length - 4, &Request[4]));
+      memcpy(Response, Request, 4);
+      STORE_U16(Error, &Response[4]);
+      SendPacket(Response, 6);
+      break;
+
+    // remote read: node idx(2) sub -> node idx(2) sub err(2) data, the
+    // response is sent when the SDO transfer on the bus completed
+    case 'U':
+      Node = (Request[1] <= DEVICESIM_MAX_NODES) ? Nodes[Request[1]] : NULL;
+      if (Length != 5) Error = ERROR_INVALIDCOMMANDLENGTH;
+      else if ((Node == NULL) || !Exchange(Request[1], 1, &Time)) Error = ERROR_SDOTIMEOUT;
+      else if (Node->CheckAccess(GET_U16(&Request[2]), Request[4], 0, FALSE) != 0) Error = ERROR_TRANSFERABORTED;
+      else if (Node->Read(GET_U16(&Request[2]), Request[4], &DataLength, &Data) != 0) Error = ERROR_TRANSFERABORTED;
+      else if (DataLength > MAX_PACKET_LENGTH - 7) Error = ERROR_RXBUFFERTOOSMALL;
+      else if ((DataLength > 4) && !Exchange(Request[1], (DataLength + 6) / 7, &Time)) Error = ERROR_SDOTIMEOUT;
+      else Error = ERROR_NOERROR;
+      if (Error == ERROR_SDOTIMEOUT)
+      {
+        Time += DEVICESIM_SDO_TIMEOUT;
+        SdoTimeoutCount++;
+      }
+      if (Error != ERROR_NOERROR) DataLength = 0;
+      memcpy(Response, Request, 5);
+      STORE_U16(Error, &Response[5]);
+      if (DataLength) memcpy(&Response[7], Data, DataLength);
+      SendDelayed(Time, Request[1], Response, 7 + DataLength);
+      break;
+
+    // remote write: node idx(2) sub data -> node idx(2) sub err(2), data
+    // longer than 4 bytes needs one segment per 7 bytes
+    case 'S':
+      Node = (Request[1] <= DEVICESIM_MAX_NODES) ? Nodes[Request[1]] : NULL;
+      DataLength = Length - 5;
+      if (Length < 6) Error = ERROR_INVALIDCOMMANDLENGTH;
+      else if ((Node == NULL) || !Exchange(Request[1], 1 + ((DataLength > 4) ? (DataLength + 6) / 7 : 0), &Time)) Error = ERROR_SDOTIMEOUT;
+      else if (Node->Write(GET_U16(&Request[2]), Request[4], DataLength, &Request[5], TRUE) != 0) Error = ERROR_TRANSFERABORTED;
+      else Error = ERROR_NOERROR;
+      if (Error == ERROR_SDOTIMEOUT)
+      {
+        Time += DEVICESIM_SDO_TIMEOUT;
+        SdoTimeoutCount++;
+      }
+      if (Node) UpdateHeartbeatTime(Request[1]);
+      memcpy(Response, Request, 5);
+      STORE_U16(Error, &Response[5]);
+      SendDelayed(Time, Request[1], Response, 7);
+      break;
+
+    // SDO request to a remote node: node request(8), answered by 'V'
+    // packets, unknown nodes do not answer. The node handles the request
+    // at once, only the frames are delayed or lost.
+    case 'C':
+      Node = (Request[1] <= DEVICESIM_MAX_NODES) ? Nodes[Request[1]] : NULL;
+      if ((Length != 10) || (Node == NULL) || !Bus.Transmit(Request[1], 8, Time, &Time)) break;
+      Count = Node->HandleSDO(&Request[2], Responses);
+      UpdateHeartbeatTime(Request[1]);
+      Response[0] = 'V';
+      Response[1] = Request[1];
+      for (r = 0; r < Count; r++)
+      {
+        if (!Bus.Transmit(Request[1], 8, Time, &Time)) continue;
+        memcpy(&Response[2], Responses[r], 8);
+        SendDelayed(Time, Request[1], Response, 10);
+      }
+      break;
+
+    // host response to an extended SDO request: server last response(8)
+    case 'G':
+      if ((Length == 11) && (Request[1] == XServer) && (XState != DEVICESIM_XSDO_IDLE))
+      {
+        HandleExtendedResponse(&Request[3]);
+      }
+      break;
+
+    default:
+      fprintf(stderr, "WARNING: unknown command 0x%2.2X from host\n", Request[0]);
+      break;
+  }
+}
+
+
+/**************************************************************************
+DOES:    Waits for packets from the host and handles them, runs boot
+         sequences and produces process data
+RETURNS: Nothing
+**************************************************************************/
+void DEVICESIM::Process
+  (
+  UNSIGNED32 Timeout                                       // max milliseconds to wait for packets
+  )
+{
+  UNSIGNED8 Buffer[256];
+  struct pollfd Fd;
+  uint64_t Now = Timer::GetMicroseconds();
+  uint64_t Next;
+  ssize_t Received;
+  ssize_t b;
+
+  // wake up for the next timed event
+  Next = GetNextTime(Now + (uint64_t)Timeout * 1000);
+
+  Fd.fd = Master;
+  Fd.events = POLLIN;
+  if (poll(&Fd, 1, (Next > Now) ? (int)((Next - Now + 999) / 1000) : 0) > 0)
+  {
+    Received = read(Master, Buffer, sizeof(Buffer));
+    for (b = 0; b < Received; b++)
+    {
+      if (ReceiveByte(Buffer[b])) HandlePacket();
+    }
+  }
+
+  RunTimers(Timer::GetMicroseconds());
+}
+
+
+/**************************************************************************
+DOES:    Prints the counters of the device and the bus
+RETURNS: Nothing
+**************************************************************************/
+void DEVICESIM::PrintStatistics
+  (
+  void
+  )
+{
+  const SIMBUS_STATISTICS *BusStats = Bus.GetStatistics();
+
+  printf("Packets to host:   %lu sent, %lu dropped\n", PacketsSent, PacketsDropped);
+  printf("PDOs produced:     %lu\n", ProcessDataCount);
+  printf("Heartbeats:        %lu produced, %lu losses reported\n", HeartbeatCount, HeartbeatLostCount);
+  printf("SDO timeouts:      %lu\n", SdoTimeoutCount);
+  printf("CAN frames:        %lu sent, %lu lost\n", BusStats->Frames, BusStats->Lost);
+  printf("Bus events:        %lu delivered, %lu overruns\n", BusStats->Events, BusStats->Overruns);
+  printf("Max bus wait:      %lu us\n", (unsigned long)BusStats->MaxDelay);
+}
+
+/*----------------------- END OF FILE ----------------------------------*/
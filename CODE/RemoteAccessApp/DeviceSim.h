@@ -0,0 +1,279 @@
+/**************************************************************************
+MODULE:    DeviceSim
+CONTAINS:  Simulated CANopenIA device on a pseudo terminal. Implements the
+           device side of the serial protocol, a local object dictionary
+           and a network of simulated remote nodes on a virtual CAN bus.
+COPYRIGHT: Embedded Systems Academy, Inc. 2008-2017.
+DISCLAIM:  Read and understand our disclaimer before using this code!
+           www.esacademy.com/disclaim.htm
+           This software was written in accordance to the guidelines at
+           www.esacademy.com/software/softwarestyleguide.pdf
+LICENSE:   Free to use with licensed CANopenIA chips, modules or devices
+           like CANgineBerry, CANgineXXX and 447izer
+VERSION:   1.10, EmSA 10-NOV-17
+           $LastChangedDate: 2014-01-11 17:30:59 +0100 (Sa, 11 Jan 2014) $
+           $LastChangedRevision: 1702 $
+***************************************************************************/
+#pragma once
+
+#ifndef _DEVICESIM_H
+#define _DEVICESIM_H
+
+#include <stdint.h>
+#include "global.h"
+#include "SerialProtocol.h"
+#include "EDS.h"
+#include "SimNode.h"
+#include "SimBus.h"
+
+/**************************************************************************
+GLOBAL DEFINES
+***************************************************************************/
+
+// highest node id on the network
+#define DEVICESIM_MAX_NODES SIMBUS_MAX_NODES
+
+// microseconds between the status changes of a booting node
+#define DEVICESIM_STEP_TIME 10000
+
+// microseconds to wait for the host to answer an extended SDO request
+#define DEVICESIM_XSDO_TIMEOUT 1000000
+
+// microseconds until the SDO client of the device gives up on a node
+#define DEVICESIM_SDO_TIMEOUT 500000
+
+// heartbeat periods without heartbeat until a node is reported lost
+#define DEVICESIM_HB_MISSED 2
+
+// boot step of nodes that completed booting
+#define DEVICESIM_BOOTED 0xFF
+
+// states of the heartbeat consumer of the device for a node
+#define DEVICESIM_HB_IDLE   0 // no heartbeat received since boot
+#define DEVICESIM_HB_ACTIVE 1
+#define DEVICESIM_HB_LOST   2
+
+// states of the extended SDO request to the host
+#define DEVICESIM_XSDO_IDLE    0
+#define DEVICESIM_XSDO_PENDING 1 // sent once the host is connected
+#define DEVICESIM_XSDO_INIT    2 // waiting for initiate response
+#define DEVICESIM_XSDO_SEGMENT 3 // waiting for segment
+
+/**************************************************************************
+GLOBAL TYPES AND FUNCTIONS
+***************************************************************************/
+
+class DEVICESIM
+{
+  // Parsing states for packet protocol reception
+  typedef enum {
+    STATE_START,    // Start-of-header
+    STATE_LENGTH,   // Length of data
+    STATE_DATA,     // Data bytes
+    STATE_CHECKL,   // Checksum low
+    STATE_CHECKH    // Checksum high
+  } STATE;
+
+  public:
+    /**************************************************************************
+    DOES:    Constructor - creates a device with node id 1, an empty local
+             object dictionary and no remote nodes
+    **************************************************************************/
+    DEVICESIM(void);
+    /**************************************************************************
+    DOES:    Destructor - closes the pseudo terminal, releases all nodes
+    **************************************************************************/
+    ~DEVICESIM(void);
+    /**************************************************************************
+    DOES:    Creates the pseudo terminal. Hosts connect to the slave side,
+             optionally through a symbolic link that replaces any existing
+             link of that name.
+    RETURNS: TRUE for success, FALSE for error
+    **************************************************************************/
+    bool Open(
+      const char *LinkName        // symbolic link to create or NULL
+      );
+    /**************************************************************************
+    DOES:    Closes the pseudo terminal and removes the link
+    RETURNS: Nothing
+    **************************************************************************/
+    void Close(void);
+    /**************************************************************************
+    DOES:    Gets the name of the slave side of the pseudo terminal
+    RETURNS: Port name, empty if not open
+    **************************************************************************/
+    const char *GetPortName(void) const { return PortName; }
+    /**************************************************************************
+    DOES:    Sets node id and object dictionary of the device itself. The
+             status objects 5F00h, 5F04h, the NMT command 5F0Ah and the
+             generic CAN messages 5F0Ch are always simulated, whether in
+             the dictionary or not.
+    RETURNS: TRUE for success, FALSE for error
+    **************************************************************************/
+    bool SetLocalNode(
+      const EDS *Dictionary,      // object dictionary or NULL for none
+      UNSIGNED8 NodeID            // own node id, 1 to 127
+      );
+    /**************************************************************************
+    DOES:    Adds a remote node to the network, replacing a node with the
+             same id
+    RETURNS: TRUE for success, FALSE for error
+    **************************************************************************/
+    bool AddNode(
+      const EDS *Dictionary,      // object dictionary of the node
+      UNSIGNED8 NodeID            // node id, 1 to 127
+      );
+    /**************************************************************************
+    DOES:    Sets how a node behaves on the bus. While operational the node
+             produces process data: it increments the first object mappable
+             to a transmit PDO from 6000h on, the change is indicated to the
+             host as if the PDO was received. Heartbeats are produced with
+             the time in [1017h], which the host may change.
+    RETURNS: TRUE for success, FALSE if there is no such node
+    **************************************************************************/
+    bool ConfigureNode(
+      UNSIGNED8 NodeID,           // node id of a node added before
+      const SIMLINK *Link,        // latency, jitter and loss of frames
+      UNSIGNED32 Interval,        // milliseconds between PDOs, 0 for none
+      UNSIGNED16 HeartbeatTime    // milliseconds, written to [1017h] on every reset, 0 to keep the EDS default
+      );
+    /**************************************************************************
+    DOES:    Lets a node take program downloads [1F50h] and program control
+             [1F51h] as its bootloader would, see SIMNODE
+    RETURNS: TRUE for success, FALSE if there is no such node
+    **************************************************************************/
+    bool EnableProgramDownload(
+      UNSIGNED8 NodeID,           // node id of a node added before
+      unsigned long Capacity      // max bytes of each program
+      );
+    /**************************************************************************
+    DOES:    Sets the bit rate of the virtual CAN bus
+    RETURNS: Nothing
+    **************************************************************************/
+    void SetBitrate(UNSIGNED32 Bitrate) { Bus.SetBitrate(Bitrate); }
+    /**************************************************************************
+    DOES:    Sets the start value of the random numbers for jitter and loss
+    RETURNS: Nothing
+    **************************************************************************/
+    void SetSeed(UNSIGNED32 Seed) { Bus.SetSeed(Seed); }
+    /**************************************************************************
+    DOES:    Requests an entry from the host with an extended SDO upload
+             ('F' / 'G' packets) once the host is connected. The result
+             is printed.
+    RETURNS: Nothing
+    **************************************************************************/
+    void RequestExtendedRead(
+      UNSIGNED8 Server,           // SDO server of the host, 0 to 16
+      UNSIGNED16 Index,           // index of od entry to read
+      UNSIGNED8 Subindex          // subindex of od entry to read
+      );
+    /**************************************************************************
+    DOES:    Enables printing of every packet received and status change
+    RETURNS: Nothing
+    **************************************************************************/
+    void SetVerbose(bool On) { Verbose = On; }
+    /**************************************************************************
+    DOES:    Boots the device and all remote nodes, reports their states
+    RETURNS: Nothing
+    **************************************************************************/
+    void Start(void);
+    /**************************************************************************
+    DOES:    Waits for packets from the host and handles them, runs boot
+             sequences and produces process data
+    RETURNS: Nothing
+    **************************************************************************/
+    void Process(
+      UNSIGNED32 Timeout          // max milliseconds to wait for packets
+      );
+    /**************************************************************************
+    DOES:    Prints the counters of the device and the bus
+    RETURNS: Nothing
+    **************************************************************************/
+    void PrintStatistics(void);
+
+  private:
+    bool SendPacket(const UNSIGNED8 *Data, unsigned long Length);
+    bool ReceiveByte(UNSIGNED8 Byte);
+    void HandlePacket(void);
+    void HandleExtendedResponse(const UNSIGNED8 *Response);
+    void SendIndication(UNSIGNED8 NodeID, UNSIGNED16 Index, UNSIGNED8 Subindex, unsigned long Length, const UNSIGNED8 *Data);
+    void SetNodeStatus(UNSIGNED8 NodeID, UNSIGNED8 Status);
+    void StartBoot(UNSIGNED8 NodeID, uint64_t Time);
+    void UpdateHeartbeatTime(UNSIGNED8 NodeID);
+    void ResetNode(UNSIGNED8 NodeID, bool Communication);
+    uint64_t GetHeartbeatDeadline(UNSIGNED8 NodeID);
+    bool Exchange(UNSIGNED8 NodeID, unsigned long Count, uint64_t *Time);
+    void SendDelayed(uint64_t Time, UNSIGNED8 NodeID, const UNSIGNED8 *Data, unsigned long Length);
+    void ProduceProcessData(UNSIGNED8 NodeID, uint64_t Now);
+    void HandleEvent(const SIMBUS_EVENT *Event);
+    uint64_t GetNextTime(uint64_t Limit);
+    void RunTimers(uint64_t Now);
+    UNSIGNED32 ReadLocal(UNSIGNED16 Index, UNSIGNED8 Subindex, unsigned long *Length, const UNSIGNED8 **Data);
+    UNSIGNED32 WriteLocal(UNSIGNED16 Index, UNSIGNED8 Subindex, unsigned long Length, const UNSIGNED8 *Data);
+    UNSIGNED32 NMTCommand(UNSIGNED8 Command, UNSIGNED8 NodeID);
+    static unsigned short AbortToError(UNSIGNED32 Code);
+
+    HANDLE Master;                            // our side of the pseudo terminal
+    HANDLE Slave;                             // kept open while no host is connected
+    char PortName[MAX_PATH];
+    char LinkName[MAX_PATH];
+    bool Verbose;
+    bool HostConnected;                       // a packet was received, the host reads
+
+    // receive state machine
+    STATE ReceiveState;
+    unsigned long BytesRemaining;
+    unsigned short IncomingCRC;
+    PACKET IncomingPacket;
+
+    // the device itself, status [0] is own status
+    EDS EmptyDictionary;
+    SIMNODE Local;
+    UNSIGNED8 OwnNodeID;
+    UNSIGNED8 HwStatus;
+    UNSIGNED16 LastNMTCommand;
+    UNSIGNED8 Scratch[4];                     // values of simulated status objects
+    UNSIGNED8 GenericCan;                     // [5F01h,0Bh], generic CAN messages enabled
+
+    // remote nodes by node id, [0] is the device itself
+    SIMBUS Bus;
+    SIMNODE *Nodes[DEVICESIM_MAX_NODES + 1];
+    UNSIGNED8 NodeStatus[DEVICESIM_MAX_NODES + 1]; // last status reported
+    UNSIGNED8 NmtState[DEVICESIM_MAX_NODES + 1];
+    UNSIGNED8 BootStep[DEVICESIM_MAX_NODES + 1];
+    uint64_t BootTime[DEVICESIM_MAX_NODES + 1];
+
+    // process data
+    const EDS_ENTRY *ProcessData[DEVICESIM_MAX_NODES + 1];
+    UNSIGNED32 ProcessDataInterval[DEVICESIM_MAX_NODES + 1]; // microseconds
+    uint64_t ProcessDataTime[DEVICESIM_MAX_NODES + 1];
+
+    // heartbeat producers of the nodes and consumer of the device
+    UNSIGNED16 HeartbeatDefault[DEVICESIM_MAX_NODES + 1]; // ms, 0 for EDS default
+    UNSIGNED32 HeartbeatTime[DEVICESIM_MAX_NODES + 1];    // microseconds, 0 for none
+    uint64_t HeartbeatNext[DEVICESIM_MAX_NODES + 1];      // next heartbeat produced
+    uint64_t HeartbeatSeen[DEVICESIM_MAX_NODES + 1];      // last heartbeat consumed
+    UNSIGNED8 HeartbeatState[DEVICESIM_MAX_NODES + 1];    // DEVICESIM_HB_xxx
+
+    // counters
+    unsigned long PacketsSent;
+    unsigned long PacketsDropped;
+    unsigned long ProcessDataCount;
+    unsigned long HeartbeatCount;
+    unsigned long HeartbeatLostCount;
+    unsigned long SdoTimeoutCount;
+
+    // extended SDO request to the host
+    UNSIGNED8 XState;                         // DEVICESIM_XSDO_xxx
+    UNSIGNED8 XServer;
+    UNSIGNED16 XIndex;
+    UNSIGNED8 XSubindex;
+    UNSIGNED8 XToggle;
+    unsigned long XLength;
+    uint64_t XTimeout;
+    UNSIGNED8 XBuffer[SIMNODE_DOMAIN_SIZE];
+};
+
+#endif // _DEVICESIM_H
+
+/*----------------------- END OF FILE ----------------------------------*/
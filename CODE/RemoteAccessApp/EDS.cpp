@@ -0,0 +1,769 @@
+/**************************************************************************
+MODULE:    EDS
+CONTAINS:  Electronic Data Sheet parser and compiled object dictionary model
+COPYRIGHT: Embedded Systems Academy, Inc. 2008-2017.
+DISCLAIM:  Read and understand our disclaimer before using this code!
+           www.esacademy.com/disclaim.htm
+           This software was written in accordance to the guidelines at
+           www.esacademy.com/software/softwarestyleguide.pdf
+LICENSE:   Free to use with licensed CANopenIA chips, modules or devices
+           like CANgineBerry, CANgineXXX and 447izer
+VERSION:   1.10, EmSA 10-NOV-17
+           $LastChangedDate: 2014-01-11 17:30:59 +0100 (Sa, 11 Jan 2014) $
+           $LastChangedRevision: 1702 $
+***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "EDS.h"
+
+/**************************************************************************
+LOCAL DEFINES
+***************************************************************************/
+
+// initial number of entries allocated, grows by doubling
+#define INITIAL_ENTRIES 256
+// initial size of string pool in bytes, grows by doubling
+#define INITIAL_STRINGS 4096
+// longest numeric value accepted in an EDS
+#define MAX_NUMBER_LENGTH 63
+
+// kinds of sections
+#define SECTION_OTHER      0
+#define SECTION_OBJECT     1
+#define SECTION_DEVICEINFO 2
+#define SECTION_FILEINFO   3
+#define SECTION_DUMMYUSAGE 4
+
+/**************************************************************************
+DOES:    Compares a key of given length to a name, ignoring case
+RETURNS: TRUE if equal
+**************************************************************************/
+static bool KeyIs(
+  const char *Key,              // key, not zero terminated
+  unsigned long KeyLength,      // length of key
+  const char *Name              // zero terminated name to compare with
+  )
+{
+  unsigned long b;
+
+  for (b = 0; b < KeyLength; b++)
+  {
+    if (!Name[b]) return FALSE;
+    if ((Key[b] | 0x20) != (Name[b] | 0x20)) return FALSE;
+  }
+  return Name[KeyLength] == 0;
+}
+
+/**************************************************************************
+DOES:    Parses hex digits
+RETURNS: Number of digits used
+**************************************************************************/
+static unsigned long ParseHex(
+  const char *Str,              // digits
+  unsigned long Length,         // max number of digits
+  UNSIGNED32 *Value             // location to store value
+  )
+{
+  unsigned long b;
+  char c;
+
+  *Value = 0;
+  for (b = 0; b < Length; b++)
+  {
+    c = Str[b];
+    if ((c >= '0') && (c <= '9'))      *Value = (*Value << 4) | (c - '0');
+    else if ((c >= 'a') && (c <= 'f')) *Value = (*Value << 4) | (c - 'a' + 10);
+    else if ((c >= 'A') && (c <= 'F')) *Value = (*Value << 4) | (c - 'A' + 10);
+    else break;
+  }
+  return b;
+}
+
+/**************************************************************************
+DOES:    Parses a numeric EDS value: decimal, octal, 0x hex, negative,
+         optionally with $NODEID+ before or +$NODEID after the number
+RETURNS: TRUE if a value was found
+**************************************************************************/
+static bool ParseNumber(
+  const char *Str,              // value, not zero terminated
+  unsigned long Length,         // length of value
+  uint64_t *Value,              // location to store value
+  bool *NodeID                  // set to TRUE if value is relative to node id
+  )
+{
+  char Buf[MAX_NUMBER_LENGTH + 1];
+  char *End;
+
+  *NodeID = FALSE;
+  if ((Length > 8) && KeyIs(Str, 8, "$NODEID+"))
+  {
+    *NodeID = TRUE;
+    Str += 8;
+    Length -= 8;
+  }
+  else if ((Length > 8) && KeyIs(Str + Length - 8, 8, "+$NODEID"))
+  {
+    *NodeID = TRUE;
+    Length -= 8;
+  }
+  if ((Length == 0) || (Length > MAX_NUMBER_LENGTH))
+  {
+    return FALSE;
+  }
+
+  memcpy(Buf, Str, Length);
+  Buf[Length] = 0;
+  errno = 0;
+  if (Buf[0] == '-')
+    *Value = (uint64_t)strtoll(Buf, &End, 0);
+  else
+    *Value = (uint64_t)strtoull(Buf, &End, 0);
+
+  return (End != Buf) && (*End == 0) && (errno == 0);
+}
+
+/**************************************************************************
+DOES:    Orders entries by index and subindex
+RETURNS: <0, 0, >0 like strcmp
+**************************************************************************/
+static int CompareEntries(
+  const void *A,
+  const void *B
+  )
+{
+  UNSIGNED32 KeyA = EDS_KEY(((const EDS_ENTRY *)A)->Index, ((const EDS_ENTRY *)A)->Subindex);
+  UNSIGNED32 KeyB = EDS_KEY(((const EDS_ENTRY *)B)->Index, ((const EDS_ENTRY *)B)->Subindex);
+
+  if (KeyA < KeyB) return -1;
+  if (KeyA > KeyB) return 1;
+  return 0;
+}
+
+/**************************************************************************
+DOES:    Constructor - creates an empty object dictionary
+**************************************************************************/
+EDS::EDS(
+  void
+  )
+{
+  Entries = NULL;
+  Keys = NULL;
+  Count = 0;
+  Capacity = 0;
+  Strings = NULL;
+  StringsLength = 0;
+  StringsCapacity = 0;
+  Clear();
+}
+
+/**************************************************************************
+DOES:    Destructor - releases all memory used by the model
+**************************************************************************/
+EDS::~EDS(
+  void
+  )
+{
+  free(Entries);
+  free(Keys);
+  free(Strings);
+}
+
+/**************************************************************************
+DOES:    Removes all entries, keeps allocated memory for reuse
+RETURNS: Nothing
+**************************************************************************/
+void EDS::Clear(
+  void
+  )
+{
+  Count = 0;
+  StringsLength = 0;
+  memset(&DeviceInfo, 0, sizeof(DeviceInfo));
+  // offset 0 is always the empty string
+  AddString("", 0);
+}
+
+/**************************************************************************
+DOES:    Appends a new entry
+RETURNS: Entry or NULL if out of memory
+**************************************************************************/
+EDS_ENTRY *EDS::NewEntry(
+  UNSIGNED16 Index,             // index of new entry
+  UNSIGNED8 Subindex            // subindex of new entry
+  )
+{
+  EDS_ENTRY *Entry;
+  EDS_ENTRY *NewEntries;
+  unsigned long NewCapacity;
+
+  if (Count == Capacity)
+  {
+    NewCapacity = Capacity ? (Capacity * 2) : INITIAL_ENTRIES;
+    NewEntries = (EDS_ENTRY *)realloc(Entries, NewCapacity * sizeof(EDS_ENTRY));
+    if (!NewEntries)
+    {
+      return NULL;
+    }
+    Entries = NewEntries;
+    Capacity = NewCapacity;
+  }
+
+  Entry = &Entries[Count++];
+  memset(Entry, 0, sizeof(EDS_ENTRY));
+  Entry->Index = Index;
+  Entry->Subindex = Subindex;
+  Entry->ObjectType = EDS_OBJTYPE_VAR;
+  return Entry;
+}
+
+/**************************************************************************
+DOES:    Adds a string to the string pool
+RETURNS: Offset of string in pool, 0 (empty string) if out of memory
+**************************************************************************/
+UNSIGNED32 EDS::AddString(
+  const char *Str,              // string, not zero terminated
+  unsigned long Length          // length of string
+  )
+{
+  char *NewStrings;
+  unsigned long NewCapacity;
+  UNSIGNED32 Offset;
+
+  if (StringsLength + Length + 1 > StringsCapacity)
+  {
+    NewCapacity = StringsCapacity ? StringsCapacity : INITIAL_STRINGS;
+    while (StringsLength + Length + 1 > NewCapacity) NewCapacity *= 2;
+    NewStrings = (char *)realloc(Strings, NewCapacity);
+    if (!NewStrings)
+    {
+      return 0;
+    }
+    Strings = NewStrings;
+    StringsCapacity = NewCapacity;
+  }
+
+  Offset = (UNSIGNED32)StringsLength;
+  memcpy(&Strings[StringsLength], Str, Length);
+  Strings[StringsLength + Length] = 0;
+  StringsLength += Length + 1;
+  return Offset;
+}
+
+/**************************************************************************
+DOES:    Stores a key of an object section in an entry
+RETURNS: Nothing
+**************************************************************************/
+void EDS::SetEntryValue(
+  EDS_ENTRY *Entry,             // entry of current section
+  const char *Key,              // key, not zero terminated
+  unsigned long KeyLength,      // length of key
+  const char *Value,            // value, not zero terminated
+  unsigned long ValueLength     // length of value
+  )
+{
+  uint64_t Value64;
+  bool NodeID;
+
+  if (KeyIs(Key, KeyLength, "DataType"))
+  {
+    if (ParseNumber(Value, ValueLength, &Value64, &NodeID)) Entry->DataType = (UNSIGNED16)Value64;
+  }
+  else if (KeyIs(Key, KeyLength, "AccessType"))
+  {
+    if (KeyIs(Value, ValueLength, "ro"))         Entry->Access = ODRD | RMAP;
+    else if (KeyIs(Value, ValueLength, "wo"))    Entry->Access = ODWR | WMAP;
+    else if (KeyIs(Value, ValueLength, "rw"))    Entry->Access = ODRD | ODWR | RMAP | WMAP;
+    else if (KeyIs(Value, ValueLength, "rwr"))   Entry->Access = ODRD | ODWR | RMAP;
+    else if (KeyIs(Value, ValueLength, "rww"))   Entry->Access = ODRD | ODWR | WMAP;
+    else if (KeyIs(Value, ValueLength, "const"))
+    {
+      Entry->Access = ODRD;
+      Entry->Flags |= EDS_FLAG_CONST;
+    }
+  }
+  else if (KeyIs(Key, KeyLength, "DefaultValue"))
+  {
+    if (ValueLength == 0)
+    {
+      return;
+    }
+    Entry->Flags |= EDS_FLAG_DEFAULT;
+    if (ParseNumber(Value, ValueLength, &Entry->Default, &NodeID))
+    {
+      if (NodeID) Entry->Flags |= EDS_FLAG_NODEID;
+    }
+    else
+    { // not a number, keep as string
+      Entry->Default = AddString(Value, ValueLength);
+      Entry->Flags |= EDS_FLAG_STRING;
+    }
+  }
+  else if (KeyIs(Key, KeyLength, "LowLimit"))
+  {
+    if (ParseNumber(Value, ValueLength, &Entry->LowLimit, &NodeID)) Entry->Flags |= EDS_FLAG_LOWLIMIT;
+  }
+  else if (KeyIs(Key, KeyLength, "HighLimit"))
+  {
+    if (ParseNumber(Value, ValueLength, &Entry->HighLimit, &NodeID)) Entry->Flags |= EDS_FLAG_HIGHLIMIT;
+  }
+  else if (KeyIs(Key, KeyLength, "PDOMapping"))
+  {
+    if ((ValueLength == 1) && (Value[0] == '1')) Entry->Flags |= EDS_FLAG_PDOMAPPING;
+  }
+  else if (KeyIs(Key, KeyLength, "ObjectType"))
+  {
+    if (ParseNumber(Value, ValueLength, &Value64, &NodeID)) Entry->ObjectType = (UNSIGNED8)Value64;
+  }
+  else if (KeyIs(Key, KeyLength, "SubNumber"))
+  { // only records and arrays have sub-entries
+    if (ParseNumber(Value, ValueLength, &Value64, &NodeID) && Value64) Entry->ObjectType = EDS_OBJTYPE_RECORD;
+  }
+  else if (KeyIs(Key, KeyLength, "ParameterName"))
+  {
+    Entry->Name = AddString(Value, ValueLength);
+  }
+}
+
+/**************************************************************************
+DOES:    Stores a key of the [DeviceInfo], [FileInfo] or [DummyUsage] section
+RETURNS: Nothing
+**************************************************************************/
+void EDS::SetDeviceInfo(
+  const char *Key,              // key, not zero terminated
+  unsigned long KeyLength,      // length of key
+  const char *Value,            // value, not zero terminated
+  unsigned long ValueLength     // length of value
+  )
+{
+  static const char *BaudKeys[] = {
+    "BaudRate_10", "BaudRate_20", "BaudRate_50", "BaudRate_125",
+    "BaudRate_250", "BaudRate_500", "BaudRate_800", "BaudRate_1000"
+  };
+  uint64_t Number = 0;
+  bool NodeID;
+  unsigned int b;
+
+  ParseNumber(Value, ValueLength, &Number, &NodeID);
+
+  if (KeyIs(Key, KeyLength, "VendorNumber"))        DeviceInfo.VendorNumber = (UNSIGNED32)Number;
+  else if (KeyIs(Key, KeyLength, "ProductNumber"))  DeviceInfo.ProductNumber = (UNSIGNED32)Number;
+  else if (KeyIs(Key, KeyLength, "RevisionNumber")) DeviceInfo.RevisionNumber = (UNSIGNED32)Number;
+  else if (KeyIs(Key, KeyLength, "NrOfRXPDO"))      DeviceInfo.NrOfRXPDO = (UNSIGNED16)Number;
+  else if (KeyIs(Key, KeyLength, "NrOfTXPDO"))      DeviceInfo.NrOfTXPDO = (UNSIGNED16)Number;
+  else if (KeyIs(Key, KeyLength, "LSS_Supported"))  DeviceInfo.LSSSupported = (UNSIGNED8)Number;
+  else if (KeyIs(Key, KeyLength, "ProductName"))    DeviceInfo.ProductName = AddString(Value, ValueLength);
+  else if (KeyIs(Key, KeyLength, "Description"))    DeviceInfo.Description = AddString(Value, ValueLength);
+  else if ((KeyLength == 9) && KeyIs(Key, 5, "Dummy") && (Key[8] >= '1') && (Key[8] <= '7'))
+  {
+    if (Number) DeviceInfo.DummyUsage |= (UNSIGNED8)(1 << (Key[8] - '0'));
+  }
+  else
+  {
+    for (b = 0; b < sizeof(BaudKeys) / sizeof(BaudKeys[0]); b++)
+    {
+      if (KeyIs(Key, KeyLength, BaudKeys[b]))
+      {
+        if (Number) DeviceInfo.BaudRates |= (UNSIGNED8)(1 << b);
+        break;
+      }
+    }
+  }
+}
+
+/**************************************************************************
+DOES:    Sorts the entries, builds the search keys and resolves data
+         types, sizes and PDO mapping of all entries
+RETURNS: Nothing
+**************************************************************************/
+void EDS::Compile(
+  bool Sorted                   // TRUE if entries were parsed in order
+  )
+{
+  unsigned long e;
+  unsigned long Unique;
+  UNSIGNED32 *NewKeys;
+  EDS_ENTRY *Entry;
+  const EDS_ENTRY *Member;
+  UNSIGNED16 DataType;
+
+  if (!Sorted)
+  {
+    qsort(Entries, Count, sizeof(EDS_ENTRY), CompareEntries);
+  }
+
+  // drop duplicate sections, first one wins
+  Unique = 0;
+  for (e = 0; e < Count; e++)
+  {
+    if ((Unique > 0) && (CompareEntries(&Entries[Unique - 1], &Entries[e]) == 0)) continue;
+    if (Unique != e) Entries[Unique] = Entries[e];
+    Unique++;
+  }
+  Count = Unique;
+
+  NewKeys = (UNSIGNED32 *)realloc(Keys, (Count ? Count : 1) * sizeof(UNSIGNED32));
+  if (!NewKeys)
+  {
+    Count = 0;
+    return;
+  }
+  Keys = NewKeys;
+  for (e = 0; e < Count; e++) Keys[e] = EDS_KEY(Entries[e].Index, Entries[e].Subindex);
+
+  for (e = 0; e < Count; e++)
+  {
+    Entry = &Entries[e];
+
+    // headers were dropped while parsing, some tools still mark sub-entries
+    // of arrays as arrays
+    if ((Entry->ObjectType == EDS_OBJTYPE_ARRAY) || (Entry->ObjectType == EDS_OBJTYPE_RECORD))
+    {
+      Entry->ObjectType = EDS_OBJTYPE_VAR;
+    }
+
+    // members of a record with a complex data type get their type from the
+    // data type definition, e.g. [6031sub1] DataType=0x0081 -> [81sub1]
+    DataType = Entry->DataType;
+    if ((GetTypeSize(DataType) == 0) && (DataType > EDS_TYPE_UNSIGNED64))
+    {
+      Member = Find(DataType, Entry->Subindex);
+      if (Member && (Member->DataType <= EDS_TYPE_UNSIGNED64)) Entry->DataType = Member->DataType;
+    }
+
+    Entry->Size = GetTypeSize(Entry->DataType);
+    if ((Entry->Size == 0) && (Entry->Flags & EDS_FLAG_STRING))
+    {
+      Entry->Size = (UNSIGNED16)strlen(&Strings[Entry->Default]);
+    }
+    // INTEGER8/16/32, INTEGER24 and INTEGER40 to INTEGER64
+    if (((Entry->DataType >= EDS_TYPE_INTEGER8) && (Entry->DataType <= EDS_TYPE_INTEGER32)) ||
+        (Entry->DataType == 0x0010) || ((Entry->DataType >= 0x0012) && (Entry->DataType <= EDS_TYPE_INTEGER64)))
+    {
+      Entry->Flags |= EDS_FLAG_SIGNED;
+    }
+
+    // only entries marked as mappable keep their mapping direction
+    if (!(Entry->Flags & EDS_FLAG_PDOMAPPING))
+    {
+      Entry->Access &= ~(RMAP | WMAP);
+    }
+  }
+}
+
+/**************************************************************************
+DOES:    Loads and parses an EDS file, replacing any previous contents
+RETURNS: TRUE for success, FALSE for error
+**************************************************************************/
+bool EDS::Load(
+  const char *FileName          // name of EDS file
+  )
+{
+  FILE *fp;
+  char *Text;
+  long Length;
+  bool Result;
+
+  fp = fopen(FileName, "rb");
+  if (!fp)
+  {
+    fprintf(stderr, "ERROR: %d opening %s: %s\n", errno, FileName, strerror(errno));
+    return FALSE;
+  }
+
+  fseek(fp, 0, SEEK_END);
+  Length = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  if (Length < 0)
+  {
+    fclose(fp);
+    return FALSE;
+  }
+
+  Text = (char *)malloc(Length + 1);
+  if (!Text)
+  {
+    fclose(fp);
+    return FALSE;
+  }
+  if (fread(Text, 1, Length, fp) != (size_t)Length)
+  {
+    fprintf(stderr, "ERROR: reading %s\n", FileName);
+    free(Text);
+    fclose(fp);
+    return FALSE;
+  }
+  fclose(fp);
+
+  Result = Parse(Text, (unsigned long)Length);
+  free(Text);
+  return Result;
+}
+
+/**************************************************************************
+DOES:    Parses EDS text in memory in a single pass, replacing any
+         previous contents. Unknown sections and keys are ignored.
+RETURNS: TRUE for success, FALSE for error
+**************************************************************************/
+bool EDS::Parse(
+  const char *Text,             // EDS contents, need not be zero terminated
+  unsigned long Length          // length of contents
+  )
+{
+  const char *Pos = Text;
+  const char *End = Text + Length;
+  const char *Line;
+  const char *LineEnd;
+  const char *Equal;
+  const char *Key;
+  const char *Value;
+  unsigned long KeyLength;
+  unsigned long ValueLength;
+  unsigned long Digits;
+  int Section = SECTION_OTHER;
+  bool IsHeader = FALSE;
+  bool Sorted = TRUE;
+  UNSIGNED32 LastKey = 0;
+  UNSIGNED32 Index;
+  UNSIGNED32 Subindex;
+  EDS_ENTRY *Entry = NULL;
+
+  Clear();
+
+  while (Pos < End)
+  {
+    // isolate line without leading and trailing white space
+    while ((Pos < End) && ((*Pos == ' ') || (*Pos == '\t'))) Pos++;
+    Line = Pos;
+    while ((Pos < End) && (*Pos != '\n')) Pos++;
+    LineEnd = Pos;
+    if (Pos < End) Pos++;
+    while ((LineEnd > Line) && ((LineEnd[-1] == '\r') || (LineEnd[-1] == ' ') || (LineEnd[-1] == '\t'))) LineEnd--;
+
+    if ((LineEnd == Line) || (*Line == ';'))
+    {
+      continue;
+    }
+
+    if (*Line == '[')
+    {
+      // close previous section, record and array headers are not entries
+      if ((Section == SECTION_OBJECT) && IsHeader &&
+          ((Entry->ObjectType == EDS_OBJTYPE_ARRAY) || (Entry->ObjectType == EDS_OBJTYPE_RECORD)))
+      {
+        Count--;
+      }
+      else if (Section == SECTION_OBJECT)
+      {
+        if (EDS_KEY(Entry->Index, Entry->Subindex) <= LastKey) Sorted = FALSE;
+        LastKey = EDS_KEY(Entry->Index, Entry->Subindex);
+      }
+
+      Line++;
+      if (LineEnd[-1] == ']') LineEnd--;
+      Section = SECTION_OTHER;
+
+      if (KeyIs(Line, LineEnd - Line, "DeviceInfo"))
+      {
+        Section = SECTION_DEVICEINFO;
+        continue;
+      }
+      if (KeyIs(Line, LineEnd - Line, "FileInfo"))
+      {
+        Section = SECTION_FILEINFO;
+        continue;
+      }
+      if (KeyIs(Line, LineEnd - Line, "DummyUsage"))
+      {
+        Section = SECTION_DUMMYUSAGE;
+        continue;
+      }
+
+      // [iiii] or [iiiisubss], anything else like [1018Value] is ignored
+      Digits = ParseHex(Line, LineEnd - Line, &Index);
+      if ((Digits == 0) || (Digits > 4))
+      {
+        continue;
+      }
+      IsHeader = (Line + Digits == LineEnd);
+      Subindex = 0;
+      if (!IsHeader)
+      {
+        if ((LineEnd - Line <= (long)(Digits + 3)) || !KeyIs(Line + Digits, 3, "sub"))
+        {
+          continue;
+        }
+        Digits += 3;
+        Digits += ParseHex(Line + Digits, LineEnd - Line - Digits, &Subindex);
+        if ((Line + Digits != LineEnd) || (Subindex > 0xFF))
+        {
+          continue;
+        }
+      }
+
+      Entry = NewEntry((UNSIGNED16)Index, (UNSIGNED8)Subindex);
+      if (!Entry)
+      {
+        fprintf(stderr, "ERROR: out of memory parsing EDS\n");
+        Count = 0;
+        return FALSE;
+      }
+      Section = SECTION_OBJECT;
+      continue;
+    }
+
+    if (Section == SECTION_OTHER)
+    {
+      continue;
+    }
+
+    // key=value
+    Equal = (const char *)memchr(Line, '=', LineEnd - Line);
+    if (!Equal)
+    {
+      continue;
+    }
+    Key = Line;
+    KeyLength = Equal - Line;
+    while ((KeyLength > 0) && ((Key[KeyLength - 1] == ' ') || (Key[KeyLength - 1] == '\t'))) KeyLength--;
+    Value = Equal + 1;
+    while ((Value < LineEnd) && ((*Value == ' ') || (*Value == '\t'))) Value++;
+    ValueLength = LineEnd - Value;
+
+    if (Section == SECTION_OBJECT)
+    {
+      SetEntryValue(Entry, Key, KeyLength, Value, ValueLength);
+    }
+    else
+    {
+      SetDeviceInfo(Key, KeyLength, Value, ValueLength);
+    }
+  }
+
+  // close last section
+  if ((Section == SECTION_OBJECT) && IsHeader &&
+      ((Entry->ObjectType == EDS_OBJTYPE_ARRAY) || (Entry->ObjectType == EDS_OBJTYPE_RECORD)))
+  {
+    Count--;
+  }
+  else if ((Section == SECTION_OBJECT) && (EDS_KEY(Entry->Index, Entry->Subindex) <= LastKey))
+  {
+    Sorted = FALSE;
+  }
+
+  Compile(Sorted);
+  return TRUE;
+}
+
+/**************************************************************************
+DOES:    Looks up an entry by binary search
+RETURNS: Entry or NULL if the entry does not exist
+**************************************************************************/
+const EDS_ENTRY *EDS::Find(
+  UNSIGNED16 Index,             // index of od entry
+  UNSIGNED8 Subindex            // subindex of od entry
+  ) const
+{
+  UNSIGNED32 Key = EDS_KEY(Index, Subindex);
+  unsigned long Low = 0;
+  unsigned long High = Count;
+  unsigned long Mid;
+
+  while (Low < High)
+  {
+    Mid = (Low + High) / 2;
+    if (Keys[Mid] < Key)
+      Low = Mid + 1;
+    else
+      High = Mid;
+  }
+
+  if ((Low < Count) && (Keys[Low] == Key))
+  {
+    return &Entries[Low];
+  }
+  return NULL;
+}
+
+/**************************************************************************
+DOES:    Checks if an SDO access of a given length would be accepted
+         by a device implementing this object dictionary
+RETURNS: 0 if access is valid, else the SDO abort code the device
+         would respond with
+**************************************************************************/
+UNSIGNED32 EDS::CheckAccess(
+  UNSIGNED16 Index,             // index of od entry
+  UNSIGNED8 Subindex,           // subindex of od entry
+  unsigned long Length,         // length of data, ignored for reads
+  bool Write                    // TRUE for write access, FALSE for read
+  ) const
+{
+  const EDS_ENTRY *Entry = Find(Index, Subindex);
+
+  if (!Entry)
+  {
+    // distinguish between unknown object and unknown subindex
+    if (Find(Index, 0)) return SDO_ABORT_UNKNOWNSUB;
+    return SDO_ABORT_NOT_EXISTS;
+  }
+
+  if (!Write)
+  {
+    return (Entry->Access & ODRD) ? 0 : SDO_ABORT_WRITEONLY;
+  }
+
+  if (!(Entry->Access & ODWR))
+  {
+    return SDO_ABORT_READONLY;
+  }
+  // fixed size types must be written completely, strings and domains
+  // are accepted up to their size
+  if (Entry->Size && (GetTypeSize(Entry->DataType) != 0) && (Length != Entry->Size))
+  {
+    return SDO_ABORT_TYPEMISMATCH;
+  }
+  return 0;
+}
+
+/**************************************************************************
+DOES:    Gets the default value of an entry for a specific node id
+RETURNS: Default value with $NODEID added if needed
+**************************************************************************/
+uint64_t EDS::GetDefault(
+  const EDS_ENTRY *Entry,       // entry with numeric default value
+  UNSIGNED8 NodeID              // node id to use for $NODEID
+  )
+{
+  if (Entry->Flags & EDS_FLAG_NODEID)
+  {
+    return Entry->Default + NodeID;
+  }
+  return Entry->Default;
+}
+
+/**************************************************************************
+DOES:    Gets the size of a CANopen basic data type
+RETURNS: Size in bytes or 0 for variable length or unknown types
+**************************************************************************/
+UNSIGNED16 EDS::GetTypeSize(
+  UNSIGNED16 DataType           // CANopen data type index
+  )
+{
+  // sizes of basic data types 0x0000 to 0x001B
+  static const UNSIGNED8 TypeSizes[] = {
+    0, 1, 1, 2, 4, 1, 2, 4,     // -, BOOLEAN, INTEGER8/16/32, UNSIGNED8/16/32
+    4, 0, 0, 0, 6, 6, 0, 0,     // REAL32, strings, TIME_OF_DAY, TIME_DIFF, -, DOMAIN
+    3, 8, 5, 6, 7, 8, 3, 0,     // INTEGER24, REAL64, INTEGER40/48/56/64, UNSIGNED24, -
+    5, 6, 7, 8                  // UNSIGNED40/48/56/64
+  };
+
+  if (DataType < sizeof(TypeSizes))
+  {
+    return TypeSizes[DataType];
+  }
+  return 0;
+}
+
+/*----------------------- END OF FILE ----------------------------------*/
@@ -0,0 +1,197 @@
+/**************************************************************************
+MODULE:    EDS
+CONTAINS:  Electronic Data Sheet parser and compiled object dictionary model
+COPYRIGHT: Embedded Systems Academy, Inc. 2008-2017.
+DISCLAIM:  Read and understand our disclaimer before using this code!
+           www.esacademy.com/disclaim.htm
+           This software was written in accordance to the guidelines at
+           www.esacademy.com/software/softwarestyleguide.pdf
+LICENSE:   Free to use with licensed CANopenIA chips, modules or devices
+           like CANgineBerry, CANgineXXX and 447izer
+VERSION:   1.10, EmSA 10-NOV-17
+           $LastChangedDate: 2014-01-11 17:30:59 +0100 (Sa, 11 Jan 2014) $
+           $LastChangedRevision: 1702 $
+***************************************************************************/
+#pragma once
+
+#ifndef _EDS_H
+#define _EDS_H
+
+#include <stdint.h>
+#include "global.h"
+#include "xsdo.h"
+
+/**************************************************************************
+GLOBAL DEFINES
+***************************************************************************/
+
+// CANopen object types
+#define EDS_OBJTYPE_DOMAIN 0x02
+#define EDS_OBJTYPE_VAR    0x07
+#define EDS_OBJTYPE_ARRAY  0x08
+#define EDS_OBJTYPE_RECORD 0x09
+
+// CANopen basic data types
+#define EDS_TYPE_BOOLEAN        0x0001
+#define EDS_TYPE_INTEGER8       0x0002
+#define EDS_TYPE_INTEGER16      0x0003
+#define EDS_TYPE_INTEGER32      0x0004
+#define EDS_TYPE_UNSIGNED8      0x0005
+#define EDS_TYPE_UNSIGNED16     0x0006
+#define EDS_TYPE_UNSIGNED32     0x0007
+#define EDS_TYPE_REAL32         0x0008
+#define EDS_TYPE_VISIBLE_STRING 0x0009
+#define EDS_TYPE_OCTET_STRING   0x000A
+#define EDS_TYPE_UNICODE_STRING 0x000B
+#define EDS_TYPE_DOMAIN         0x000F
+#define EDS_TYPE_REAL64         0x0011
+#define EDS_TYPE_INTEGER64      0x0015
+#define EDS_TYPE_UNSIGNED64     0x001B
+
+// entry flags
+#define EDS_FLAG_CONST      0x01 // access type const
+#define EDS_FLAG_DEFAULT    0x02 // default value present
+#define EDS_FLAG_NODEID     0x04 // default value is relative to node id
+#define EDS_FLAG_LOWLIMIT   0x08 // low limit present
+#define EDS_FLAG_HIGHLIMIT  0x10 // high limit present
+#define EDS_FLAG_STRING     0x20 // default value is a string pool offset
+#define EDS_FLAG_SIGNED     0x40 // numeric values are two's complement
+#define EDS_FLAG_PDOMAPPING 0x80 // PDOMapping=1
+
+// supported baudrates, bit positions in EDS_DEVICEINFO.BaudRates
+#define EDS_BAUD_10   (1UL << 0)
+#define EDS_BAUD_20   (1UL << 1)
+#define EDS_BAUD_50   (1UL << 2)
+#define EDS_BAUD_125  (1UL << 3)
+#define EDS_BAUD_250  (1UL << 4)
+#define EDS_BAUD_500  (1UL << 5)
+#define EDS_BAUD_800  (1UL << 6)
+#define EDS_BAUD_1000 (1UL << 7)
+
+// lookup key of an entry, entries are sorted by this value
+#define EDS_KEY(index, subindex) (((UNSIGNED32)(index) << 8) | (UNSIGNED8)(subindex))
+
+/**************************************************************************
+GLOBAL TYPES AND FUNCTIONS
+***************************************************************************/
+
+// Single object dictionary entry (VAR or DOMAIN, never a record/array header)
+typedef struct
+{
+  UNSIGNED16 Index;
+  UNSIGNED8 Subindex;
+  UNSIGNED8 Access;           // ODRD, ODWR, RMAP, WMAP
+  UNSIGNED16 DataType;        // basic data type, record members resolved
+  UNSIGNED16 Size;            // size in bytes, 0 for domains
+  UNSIGNED8 ObjectType;       // EDS_OBJTYPE_xxx
+  UNSIGNED8 Flags;            // EDS_FLAG_xxx
+  UNSIGNED16 Reserved;
+  UNSIGNED32 Name;            // string pool offset of parameter name
+  uint64_t Default;           // default value or string pool offset
+  uint64_t LowLimit;
+  uint64_t HighLimit;
+} EDS_ENTRY;
+
+// Device description from [DeviceInfo], [FileInfo] and [DummyUsage]
+typedef struct
+{
+  UNSIGNED32 VendorNumber;
+  UNSIGNED32 ProductNumber;
+  UNSIGNED32 RevisionNumber;
+  UNSIGNED16 NrOfRXPDO;
+  UNSIGNED16 NrOfTXPDO;
+  UNSIGNED8 BaudRates;        // EDS_BAUD_xxx
+  UNSIGNED8 LSSSupported;
+  UNSIGNED8 DummyUsage;       // bit n set if Dummy000n is supported
+  UNSIGNED32 ProductName;     // string pool offsets
+  UNSIGNED32 Description;
+} EDS_DEVICEINFO;
+
+class EDS
+{
+  public:
+    /**************************************************************************
+    DOES:    Constructor - creates an empty object dictionary
+    **************************************************************************/
+    EDS(void);
+    /**************************************************************************
+    DOES:    Destructor - releases all memory used by the model
+    **************************************************************************/
+    ~EDS(void);
+    /**************************************************************************
+    DOES:    Loads and parses an EDS file, replacing any previous contents
+    RETURNS: TRUE for success, FALSE for error
+    **************************************************************************/
+    bool Load(const char *FileName);
+    /**************************************************************************
+    DOES:    Parses EDS text in memory in a single pass, replacing any
+             previous contents. Unknown sections and keys are ignored.
+    RETURNS: TRUE for success, FALSE for error
+    **************************************************************************/
+    bool Parse(const char *Text, unsigned long Length);
+    /**************************************************************************
+    DOES:    Looks up an entry by binary search
+    RETURNS: Entry or NULL if the entry does not exist
+    **************************************************************************/
+    const EDS_ENTRY *Find(UNSIGNED16 Index, UNSIGNED8 Subindex) const;
+    /**************************************************************************
+    DOES:    Checks if an SDO access of a given length would be accepted
+             by a device implementing this object dictionary
+    RETURNS: 0 if access is valid, else the SDO abort code the device
+             would respond with
+    **************************************************************************/
+    UNSIGNED32 CheckAccess(
+      UNSIGNED16 Index,           // index of od entry
+      UNSIGNED8 Subindex,         // subindex of od entry
+      unsigned long Length,       // length of data, ignored for reads
+      bool Write                  // TRUE for write access, FALSE for read
+      ) const;
+    /**************************************************************************
+    DOES:    Gets the number of entries and an entry by its position, entries
+             are sorted by index and subindex
+    RETURNS: Number of entries / entry
+    **************************************************************************/
+    unsigned long GetEntryCount(void) const { return Count; }
+    const EDS_ENTRY *GetEntry(unsigned long Position) const { return &Entries[Position]; }
+    /**************************************************************************
+    DOES:    Gets the device description
+    RETURNS: Device info, string members are string pool offsets
+    **************************************************************************/
+    const EDS_DEVICEINFO *GetDeviceInfo(void) const { return &DeviceInfo; }
+    /**************************************************************************
+    DOES:    Resolves a string pool offset
+    RETURNS: Zero terminated string
+    **************************************************************************/
+    const char *GetString(UNSIGNED32 Offset) const { return &Strings[Offset]; }
+    /**************************************************************************
+    DOES:    Gets the default value of an entry for a specific node id
+    RETURNS: Default value with $NODEID added if needed
+    **************************************************************************/
+    static uint64_t GetDefault(const EDS_ENTRY *Entry, UNSIGNED8 NodeID);
+    /**************************************************************************
+    DOES:    Gets the size of a CANopen basic data type
+    RETURNS: Size in bytes or 0 for variable length or unknown types
+    **************************************************************************/
+    static UNSIGNED16 GetTypeSize(UNSIGNED16 DataType);
+
+  private:
+    void Clear(void);
+    EDS_ENTRY *NewEntry(UNSIGNED16 Index, UNSIGNED8 Subindex);
+    UNSIGNED32 AddString(const char *Str, unsigned long Length);
+    void SetEntryValue(EDS_ENTRY *Entry, const char *Key, unsigned long KeyLength, const char *Value, unsigned long ValueLength);
+    void SetDeviceInfo(const char *Key, unsigned long KeyLength, const char *Value, unsigned long ValueLength);
+    void Compile(bool Sorted);
+
+    EDS_ENTRY *Entries;         // entries sorted by key
+    UNSIGNED32 *Keys;           // EDS_KEY() of each entry, searched separately
+    unsigned long Count;
+    unsigned long Capacity;
+    char *Strings;              // string pool, offset 0 is the empty string
+    unsigned long StringsLength;
+    unsigned long StringsCapacity;
+    EDS_DEVICEINFO DeviceInfo;
+};
+
+#endif // _EDS_H
+
+/*----------------------- END OF FILE ----------------------------------*/
@@ -0,0 +1,296 @@
+/**************************************************************************
+MODULE:    EmcyLog
+CONTAINS:  Records emergency events of all nodes in one ring per node. Each
+           ring has a single writer, the thread calling
+           SerialProtocol::Process, and a single reader, the thread calling
+           Drain. A bit per node tells the reader which rings hold events.
+COPYRIGHT: Embedded Systems Academy, Inc. 2008-2017.
+DISCLAIM:  Read and understand our disclaimer before using this code!
+           www.esacademy.com/disclaim.htm
+           This software was written in accordance to the guidelines at
+           www.esacademy.com/software/softwarestyleguide.pdf
+LICENSE:   Free to use with licensed CANopenIA chips, modules or devices
+           like CANgineBerry, CANgineXXX and 447izer
+VERSION:   1.10, EmSA 10-NOV-17
+           $LastChangedDate: 2014-01-11 17:30:59 +0100 (Sa, 11 Jan 2014) $
+           $LastChangedRevision: 1702 $
+***************************************************************************/
+
+#include <string.h>
+#include "EmcyLog.h"
+#include "SerialProtocol.h"
+#include "Timer.h"
+
+/**************************************************************************
+LOCAL DEFINES
+***************************************************************************/
+
+// us per rate window
+#define RATE_WINDOW 1000000ULL
+
+
+/**************************************************************************
+DOES:    Constructor - all rings empty
+**************************************************************************/
+EMCYLOG::EMCYLOG
+  (
+  void
+  )
+{
+  int n;
+
+  for (n = 0; n < NODESET_NODES; n++)
+  {
+    Rings[n].Head = 0;
+    Rings[n].Tail = 0;
+    STATS_Set(&Rings[n].Received, 0);
+    STATS_Set(&Rings[n].Dropped, 0);
+    Rings[n].WindowStart = 0;
+    Rings[n].WindowCount = 0;
+    Rings[n].Rate = 0;
+    Rings[n].PeakRate = 0;
+  }
+  Pending[0] = 0;
+  Pending[1] = 0;
+}
+
+
+/**************************************************************************
+DOES:    Takes data written by the device, to be called from the data
+         call-back. Only emergency states of the node status [5F04h]
+         are recorded.
+RETURNS: TRUE if an event was recorded, else FALSE
+**************************************************************************/
+bool EMCYLOG::HandleData
+  (
+  int Index,                  // index of od entry written
+  unsigned char Subindex,     // subindex of od entry written
+  unsigned long DataLength,   // length of data written
+  unsigned char *Data         // data written
+  )
+{
+  if ((Index != 0x5F04) || (DataLength < 1)) return FALSE;
+  if ((Data[0] != NODESTATUS_EMCY_NEW) && (Data[0] != NODESTATUS_EMCY_OVER)) return FALSE;
+  return Record(Subindex & 0x7F, Data[0], 0, NULL);
+}
+
+
+/**************************************************************************
+DOES:    Records an emergency message with its error code, e.g. from a
+         received frame. Length 0 records the event without a code.
+         Must only be called by one thread, the receive path.
+RETURNS: TRUE if recorded, FALSE if the ring of the node is full
+**************************************************************************/
+bool EMCYLOG::Record
+  (
+  UNSIGNED8 NodeID,           // node id, 1 to 127
+  UNSIGNED8 Status,           // NODESTATUS_EMCY_NEW or NODESTATUS_EMCY_OVER
+  unsigned long DataLength,   // length of the emergency message, 0 or 8
+  const unsigned char *Data   // emergency message
+  )
+{
+  RING *Ring = &Rings[NodeID & 0x7F];
+  EMCY_EVENT *Event;
+  uint64_t Now = Timer::GetMicroseconds();
+  uint32_t Head = Ring->Head.load(std::memory_order_relaxed);
+
+  // events per second, counted in whole seconds
+  if (Now - Ring->WindowStart.load(std::memory_order_relaxed) >= RATE_WINDOW)
+  {
+    Ring->Rate.store((Now - Ring->WindowStart.load(std::memory_order_relaxed) < 2 * RATE_WINDOW) ? Ring->WindowCount : 0,
+      std::memory_order_relaxed);
+    Ring->WindowStart.store(Now, std::memory_order_relaxed);
+    Ring->WindowCount = 0;
+  }
+  Ring->WindowCount++;
+  if (Ring->WindowCount > Ring->PeakRate.load(std::memory_order_relaxed))
+  {
+    Ring->PeakRate.store(Ring->WindowCount, std::memory_order_relaxed);
+  }
+  STATS_Add(&Ring->Received, 1);
+
+  if (Head - Ring->Tail.load(std::memory_order_acquire) >= EMCYLOG_EVENTS)
+  {
+    STATS_Add(&Ring->Dropped, 1);
+    return FALSE;
+  }
+  Event = &Ring->Events[Head & (EMCYLOG_EVENTS - 1)];
+  Event->Time = Now;
+  Event->NodeID = NodeID & 0x7F;
+  Event->Status = Status;
+  if ((DataLength >= 8) && (Data != NULL))
+  {
+    Event->Code = Data[0] | (Data[1] << 8);
+    Event->Register = Data[2];
+    memcpy(Event->Data, &Data[3], sizeof(Event->Data));
+    Event->Flags = EMCY_FLAG_CODE | EMCY_FLAG_MESSAGE;
+  }
+  else
+  {
+    Event->Code = 0;
+    Event->Register = 0;
+    memset(Event->Data, 0, sizeof(Event->Data));
+    Event->Flags = 0;
+  }
+  Ring->Head.store(Head + 1, std::memory_order_release);
+  Pending[(NodeID >> 6) & 1].fetch_or((uint64_t)1 << (NodeID & 63), std::memory_order_release);
+  return TRUE;
+}
+
+
+/**************************************************************************
+DOES:    Sets the error code of the new emergencies of a node still in its
+         ring that have none. The events between tail and head belong to
+         the reader, the receive path only writes at the head.
+RETURNS: Number of events set
+**************************************************************************/
+unsigned int EMCYLOG::SetCode
+  (
+  UNSIGNED8 NodeID,           // node id
+  UNSIGNED16 Code             // emergency error code
+  )
+{
+  RING *Ring = &Rings[NodeID & 0x7F];
+  uint32_t Head = Ring->Head.load(std::memory_order_acquire);
+  uint32_t Tail = Ring->Tail.load(std::memory_order_relaxed);
+  EMCY_EVENT *Event;
+  unsigned int Count = 0;
+
+  for (; Tail != Head; Tail++)
+  {
+    Event = &Ring->Events[Tail & (EMCYLOG_EVENTS - 1)];
+    if ((Event->Status != NODESTATUS_EMCY_NEW) || (Event->Flags & EMCY_FLAG_CODE)) continue;
+    Event->Code = Code;
+    Event->Flags |= EMCY_FLAG_CODE;
+    Count++;
+  }
+  return Count;
+}
+
+
+/**************************************************************************
+DOES:    Takes the oldest events out of the rings, all nodes or some,
+         node by node. All events taken out are returned. Must only be
+         called by one thread.
+RETURNS: Number of events stored
+**************************************************************************/
+unsigned int EMCYLOG::Drain
+  (
+  EMCY_EVENT *Events,         // location to store the events
+  unsigned int MaxEvents,     // max events to store
+  const NODESET *Nodes        // nodes to drain, NULL for all
+  )
+{
+  unsigned int Count = 0;
+  NODESET Ready;
+  UNSIGNED8 NodeID;
+  uint64_t Bit;
+  uint32_t Head;
+  uint32_t Tail;
+  RING *Ring;
+
+  GetPending(&Ready);
+  if (Nodes != NULL) NODESET_And(&Ready, &Ready, Nodes);
+  for (NodeID = NODESET_Next(&Ready, 1); NodeID && (Count < MaxEvents); NodeID = NODESET_Next(&Ready, NodeID + 1))
+  {
+    Ring = &Rings[NodeID];
+    Bit = (uint64_t)1 << (NodeID & 63);
+    // cleared before reading, an event recorded meanwhile sets it again
+    Pending[NodeID >> 6].fetch_and(~Bit, std::memory_order_acq_rel);
+    Head = Ring->Head.load(std::memory_order_acquire);
+    Tail = Ring->Tail.load(std::memory_order_relaxed);
+    while ((Tail != Head) && (Count < MaxEvents))
+    {
+      Events[Count++] = Ring->Events[Tail & (EMCYLOG_EVENTS - 1)];
+      Tail++;
+    }
+    Ring->Tail.store(Tail, std::memory_order_release);
+    if (Tail != Head) Pending[NodeID >> 6].fetch_or(Bit, std::memory_order_relaxed);
+  }
+  return Count;
+}
+
+
+/**************************************************************************
+DOES:    Copies the events of a node still in its ring without taking
+         them out, oldest first. Only from the thread calling Drain.
+RETURNS: Number of events stored
+**************************************************************************/
+unsigned int EMCYLOG::Peek
+  (
+  UNSIGNED8 NodeID,           // node id
+  EMCY_EVENT *Events,         // location to store the events
+  unsigned int MaxEvents,     // max events to store
+  UNSIGNED16 Code,            // error code to match
+  UNSIGNED16 CodeMask         // bits of the code to compare, 0 for all events
+  ) const
+{
+  const RING *Ring = &Rings[NodeID & 0x7F];
+  uint32_t Head = Ring->Head.load(std::memory_order_acquire);
+  uint32_t Tail = Ring->Tail.load(std::memory_order_relaxed);
+  unsigned int Count = 0;
+
+  for (; (Tail != Head) && (Count < MaxEvents); Tail++)
+  {
+    if (Matches(&Ring->Events[Tail & (EMCYLOG_EVENTS - 1)], Code, CodeMask))
+    {
+      Events[Count++] = Ring->Events[Tail & (EMCYLOG_EVENTS - 1)];
+    }
+  }
+  return Count;
+}
+
+
+/**************************************************************************
+DOES:    Gets the nodes with events in their rings
+RETURNS: Nothing
+**************************************************************************/
+void EMCYLOG::GetPending
+  (
+  NODESET *Nodes              // location to store the nodes
+  ) const
+{
+  Nodes->Bits[0] = Pending[0].load(std::memory_order_acquire);
+  Nodes->Bits[1] = Pending[1].load(std::memory_order_acquire);
+}
+
+
+/**************************************************************************
+DOES:    Gets the counters of a node, may be called from any thread
+RETURNS: Nothing
+**************************************************************************/
+void EMCYLOG::GetStatistics
+  (
+  UNSIGNED8 NodeID,           // node id
+  EMCYLOG_STATS *Stats        // location to store the counters
+  ) const
+{
+  const RING *Ring = &Rings[NodeID & 0x7F];
+
+  Stats->Received = STATS_Get(&Ring->Received);
+  Stats->Dropped = STATS_Get(&Ring->Dropped);
+  Stats->Queued = Ring->Head.load(std::memory_order_acquire) - Ring->Tail.load(std::memory_order_acquire);
+  // no events for a whole window, the rate dropped to 0
+  if (Timer::GetMicroseconds() - Ring->WindowStart.load(std::memory_order_relaxed) >= 2 * RATE_WINDOW) Stats->Rate = 0;
+  else Stats->Rate = Ring->Rate.load(std::memory_order_relaxed);
+  Stats->PeakRate = Ring->PeakRate.load(std::memory_order_relaxed);
+}
+
+
+/**************************************************************************
+DOES:    Checks an event against an error code filter
+RETURNS: TRUE if it matches, else FALSE
+**************************************************************************/
+bool EMCYLOG::Matches
+  (
+  const EMCY_EVENT *Event,    // event to check
+  UNSIGNED16 Code,            // error code to match
+  UNSIGNED16 CodeMask         // bits of the code to compare, 0 for all events
+  )
+{
+  if (CodeMask == 0) return TRUE;
+  if ((Event->Flags & EMCY_FLAG_CODE) == 0) return FALSE;
+  return ((Event->Code ^ Code) & CodeMask) == 0;
+}
+
+/*----------------------- END OF FILE ----------------------------------*/
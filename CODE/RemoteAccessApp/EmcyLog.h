@@ -0,0 +1,173 @@
+/**************************************************************************
+MODULE:    EmcyLog
+CONTAINS:  Records emergency events of all nodes of the network with their
+           time, in one fixed size ring per node. The receive path only
+           writes to the ring of the node and never allocates or blocks,
+           another thread drains the rings in bulk, filtered by node.
+           Events are looked at by error code without taking them out of
+           the ring. The node status [5F04h] carries no error code, it is
+           added with SetCode, e.g. from the error field [1003h] read when
+           the node reported the emergency. Counters give the rate of
+           events per node.
+COPYRIGHT: Embedded Systems Academy, Inc. 2008-2017.
+DISCLAIM:  Read and understand our disclaimer before using this code!
+           www.esacademy.com/disclaim.htm
+           This software was written in accordance to the guidelines at
+           www.esacademy.com/software/softwarestyleguide.pdf
+LICENSE:   Free to use with licensed CANopenIA chips, modules or devices
+           like CANgineBerry, CANgineXXX and 447izer
+VERSION:   1.10, EmSA 10-NOV-17
+           $LastChangedDate: 2014-01-11 17:30:59 +0100 (Sa, 11 Jan 2014) $
+           $LastChangedRevision: 1702 $
+***************************************************************************/
+#pragma once
+
+#ifndef _EMCYLOG_H
+#define _EMCYLOG_H
+
+#include <stdint.h>
+#include <atomic>
+#include "global.h"
+#include "Statistics.h"
+#include "NodeTracker.h"
+
+/**************************************************************************
+GLOBAL DEFINES
+***************************************************************************/
+
+// events kept per node, a power of 2. Events of a node with a full ring
+// are dropped and counted, the receive path never waits for the reader.
+#define EMCYLOG_EVENTS 64
+
+// event flags
+#define EMCY_FLAG_CODE    0x01    // error code is valid
+#define EMCY_FLAG_MESSAGE 0x02    // error register and data are valid
+
+/**************************************************************************
+GLOBAL TYPES AND FUNCTIONS
+***************************************************************************/
+
+// an emergency event. The node status [5F04h] only tells that an emergency
+// started or ended, the error code comes with the emergency message itself.
+typedef struct
+{
+  uint64_t Time;                            // monotonic time in us
+  UNSIGNED16 Code;                          // emergency error code
+  UNSIGNED8 Register;                       // error register [1001h]
+  UNSIGNED8 NodeID;
+  UNSIGNED8 Status;                         // NODESTATUS_EMCY_NEW or NODESTATUS_EMCY_OVER
+  UNSIGNED8 Flags;                          // EMCY_FLAG_xxx
+  UNSIGNED8 Data[5];                        // manufacturer specific error field
+} EMCY_EVENT;
+
+// counters of a node
+typedef struct
+{
+  uint64_t Received;                        // events recorded
+  uint64_t Dropped;                         // events lost, ring full
+  unsigned long Queued;                     // events in the ring
+  unsigned long Rate;                       // events in the last full second
+  unsigned long PeakRate;                   // most events in one second
+} EMCYLOG_STATS;
+
+class EMCYLOG
+{
+  // events of one node, written by the receive path, read by the drain
+  typedef struct
+  {
+    EMCY_EVENT Events[EMCYLOG_EVENTS];
+    std::atomic<uint32_t> Head;             // next event written
+    std::atomic<uint32_t> Tail;             // next event read
+    STATS_COUNTER Received;
+    STATS_COUNTER Dropped;
+    std::atomic<uint64_t> WindowStart;      // us, start of the second counted
+    uint32_t WindowCount;                   // events in it, only used by the receive path
+    std::atomic<uint32_t> Rate;
+    std::atomic<uint32_t> PeakRate;
+  } RING;
+
+  public:
+    /**************************************************************************
+    DOES:    Constructor - all rings empty
+    **************************************************************************/
+    EMCYLOG(void);
+    /**************************************************************************
+    DOES:    Takes data written by the device, to be called from the data
+             call-back. Only emergency states of the node status [5F04h]
+             are recorded.
+    RETURNS: TRUE if an event was recorded, else FALSE
+    **************************************************************************/
+    bool HandleData(
+      int Index,                  // index of od entry written
+      unsigned char Subindex,     // subindex of od entry written
+      unsigned long DataLength,   // length of data written
+      unsigned char *Data         // data written
+      );
+    /**************************************************************************
+    DOES:    Records an emergency message with its error code, e.g. from a
+             received frame. Length 0 records the event without a code.
+             Must only be called by one thread, the receive path.
+    RETURNS: TRUE if recorded, FALSE if the ring of the node is full
+    **************************************************************************/
+    bool Record(
+      UNSIGNED8 NodeID,           // node id, 1 to 127
+      UNSIGNED8 Status,           // NODESTATUS_EMCY_NEW or NODESTATUS_EMCY_OVER
+      unsigned long DataLength,   // length of the emergency message, 0 or 8
+      const unsigned char *Data   // emergency message
+      );
+    /**************************************************************************
+    DOES:    Sets the error code of the new emergencies of a node still in
+             its ring that have none, e.g. from the error field [1003h,1]
+             read after the node status reported them. Only from the
+             thread calling Drain.
+    RETURNS: Number of events set
+    **************************************************************************/
+    unsigned int SetCode(
+      UNSIGNED8 NodeID,           // node id
+      UNSIGNED16 Code             // emergency error code
+      );
+    /**************************************************************************
+    DOES:    Takes the oldest events out of the rings, all nodes or some,
+             node by node. All events taken out are returned, use Peek to
+             select events by error code. Must only be called by one
+             thread.
+    RETURNS: Number of events stored
+    **************************************************************************/
+    unsigned int Drain(
+      EMCY_EVENT *Events,         // location to store the events
+      unsigned int MaxEvents,     // max events to store
+      const NODESET *Nodes        // nodes to drain, NULL for all
+      );
+    /**************************************************************************
+    DOES:    Copies the events of a node still in its ring without taking
+             them out, oldest first. Only from the thread calling Drain.
+    RETURNS: Number of events stored
+    **************************************************************************/
+    unsigned int Peek(
+      UNSIGNED8 NodeID,           // node id
+      EMCY_EVENT *Events,         // location to store the events
+      unsigned int MaxEvents,     // max events to store
+      UNSIGNED16 Code,            // error code to match
+      UNSIGNED16 CodeMask         // bits of the code to compare, 0 for all events
+      ) const;
+    /**************************************************************************
+    DOES:    Gets the nodes with events in their rings
+    RETURNS: Nothing
+    **************************************************************************/
+    void GetPending(NODESET *Nodes) const;
+    /**************************************************************************
+    DOES:    Gets the counters of a node, may be called from any thread
+    RETURNS: Nothing
+    **************************************************************************/
+    void GetStatistics(UNSIGNED8 NodeID, EMCYLOG_STATS *Stats) const;
+
+  private:
+    static bool Matches(const EMCY_EVENT *Event, UNSIGNED16 Code, UNSIGNED16 CodeMask);
+
+    RING Rings[NODESET_NODES];
+    std::atomic<uint64_t> Pending[NODESET_WORDS]; // nodes with events, bit per node
+};
+
+#endif // _EMCYLOG_H
+
+/*----------------------- END OF FILE ----------------------------------*/
@@ -0,0 +1,986 @@
+/**************************************************************************
+MODULE:    LogReader
+CONTAINS:  Queries of a process data log written by DATALOG
+COPYRIGHT: Embedded Systems Academy, Inc. 2008-2017.
+DISCLAIM:  Read and understand our disclaimer before using this code!
+           www.esacademy.com/disclaim.htm
+           This software was written in accordance to the guidelines at
+           www.esacademy.com/software/softwarestyleguide.pdf
+LICENSE:   Free to use with licensed CANopenIA chips, modules or devices
+           like CANgineBerry, CANgineXXX and 447izer
+VERSION:   1.10, EmSA 10-NOV-17
+           $LastChangedDate: 2014-01-11 17:30:59 +0100 (Sa, 11 Jan 2014) $
+           $LastChangedRevision: 1702 $
+***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#ifndef WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#include "LogReader.h"
+
+/**************************************************************************
+LOCAL DEFINES
+***************************************************************************/
+
+// key of a series, as by DATALOG
+#define SERIES_KEY(NodeID, Index, Subindex) (((uint32_t)(NodeID) << 24) | ((uint32_t)(Index) << 8) | (Subindex))
+
+// slot of a series in the hash table
+#define SERIES_SLOT(Key) ((((Key) * 2654435761U) >> 16) & (DATALOG_MAX_SERIES - 1))
+
+// entries added to the index or to a series at once
+#define INDEX_GROWTH 1024
+#define SERIES_GROWTH 64
+
+/**************************************************************************
+LOCAL TYPES
+***************************************************************************/
+
+// bits read from the most significant one of each byte
+typedef struct
+{
+  const unsigned char *Data;
+  unsigned long Bits;                                      // read so far
+  unsigned long Length;                                    // bits available
+} BITS;
+
+
+/**************************************************************************
+DOES:    Reads bits from a bit stream
+RETURNS: Bits read, in the lowest bits. FALSE in Valid if the stream ends.
+**************************************************************************/
+static uint64_t GetBits
+  (
+  BITS *In,                                                // bit stream
+  unsigned int Count,                                      // number of bits, 1 to 64
+  bool *Valid                                              // cleared if the stream ends
+  )
+{
+  uint64_t Value = 0;
+  unsigned int Left;
+  unsigned int n;
+
+  if (In->Bits + Count > In->Length)
+  {
+    *Valid = FALSE;
+    return 0;
+  }
+  while (Count)
+  {
+    Left = 8 - (In->Bits & 7);
+    n = (Count < Left) ? Count : Left;
+    Value = (Value << n) | ((In->Data[In->Bits >> 3] >> (Left - n)) & ((1U << n) - 1));
+    In->Bits += n;
+    Count -= n;
+  }
+  return Value;
+}
+
+
+/**************************************************************************
+DOES:    Reads a prefix of up to four one bits ended by a zero bit
+RETURNS: Number of one bits, 0 to 4
+**************************************************************************/
+static unsigned int GetPrefix
+  (
+  BITS *In,                                                // bit stream
+  bool *Valid                                              // cleared if the stream ends
+  )
+{
+  unsigned int n = 0;
+
+  while ((n < 4) && GetBits(In, 1, Valid)) n++;
+  return n;
+}
+
+
+/**************************************************************************
+DOES:    Maps zigzag coded values back to signed values
+RETURNS: Two's complement value
+**************************************************************************/
+static uint64_t UnZigZag
+  (
+  uint64_t Value                                           // zigzag coded value
+  )
+{
+  return (Value >> 1) ^ (0 - (Value & 1));
+}
+
+
+/**************************************************************************
+DOES:    Loads a little endian value
+RETURNS: Value
+**************************************************************************/
+static uint64_t LoadLE
+  (
+  const unsigned char *Location,                           // location of the value
+  unsigned int Bytes                                       // number of bytes
+  )
+{
+  uint64_t Value = 0;
+
+  while (Bytes--) Value = (Value << 8) | Location[Bytes];
+  return Value;
+}
+
+
+/**************************************************************************
+DOES:    Adds a value to a bucket, the sum is kept in Avg
+RETURNS: Nothing
+**************************************************************************/
+static void AddToBucket
+  (
+  LOG_ROLLUP *Bucket,                                      // bucket
+  uint64_t Count,                                          // number of values
+  double Min,                                              // smallest value
+  double Max,                                              // largest value
+  double Sum                                               // sum of the values
+  )
+{
+  if (Bucket->Count == 0)
+  {
+    Bucket->Min = Min;
+    Bucket->Max = Max;
+  }
+  else
+  {
+    if (Min < Bucket->Min) Bucket->Min = Min;
+    if (Max > Bucket->Max) Bucket->Max = Max;
+  }
+  Bucket->Count += Count;
+  Bucket->Avg += Sum;
+}
+
+
+/**************************************************************************
+DOES:    Constructor - creates a reader without a log
+**************************************************************************/
+LOGREADER::LOGREADER
+  (
+  void
+  )
+{
+  LogName = NULL;
+  IndexName = NULL;
+  Image = NULL;
+  Length = 0;
+  Indexed = 0;
+  Mapping = NULL;
+#ifdef WIN32
+  File = INVALID_HANDLE_VALUE;
+  MappingHandle = NULL;
+#endif
+  Index = NULL;
+  NumBlocks = 0;
+  AllocatedBlocks = 0;
+  SavedBlocks = 0;
+  memset(Series, 0, sizeof(Series));
+  memset(SeriesList, 0, sizeof(SeriesList));
+  NumSeries = 0;
+}
+
+
+/**************************************************************************
+DOES:    Destructor - unmaps the log
+**************************************************************************/
+LOGREADER::~LOGREADER
+  (
+  void
+  )
+{
+  Close();
+}
+
+
+/**************************************************************************
+DOES:    Maps a log and loads its index. Blocks not yet in the index file
+         are indexed and added to it.
+RETURNS: TRUE for success, FALSE for error
+**************************************************************************/
+bool LOGREADER::Open
+  (
+  const char *FileName                                     // name of the log
+  )
+{
+  Close();
+
+  LogName = (char *)malloc(strlen(FileName) + 1);
+  IndexName = (char *)malloc(strlen(FileName) + strlen(LOGINDEX_EXTENSION) + 1);
+  if ((LogName == NULL) || (IndexName == NULL))
+  {
+    Close();
+    return FALSE;
+  }
+  strcpy(LogName, FileName);
+  strcpy(IndexName, FileName);
+  strcat(IndexName, LOGINDEX_EXTENSION);
+
+  if (!Map()) return FALSE;
+  if ((Length < DATALOG_MAGIC_LENGTH) || memcmp(Image, DATALOG_MAGIC, DATALOG_MAGIC_LENGTH))
+  {
+    fprintf(stderr, "ERROR: %s is not a process data log\n", FileName);
+    Close();
+    return FALSE;
+  }
+
+  LoadIndex();
+  IndexBlocks();
+  SaveIndex(SavedBlocks);
+  return TRUE;
+}
+
+
+/**************************************************************************
+DOES:    Maps the log again and indexes the blocks written meanwhile
+RETURNS: TRUE for success, FALSE for error
+**************************************************************************/
+bool LOGREADER::Refresh
+  (
+  void
+  )
+{
+  unsigned int s;
+
+  if (LogName == NULL) return FALSE;
+
+  Unmap();
+  if (!Map()) return FALSE;
+  if (Length < Indexed)
+  { // log was replaced, index it again
+    for (s = 0; s < NumSeries; s++)
+    {
+      free(SeriesList[s]->Blocks);
+      delete SeriesList[s];
+    }
+    memset(Series, 0, sizeof(Series));
+    NumSeries = 0;
+    NumBlocks = 0;
+    SavedBlocks = 0;
+    Indexed = DATALOG_MAGIC_LENGTH;
+  }
+  IndexBlocks();
+  SaveIndex(SavedBlocks);
+  return TRUE;
+}
+
+
+/**************************************************************************
+DOES:    Unmaps the log and drops the index
+RETURNS: Nothing
+**************************************************************************/
+void LOGREADER::Close
+  (
+  void
+  )
+{
+  unsigned int s;
+
+  Unmap();
+  for (s = 0; s < NumSeries; s++)
+  {
+    free(SeriesList[s]->Blocks);
+    delete SeriesList[s];
+  }
+  memset(Series, 0, sizeof(Series));
+  memset(SeriesList, 0, sizeof(SeriesList));
+  NumSeries = 0;
+  free(Index);
+  Index = NULL;
+  NumBlocks = 0;
+  AllocatedBlocks = 0;
+  SavedBlocks = 0;
+  Indexed = 0;
+  free(LogName);
+  LogName = NULL;
+  free(IndexName);
+  IndexName = NULL;
+}
+
+
+/**************************************************************************
+DOES:    Gets a series by its number
+RETURNS: TRUE for success, FALSE if there is no such series
+**************************************************************************/
+bool LOGREADER::GetSeries
+  (
+  unsigned int Number,                                     // 0 to GetSeriesCount() - 1
+  LOG_SERIES_INFO *Info                                    // location to store the series
+  ) const
+{
+  const SERIES *S;
+  unsigned long b;
+
+  if (Number >= NumSeries) return FALSE;
+  S = SeriesList[Number];
+  Info->NodeID = (UNSIGNED8)(S->Key >> 24);
+  Info->Index = (UNSIGNED16)(S->Key >> 8);
+  Info->Subindex = (UNSIGNED8)S->Key;
+  Info->Type = Index[S->Blocks[S->Count - 1]].Type;
+  Info->Blocks = S->Count;
+  Info->Samples = 0;
+  for (b = 0; b < S->Count; b++) Info->Samples += Index[S->Blocks[b]].Count;
+  Info->FirstTime = Index[S->Blocks[0]].FirstTime;
+  Info->LastTime = Index[S->Blocks[S->Count - 1]].LastTime;
+  return TRUE;
+}
+
+
+/**************************************************************************
+DOES:    Gets the samples of a series in a time range, oldest first,
+         skipping samples at From returned by the query before
+RETURNS: Number of samples stored
+**************************************************************************/
+unsigned long LOGREADER::Query
+  (
+  UNSIGNED8 NodeID,                                        // node id
+  UNSIGNED16 Index,                                        // index of od entry
+  UNSIGNED8 Subindex,                                      // subindex of od entry
+  uint64_t From,                                           // first time, us since 1970
+  unsigned long Skip,                                      // samples at From already returned
+  uint64_t To,                                             // last time
+  LOG_SAMPLE *Samples,                                     // location to store the samples
+  unsigned long MaxSamples                                 // max samples to store
+  ) const
+{
+  const SERIES *S = FindSeries(SERIES_KEY(NodeID, Index, Subindex));
+  uint64_t Times[DATALOG_BLOCK_SAMPLES];
+  uint64_t Values[DATALOG_BLOCK_SAMPLES];
+  const LOG_BLOCK *B;
+  unsigned long Stored = 0;
+  unsigned long b;
+  unsigned int Count;
+  unsigned int s;
+
+  if ((S == NULL) || (From > To)) return 0;
+
+  for (b = FindBlock(S, From); (b < S->Count) && (Stored < MaxSamples); b++)
+  {
+    B = &this->Index[S->Blocks[b]];
+    if (B->FirstTime > To) break;
+    Count = DecodeBlock(&Image[B->Offset], Length - B->Offset, Times, Values);
+    for (s = 0; (s < Count) && (Stored < MaxSamples); s++)
+    {
+      if ((Times[s] < From) || (Times[s] > To)) continue;
+      if ((Times[s] == From) && Skip)
+      {
+        Skip--;
+        continue;
+      }
+      Samples[Stored].Time = Times[s];
+      Samples[Stored].Value = ToDouble(Values[s], B->Length, B->Type);
+      Stored++;
+    }
+  }
+  return Stored;
+}
+
+
+/**************************************************************************
+DOES:    Downsamples a series in a time range to buckets of equal time.
+         Blocks within a bucket are taken from the index, only the others
+         are decoded.
+RETURNS: Number of buckets stored
+**************************************************************************/
+unsigned int LOGREADER::Rollup
+  (
+  UNSIGNED8 NodeID,                                        // node id
+  UNSIGNED16 Index,                                        // index of od entry
+  UNSIGNED8 Subindex,                                      // subindex of od entry
+  uint64_t From,                                           // first time, us since 1970
+  uint64_t To,                                             // last time
+  unsigned int Buckets,                                    // number of buckets
+  LOG_ROLLUP *Results                                      // location to store the buckets
+  ) const
+{
+  const SERIES *S = FindSeries(SERIES_KEY(NodeID, Index, Subindex));
+  uint64_t Times[DATALOG_BLOCK_SAMPLES];
+  uint64_t Values[DATALOG_BLOCK_SAMPLES];
+  const LOG_BLOCK *B;
+  uint64_t Width;
+  unsigned long b;
+  unsigned int Count;
+  unsigned int s;
+  double Value;
+
+  if ((Buckets == 0) || (From > To)) return 0;
+
+  // the last bucket may be shorter, all times of the range fit
+  Width = (To - From) / Buckets + 1;
+  for (s = 0; s < Buckets; s++)
+  {
+    Results[s].Start = From + s * Width;
+    Results[s].Count = 0;
+    Results[s].Min = 0;
+    Results[s].Max = 0;
+    Results[s].Avg = 0;
+  }
+  if (S == NULL) return Buckets;
+
+  for (b = FindBlock(S, From); b < S->Count; b++)
+  {
+    B = &this->Index[S->Blocks[b]];
+    if (B->FirstTime > To) break;
+    if ((B->FirstTime >= From) && (B->LastTime <= To) &&
+        ((B->FirstTime - From) / Width == (B->LastTime - From) / Width))
+    { // block within a bucket
+      AddToBucket(&Results[(B->FirstTime - From) / Width], B->Count, B->Min, B->Max, B->Sum);
+      continue;
+    }
+    Count = DecodeBlock(&Image[B->Offset], Length - B->Offset, Times, Values);
+    for (s = 0; s < Count; s++)
+    {
+      if ((Times[s] < From) || (Times[s] > To)) continue;
+      Value = ToDouble(Values[s], B->Length, B->Type);
+      AddToBucket(&Results[(Times[s] - From) / Width], 1, Value, Value, Value);
+    }
+  }
+
+  for (s = 0; s < Buckets; s++)
+  {
+    if (Results[s].Count) Results[s].Avg /= (double)Results[s].Count;
+  }
+  return Buckets;
+}
+
+
+/**************************************************************************
+DOES:    Decodes a block of the log
+RETURNS: Number of samples, 0 if the block is damaged
+**************************************************************************/
+unsigned int LOGREADER::DecodeBlock
+  (
+  const unsigned char *Block,                              // block header and encoded samples
+  uint64_t Available,                                      // bytes from the block to the end of the log
+  uint64_t *Times,                                         // location to store DATALOG_BLOCK_SAMPLES times
+  uint64_t *Values                                         // location to store DATALOG_BLOCK_SAMPLES values
+  )
+{
+  BITS In;
+  bool Valid = TRUE;
+  unsigned int Count;
+  unsigned int Lead = 64;                                  // none yet
+  unsigned int Trail = 0;
+  unsigned int Bits;
+  uint64_t Delta = 0;
+  uint64_t Z;
+  unsigned int s;
+
+  if (Available < DATALOG_BLOCK_HEADER) return 0;
+  if (LoadLE(&Block[0], 2) != DATALOG_BLOCK_MAGIC) return 0;
+  Count = (unsigned int)LoadLE(&Block[10], 2);
+  if ((Count == 0) || (Count > DATALOG_BLOCK_SAMPLES)) return 0;
+  In.Data = &Block[DATALOG_BLOCK_HEADER];
+  In.Bits = 0;
+  In.Length = (unsigned long)LoadLE(&Block[12], 2) * 8;
+  if (DATALOG_BLOCK_HEADER + In.Length / 8 > Available) return 0;
+
+  Times[0] = LoadLE(&Block[14], 8);
+  for (s = 1; s < Count; s++)
+  {
+    switch (GetPrefix(&In, &Valid))
+    {
+      case 0: Z = 0; break;
+      case 1: Z = GetBits(&In, 7, &Valid); break;
+      case 2: Z = GetBits(&In, 12, &Valid); break;
+      case 3: Z = GetBits(&In, 20, &Valid); break;
+      default: Z = GetBits(&In, 64, &Valid); break;
+    }
+    Delta += UnZigZag(Z);
+    Times[s] = Times[s - 1] + Delta;
+  }
+  if (Times[Count - 1] != LoadLE(&Block[22], 8)) return 0;
+
+  Values[0] = LoadLE(&Block[30], 8);
+  if (Block[8] == DATALOG_ENC_XOR)
+  {
+    for (s = 1; s < Count; s++)
+    {
+      if (GetBits(&In, 1, &Valid) == 0) Z = 0;
+      else if (GetBits(&In, 1, &Valid) == 0)
+      { // bits of the last value stored
+        if (Lead == 64) return 0;
+        Z = GetBits(&In, 64 - Lead - Trail, &Valid) << Trail;
+      }
+      else
+      {
+        Lead = (unsigned int)GetBits(&In, 5, &Valid);
+        Bits = (unsigned int)GetBits(&In, 6, &Valid) + 1;
+        if (Lead + Bits > 64) return 0;
+        Trail = 64 - Lead - Bits;
+        Z = GetBits(&In, Bits, &Valid) << Trail;
+      }
+      Values[s] = Values[s - 1] ^ Z;
+    }
+  }
+  else if (Block[8] == DATALOG_ENC_DELTA)
+  {
+    Delta = 0;
+    for (s = 1; s < Count; s++)
+    {
+      switch (GetPrefix(&In, &Valid))
+      {
+        case 0: Z = 0; break;
+        case 1: Z = GetBits(&In, 8, &Valid); break;
+        case 2: Z = GetBits(&In, 16, &Valid); break;
+        case 3: Z = GetBits(&In, 32, &Valid); break;
+        default: Z = GetBits(&In, 64, &Valid); break;
+      }
+      Delta += UnZigZag(Z);
+      Values[s] = Values[s - 1] + Delta;
+    }
+  }
+  else return 0;
+
+  return Valid ? Count : 0;
+}
+
+
+/**************************************************************************
+DOES:    Converts a value of the log by the type of its series
+RETURNS: Value
+**************************************************************************/
+double LOGREADER::ToDouble
+  (
+  uint64_t Value,                                          // value, little endian bytes
+  UNSIGNED8 Length,                                        // value length, 1 to 8
+  UNSIGNED8 Type                                           // DATALOG_TYPE_xxx
+  )
+{
+  uint32_t Real32;
+  float Float;
+  double Double;
+
+  if ((Type == DATALOG_TYPE_REAL) && (Length == 4))
+  {
+    Real32 = (uint32_t)Value;
+    memcpy(&Float, &Real32, sizeof(Float));
+    return Float;
+  }
+  if ((Type == DATALOG_TYPE_REAL) && (Length == 8))
+  {
+    memcpy(&Double, &Value, sizeof(Double));
+    return Double;
+  }
+  if ((Type == DATALOG_TYPE_SIGNED) && (Length >= 1) && (Length < 8))
+  {
+    if (Value & (1ULL << (Length * 8 - 1))) Value |= ~0ULL << (Length * 8);
+  }
+  if (Type == DATALOG_TYPE_SIGNED) return (double)(int64_t)Value;
+  return (double)Value;
+}
+
+
+/**************************************************************************
+DOES:    Memory maps the log
+RETURNS: TRUE for success, FALSE for error
+**************************************************************************/
+bool LOGREADER::Map
+  (
+  void
+  )
+{
+#ifdef WIN32
+  LARGE_INTEGER Size;
+
+  // the log may still be written
+  File = CreateFileA(LogName, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (File == INVALID_HANDLE_VALUE)
+  {
+    fprintf(stderr, "ERROR: %lu opening %s\n", GetLastError(), LogName);
+    return FALSE;
+  }
+  if (!GetFileSizeEx(File, &Size) || (Size.QuadPart == 0))
+  {
+    fprintf(stderr, "ERROR: %s is not a process data log\n", LogName);
+    Unmap();
+    return FALSE;
+  }
+  MappingHandle = CreateFileMapping(File, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (MappingHandle)
+  {
+    Mapping = MapViewOfFile(MappingHandle, FILE_MAP_READ, 0, 0, 0);
+  }
+  if (!Mapping)
+  {
+    fprintf(stderr, "ERROR: %lu mapping %s\n", GetLastError(), LogName);
+    Unmap();
+    return FALSE;
+  }
+  Length = (uint64_t)Size.QuadPart;
+#else
+  struct stat st;
+  int fd = open(LogName, O_RDONLY);
+
+  if (fd < 0)
+  {
+    fprintf(stderr, "ERROR: %d opening %s: %s\n", errno, LogName, strerror(errno));
+    return FALSE;
+  }
+  if ((fstat(fd, &st) != 0) || (st.st_size == 0))
+  {
+    fprintf(stderr, "ERROR: %s is not a process data log\n", LogName);
+    close(fd);
+    return FALSE;
+  }
+  Mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // the mapping stays valid after the descriptor is closed
+  close(fd);
+  if (Mapping == MAP_FAILED)
+  {
+    fprintf(stderr, "ERROR: %d mapping %s: %s\n", errno, LogName, strerror(errno));
+    Mapping = NULL;
+    return FALSE;
+  }
+  Length = (uint64_t)st.st_size;
+#endif
+
+  Image = (const unsigned char *)Mapping;
+  return TRUE;
+}
+
+
+/**************************************************************************
+DOES:    Unmaps the log, the index is kept
+RETURNS: Nothing
+**************************************************************************/
+void LOGREADER::Unmap
+  (
+  void
+  )
+{
+#ifdef WIN32
+  if (Mapping) UnmapViewOfFile(Mapping);
+  if (MappingHandle) CloseHandle(MappingHandle);
+  if (File != INVALID_HANDLE_VALUE) CloseHandle(File);
+  MappingHandle = NULL;
+  File = INVALID_HANDLE_VALUE;
+#else
+  if (Mapping) munmap(Mapping, Length);
+#endif
+  Mapping = NULL;
+  Image = NULL;
+  Length = 0;
+}
+
+
+/**************************************************************************
+DOES:    Loads the index file if it belongs to the log. Otherwise the log
+         is indexed from its start.
+RETURNS: Nothing
+**************************************************************************/
+void LOGREADER::LoadIndex
+  (
+  void
+  )
+{
+  unsigned char Header[LOGINDEX_HEADER];
+  const unsigned char *Block;
+  const LOG_BLOCK *Last;
+  FILE *IndexFile;
+  uint64_t Size;
+  uint32_t EntrySize;
+  long FileLength;
+  unsigned long Count;
+  unsigned long e;
+
+  NumBlocks = 0;
+  SavedBlocks = 0;
+  Indexed = DATALOG_MAGIC_LENGTH;
+
+  IndexFile = fopen(IndexName, "rb");
+  if (IndexFile == NULL) return;
+  fseek(IndexFile, 0, SEEK_END);
+  FileLength = ftell(IndexFile);
+  fseek(IndexFile, 0, SEEK_SET);
+  if ((FileLength < LOGINDEX_HEADER) ||
+      (fread(Header, 1, sizeof(Header), IndexFile) != sizeof(Header)) ||
+      memcmp(Header, LOGINDEX_MAGIC, LOGINDEX_MAGIC_LENGTH))
+  {
+    fclose(IndexFile);
+    return;
+  }
+  memcpy(&Size, &Header[8], sizeof(Size));
+  memcpy(&EntrySize, &Header[16], sizeof(EntrySize));
+  if ((EntrySize != sizeof(LOG_BLOCK)) || (Size < DATALOG_MAGIC_LENGTH) || (Size > Length))
+  {
+    fclose(IndexFile);
+    return;
+  }
+
+  Count = (unsigned long)((FileLength - LOGINDEX_HEADER) / sizeof(LOG_BLOCK));
+  Index = (LOG_BLOCK *)malloc((Count + INDEX_GROWTH) * sizeof(LOG_BLOCK));
+  if (Index == NULL)
+  {
+    fclose(IndexFile);
+    return;
+  }
+  AllocatedBlocks = Count + INDEX_GROWTH;
+  if (fread(Index, sizeof(LOG_BLOCK), Count, IndexFile) != Count) Count = 0;
+  fclose(IndexFile);
+
+  // the last block indexed must be the one in the log
+  if (Count)
+  {
+    Last = &Index[Count - 1];
+    if ((Last->Offset < DATALOG_MAGIC_LENGTH) || (Last->Offset + DATALOG_BLOCK_HEADER > Size)) return;
+    Block = &Image[Last->Offset];
+    if ((LoadLE(&Block[0], 2) != DATALOG_BLOCK_MAGIC) ||
+        (LoadLE(&Block[10], 2) != Last->Count) ||
+        (LoadLE(&Block[14], 8) != Last->FirstTime) ||
+        (SERIES_KEY(Block[2], LoadLE(&Block[4], 2), Block[3]) != Last->Key) ||
+        (Last->Offset + DATALOG_BLOCK_HEADER + LoadLE(&Block[12], 2) != Size)) return;
+  }
+  else if (Size != DATALOG_MAGIC_LENGTH) return;
+
+  for (e = 1; e < Count; e++)
+  {
+    if (Index[e].Offset <= Index[e - 1].Offset) return;
+  }
+  for (e = 0; e < Count; e++) AddToSeries(e);
+  NumBlocks = Count;
+  SavedBlocks = Count;
+  Indexed = Size;
+}
+
+
+/**************************************************************************
+DOES:    Searches the next block after damaged data, a valid header whose
+         samples can be decoded
+RETURNS: Offset of the block, 0 if there is none
+**************************************************************************/
+uint64_t LOGREADER::FindNextBlock
+  (
+  uint64_t From,                                           // first offset to check
+  uint64_t To,                                             // offset after the last one to check
+  uint64_t *Times,                                         // location to decode DATALOG_BLOCK_SAMPLES times
+  uint64_t *Values                                         // location to decode DATALOG_BLOCK_SAMPLES values
+  ) const
+{
+  unsigned long Size;
+  uint64_t Offset;
+
+  for (Offset = From; (Offset < To) && (Offset + DATALOG_BLOCK_HEADER <= Length); Offset++)
+  {
+    // quick check of the magic first
+    if ((Image[Offset] != (DATALOG_BLOCK_MAGIC & 0xFF)) || (Image[Offset + 1] != (DATALOG_BLOCK_MAGIC >> 8))) continue;
+    Size = DATALOG::CheckBlock(&Image[Offset]);
+    if (Size && (Offset + Size <= Length) && DecodeBlock(&Image[Offset], Length - Offset, Times, Values)) return Offset;
+  }
+  return 0;
+}
+
+
+/**************************************************************************
+DOES:    Indexes the blocks of the log after the ones indexed. Damaged data,
+         e.g. a block cut off by a power failure and followed by the blocks
+         written after it, is skipped. Stops at a block not completely
+         written yet.
+RETURNS: Nothing
+**************************************************************************/
+void LOGREADER::IndexBlocks
+  (
+  void
+  )
+{
+  uint64_t *Times = new uint64_t[DATALOG_BLOCK_SAMPLES];
+  uint64_t *Values = new uint64_t[DATALOG_BLOCK_SAMPLES];
+  const unsigned char *Block;
+  LOG_BLOCK *B;
+  LOG_BLOCK *Grown;
+  unsigned long Size;
+  uint64_t Next;
+  unsigned int Count;
+  unsigned int s;
+  double Value;
+
+  while (Indexed + DATALOG_BLOCK_HEADER <= Length)
+  {
+    Block = &Image[Indexed];
+    Size = DATALOG::CheckBlock(Block);
+    Count = 0;
+    if (Size && (Indexed + Size <= Length))
+    {
+      Count = DecodeBlock(Block, Length - Indexed, Times, Values);
+      // a cut off block may decode with the data written after it, it is
+      // damaged if no valid header follows and a block starts inside it
+      if (Count && (Indexed + Size + DATALOG_BLOCK_HEADER <= Length) && !DATALOG::CheckBlock(&Image[Indexed + Size]))
+      {
+        if (FindNextBlock(Indexed + 1, Indexed + Size, Times, Values)) Count = 0;
+        else Count = DecodeBlock(Block, Length - Indexed, Times, Values);
+      }
+    }
+    if (Count == 0)
+    {
+      // nothing valid after it, the block is still written
+      Next = FindNextBlock(Indexed + 1, Length, Times, Values);
+      if (Next == 0) break;
+      fprintf(stderr, "ERROR: damaged data at %llu to %llu of %s skipped\n", (unsigned long long)Indexed,
+        (unsigned long long)Next, LogName);
+      Indexed = Next;
+      continue;
+    }
+
+    if (NumBlocks == AllocatedBlocks)
+    {
+      Grown = (LOG_BLOCK *)realloc(Index, (AllocatedBlocks + INDEX_GROWTH) * sizeof(LOG_BLOCK));
+      if (Grown == NULL) break;
+      Index = Grown;
+      AllocatedBlocks += INDEX_GROWTH;
+    }
+    B = &Index[NumBlocks];
+    memset(B, 0, sizeof(LOG_BLOCK));
+    B->Offset = Indexed;
+    B->FirstTime = Times[0];
+    B->LastTime = Times[Count - 1];
+    B->Key = SERIES_KEY(Block[2], LoadLE(&Block[4], 2), Block[3]);
+    B->Count = (UNSIGNED16)Count;
+    B->Length = Block[6];
+    B->Type = Block[7];
+    for (s = 0; s < Count; s++)
+    {
+      Value = ToDouble(Values[s], B->Length, B->Type);
+      if ((s == 0) || (Value < B->Min)) B->Min = Value;
+      if ((s == 0) || (Value > B->Max)) B->Max = Value;
+      B->Sum += Value;
+    }
+    // blocks of too many series stay in the index file but are not found
+    AddToSeries(NumBlocks);
+    NumBlocks++;
+    Indexed += Size;
+  }
+
+  delete[] Times;
+  delete[] Values;
+}
+
+
+/**************************************************************************
+DOES:    Appends the blocks indexed to the index file, writes it again if
+         First is 0. The index stays in memory only if the file can not be
+         written.
+RETURNS: Nothing
+**************************************************************************/
+void LOGREADER::SaveIndex
+  (
+  unsigned long First                                      // first entry not in the file
+  )
+{
+  unsigned char Header[LOGINDEX_HEADER];
+  uint32_t EntrySize = sizeof(LOG_BLOCK);
+  FILE *IndexFile;
+  bool Success;
+
+  if ((First == NumBlocks) && (First != 0)) return;
+
+  IndexFile = fopen(IndexName, (First == 0) ? "wb" : "r+b");
+  if (IndexFile == NULL) return;
+
+  memcpy(&Header[0], LOGINDEX_MAGIC, LOGINDEX_MAGIC_LENGTH);
+  memcpy(&Header[8], &Indexed, sizeof(Indexed));
+  memcpy(&Header[16], &EntrySize, sizeof(EntrySize));
+  // entries first, the header tells the length of the log they cover
+  Success = (fseek(IndexFile, LOGINDEX_HEADER + First * sizeof(LOG_BLOCK), SEEK_SET) == 0) &&
+            (fwrite(&Index[First], sizeof(LOG_BLOCK), NumBlocks - First, IndexFile) == NumBlocks - First) &&
+            (fseek(IndexFile, 0, SEEK_SET) == 0) &&
+            (fwrite(Header, 1, sizeof(Header), IndexFile) == sizeof(Header));
+  if (fclose(IndexFile) != 0) Success = FALSE;
+  if (Success) SavedBlocks = NumBlocks;
+}
+
+
+/**************************************************************************
+DOES:    Adds an entry of the index to its series, the series is created
+         when first seen
+RETURNS: TRUE for success, FALSE if there are too many series
+**************************************************************************/
+bool LOGREADER::AddToSeries
+  (
+  unsigned long Entry                                      // entry of Index
+  )
+{
+  uint32_t Key = Index[Entry].Key;
+  unsigned int Slot = SERIES_SLOT(Key);
+  unsigned long *Grown;
+  SERIES *S;
+  unsigned int Probe;
+
+  for (Probe = 0; Probe < DATALOG_MAX_SERIES; Probe++, Slot = (Slot + 1) & (DATALOG_MAX_SERIES - 1))
+  {
+    if ((Series[Slot] == NULL) || (Series[Slot]->Key == Key)) break;
+  }
+  if (Probe == DATALOG_MAX_SERIES) return FALSE;
+  if (Series[Slot] == NULL)
+  {
+    S = new SERIES;
+    S->Key = Key;
+    S->Count = 0;
+    S->Allocated = 0;
+    S->Blocks = NULL;
+    Series[Slot] = S;
+    SeriesList[NumSeries++] = S;
+  }
+  S = Series[Slot];
+  if (S->Count == S->Allocated)
+  {
+    Grown = (unsigned long *)realloc(S->Blocks, (S->Allocated + SERIES_GROWTH) * sizeof(unsigned long));
+    if (Grown == NULL) return FALSE;
+    S->Blocks = Grown;
+    S->Allocated += SERIES_GROWTH;
+  }
+  S->Blocks[S->Count++] = Entry;
+  return TRUE;
+}
+
+
+/**************************************************************************
+DOES:    Finds a series by its key
+RETURNS: Series, NULL if not in the log
+**************************************************************************/
+const LOGREADER::SERIES *LOGREADER::FindSeries
+  (
+  uint32_t Key                                             // node id, index and subindex
+  ) const
+{
+  unsigned int Slot = SERIES_SLOT(Key);
+  unsigned int Probe;
+
+  for (Probe = 0; Probe < DATALOG_MAX_SERIES; Probe++, Slot = (Slot + 1) & (DATALOG_MAX_SERIES - 1))
+  {
+    if (Series[Slot] == NULL) return NULL;
+    if (Series[Slot]->Key == Key) return Series[Slot];
+  }
+  return NULL;
+}
+
+
+/**************************************************************************
+DOES:    Finds the first block of a series ending at or after a time
+RETURNS: Block of the series, S->Count if none
+**************************************************************************/
+unsigned long LOGREADER::FindBlock
+  (
+  const SERIES *S,                                         // series
+  uint64_t From                                            // time, us since 1970
+  ) const
+{
+  unsigned long Low = 0;
+  unsigned long High = S->Count;
+  unsigned long Middle;
+
+  while (Low < High)
+  {
+    Middle = Low + (High - Low) / 2;
+    if (Index[S->Blocks[Middle]].LastTime < From) Low = Middle + 1;
+    else High = Middle;
+  }
+  return Low;
+}
+
+/*----------------------- END OF FILE ----------------------------------*/
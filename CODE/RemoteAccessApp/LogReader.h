@@ -0,0 +1,227 @@
+/**************************************************************************
+MODULE:    LogReader
+CONTAINS:  Queries of a process data log written by DATALOG. The log is
+           memory mapped, only the blocks of the series and time range
+           asked for are decoded. The index lists the blocks of each
+           series with their time range and the min, max and sum of
+           their values, so downsampled views of long ranges use the
+           blocks as they are and only decode those at the edges of a
+           bucket. The index is kept next to the log as <log>.idx and
+           only blocks written since it was saved are read at Open.
+           The times of a series must increase through the log.
+           Index file, host byte order, rebuilt when it does not fit:
+             header  "COIAIDX1"
+                     8 bytes  length of the log indexed
+                     4 bytes  size of an entry
+             entries LOG_BLOCK, one per block in the order of the log
+COPYRIGHT: Embedded Systems Academy, Inc. 2008-2017.
+DISCLAIM:  Read and understand our disclaimer before using this code!
+           www.esacademy.com/disclaim.htm
+           This software was written in accordance to the guidelines at
+           www.esacademy.com/software/softwarestyleguide.pdf
+LICENSE:   Free to use with licensed CANopenIA chips, modules or devices
+           like CANgineBerry, CANgineXXX and 447izer
+VERSION:   1.10, EmSA 10-NOV-17
+           $LastChangedDate: 2014-01-11 17:30:59 +0100 (Sa, 11 Jan 2014) $
+           $LastChangedRevision: 1702 $
+***************************************************************************/
+#pragma once
+
+#ifndef _LOGREADER_H
+#define _LOGREADER_H
+
+#include <stdint.h>
+#include "global.h"
+#include "DataLog.h"
+
+/**************************************************************************
+GLOBAL DEFINES
+***************************************************************************/
+
+// start of an index file
+#define LOGINDEX_MAGIC        "COIAIDX1"
+#define LOGINDEX_MAGIC_LENGTH 8
+#define LOGINDEX_HEADER       20
+
+// extension of the index file
+#define LOGINDEX_EXTENSION ".idx"
+
+/**************************************************************************
+GLOBAL TYPES AND FUNCTIONS
+***************************************************************************/
+
+// a block of the log as indexed
+typedef struct
+{
+  uint64_t Offset;                          // of the block in the log
+  uint64_t FirstTime;                       // us since 1970
+  uint64_t LastTime;
+  double Min;                               // rollup of the values
+  double Max;
+  double Sum;
+  uint32_t Key;                             // node id, index and subindex
+  UNSIGNED16 Count;                         // samples
+  UNSIGNED8 Type;                           // DATALOG_TYPE_xxx
+  UNSIGNED8 Length;                         // value length
+} LOG_BLOCK;
+
+// a sample of a query
+typedef struct
+{
+  uint64_t Time;                            // us since 1970
+  double Value;                             // value by the type of the series
+} LOG_SAMPLE;
+
+// a bucket of a downsampled range
+typedef struct
+{
+  uint64_t Start;                           // us since 1970, first time of the bucket
+  uint64_t Count;                           // samples, 0 if none
+  double Min;
+  double Max;
+  double Avg;
+} LOG_ROLLUP;
+
+// a series of the log
+typedef struct
+{
+  UNSIGNED8 NodeID;
+  UNSIGNED8 Subindex;
+  UNSIGNED16 Index;
+  UNSIGNED8 Type;                           // DATALOG_TYPE_xxx of the last block
+  unsigned long Blocks;
+  uint64_t Samples;
+  uint64_t FirstTime;                       // us since 1970
+  uint64_t LastTime;
+} LOG_SERIES_INFO;
+
+class LOGREADER
+{
+  // blocks of a series in the order of the log
+  typedef struct
+  {
+    uint32_t Key;
+    unsigned long Count;
+    unsigned long Allocated;
+    unsigned long *Blocks;                  // entries of Index
+  } SERIES;
+
+  public:
+    /**************************************************************************
+    DOES:    Constructor - creates a reader without a log
+    **************************************************************************/
+    LOGREADER(void);
+    /**************************************************************************
+    DOES:    Destructor - unmaps the log
+    **************************************************************************/
+    ~LOGREADER(void);
+    /**************************************************************************
+    DOES:    Maps a log and loads its index. Blocks not yet in the index
+             file are indexed and added to it.
+    RETURNS: TRUE for success, FALSE for error
+    **************************************************************************/
+    bool Open(const char *FileName);
+    /**************************************************************************
+    DOES:    Maps the log again and indexes the blocks written meanwhile,
+             e.g. while the log is still written
+    RETURNS: TRUE for success, FALSE for error
+    **************************************************************************/
+    bool Refresh(void);
+    /**************************************************************************
+    DOES:    Unmaps the log and drops the index
+    RETURNS: Nothing
+    **************************************************************************/
+    void Close(void);
+    /**************************************************************************
+    DOES:    Gets the number of series, in the order first seen in the log
+    RETURNS: Number of series
+    **************************************************************************/
+    unsigned int GetSeriesCount(void) const { return NumSeries; }
+    /**************************************************************************
+    DOES:    Gets a series by its number
+    RETURNS: TRUE for success, FALSE if there is no such series
+    **************************************************************************/
+    bool GetSeries(
+      unsigned int Number,        // 0 to GetSeriesCount() - 1
+      LOG_SERIES_INFO *Info       // location to store the series
+      ) const;
+    /**************************************************************************
+    DOES:    Gets the samples of a series in a time range, oldest first.
+             Further samples are got with From the time of the last one
+             and Skip the number of samples returned at that time, so
+             samples sharing a time are not lost between two queries.
+    RETURNS: Number of samples stored
+    **************************************************************************/
+    unsigned long Query(
+      UNSIGNED8 NodeID,           // node id
+      UNSIGNED16 Index,           // index of od entry
+      UNSIGNED8 Subindex,         // subindex of od entry
+      uint64_t From,              // first time, us since 1970
+      unsigned long Skip,         // samples at From already returned
+      uint64_t To,                // last time
+      LOG_SAMPLE *Samples,        // location to store the samples
+      unsigned long MaxSamples    // max samples to store
+      ) const;
+    /**************************************************************************
+    DOES:    Downsamples a series in a time range to buckets of equal time,
+             with count, min, max and average of each
+    RETURNS: Number of buckets stored
+    **************************************************************************/
+    unsigned int Rollup(
+      UNSIGNED8 NodeID,           // node id
+      UNSIGNED16 Index,           // index of od entry
+      UNSIGNED8 Subindex,         // subindex of od entry
+      uint64_t From,              // first time, us since 1970
+      uint64_t To,                // last time
+      unsigned int Buckets,       // number of buckets
+      LOG_ROLLUP *Results         // location to store the buckets
+      ) const;
+    /**************************************************************************
+    DOES:    Decodes a block of the log
+    RETURNS: Number of samples, 0 if the block is damaged
+    **************************************************************************/
+    static unsigned int DecodeBlock(
+      const unsigned char *Block, // block header and encoded samples
+      uint64_t Available,         // bytes from the block to the end of the log
+      uint64_t *Times,            // location to store DATALOG_BLOCK_SAMPLES times
+      uint64_t *Values            // location to store DATALOG_BLOCK_SAMPLES values
+      );
+    /**************************************************************************
+    DOES:    Converts a value of the log by the type of its series
+    RETURNS: Value
+    **************************************************************************/
+    static double ToDouble(uint64_t Value, UNSIGNED8 Length, UNSIGNED8 Type);
+
+  private:
+    bool Map(void);
+    void Unmap(void);
+    void LoadIndex(void);
+    void IndexBlocks(void);
+    uint64_t FindNextBlock(uint64_t From, uint64_t To, uint64_t *Times, uint64_t *Values) const;
+    void SaveIndex(unsigned long First);
+    bool AddToSeries(unsigned long Entry);
+    const SERIES *FindSeries(uint32_t Key) const;
+    unsigned long FindBlock(const SERIES *S, uint64_t From) const;
+
+    char *LogName;
+    char *IndexName;
+    const unsigned char *Image;
+    uint64_t Length;                          // of the mapping
+    uint64_t Indexed;                         // bytes of the log in the index
+    void *Mapping;
+#ifdef WIN32
+    HANDLE File;
+    HANDLE MappingHandle;
+#endif
+    LOG_BLOCK *Index;
+    unsigned long NumBlocks;
+    unsigned long AllocatedBlocks;
+    unsigned long SavedBlocks;                // entries in the index file
+    SERIES *Series[DATALOG_MAX_SERIES];       // by hash of their key
+    SERIES *SeriesList[DATALOG_MAX_SERIES];   // in the order first seen
+    unsigned int NumSeries;
+};
+
+#endif // _LOGREADER_H
+
+/*----------------------- END OF FILE ----------------------------------*/
@@ -0,0 +1,444 @@
+/**************************************************************************
+MODULE:    NodeFlasher
+CONTAINS:  CiA 302-3 program download to remote nodes through many
+           devices at once. Each port is flashed by its own thread with its
+           own serial protocol, all threads stream from the same read-only
+           mapping of an image. The SDO client sends a burst of block
+           download segments, 16 by default, per back-to-back timeout in
+           one write to the serial port, so the bootloader writes pages
+           while the next segments are on their way. SetBlockBurst(1)
+           sends one segment at a time for devices that need it.
+COPYRIGHT: Embedded Systems Academy, Inc. 2008-2017.
+DISCLAIM:  Read and understand our disclaimer before using this code!
+           www.esacademy.com/disclaim.htm
+           This software was written in accordance to the guidelines at
+           www.esacademy.com/software/softwarestyleguide.pdf
+LICENSE:   Free to use with licensed CANopenIA chips, modules or devices
+           like CANgineBerry, CANgineXXX and 447izer
+VERSION:   1.10, EmSA 10-NOV-17
+           $LastChangedDate: 2014-01-11 17:30:59 +0100 (Sa, 11 Jan 2014) $
+           $LastChangedRevision: 1702 $
+***************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "NodeFlasher.h"
+#include "sdoclnt.h"
+#include "Timer.h"
+
+/**************************************************************************
+MODULE VARIABLES
+***************************************************************************/
+
+thread_local FLASH_PORT *NODEFLASHER::CurrentPort = NULL;
+
+
+/**************************************************************************
+DOES:    Constructor - creates a flasher without images and ports
+**************************************************************************/
+NODEFLASHER::NODEFLASHER
+  (
+  void
+  )
+{
+  NumImages = 0;
+  NumPorts = 0;
+  Baudrate = 115200;
+  LowLatency = FALSE;
+  Backend = SERIAL_BACKEND_SYSCALL;
+  BlockBurst = 0;
+  Start = TRUE;
+  pthread_mutex_init(&PrintLock, NULL);
+}
+
+
+/**************************************************************************
+DOES:    Destructor - releases the images
+**************************************************************************/
+NODEFLASHER::~NODEFLASHER
+  (
+  void
+  )
+{
+  int i;
+
+  for (i = 0; i < NumImages; i++)
+  {
+    munmap((void *)Images[i].Data, Images[i].Length);
+  }
+  pthread_mutex_destroy(&PrintLock);
+}
+
+
+/**************************************************************************
+DOES:    Maps an image file into memory, to be written to a program of
+         all ports. Images are written in the order added.
+RETURNS: TRUE for success, FALSE for error
+**************************************************************************/
+bool NODEFLASHER::AddImage
+  (
+  UNSIGNED8 Program,          // program number, FLASH_PROGRAM_xxx
+  const char *FileName        // image file
+  )
+{
+  FLASH_IMAGE *Image;
+  struct stat Status;
+  void *Data;
+  int File;
+
+  if (NumImages >= NODEFLASHER_MAX_IMAGES)
+  {
+    fprintf(stderr, "ERROR: too many images\n");
+    return FALSE;
+  }
+  File = open(FileName, O_RDONLY);
+  if (File < 0)
+  {
+    fprintf(stderr, "ERROR: %s: cannot open file\n", FileName);
+    return FALSE;
+  }
+  if ((fstat(File, &Status) != 0) || (Status.st_size == 0))
+  {
+    fprintf(stderr, "ERROR: %s: empty file\n", FileName);
+    close(File);
+    return FALSE;
+  }
+  // the mapping stays valid when the file is closed
+  Data = mmap(NULL, Status.st_size, PROT_READ, MAP_PRIVATE, File, 0);
+  close(File);
+  if (Data == MAP_FAILED)
+  {
+    fprintf(stderr, "ERROR: %s: cannot map file\n", FileName);
+    return FALSE;
+  }
+  madvise(Data, Status.st_size, MADV_SEQUENTIAL);
+
+  Image = &Images[NumImages++];
+  Image->FileName = FileName;
+  Image->Program = Program;
+  Image->Data = (const UNSIGNED8 *)Data;
+  Image->Length = Status.st_size;
+  Image->Verify = FALSE;
+  Image->Identification = 0;
+  return TRUE;
+}
+
+
+/**************************************************************************
+DOES:    Sets the software identification [1F56h] a program must have
+         after its image was written
+RETURNS: TRUE for success, FALSE if no image was added for the program
+**************************************************************************/
+bool NODEFLASHER::SetIdentification
+  (
+  UNSIGNED8 Program,          // program number of an image added
+  UNSIGNED32 Identification   // expected value of [1F56h]
+  )
+{
+  int i;
+
+  for (i = 0; i < NumImages; i++)
+  {
+    if (Images[i].Program != Program) continue;
+    Images[i].Verify = TRUE;
+    Images[i].Identification = Identification;
+    return TRUE;
+  }
+  fprintf(stderr, "ERROR: no image for program %u\n", Program);
+  return FALSE;
+}
+
+
+/**************************************************************************
+DOES:    Adds a port to flash
+RETURNS: TRUE for success, FALSE for error
+**************************************************************************/
+bool NODEFLASHER::AddPort
+  (
+  const char *PortName,       // serial port of the device
+  UNSIGNED8 NodeID            // node id of the bootloader, 1 to 127
+  )
+{
+  FLASH_PORT *Port;
+
+  if (NumPorts >= NODEFLASHER_MAX_PORTS)
+  {
+    fprintf(stderr, "ERROR: too many ports\n");
+    return FALSE;
+  }
+  if ((NodeID < 1) || (NodeID > 127))
+  {
+    fprintf(stderr, "ERROR: %s: invalid node id %u\n", PortName, NodeID);
+    return FALSE;
+  }
+  Port = &Ports[NumPorts++];
+  memset(Port, 0, sizeof(FLASH_PORT));
+  Port->Flasher = this;
+  strncpy(Port->PortName, PortName, sizeof(Port->PortName) - 1);
+  Port->NodeID = NodeID;
+  return TRUE;
+}
+
+
+/**************************************************************************
+DOES:    Flashes all images to all ports, the ports in parallel. A line
+         is printed as each port completes.
+RETURNS: TRUE if all ports were flashed, FALSE for errors
+**************************************************************************/
+bool NODEFLASHER::Run
+  (
+  void
+  )
+{
+  bool Success = TRUE;
+  int p;
+
+  for (p = 0; p < NumPorts; p++)
+  {
+    Ports[p].Success = FALSE;
+    Ports[p].Bytes = 0;
+    Ports[p].Duration = 0;
+    if (pthread_create(&Ports[p].Thread, NULL, PortThread, &Ports[p]) != 0)
+    {
+      fprintf(stderr, "ERROR: %s: creating thread\n", Ports[p].PortName);
+      Ports[p].Thread = 0;
+    }
+  }
+  for (p = 0; p < NumPorts; p++)
+  {
+    if (Ports[p].Thread) pthread_join(Ports[p].Thread, NULL);
+    if (!Ports[p].Success) Success = FALSE;
+  }
+  return Success;
+}
+
+
+/**************************************************************************
+DOES:    Gets the result of a port after Run
+RETURNS: Port or NULL if there is no such port
+**************************************************************************/
+const FLASH_PORT *NODEFLASHER::GetPort
+  (
+  int Port
+  ) const
+{
+  if ((Port < 0) || (Port >= NumPorts)) return NULL;
+  return &Ports[Port];
+}
+
+
+/**************************************************************************
+DOES:    Thread function, flashes one port and prints its result
+RETURNS: NULL
+**************************************************************************/
+void *NODEFLASHER::PortThread
+  (
+  void *Param                 // port to flash
+  )
+{
+  FLASH_PORT *Port = (FLASH_PORT *)Param;
+  NODEFLASHER *Flasher = Port->Flasher;
+  uint64_t StartTime = Timer::GetMicroseconds();
+
+  CurrentPort = Port;
+  Port->Success = Flasher->FlashPort(Port);
+  Port->Duration = Timer::GetMicroseconds() - StartTime;
+
+  pthread_mutex_lock(&Flasher->PrintLock);
+  printf("%s: %s, %lu bytes in %.2f s\n", Port->PortName, Port->Success ? "OK" : "FAILED",
+    Port->Bytes, Port->Duration / 1000000.0);
+  fflush(stdout);
+  pthread_mutex_unlock(&Flasher->PrintLock);
+  return NULL;
+}
+
+
+/**************************************************************************
+DOES:    Connects to a port, writes all images to the bootloader of its
+         node and starts the firmware
+RETURNS: TRUE for success, FALSE for error
+**************************************************************************/
+bool NODEFLASHER::FlashPort
+  (
+  FLASH_PORT *Port            // port to flash
+  )
+{
+  bool Success = TRUE;
+  int i;
+
+  Port->Protocol = new SerialProtocol();
+  Port->Protocol->SetLowLatency(LowLatency);
+  Port->Protocol->SetBackend(Backend);
+  if (BlockBurst) Port->Protocol->SetSdoBlockBurst(BlockBurst);
+  if (!Port->Protocol->Connect(Port->PortName, Baudrate))
+  {
+    fprintf(stderr, "ERROR: %s: cannot connect\n", Port->PortName);
+    delete Port->Protocol;
+    Port->Protocol = NULL;
+    return FALSE;
+  }
+  Port->Protocol->RegisterSDORequestCallbacks((SDOREQUESTCOMPLETECALLBACK *)SDORequestComplete);
+
+  for (i = 0; (i < NumImages) && Success; i++)
+  {
+    Success = FlashImage(Port, &Images[i]);
+  }
+  if (Success && Start && NumImages)
+  {
+    Success = Control(Port, Images[0].Program, FLASH_CONTROL_START);
+  }
+
+  Port->Protocol->RegisterSDORequestCallbacks(NULL);
+  Port->Protocol->Disconnect();
+  delete Port->Protocol;
+  Port->Protocol = NULL;
+  return Success;
+}
+
+
+/**************************************************************************
+DOES:    Writes one image: stops and clears the program, downloads the
+         image and checks flash status and, if set, the software
+         identification
+RETURNS: TRUE for success, FALSE for error
+**************************************************************************/
+bool NODEFLASHER::FlashImage
+  (
+  FLASH_PORT *Port,           // port to flash
+  const FLASH_IMAGE *Image    // image to write
+  )
+{
+  uint64_t Timeout;
+  uint64_t Segments;
+  uint64_t Bursts;
+  UNSIGNED32 Value;
+
+  if (!Control(Port, Image->Program, FLASH_CONTROL_STOP)) return FALSE;
+  if (!Control(Port, Image->Program, FLASH_CONTROL_CLEAR)) return FALSE;
+
+  // the SDO client sends straight from the mapping, the call-back ends it
+  Port->SdoCompleted = FALSE;
+  if (Port->Protocol->WriteRemoteODExtended(Port->NodeID, 0x1F50, Image->Program,
+    Image->Length, (unsigned char *)Image->Data) != ERROR_NOERROR)
+  {
+    fprintf(stderr, "ERROR: %s: cannot start download of %s\n", Port->PortName, Image->FileName);
+    return FALSE;
+  }
+  // the download is paced by the bursts of the SDO client and the baudrate
+  Segments = (Image->Length + FLASH_SEGMENT_DATA - 1) / FLASH_SEGMENT_DATA;
+  Bursts = (Segments + Port->Protocol->GetSdoBlockBurst() - 1) / Port->Protocol->GetSdoBlockBurst();
+  Timeout = Timer::GetMicroseconds() + FLASH_TIMEOUT + Bursts * FLASH_TIMEOUT_PER_BURST;
+  if (Baudrate) Timeout += Segments * FLASH_SEGMENT_BITS * 2 * 1000000UL / Baudrate;
+  while (!Port->SdoCompleted)
+  {
+    if (Timer::GetMicroseconds() >= Timeout)
+    {
+      fprintf(stderr, "ERROR: %s: download of %s timed out\n", Port->PortName, Image->FileName);
+      return FALSE;
+    }
+    Port->Protocol->Process();
+  }
+  if (Port->SdoResult != SDOERR_OK)
+  {
+    fprintf(stderr, "ERROR: %s: download of %s failed, 0x%08lX\n", Port->PortName,
+      Image->FileName, (unsigned long)Port->SdoResult);
+    return FALSE;
+  }
+  Port->Bytes += Image->Length;
+
+  if (!ReadStatus(Port, 0x1F57, Image->Program, &Value)) return FALSE;
+  if (Value != 0)
+  {
+    fprintf(stderr, "ERROR: %s: flash status of program %u is 0x%08lX\n", Port->PortName,
+      Image->Program, (unsigned long)Value);
+    return FALSE;
+  }
+  if (Image->Verify)
+  {
+    if (!ReadStatus(Port, 0x1F56, Image->Program, &Value)) return FALSE;
+    if (Value != Image->Identification)
+    {
+      fprintf(stderr, "ERROR: %s: verification of %s failed, identification 0x%08lX, expected 0x%08lX\n",
+        Port->PortName, Image->FileName, (unsigned long)Value, (unsigned long)Image->Identification);
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+
+/**************************************************************************
+DOES:    Writes a command to the program control [1F51h]
+RETURNS: TRUE for success, FALSE for error
+**************************************************************************/
+bool NODEFLASHER::Control
+  (
+  FLASH_PORT *Port,           // port to flash
+  UNSIGNED8 Program,          // program number
+  UNSIGNED8 Command           // FLASH_CONTROL_xxx
+  )
+{
+  unsigned long Result;
+
+  Result = Port->Protocol->WriteRemoteOD(Port->NodeID, 0x1F51, Program, 1, &Command);
+  if (Result != ERROR_NOERROR)
+  {
+    fprintf(stderr, "ERROR: %s: program control %u of program %u failed, 0x%08lX\n",
+      Port->PortName, Command, Program, Result);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+
+/**************************************************************************
+DOES:    Reads a 32-bit entry of a program, flash status or software
+         identification
+RETURNS: TRUE for success, FALSE for error
+**************************************************************************/
+bool NODEFLASHER::ReadStatus
+  (
+  FLASH_PORT *Port,           // port to flash
+  UNSIGNED16 Index,           // index of the entry
+  UNSIGNED8 Program,          // program number
+  UNSIGNED32 *Value           // location to store the value
+  )
+{
+  unsigned char Data[MAX_PACKET_LENGTH];
+  unsigned long Length = 0;
+  unsigned long Result;
+
+  Result = Port->Protocol->ReadRemoteOD(Port->NodeID, Index, Program, &Length, Data);
+  if ((Result != ERROR_NOERROR) || (Length != 4))
+  {
+    fprintf(stderr, "ERROR: %s: reading [%04X,%02X] failed, 0x%08lX\n", Port->PortName,
+      Index, Program, Result);
+    return FALSE;
+  }
+  *Value = Data[0] | (Data[1] << 8) | ((UNSIGNED32)Data[2] << 16) | ((UNSIGNED32)Data[3] << 24);
+  return TRUE;
+}
+
+
+/**************************************************************************
+DOES:    Call-back function, signals the end of a program download. Each
+         port has its own thread, the call-back comes from the thread of
+         the port.
+RETURNS: Nothing
+**************************************************************************/
+void NODEFLASHER::SDORequestComplete
+  (
+  UNSIGNED8 Channel,          // SDO client channel
+  UNSIGNED32 Result           // SDOERR_xxx
+  )
+{
+  if (CurrentPort == NULL) return;
+  CurrentPort->SdoResult = Result;
+  CurrentPort->SdoCompleted = TRUE;
+}
+
+/*----------------------- END OF FILE ----------------------------------*/
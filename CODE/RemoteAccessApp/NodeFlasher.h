@@ -0,0 +1,188 @@
+/**************************************************************************
+MODULE:    NodeFlasher
+CONTAINS:  CiA 302-3 program download to remote nodes through many
+           CANopenIA devices at once. Images are mapped into memory once
+           and streamed to the bootloader of a node on the CAN bus of every
+           port with SDO block transfers: program control [1F51h] stops
+           and clears the program, program data [1F50h] takes the image and
+           flash status [1F57h] reports the result. The software
+           identification [1F56h] is checked against a value given for the
+           image, its meaning is up to the bootloader.
+           The firmware of the CANgineBerry itself is not updated this way,
+           it has its own bootloader, see coiaupdater.
+COPYRIGHT: Embedded Systems Academy, Inc. 2008-2017.
+DISCLAIM:  Read and understand our disclaimer before using this code!
+           www.esacademy.com/disclaim.htm
+           This software was written in accordance to the guidelines at
+           www.esacademy.com/software/softwarestyleguide.pdf
+LICENSE:   Free to use with licensed CANopenIA chips, modules or devices
+           like CANgineBerry, CANgineXXX and 447izer
+VERSION:   1.10, EmSA 10-NOV-17
+           $LastChangedDate: 2014-01-11 17:30:59 +0100 (Sa, 11 Jan 2014) $
+           $LastChangedRevision: 1702 $
+***************************************************************************/
+#pragma once
+
+#ifndef _NODEFLASHER_H
+#define _NODEFLASHER_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include "global.h"
+#include "SerialProtocol.h"
+#include "sdoclnt.h"
+
+/**************************************************************************
+GLOBAL DEFINES
+***************************************************************************/
+
+// max number of ports flashed at once and of images per port
+#define NODEFLASHER_MAX_PORTS  32
+#define NODEFLASHER_MAX_IMAGES 4
+
+// program numbers, subindex of [1F50h], [1F51h], [1F56h] and [1F57h]
+#define FLASH_PROGRAM_FIRMWARE 1
+#define FLASH_PROGRAM_CONFIG   2
+
+// program control commands [1F51h]
+#define FLASH_CONTROL_STOP  0
+#define FLASH_CONTROL_START 1
+#define FLASH_CONTROL_CLEAR 3
+
+// microseconds allowed for a program download, plus per burst of
+// segments the SDO client sends each SDO_BACK2BACK_TIMEOUT, plus twice
+// the time of the segments on the serial port
+#define FLASH_TIMEOUT           5000000UL
+#define FLASH_TIMEOUT_PER_BURST (2000UL * (SDO_BACK2BACK_TIMEOUT + 1))
+
+// image bytes of a block download segment, and bits of its 'C' packet
+// on the serial port, 16 bytes with start and stop bits
+#define FLASH_SEGMENT_DATA 7
+#define FLASH_SEGMENT_BITS (16 * 10)
+
+/**************************************************************************
+GLOBAL TYPES AND FUNCTIONS
+***************************************************************************/
+
+// an image mapped into memory, shared by all ports
+typedef struct
+{
+  const char *FileName;
+  UNSIGNED8 Program;                        // FLASH_PROGRAM_xxx or other program number
+  const UNSIGNED8 *Data;
+  unsigned long Length;
+  bool Verify;                              // check the software identification
+  UNSIGNED32 Identification;                // expected in [1F56h]
+} FLASH_IMAGE;
+
+class NODEFLASHER;
+
+// a device flashed by its own thread
+typedef struct
+{
+  NODEFLASHER *Flasher;
+  char PortName[MAX_PATH];
+  UNSIGNED8 NodeID;                         // node id of the bootloader
+  pthread_t Thread;
+  SerialProtocol *Protocol;
+  volatile bool SdoCompleted;
+  volatile UNSIGNED32 SdoResult;            // SDOERR_xxx
+  bool Success;
+  uint64_t Duration;                        // microseconds
+  unsigned long Bytes;                      // image bytes written
+} FLASH_PORT;
+
+class NODEFLASHER
+{
+  public:
+    /**************************************************************************
+    DOES:    Constructor - creates a flasher without images and ports
+    **************************************************************************/
+    NODEFLASHER(void);
+    /**************************************************************************
+    DOES:    Destructor - releases the images
+    **************************************************************************/
+    ~NODEFLASHER(void);
+    /**************************************************************************
+    DOES:    Maps an image file into memory, to be written to a program of
+             all ports. Images are written in the order added.
+    RETURNS: TRUE for success, FALSE for error
+    **************************************************************************/
+    bool AddImage(
+      UNSIGNED8 Program,          // program number, FLASH_PROGRAM_xxx
+      const char *FileName        // image file
+      );
+    /**************************************************************************
+    DOES:    Adds a port to flash
+    RETURNS: TRUE for success, FALSE for error
+    **************************************************************************/
+    bool AddPort(
+      const char *PortName,       // serial port of the device
+      UNSIGNED8 NodeID            // node id of the bootloader, 1 to 127
+      );
+    /**************************************************************************
+    DOES:    Sets how ports are connected, see SerialProtocol
+    RETURNS: Nothing
+    **************************************************************************/
+    void SetBaudrate(unsigned long Bps) { Baudrate = Bps; }
+    void SetLowLatency(bool On) { LowLatency = On; }
+    void SetBackend(int NewBackend) { Backend = NewBackend; }
+    /**************************************************************************
+    DOES:    Sets how many segments of a program download are sent at once,
+             0 for the default of the SDO client
+    RETURNS: Nothing
+    **************************************************************************/
+    void SetBlockBurst(UNSIGNED8 Segments) { BlockBurst = Segments; }
+    /**************************************************************************
+    DOES:    Sets the software identification [1F56h] a program must have
+             after its image was written, not checked if not set
+    RETURNS: TRUE for success, FALSE if no image was added for the program
+    **************************************************************************/
+    bool SetIdentification(
+      UNSIGNED8 Program,          // program number of an image added
+      UNSIGNED32 Identification   // expected value of [1F56h]
+      );
+    /**************************************************************************
+    DOES:    Selects whether the firmware is started after all images were
+             written
+    RETURNS: Nothing
+    **************************************************************************/
+    void SetStart(bool On) { Start = On; }
+    /**************************************************************************
+    DOES:    Flashes all images to all ports, the ports in parallel. A line
+             is printed as each port completes.
+    RETURNS: TRUE if all ports were flashed, FALSE for errors
+    **************************************************************************/
+    bool Run(void);
+    /**************************************************************************
+    DOES:    Gets the result of a port after Run
+    RETURNS: Port or NULL if there is no such port
+    **************************************************************************/
+    const FLASH_PORT *GetPort(int Port) const;
+
+  private:
+    bool FlashPort(FLASH_PORT *Port);
+    bool FlashImage(FLASH_PORT *Port, const FLASH_IMAGE *Image);
+    bool Control(FLASH_PORT *Port, UNSIGNED8 Program, UNSIGNED8 Command);
+    bool ReadStatus(FLASH_PORT *Port, UNSIGNED16 Index, UNSIGNED8 Program, UNSIGNED32 *Value);
+    static void *PortThread(void *Param);
+    static void SDORequestComplete(UNSIGNED8 Channel, UNSIGNED32 Result);
+
+    // port run by the calling thread, for the SDO call-back
+    static thread_local FLASH_PORT *CurrentPort;
+
+    FLASH_IMAGE Images[NODEFLASHER_MAX_IMAGES];
+    int NumImages;
+    FLASH_PORT Ports[NODEFLASHER_MAX_PORTS];
+    int NumPorts;
+    unsigned long Baudrate;
+    bool LowLatency;
+    int Backend;
+    UNSIGNED8 BlockBurst;                   // 0 for the default of the SDO client
+    bool Start;
+    pthread_mutex_t PrintLock;              // result lines of the ports
+};
+
+#endif // _NODEFLASHER_H
+
+/*----------------------- END OF FILE ----------------------------------*/
@@ -0,0 +1,275 @@
+/**************************************************************************
+MODULE:    NodeTracker
+CONTAINS:  Tracks the state of all nodes of the network from the node
+           status [5F04h] written by the CANopenIA device. Runs in the
+           thread calling SerialProtocol::Process, like the data call-back
+           feeding it.
+COPYRIGHT: Embedded Systems Academy, Inc. 2008-2017.
+DISCLAIM:  Read and understand our disclaimer before using this code!
+           www.esacademy.com/disclaim.htm
+           This software was written in accordance to the guidelines at
+           www.esacademy.com/software/softwarestyleguide.pdf
+LICENSE:   Free to use with licensed CANopenIA chips, modules or devices
+           like CANgineBerry, CANgineXXX and 447izer
+VERSION:   1.10, EmSA 10-NOV-17
+           $LastChangedDate: 2014-01-11 17:30:59 +0100 (Sa, 11 Jan 2014) $
+           $LastChangedRevision: 1702 $
+***************************************************************************/
+
+#include <string.h>
+#include "NodeTracker.h"
+#include "SerialProtocol.h"
+#include "Timer.h"
+
+/**************************************************************************
+LOCAL DEFINES
+***************************************************************************/
+
+// status not seen yet
+#define NO_STATUS 0xFF
+
+// states of the NMT state machine, one at a time
+#define NMT_STATES (NODETRACK_BIT(NODETRACK_OPERATIONAL) | NODETRACK_BIT(NODETRACK_PREOP) | NODETRACK_BIT(NODETRACK_STOPPED))
+
+
+/**************************************************************************
+DOES:    Constructor - all nodes without state
+**************************************************************************/
+NODETRACKER::NODETRACKER
+  (
+  void
+  )
+{
+  NumCallbacks = 0;
+  Reset();
+}
+
+
+/**************************************************************************
+DOES:    Forgets the states of all nodes, e.g. after a reconnect
+RETURNS: Nothing
+**************************************************************************/
+void NODETRACKER::Reset
+  (
+  void
+  )
+{
+  int s;
+
+  for (s = 0; s < NODETRACK_STATES; s++) NODESET_Empty(&States[s]);
+  memset(LastStatus, NO_STATUS, sizeof(LastStatus));
+  memset(LastChange, 0, sizeof(LastChange));
+}
+
+
+/**************************************************************************
+DOES:    Registers a call-back for node status changes
+RETURNS: TRUE for success, FALSE if there are too many call-backs
+**************************************************************************/
+bool NODETRACKER::RegisterCallback
+  (
+  NODETRACK_CALLBACK Callback,  // function to call
+  void *Param                   // passed to the call-back
+  )
+{
+  if (NumCallbacks >= NODETRACK_MAX_CALLBACKS) return FALSE;
+  Callbacks[NumCallbacks] = Callback;
+  CallbackParams[NumCallbacks++] = Param;
+  return TRUE;
+}
+
+
+/**************************************************************************
+DOES:    Removes a call-back
+RETURNS: Nothing
+**************************************************************************/
+void NODETRACKER::UnregisterCallback
+  (
+  NODETRACK_CALLBACK Callback,  // function registered
+  void *Param                   // parameter registered
+  )
+{
+  int c;
+
+  for (c = 0; c < NumCallbacks; c++)
+  {
+    if ((Callbacks[c] == Callback) && (CallbackParams[c] == Param))
+    {
+      NumCallbacks--;
+      Callbacks[c] = Callbacks[NumCallbacks];
+      CallbackParams[c] = CallbackParams[NumCallbacks];
+      return;
+    }
+  }
+}
+
+
+/**************************************************************************
+DOES:    Takes data written by the device, to be called from the data
+         call-back. Only the node status [5F04h] is used.
+RETURNS: TRUE if it was a node status, else FALSE
+**************************************************************************/
+bool NODETRACKER::HandleData
+  (
+  int Index,                  // index of od entry written
+  unsigned char Subindex,     // subindex of od entry written
+  unsigned long DataLength,   // length of data written
+  unsigned char *Data         // data written
+  )
+{
+  if ((Index != 0x5F04) || (DataLength < 1)) return FALSE;
+  Update(Subindex, Data[0]);
+  return TRUE;
+}
+
+
+/**************************************************************************
+DOES:    Applies a node status, updates the states of the node and calls
+         the call-backs
+RETURNS: Nothing
+**************************************************************************/
+void NODETRACKER::Update
+  (
+  UNSIGNED8 NodeID,           // node id, highest bit set for the device itself
+  UNSIGNED8 Status            // NODESTATUS_xxx
+  )
+{
+  UNSIGNED8 Node = NodeID & 0x7F;
+  unsigned long OldStates = GetStates(Node);
+  unsigned long NewStates = OldStates;
+  unsigned long Changed;
+  int s;
+  int c;
+
+  if (NodeID & 0x80) NewStates |= NODETRACK_BIT(NODETRACK_SELF);
+  switch (Status)
+  {
+    case NODESTATUS_BOOT:
+      NewStates &= ~NMT_STATES;
+      NewStates |= NODETRACK_BIT(NODETRACK_BOOTED) | NODETRACK_BIT(NODETRACK_PREOP);
+      break;
+    case NODESTATUS_STOPPED:
+      NewStates = (NewStates & ~NMT_STATES) | NODETRACK_BIT(NODETRACK_STOPPED);
+      break;
+    case NODESTATUS_OPERATIONAL:
+      NewStates = (NewStates & ~NMT_STATES) | NODETRACK_BIT(NODETRACK_OPERATIONAL);
+      break;
+    case NODESTATUS_PREOP:
+      NewStates = (NewStates & ~NMT_STATES) | NODETRACK_BIT(NODETRACK_PREOP);
+      break;
+    case NODESTATUS_EMCY_NEW:
+      NewStates |= NODETRACK_BIT(NODETRACK_EMCY);
+      break;
+    case NODESTATUS_EMCY_OVER:
+      NewStates &= ~NODETRACK_BIT(NODETRACK_EMCY);
+      break;
+    case NODESTATUS_HBACTIVE:
+      NewStates |= NODETRACK_BIT(NODETRACK_HBACTIVE);
+      NewStates &= ~NODETRACK_BIT(NODETRACK_HBLOST);
+      break;
+    case NODESTATUS_HBLOST:
+      // the node is gone, it is scanned again when it comes back
+      NewStates &= NODETRACK_BIT(NODETRACK_SELF);
+      NewStates |= NODETRACK_BIT(NODETRACK_HBACTIVE) | NODETRACK_BIT(NODETRACK_HBLOST);
+      break;
+    case NODESTATUS_SCANSTARTED:
+      NewStates |= NODETRACK_BIT(NODETRACK_SCANNING);
+      NewStates &= ~(NODETRACK_BIT(NODETRACK_BOOTED) | NODETRACK_BIT(NODETRACK_SCANNED));
+      break;
+    case NODESTATUS_SCANCOMPLETE:
+      NewStates |= NODETRACK_BIT(NODETRACK_SCANNED);
+      NewStates &= ~NODETRACK_BIT(NODETRACK_SCANNING);
+      break;
+    case NODESTATUS_SCANABORTED:
+      NewStates &= ~(NODETRACK_BIT(NODETRACK_SCANNING) | NODETRACK_BIT(NODETRACK_SCANNED));
+      break;
+    case NODESTATUS_RESETAPP:
+    case NODESTATUS_RESETCOM:
+      NewStates &= ~NMT_STATES;
+      break;
+    default:
+      break;
+  }
+
+  // only the sets of states that changed are written
+  Changed = OldStates ^ NewStates;
+  for (s = 0; Changed; s++, Changed >>= 1)
+  {
+    if ((Changed & 1) == 0) continue;
+    if (NewStates & NODETRACK_BIT(s)) NODESET_Set(&States[s], Node);
+    else NODESET_Clear(&States[s], Node);
+  }
+  LastStatus[Node] = Status;
+  LastChange[Node] = Timer::GetMicroseconds();
+
+  for (c = 0; c < NumCallbacks; c++)
+  {
+    Callbacks[c](NodeID, Status, OldStates, NewStates, CallbackParams[c]);
+  }
+}
+
+
+/**************************************************************************
+DOES:    Sets or clears a state of a node, e.g. a NODETRACK_USER state.
+         No call-backs are called.
+RETURNS: Nothing
+**************************************************************************/
+void NODETRACKER::SetState
+  (
+  UNSIGNED8 NodeID,           // node id
+  int State,                  // NODETRACK_xxx
+  bool On                     // TRUE to set, FALSE to clear
+  )
+{
+  if ((State < 0) || (State >= NODETRACK_STATES)) return;
+  if (On) NODESET_Set(&States[State], NodeID & 0x7F);
+  else NODESET_Clear(&States[State], NodeID & 0x7F);
+}
+
+
+/**************************************************************************
+DOES:    Finds the nodes in all states of one mask and in none of
+         another, e.g. all operational nodes of a device profile
+RETURNS: Nothing
+**************************************************************************/
+void NODETRACKER::Select
+  (
+  NODESET *Result,            // location to store the nodes found
+  unsigned long Include,      // NODETRACK_BIT of the states required
+  unsigned long Exclude       // NODETRACK_BIT of the states not allowed
+  ) const
+{
+  int s;
+
+  // with no state required all nodes qualify
+  Result->Bits[0] = ~(uint64_t)0;
+  Result->Bits[1] = ~(uint64_t)0;
+  for (s = 0; s < NODETRACK_STATES; s++)
+  {
+    if (Include & NODETRACK_BIT(s)) NODESET_And(Result, Result, &States[s]);
+    else if (Exclude & NODETRACK_BIT(s)) NODESET_AndNot(Result, Result, &States[s]);
+  }
+  NODESET_Clear(Result, 0);
+}
+
+
+/**************************************************************************
+DOES:    Gets the states of a node
+RETURNS: Mask of NODETRACK_BIT
+**************************************************************************/
+unsigned long NODETRACKER::GetStates
+  (
+  UNSIGNED8 NodeID            // node id
+  ) const
+{
+  unsigned long Mask = 0;
+  int s;
+
+  for (s = 0; s < NODETRACK_STATES; s++)
+  {
+    if (NODESET_Test(&States[s], NodeID & 0x7F)) Mask |= NODETRACK_BIT(s);
+  }
+  return Mask;
+}
+
+/*----------------------- END OF FILE ----------------------------------*/
@@ -0,0 +1,273 @@
+/**************************************************************************
+MODULE:    NodeTracker
+CONTAINS:  Tracks the state of all nodes of the network from the node
+           status [5F04h] written by the CANopenIA device. Each state is
+           kept as a set of 128 bits with one bit per node id, so that a
+           query over all nodes, like all operational nodes that are
+           scanned, is a few word operations. Changes are passed on to
+           registered call-backs as they arrive.
+COPYRIGHT: Embedded Systems Academy, Inc. 2008-2017.
+DISCLAIM:  Read and understand our disclaimer before using this code!
+           www.esacademy.com/disclaim.htm
+           This software was written in accordance to the guidelines at
+           www.esacademy.com/software/softwarestyleguide.pdf
+LICENSE:   Free to use with licensed CANopenIA chips, modules or devices
+           like CANgineBerry, CANgineXXX and 447izer
+VERSION:   1.10, EmSA 10-NOV-17
+           $LastChangedDate: 2014-01-11 17:30:59 +0100 (Sa, 11 Jan 2014) $
+           $LastChangedRevision: 1702 $
+***************************************************************************/
+#pragma once
+
+#ifndef _NODETRACKER_H
+#define _NODETRACKER_H
+
+#include <stdint.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#include "global.h"
+
+/**************************************************************************
+GLOBAL DEFINES
+***************************************************************************/
+
+// node ids 0 to 127, bit 0 of a node set is not used
+#define NODESET_NODES 128
+#define NODESET_WORDS 2
+
+// node states, each tracked as a node set
+#define NODETRACK_HBACTIVE    0   // heartbeat consumed
+#define NODETRACK_HBLOST      1   // heartbeat lost, all other states are cleared
+#define NODETRACK_BOOTED      2   // boot-up seen, cleared when a scan starts
+#define NODETRACK_SCANNING    3   // scan of the node by the device, do not use the SDO client
+#define NODETRACK_SCANNED     4   // scan complete, the node may be accessed
+#define NODETRACK_OPERATIONAL 5
+#define NODETRACK_PREOP       6
+#define NODETRACK_STOPPED     7
+#define NODETRACK_EMCY        8   // emergency active
+#define NODETRACK_SELF        9   // status is of the device itself
+#define NODETRACK_USER        10  // first state set by the application, e.g. for a device profile
+#define NODETRACK_STATES      16
+
+// mask of a state for Select and the call-backs
+#define NODETRACK_BIT(State) (1UL << (State))
+
+// max number of call-backs registered
+#define NODETRACK_MAX_CALLBACKS 8
+
+/**************************************************************************
+GLOBAL TYPES AND FUNCTIONS
+***************************************************************************/
+
+// one bit per node id
+typedef struct
+{
+  uint64_t Bits[NODESET_WORDS];
+} NODESET;
+
+/**************************************************************************
+DOES:    Empties a node set
+RETURNS: Nothing
+**************************************************************************/
+inline void NODESET_Empty(NODESET *Set)
+{
+  Set->Bits[0] = 0;
+  Set->Bits[1] = 0;
+}
+
+/**************************************************************************
+DOES:    Adds a node to a set
+RETURNS: Nothing
+**************************************************************************/
+inline void NODESET_Set(NODESET *Set, UNSIGNED8 NodeID)
+{
+  Set->Bits[(NodeID >> 6) & 1] |= (uint64_t)1 << (NodeID & 63);
+}
+
+/**************************************************************************
+DOES:    Removes a node from a set
+RETURNS: Nothing
+**************************************************************************/
+inline void NODESET_Clear(NODESET *Set, UNSIGNED8 NodeID)
+{
+  Set->Bits[(NodeID >> 6) & 1] &= ~((uint64_t)1 << (NodeID & 63));
+}
+
+/**************************************************************************
+DOES:    Checks if a node is in a set
+RETURNS: TRUE if it is, else FALSE
+**************************************************************************/
+inline bool NODESET_Test(const NODESET *Set, UNSIGNED8 NodeID)
+{
+  return (Set->Bits[(NodeID >> 6) & 1] >> (NodeID & 63)) & 1;
+}
+
+/**************************************************************************
+DOES:    Checks if a set has no nodes
+RETURNS: TRUE if empty, else FALSE
+**************************************************************************/
+inline bool NODESET_IsEmpty(const NODESET *Set)
+{
+  return (Set->Bits[0] | Set->Bits[1]) == 0;
+}
+
+/**************************************************************************
+DOES:    Counts the nodes of a set
+RETURNS: Number of nodes
+**************************************************************************/
+inline int NODESET_Count(const NODESET *Set)
+{
+#ifdef _MSC_VER
+  return (int)(__popcnt64(Set->Bits[0]) + __popcnt64(Set->Bits[1]));
+#else
+  return __builtin_popcountll(Set->Bits[0]) + __builtin_popcountll(Set->Bits[1]);
+#endif
+}
+
+/**************************************************************************
+DOES:    Finds the lowest node of a set from a node id on, e.g.
+           for (n = NODESET_Next(&Set, 1); n; n = NODESET_Next(&Set, n + 1))
+RETURNS: Node id, 0 if there is none
+**************************************************************************/
+inline UNSIGNED8 NODESET_Next(const NODESET *Set, unsigned int From)
+{
+  unsigned int w;
+  uint64_t Bits;
+
+  for (w = From >> 6; w < NODESET_WORDS; w++)
+  {
+    Bits = Set->Bits[w];
+    if (w == (From >> 6)) Bits &= ~(uint64_t)0 << (From & 63);
+    if (Bits)
+    {
+#ifdef _MSC_VER
+      unsigned long Bit;
+      _BitScanForward64(&Bit, Bits);
+      return (UNSIGNED8)(w * 64 + Bit);
+#else
+      return (UNSIGNED8)(w * 64 + __builtin_ctzll(Bits));
+#endif
+    }
+  }
+  return 0;
+}
+
+/**************************************************************************
+DOES:    Combines two sets
+RETURNS: Nothing, Result may be one of the sets
+**************************************************************************/
+inline void NODESET_And(NODESET *Result, const NODESET *A, const NODESET *B)
+{
+  Result->Bits[0] = A->Bits[0] & B->Bits[0];
+  Result->Bits[1] = A->Bits[1] & B->Bits[1];
+}
+
+inline void NODESET_Or(NODESET *Result, const NODESET *A, const NODESET *B)
+{
+  Result->Bits[0] = A->Bits[0] | B->Bits[0];
+  Result->Bits[1] = A->Bits[1] | B->Bits[1];
+}
+
+inline void NODESET_AndNot(NODESET *Result, const NODESET *A, const NODESET *B)
+{
+  Result->Bits[0] = A->Bits[0] & ~B->Bits[0];
+  Result->Bits[1] = A->Bits[1] & ~B->Bits[1];
+}
+
+// called for each node status, with the states of the node before and
+// after as masks of NODETRACK_BIT
+typedef void (*NODETRACK_CALLBACK)(UNSIGNED8 NodeID, UNSIGNED8 Status, unsigned long OldStates, unsigned long NewStates, void *Param);
+
+class NODETRACKER
+{
+  public:
+    /**************************************************************************
+    DOES:    Constructor - all nodes without state
+    **************************************************************************/
+    NODETRACKER(void);
+    /**************************************************************************
+    DOES:    Forgets the states of all nodes, e.g. after a reconnect
+    RETURNS: Nothing
+    **************************************************************************/
+    void Reset(void);
+    /**************************************************************************
+    DOES:    Registers a call-back for node status changes
+    RETURNS: TRUE for success, FALSE if there are too many call-backs
+    **************************************************************************/
+    bool RegisterCallback(NODETRACK_CALLBACK Callback, void *Param);
+    /**************************************************************************
+    DOES:    Removes a call-back
+    RETURNS: Nothing
+    **************************************************************************/
+    void UnregisterCallback(NODETRACK_CALLBACK Callback, void *Param);
+    /**************************************************************************
+    DOES:    Takes data written by the device, to be called from the data
+             call-back. Only the node status [5F04h] is used.
+    RETURNS: TRUE if it was a node status, else FALSE
+    **************************************************************************/
+    bool HandleData(
+      int Index,                  // index of od entry written
+      unsigned char Subindex,     // subindex of od entry written
+      unsigned long DataLength,   // length of data written
+      unsigned char *Data         // data written
+      );
+    /**************************************************************************
+    DOES:    Applies a node status, updates the states of the node and calls
+             the call-backs
+    RETURNS: Nothing
+    **************************************************************************/
+    void Update(
+      UNSIGNED8 NodeID,           // node id, highest bit set for the device itself
+      UNSIGNED8 Status            // NODESTATUS_xxx
+      );
+    /**************************************************************************
+    DOES:    Sets or clears a state of a node, e.g. a NODETRACK_USER state.
+             No call-backs are called.
+    RETURNS: Nothing
+    **************************************************************************/
+    void SetState(UNSIGNED8 NodeID, int State, bool On);
+    /**************************************************************************
+    DOES:    Gets the nodes in a state
+    RETURNS: Node set, valid until the next change
+    **************************************************************************/
+    const NODESET *Get(int State) const { return &States[State]; }
+    /**************************************************************************
+    DOES:    Checks a state of a node
+    RETURNS: TRUE if the node is in the state, else FALSE
+    **************************************************************************/
+    bool Test(UNSIGNED8 NodeID, int State) const { return NODESET_Test(&States[State], NodeID); }
+    /**************************************************************************
+    DOES:    Finds the nodes in all states of one mask and in none of
+             another, e.g. all operational nodes of a device profile
+    RETURNS: Nothing
+    **************************************************************************/
+    void Select(
+      NODESET *Result,            // location to store the nodes found
+      unsigned long Include,      // NODETRACK_BIT of the states required
+      unsigned long Exclude       // NODETRACK_BIT of the states not allowed
+      ) const;
+    /**************************************************************************
+    DOES:    Gets the states of a node
+    RETURNS: Mask of NODETRACK_BIT
+    **************************************************************************/
+    unsigned long GetStates(UNSIGNED8 NodeID) const;
+    /**************************************************************************
+    DOES:    Gets the last node status of a node and its time
+    RETURNS: NODESTATUS_xxx, 0xFF if none was seen
+    **************************************************************************/
+    UNSIGNED8 GetStatus(UNSIGNED8 NodeID) const { return LastStatus[NodeID & 0x7F]; }
+    uint64_t GetLastChange(UNSIGNED8 NodeID) const { return LastChange[NodeID & 0x7F]; }
+
+  private:
+    NODESET States[NODETRACK_STATES];
+    UNSIGNED8 LastStatus[NODESET_NODES];
+    uint64_t LastChange[NODESET_NODES];     // monotonic time in us
+    NODETRACK_CALLBACK Callbacks[NODETRACK_MAX_CALLBACKS];
+    void *CallbackParams[NODETRACK_MAX_CALLBACKS];
+    int NumCallbacks;
+};
+
+#endif // _NODETRACKER_H
+
+/*----------------------- END OF FILE ----------------------------------*/
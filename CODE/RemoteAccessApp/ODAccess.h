@@ -0,0 +1,233 @@
+/**************************************************************************
+MODULE:    ODAccess
+CONTAINS:  Typed object dictionary access for CANopenIA serial communication
+           Object sizes and encodings are fixed at compile time, accesses
+           with a data type that does not match the object are rejected by
+           the compiler instead of by the device
+COPYRIGHT: Embedded Systems Academy, Inc. 2008-2017.
+DISCLAIM:  Read and understand our disclaimer before using this code!
+           www.esacademy.com/disclaim.htm
+           This software was written in accordance to the guidelines at
+           www.esacademy.com/software/softwarestyleguide.pdf
+LICENSE:   Free to use with licensed CANopenIA chips, modules or devices
+           like CANgineBerry, CANgineXXX and 447izer
+VERSION:   1.10, EmSA 10-NOV-17
+           $LastChangedDate: 2014-01-11 17:30:59 +0100 (Sa, 11 Jan 2014) $
+           $LastChangedRevision: 1702 $
+***************************************************************************/
+#pragma once
+
+#ifndef _ODACCESS_H
+#define _ODACCESS_H
+
+#include <stdint.h>
+#include <string.h>
+#include "global.h"
+#include "SerialProtocol.h"
+
+/**************************************************************************
+GLOBAL DEFINES
+***************************************************************************/
+
+// node id used to address the object dictionary of the COIA device itself
+#define OD_LOCAL_NODE 0
+
+/**************************************************************************
+GLOBAL TYPES AND FUNCTIONS
+***************************************************************************/
+
+// Encoding of a CANopen basic data type in little-endian format
+// Only specialized for types that can be transferred, any other type
+// fails to compile
+template <typename T> struct OD_TYPE;
+
+template <> struct OD_TYPE<uint8_t>
+{
+  static constexpr unsigned long Size = 1;
+  static void Store(uint8_t Value, UNSIGNED8 *Loc) { Loc[0] = Value; }
+  static uint8_t Load(const UNSIGNED8 *Loc) { return Loc[0]; }
+};
+
+template <> struct OD_TYPE<uint16_t>
+{
+  static constexpr unsigned long Size = 2;
+  static void Store(uint16_t Value, UNSIGNED8 *Loc) { STORE_U16(Value, Loc); }
+  static uint16_t Load(const UNSIGNED8 *Loc) { return (uint16_t)(GET_U16(Loc)); }
+};
+
+template <> struct OD_TYPE<uint32_t>
+{
+  static constexpr unsigned long Size = 4;
+  static void Store(uint32_t Value, UNSIGNED8 *Loc) { STORE_U32(Value, Loc); }
+  static uint32_t Load(const UNSIGNED8 *Loc) { return (uint32_t)(GET_U32(Loc)); }
+};
+
+template <> struct OD_TYPE<int8_t>
+{
+  static constexpr unsigned long Size = 1;
+  static void Store(int8_t Value, UNSIGNED8 *Loc) { OD_TYPE<uint8_t>::Store((uint8_t)Value, Loc); }
+  static int8_t Load(const UNSIGNED8 *Loc) { return (int8_t)OD_TYPE<uint8_t>::Load(Loc); }
+};
+
+template <> struct OD_TYPE<int16_t>
+{
+  static constexpr unsigned long Size = 2;
+  static void Store(int16_t Value, UNSIGNED8 *Loc) { OD_TYPE<uint16_t>::Store((uint16_t)Value, Loc); }
+  static int16_t Load(const UNSIGNED8 *Loc) { return (int16_t)OD_TYPE<uint16_t>::Load(Loc); }
+};
+
+template <> struct OD_TYPE<int32_t>
+{
+  static constexpr unsigned long Size = 4;
+  static void Store(int32_t Value, UNSIGNED8 *Loc) { OD_TYPE<uint32_t>::Store((uint32_t)Value, Loc); }
+  static int32_t Load(const UNSIGNED8 *Loc) { return (int32_t)OD_TYPE<uint32_t>::Load(Loc); }
+};
+
+// REAL32 is transferred as its IEEE754 bit pattern
+template <> struct OD_TYPE<float>
+{
+  static constexpr unsigned long Size = 4;
+  static void Store(float Value, UNSIGNED8 *Loc)
+  {
+    uint32_t Bits;
+    memcpy(&Bits, &Value, sizeof(Bits));
+    OD_TYPE<uint32_t>::Store(Bits, Loc);
+  }
+  static float Load(const UNSIGNED8 *Loc)
+  {
+    uint32_t Bits = OD_TYPE<uint32_t>::Load(Loc);
+    float Value;
+    memcpy(&Value, &Bits, sizeof(Value));
+    return Value;
+  }
+};
+
+// Compile time description of a single object dictionary entry
+template <typename T, UNSIGNED16 INDEX, UNSIGNED8 SUBINDEX>
+struct OD_OBJECT
+{
+  typedef T TYPE;
+  static constexpr UNSIGNED16 Index = INDEX;
+  static constexpr UNSIGNED8 Subindex = SUBINDEX;
+  static constexpr unsigned long Size = OD_TYPE<T>::Size;
+
+  static_assert(OD_TYPE<T>::Size <= MAX_WRITE_LENGTH, "object does not fit into a single packet");
+};
+
+// Objects of the CANopen communication profile
+typedef OD_OBJECT<uint32_t, 0x1000, 0x00> OD_DEVICETYPE;
+typedef OD_OBJECT<uint8_t,  0x1001, 0x00> OD_ERRORREGISTER;
+typedef OD_OBJECT<uint16_t, 0x1017, 0x00> OD_PRODUCERHEARTBEAT;
+typedef OD_OBJECT<uint32_t, 0x1018, 0x01> OD_VENDORID;
+typedef OD_OBJECT<uint32_t, 0x1018, 0x02> OD_PRODUCTCODE;
+typedef OD_OBJECT<uint32_t, 0x1018, 0x03> OD_REVISION;
+typedef OD_OBJECT<uint32_t, 0x1018, 0x04> OD_SERIALNUMBER;
+
+// Objects of the CANopenIA remote access interface
+typedef OD_OBJECT<uint8_t,  0x5F00, 0x01> OD_OWNNODEID;
+typedef OD_OBJECT<uint8_t,  0x5F00, 0x02> OD_OWNNMTSTATE;
+typedef OD_OBJECT<uint8_t,  0x5F00, 0x03> OD_OWNHWSTATUS;
+typedef OD_OBJECT<uint8_t,  0x5F01, 0x01> OD_RESETCOMMAND;
+typedef OD_OBJECT<uint8_t,  0x5F01, 0x02> OD_SLEEPOBJECTION;
+typedef OD_OBJECT<uint8_t,  0x5F09, 0x00> OD_HOSTCONTROL;
+typedef OD_OBJECT<uint16_t, 0x5F0A, 0x01> OD_NMTCOMMAND;
+
+class ODAccess
+{
+  public:
+    /**************************************************************************
+    DOES:    Constructor - binds the accessor to a connected protocol handler
+    **************************************************************************/
+    ODAccess(SerialProtocol *Protocol) : Device(Protocol) {}
+
+    /**************************************************************************
+    DOES:    Reads an object of a fixed data type from the COIA device
+             (NodeID OD_LOCAL_NODE) or from a remote node. Blocks like
+             SerialProtocol::ReadRemoteOD.
+    RETURNS: ERROR_NOERROR for success or error code for failure,
+             ERROR_WRONGRESPONSE if the object has a different size
+    **************************************************************************/
+    template <typename T>
+    unsigned long Read(
+      UNSIGNED8 NodeID,             // node id of node to read from
+      UNSIGNED16 Index,             // index of od entry to read
+      UNSIGNED8 Subindex,           // subindex of od entry to read
+      T *Value                      // location to store value read
+      )
+    {
+      UNSIGNED8 Buf[MAX_PACKET_LENGTH];
+      unsigned long Length = sizeof(Buf);
+      unsigned long result;
+
+      if (NodeID == OD_LOCAL_NODE)
+        result = Device->ReadLocalOD(Index, Subindex, &Length, Buf);
+      else
+        result = Device->ReadRemoteOD(NodeID, Index, Subindex, &Length, Buf);
+      if (result != ERROR_NOERROR)
+      {
+        return result;
+      }
+      if (Length != OD_TYPE<T>::Size)
+      {
+        return ERROR_WRONGRESPONSE;
+      }
+
+      *Value = OD_TYPE<T>::Load(Buf);
+      return ERROR_NOERROR;
+    }
+
+    /**************************************************************************
+    DOES:    Writes an object of a fixed data type to the COIA device
+             (NodeID OD_LOCAL_NODE) or to a remote node. Blocks like
+             SerialProtocol::WriteRemoteOD.
+    RETURNS: ERROR_NOERROR for success or error code for failure
+    **************************************************************************/
+    template <typename T>
+    unsigned long Write(
+      UNSIGNED8 NodeID,             // node id of node to write to
+      UNSIGNED16 Index,             // index of od entry to write
+      UNSIGNED8 Subindex,           // subindex of od entry to write
+      T Value                       // value to write
+      )
+    {
+      UNSIGNED8 Buf[OD_TYPE<T>::Size];
+
+      OD_TYPE<T>::Store(Value, Buf);
+      if (NodeID == OD_LOCAL_NODE)
+        return Device->WriteLocalOD(Index, Subindex, OD_TYPE<T>::Size, Buf);
+      return Device->WriteRemoteOD(NodeID, Index, Subindex, OD_TYPE<T>::Size, Buf);
+    }
+
+    /**************************************************************************
+    DOES:    Reads an object described by an OD_OBJECT type
+    RETURNS: ERROR_NOERROR for success or error code for failure
+    **************************************************************************/
+    template <class OBJ>
+    unsigned long Read(
+      UNSIGNED8 NodeID,             // node id of node to read from
+      typename OBJ::TYPE *Value     // location to store value read
+      )
+    {
+      return Read<typename OBJ::TYPE>(NodeID, OBJ::Index, OBJ::Subindex, Value);
+    }
+
+    /**************************************************************************
+    DOES:    Writes an object described by an OD_OBJECT type
+    RETURNS: ERROR_NOERROR for success or error code for failure
+    **************************************************************************/
+    template <class OBJ>
+    unsigned long Write(
+      UNSIGNED8 NodeID,             // node id of node to write to
+      typename OBJ::TYPE Value      // value to write
+      )
+    {
+      return Write<typename OBJ::TYPE>(NodeID, OBJ::Index, OBJ::Subindex, Value);
+    }
+
+  private:
+    SerialProtocol *Device;
+};
+
+#endif // _ODACCESS_H
+
+/*----------------------- END OF FILE ----------------------------------*/
@@ -21,24 +21,23 @@ VERSION:   1.10, EmSA 10-NOV-17
 #include <time.h>
 #include <signal.h>
 #include "SerialProtocol.h"
-
-#define MAX_NUMBER_OF_NODES 32
+#include "ODAccess.h"
+#include "NodeTracker.h"
+#include "EmcyLog.h"
+#include "DataLog.h"
 
 // define to 1 to enable display of new data on the network
 #define SHOW_NEW_DATA 0
 
+// max emergency events handled per loop pass
+#define EMCY_DRAIN 64
+
 /**************************************************************************
 MODULE VARIABLES
 ***************************************************************************/ 
 
-// node state flags
-#define NODE_STATE_NONE         0
-#define NODE_STATE_HBACTIVE     (1 << 0)
-#define NODE_STATE_HBLOSS       (1 << 1)
-#define NODE_STATE_SCANNING     (1 << 2)
-#define NODE_STATE_SCANFINISHED (1 << 3)
-#define NODE_STATE_PRODUCEDATA  (1 << 4)
-#define NODE_STATE_BOOTED       (1 << 7)
+// node state set for CiA401 devices, data is produced for them
+#define NODE_STATE_PRODUCEDATA NODETRACK_USER
 
 // NMT commands
 #define NMT_OPERATIONAL    1
@@ -51,19 +50,24 @@ MODULE VARIABLES
 #define BAUDRATE 921600
 
 static SerialProtocol *COIADevice = new SerialProtocol();
+static ODAccess *COIAObjects = new ODAccess(COIADevice);
 
 static unsigned char MyNodeID = 0;       // Our own node ID
 static unsigned char MyNMTState;         // Our own state
 static int TerminationRequested = FALSE; // termination flag
 
-// States of nodes
-// bit 0: HB active 
-// bit 1: HB loss
-// bit 2: scanner active, do not use SDO client
-// bit 3: inital scan completed
-// bit 4: produce data
-// bit 7: not available, booted
-static unsigned char NodeStates[MAX_NUMBER_OF_NODES] = { NODE_STATE_NONE };
+// States of nodes, from the node status written by the device
+static NODETRACKER Nodes;
+
+// nodes scanned since the main loop last looked at them
+static NODESET ScanPending;
+
+// emergencies of all nodes, recorded by the data call-back
+static EMCYLOG Emergencies;
+static EMCY_EVENT EmcyEvents[EMCY_DRAIN];
+
+// process data of all nodes, logged if a log file is given
+static DATALOG ProcessData;
 
 // Data to read or write
 static unsigned long Length;
@@ -131,7 +135,7 @@ void OwnStatusChanged (
 DOES:    This function is called from the new data recived call-back,
          if data received indicates a change in the node status of any of
          the nodes connected to the network
-GLOBALS: Updates NodeScanned
+GLOBALS: None, the node tracker keeps the states
 **************************************************************************/
 void NodeStatusChanged (
   unsigned char NodeID, // node ID for which a change of state was detected
@@ -139,8 +143,6 @@ void NodeStatusChanged (
   unsigned char State // current state of that node
   )
 {
-  if (NodeID >= MAX_NUMBER_OF_NODES) return;
-
   printf("\n{Node %d ", NodeID & 0x7F);
 
   if (NodeID & 0x80)
@@ -153,7 +155,6 @@ void NodeStatusChanged (
   {
     case NODESTATUS_BOOT: 
       printf("BOOT} "); 
-      NodeStates[NodeID - 1] |= NODE_STATE_BOOTED; // signal node booted
       break;
     case NODESTATUS_STOPPED: printf("STOP} "); break;
     case NODESTATUS_OPERATIONAL: printf("OPERATIONAL} "); break;
@@ -162,27 +163,18 @@ void NodeStatusChanged (
     case NODESTATUS_EMCY_NEW: printf("NEW EMCY} "); break;   
     case NODESTATUS_HBACTIVE: 
       printf("HB ACTIVE} "); 
-      NodeStates[NodeID - 1] |= NODE_STATE_HBACTIVE; // signal HB active
-      NodeStates[NodeID - 1] &= ~NODE_STATE_HBLOSS;
       break;   
     case NODESTATUS_HBLOST: 
       printf("HB LOST} "); 
-      NodeStates[NodeID - 1] = NODE_STATE_HBACTIVE | NODE_STATE_HBLOSS; // signal HB active & loss, reset all other bits
       break;     
     case NODESTATUS_SCANSTARTED: 
       printf("SCAN INIT} "); 
-      NodeStates[NodeID - 1] |= NODE_STATE_SCANNING; // signal scan init
-      NodeStates[NodeID - 1] &= ~NODE_STATE_BOOTED;
       break;
     case NODESTATUS_SCANCOMPLETE: // App can now access this node
       printf("SCANNED} "); 
-      NodeStates[NodeID - 1] |= NODE_STATE_SCANFINISHED; // signal scan complete
-      NodeStates[NodeID - 1] &= ~NODE_STATE_SCANNING;
       break;
     case NODESTATUS_SCANABORTED: 
       printf("SCAN ABORT} "); 
-      NodeStates[NodeID - 1] &= ~NODE_STATE_SCANFINISHED; // signal scan abort
-      NodeStates[NodeID - 1] &= ~NODE_STATE_SCANNING;
       break;
     case NODESTATUS_RESETAPP: printf("RESET APP} "); break;    
     case NODESTATUS_RESETCOM: printf("RESET COM} "); break;   
@@ -192,6 +184,26 @@ void NodeStatusChanged (
 }
 
 
+/**************************************************************************
+DOES:    Call-back function of the node tracker, notes the nodes whose
+         scan completed for the main loop
+GLOBALS: Updates ScanPending
+**************************************************************************/
+void NodeStatesChanged (
+  unsigned char NodeID,    // node ID for which a change of state was detected
+  unsigned char State,     // current state of that node
+  unsigned long OldStates, // states before, NODETRACK_BIT mask
+  unsigned long NewStates, // states now
+  void *Param
+  )
+{
+  if ((NewStates & ~OldStates) & NODETRACK_BIT(NODETRACK_SCANNED))
+  {
+    NODESET_Set(&ScanPending, NodeID & 0x7F);
+  }
+}
+
+
 /**************************************************************************
 DOES:    Call-back function, data indication, new data arrived in device
 **************************************************************************/
@@ -212,10 +224,14 @@ void NewData (
   else if (Index == 0x5F04)
   { // node status
     NodeStatusChanged(Subindex,*Data);
+    Nodes.HandleData(Index, Subindex, DataLength, Data);
+    Emergencies.HandleData(Index, Subindex, DataLength, Data);
   }
-#if SHOW_NEW_DATA == 1
   else
-  { // display raw data received
+  { // process data, nothing is logged without a log file
+    ProcessData.HandleData(NodeID, Index, Subindex, DataLength, Data);
+#if SHOW_NEW_DATA == 1
+    // display raw data received
     printf("{%d:%4.4X,%2.2X;", NodeID, Index, Subindex);
     while(DataLength > 0)
     {
@@ -224,8 +240,8 @@ void NewData (
       DataLength--;
     }
     printf("} ");
-  }
 #endif // SHOW_NEW_DATA
+  }
 }
 
 
@@ -262,16 +278,21 @@ int main(int argc, char* argv[])
   unsigned long result;
   time_t PDOTime;
   time_t EndTime;
-  unsigned int *p32;
-  unsigned char nodes = 0;
+  uint32_t DeviceType;
+  NODESET Producers;
+  NODESET EmcyNodes;
+  EMCYLOG_STATS EmcyStats;
+  unsigned int count;
+  unsigned int e;
+  unsigned char node;
   unsigned short NMTCmd;
   char *ComPort;
 
   printf("\nCANopenIA Remote Access by www.esacademy.com\nV1.20 of 15-NOV-2017\n\n");
 
-  if (argc != 2)
+  if ((argc != 2) && (argc != 3))
   {
-    printf("Usage: RA_App <comportnumber>\n");
+    printf("Usage: RA_App <comportnumber> [<logfile>]\n");
     return 1;
   }
 
@@ -298,6 +319,14 @@ int main(int argc, char* argv[])
   printf("Connected to %s\n", ComPort);
 #endif // !WIN32
 
+  // process data is logged from now on
+  if ((argc == 3) && !ProcessData.Open(argv[2]))
+  {
+    COIADevice->Disconnect();
+    delete COIADevice;
+    return 1;
+  }
+
 #if SHOW_NEW_DATA == 1 
   printf("\nData in {NodeID:Index,Subindex;Data}-brackets is received in call back functions.\n\n");
 #endif // SHOW_NEW_DATA
@@ -305,8 +334,7 @@ int main(int argc, char* argv[])
   // register callback functions
   COIADevice->RegisterDataCallback((DATACALLBACK *)NewData, NULL);
   COIADevice->RegisterSDORequestCallbacks((SDOREQUESTCOMPLETECALLBACK *)SDORequestComplete);
-
-  p32 = (unsigned int *) &(DataBuf[0]);
+  Nodes.RegisterCallback(NodeStatesChanged, NULL);
 
   // get NMT state of node
   printf("\nRequesting NMT state of COIA node...\n");
@@ -348,49 +376,67 @@ int main(int argc, char* argv[])
   {
     if (MyNMTState == NODESTATUS_OPERATIONAL)
     { // only if we have a node ID and are operational
-      nodes++;
-      if (nodes >= MAX_NUMBER_OF_NODES)
+      // all nodes whose scan completed since the last pass
+      for (node = NODESET_Next(&ScanPending, 1); node; node = NODESET_Next(&ScanPending, node + 1))
       {
-        nodes = 0;
-      }
-      // process nodes from 1 to MAX_NUMBER_OF_NODES
-      if ((nodes + 1) != MyNodeID) 
-      { 
-        if ((NodeStates[nodes] & NODE_STATE_SCANFINISHED) != 0)
-        { // nodes scan complete
-          // read device type
-          if ((result = COIADevice->ReadRemoteOD(nodes + 1, 0x1000, 0x00, &Length, DataBuf)) == ERROR_NOERROR)
-          {
-            if ((*p32 & 0x0000FFFFul) == 401)
-            { // This is a CiA401 generic I/O device
-              printf("[CiA401 device: data producer enabled] ");
-              NodeStates[nodes] |= NODE_STATE_PRODUCEDATA; // produce data for this device
-            }
-            else
-            {
-              printf("[CiA %lu device: no handler] ",(*p32 & 0x00000FFFul));
-            }
+        NODESET_Clear(&ScanPending, node);
+        if (node == MyNodeID) continue;
+        // read device type
+        if ((result = COIAObjects->Read<OD_DEVICETYPE>(node, &DeviceType)) == ERROR_NOERROR)
+        {
+          if ((DeviceType & 0x0000FFFFul) == 401)
+          { // This is a CiA401 generic I/O device
+            printf("[CiA401 device: data producer enabled] ");
+            Nodes.SetState(node, NODE_STATE_PRODUCEDATA, TRUE); // produce data for this device
           }
           else
           {
-             printf("[Error on device type read for node %d - 0x%8.8lX] ", nodes + 1, result);
-             if (result == ERROR_NODEERROR) printf("Node error: 0x%8.8X ", COIADevice->GetLastNodeError());
+            printf("[CiA %lu device: no handler] ",(unsigned long)(DeviceType & 0x00000FFFul));
           }
-          // reset marker
-          NodeStates[nodes] &= ~NODE_STATE_SCANFINISHED;
         }
-        else if ((NodeStates[nodes] & NODE_STATE_PRODUCEDATA) != 0)
-        { // PDO data production enabled
-          if (time(NULL) >= PDOTime) 
-          {
-            DataBuf[0] = (unsigned char) PDOTime;
-            COIADevice->WriteRemoteOD(nodes, 0x6200, 0x01, 1, DataBuf);
-            DataBuf[0] = (unsigned char) (PDOTime >> 8);
-            COIADevice->WriteRemoteOD(nodes, 0x6200, 0x02, 1, DataBuf);
-            PDOTime = time(NULL) + 1;
-          }
+        else
+        {
+           printf("[Error on device type read for node %d - 0x%8.8lX] ", node, result);
+           if (result == ERROR_NODEERROR) printf("Node error: 0x%8.8X ", COIADevice->GetLastNodeError());
         }
       }
+
+      // new emergencies since the last pass, the latest error of each node
+      // is read once however many emergencies it sent and given to them
+      Emergencies.GetPending(&EmcyNodes);
+      for (node = NODESET_Next(&EmcyNodes, 1); node; node = NODESET_Next(&EmcyNodes, node + 1))
+      {
+        if ((node != MyNodeID) && (COIADevice->ReadRemoteOD(node, 0x1003, 0x01, &Length, DataBuf) == ERROR_NOERROR) && (Length >= 2))
+        {
+          Emergencies.SetCode(node, (unsigned short)(DataBuf[0] | (DataBuf[1] << 8)));
+        }
+        // communication errors 81xxh, e.g. CAN overrun or heartbeat lost
+        count = Emergencies.Peek(node, EmcyEvents, EMCY_DRAIN, 0x8100, 0xFF00);
+        if (count) printf("[EMCY node %d: %u communication errors] ", node, count);
+      }
+      count = Emergencies.Drain(EmcyEvents, EMCY_DRAIN, NULL);
+      for (e = 0; e < count; e++)
+      {
+        if (EmcyEvents[e].Flags & EMCY_FLAG_CODE)
+        {
+          printf("[EMCY node %d: error code 0x%4.4X] ", EmcyEvents[e].NodeID, EmcyEvents[e].Code);
+        }
+      }
+
+      // PDO data production enabled, for all operational CiA401 nodes at once
+      if (time(NULL) >= PDOTime)
+      {
+        Nodes.Select(&Producers, NODETRACK_BIT(NODE_STATE_PRODUCEDATA) | NODETRACK_BIT(NODETRACK_OPERATIONAL),
+          NODETRACK_BIT(NODETRACK_SELF));
+        for (node = NODESET_Next(&Producers, 1); node; node = NODESET_Next(&Producers, node + 1))
+        {
+          DataBuf[0] = (unsigned char) PDOTime;
+          COIADevice->WriteRemoteOD(node, 0x6200, 0x01, 1, DataBuf);
+          DataBuf[0] = (unsigned char) (PDOTime >> 8);
+          COIADevice->WriteRemoteOD(node, 0x6200, 0x02, 1, DataBuf);
+        }
+        PDOTime = time(NULL) + 1;
+      }
     }
 
     // keep receiving packets
@@ -404,6 +450,23 @@ int main(int argc, char* argv[])
   COIADevice->RegisterDataCallback(NULL, NULL);
   COIADevice->RegisterSDORequestCallbacks(NULL);
 
+  // emergency statistics of all nodes that sent any
+  for (node = 1; node < NODESET_NODES; node++)
+  {
+    Emergencies.GetStatistics(node, &EmcyStats);
+    if (EmcyStats.Received == 0) continue;
+    printf("\nNode %d: %lu emergencies, %lu lost, peak %lu/s", node, (unsigned long)EmcyStats.Received,
+      (unsigned long)EmcyStats.Dropped, EmcyStats.PeakRate);
+  }
+
+  // write the remaining process data
+  ProcessData.Close();
+  if (STATS_Get(&ProcessData.GetStatistics()->Samples))
+  {
+    printf("\nProcess data: %lu samples, %lu bytes logged of %lu", (unsigned long)STATS_Get(&ProcessData.GetStatistics()->Samples),
+      (unsigned long)STATS_Get(&ProcessData.GetStatistics()->Bytes), (unsigned long)STATS_Get(&ProcessData.GetStatistics()->RawBytes));
+  }
+
   COIADevice->Disconnect();
 #ifdef WIN32
   printf("\nDisconnected from COM%s...\n", ComPort);
@@ -0,0 +1,131 @@
+/**************************************************************************
+MODULE:    RA_Batch
+CONTAINS:  Executes a command file against a CANopenIA device with precise
+           timing. Command files contain coia style commands, e.g.
+             loop 10
+               node-write 3,0x6200,1,1,0x55
+               delay 25
+             end
+             wait-for-status 3,0x05,5000
+COPYRIGHT: Embedded Systems Academy, Inc. 2008-2017.
+DISCLAIM:  Read and understand our disclaimer before using this code!
+           www.esacademy.com/disclaim.htm
+           This software was written in accordance to the guidelines at
+           www.esacademy.com/software/softwarestyleguide.pdf
+LICENSE:   Free to use with licensed CANopenIA chips, modules or devices
+           like CANgineBerry, CANgineXXX and 447izer
+VERSION:   1.10, EmSA 10-NOV-17
+           $LastChangedDate: 2014-01-11 17:30:59 +0100 (Sa, 11 Jan 2014) $
+           $LastChangedRevision: 1702 $
+***************************************************************************/
+
+#ifdef WIN32
+#include <windows.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include "SerialProtocol.h"
+#include "Batch.h"
+
+// default baudrate to connect at
+#define BAUDRATE 921600
+
+/**************************************************************************
+MODULE VARIABLES
+***************************************************************************/
+
+static SerialProtocol *COIADevice = new SerialProtocol();
+static BATCH *Batch = new BATCH();
+
+
+/*******************************************************************************
+DOES:    Called when user presses Ctrl-C. Stops the batch
+RETURNS: Nothing
+*******************************************************************************/
+static void Terminate
+  (
+  int SignalNumber
+  )
+{
+  Batch->Stop();
+}
+
+
+/**************************************************************************
+DOES:    Call-back function, prints the result of an operation
+RETURNS: Nothing
+**************************************************************************/
+static void ShowResult
+  (
+  const BATCH_OP *Op,                                      // executed operation
+  unsigned long Result,                                    // ERROR_xxx
+  unsigned long Length,                                    // length of data read
+  const UNSIGNED8 *Data,                                   // data read
+  void *Param                                              // not used
+  )
+{
+  char Text[CMD_MAX_RESULT_LENGTH + 1];
+
+  CMD_FormatResult(Text, sizeof(Text), &Op->Command, Result, Length, Data, COIADevice->GetLastNodeError());
+  printf("%lu: %s\n", Op->Line, Text);
+}
+
+
+/**************************************************************************
+DOES:    Main function, open com port, run command file
+**************************************************************************/
+int main(int argc, char* argv[])
+{
+  const BATCH_STATS *Stats;
+  unsigned long Baudrate = BAUDRATE;
+  unsigned long Result;
+
+  if ((argc != 3) && (argc != 4))
+  {
+    printf("Usage: RA_Batch <comportnumber> <commandfile> [<baudrate>]\n");
+    return 1;
+  }
+  if (argc == 4) Baudrate = strtoul(argv[3], NULL, 0);
+
+  if (!Batch->Load(argv[2]))
+  {
+    printf("Error in %s line %lu\n", argv[2], Batch->GetErrorLine());
+    return 1;
+  }
+
+  if (!COIADevice->Connect(argv[1], Baudrate))
+  {
+#ifdef WIN32
+    printf("Failed to connect to COM%s port\n", argv[1]);
+#else
+    printf("Failed to connect to %s\n", argv[1]);
+#endif // !WIN32
+    delete COIADevice;
+    return 1;
+  }
+
+  signal(SIGINT, Terminate);
+
+  Result = Batch->Run(COIADevice, TRUE, ShowResult, NULL);
+  if (Result != ERROR_NOERROR)
+  {
+    printf("Stopped in line %lu, error code = 0x%8.8lX\n", Batch->GetErrorLine(), Result);
+  }
+
+  Stats = Batch->GetStats();
+  printf("%lu operations, %lu errors, %.3f ms\n", Stats->Operations, Stats->Errors, Stats->Duration / 1000.0);
+  if (Stats->Deadlines)
+  {
+    printf("%lu delays, late by %.1f us average, %lu us max\n", Stats->Deadlines,
+      (double)Stats->TotalLateness / Stats->Deadlines, (unsigned long)Stats->MaxLateness);
+  }
+
+  COIADevice->Disconnect();
+  delete COIADevice;
+  delete Batch;
+
+  return (Result == ERROR_NOERROR) ? 0 : 1;
+}
+
+/*----------------------- END OF FILE ----------------------------------*/
@@ -0,0 +1,1053 @@
+/**************************************************************************
+MODULE:    RA_Bench
+CONTAINS:  Throughput and latency benchmarks of the serial protocol stack.
+           Runs a simulated CANopenIA device in a thread and measures the
+           host side through the pseudo terminal of the simulator:
+             local object dictionary round trip (ReadLocalOD)
+             remote expedited SDO (ReadRemoteOD)
+             segmented and block SDO (Read/WriteRemoteODExtended)
+             process data ingest through Process()
+             generic CAN messages echoed by the device (SendCanFrames)
+           Results are printed as comma separated values, one line per
+           benchmark, e.g. "make bench" or
+             RA_Bench -n 2000 -d 0.2 > results.csv
+           -l and -r run the benchmarks with the low latency mode and any
+           baudrate of the serial port, the pseudo terminal takes both. -u
+           uses the io_uring backend of the serial port. -m adds a benchmark
+           of further simulated devices run by one device manager, run by
+           Poll also with concurrent request sequences on each device.
+           Built as ra_bench20 with C++20 the same sequences also run as
+           coroutines.
+COPYRIGHT: Embedded Systems Academy, Inc. 2008-2017.
+DISCLAIM:  Read and understand our disclaimer before using this code!
+           www.esacademy.com/disclaim.htm
+           This software was written in accordance to the guidelines at
+           www.esacademy.com/software/softwarestyleguide.pdf
+LICENSE:   Free to use with licensed CANopenIA chips, modules or devices
+           like CANgineBerry, CANgineXXX and 447izer
+VERSION:   1.10, EmSA 10-NOV-17
+           $LastChangedDate: 2014-01-11 17:30:59 +0100 (Sa, 11 Jan 2014) $
+           $LastChangedRevision: 1702 $
+***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include "SerialProtocol.h"
+#include "DeviceManager.h"
+#include "DeviceSim.h"
+#include "Sequence.h"
+#include "Timer.h"
+
+/**************************************************************************
+LOCAL DEFINES
+***************************************************************************/
+
+// baudrate to connect at, the pseudo terminal ignores it
+#define BAUDRATE 921600
+
+// node ids of the simulated network, the device itself is node 1
+#define OWN_NODE       1
+#define SERVER_NODE    2   // answers SDO requests, produces background PDOs
+#define FIRST_PRODUCER 3   // nodes up to 127 produce PDOs for the ingest benchmark
+
+// data sizes, the host SDO client uses segmented transfers for buffers
+// up to 28 bytes and block transfers above
+#define SEGMENTED_SIZE   20
+#define SEGMENTED_BUFFER 28
+#define BLOCK_SIZE       SIMNODE_DOMAIN_SIZE
+
+// generic CAN messages per operation of the raw CAN benchmark
+#define CAN_BATCH (4 * CAN_TX_WINDOW)
+
+// sequences running at the same time on each device of the sequence
+// benchmark, and the bytes of the data they read and write
+#define MULTI_SEQUENCES     64
+#define MULTI_SEQUENCE_DATA 12
+
+// max number of latency samples per benchmark
+#define MAX_SAMPLES 100000
+
+// operations run before measuring
+#define WARMUP_COUNT 3
+
+// NMT commands [5F0A,01]
+#define NMT_OPERATIONAL 1
+#define NMT_STOP        2
+
+// a single operation of a benchmark, returns FALSE for failure
+typedef bool (*BENCH_OP)(unsigned long *Bytes);
+
+// a device of the multi-device benchmark, one request in flight each
+typedef struct
+{
+  DEVICESIM *Sim;
+  pthread_t Thread;
+  DEVMGR_REQUEST Request;
+  unsigned long Count;
+  unsigned long Errors;
+  unsigned int Sequences;                  // sequences running
+  volatile bool Done;
+} MULTI_DEVICE;
+
+// a commissioning sequence of the sequence benchmark: reads the device
+// type and checks the profile, reads the heartbeat time and writes it
+// back, reads the counter
+class BENCH_SEQUENCE : public SEQUENCE
+{
+  public:
+    MULTI_DEVICE *Device;
+
+  protected:
+    void Run(void);
+    void Finished(void);
+
+  private:
+    UNSIGNED8 Heartbeat[2];
+    bool Failed;
+};
+
+/**************************************************************************
+MODULE VARIABLES
+***************************************************************************/
+
+// object dictionary of all simulated nodes
+static const char BenchEDS[] =
+  "[DeviceInfo]\n"
+  "ProductName=RA_Bench Node\n"
+  "[1000]\n"
+  "ParameterName=Device Type\n"
+  "ObjectType=0x7\n"
+  "DataType=0x0007\n"
+  "AccessType=ro\n"
+  "DefaultValue=0x00000191\n"
+  "PDOMapping=0\n"
+  "[1017]\n"
+  "ParameterName=Producer Heartbeat Time\n"
+  "ObjectType=0x7\n"
+  "DataType=0x0006\n"
+  "AccessType=rw\n"
+  "DefaultValue=0\n"
+  "PDOMapping=0\n"
+  "[2000]\n"
+  "ParameterName=Block Data\n"
+  "ObjectType=0x7\n"
+  "DataType=0x000F\n"
+  "AccessType=rw\n"
+  "PDOMapping=0\n"
+  "[2001]\n"
+  "ParameterName=Segment Data\n"
+  "ObjectType=0x7\n"
+  "DataType=0x000F\n"
+  "AccessType=rw\n"
+  "PDOMapping=0\n"
+  "[6000]\n"
+  "ParameterName=Counter\n"
+  "ObjectType=0x7\n"
+  "DataType=0x0007\n"
+  "AccessType=ro\n"
+  "DefaultValue=0\n"
+  "PDOMapping=1\n";
+
+static SerialProtocol *COIADevice = new SerialProtocol();
+static DEVICESIM *Sim = new DEVICESIM();
+static EDS Dictionary;
+static volatile bool SimStopRequested = FALSE;
+
+// settings
+static unsigned long MaxCount = 1000;          // operations per benchmark
+static unsigned long MaxTime = 10000000;       // microseconds per benchmark
+static UNSIGNED32 BackgroundInterval = 1;      // ms between PDOs of the server node
+static UNSIGNED32 IngestInterval = 1;          // ms between PDOs of each producer
+static UNSIGNED32 IngestTime = 2000000;         // microseconds of PDO ingest
+static unsigned long Baudrate = BAUDRATE;      // bps of the serial port
+static unsigned int MultiDevices = 0;          // devices of the multi-device benchmark, 0 for none
+static unsigned int MultiThreads = 0;          // threads of the device manager, 0 to run it by Poll
+static unsigned long BlockBurst = 0;           // SDO block download segments sent at once, 0 for default
+static unsigned long CanWindow = 1;            // generic CAN messages sent before waiting for responses
+static bool LowLatency = FALSE;
+static int Backend = SERIAL_BACKEND_SYSCALL;
+
+// results of call-backs
+static volatile bool SdoCompleted;
+static volatile UNSIGNED32 SdoResult;
+static volatile unsigned long ProcessDataCount;
+
+static UNSIGNED32 Samples[MAX_SAMPLES];
+static UNSIGNED8 WriteBuffer[BLOCK_SIZE];
+static UNSIGNED8 ReadBuffer[BLOCK_SIZE];
+
+// multi-device benchmark
+static DEVICEMANAGER *Manager;
+static MULTI_DEVICE Multi[DEVMGR_MAX_DEVICES];
+static uint64_t MultiEnd;
+
+
+/**************************************************************************
+DOES:    Runs the simulated device until stopped
+RETURNS: NULL
+**************************************************************************/
+static void *SimThread
+  (
+  void *Param                                              // not used
+  )
+{
+  while (!SimStopRequested) Sim->Process(10);
+  return NULL;
+}
+
+
+/**************************************************************************
+DOES:    Runs a simulated device of the multi-device benchmark until stopped
+RETURNS: NULL
+**************************************************************************/
+static void *MultiSimThread
+  (
+  void *Param                                              // simulated device
+  )
+{
+  while (!SimStopRequested) ((DEVICESIM *)Param)->Process(10);
+  return NULL;
+}
+
+
+/**************************************************************************
+DOES:    Call-back function, counts process data received
+RETURNS: Nothing
+**************************************************************************/
+static void NewData
+  (
+  unsigned char NodeID,                                    // node id of node that sent the data
+  int Index,                                               // index of od entry
+  unsigned char Subindex,                                  // subindex of od entry
+  unsigned long DataLength,                                // length of data
+  unsigned char *Data,                                     // data
+  void *Param                                              // not used
+  )
+{
+  if ((Index == 0x6000) && (NodeID >= FIRST_PRODUCER)) ProcessDataCount = ProcessDataCount + 1;
+}
+
+
+/**************************************************************************
+DOES:    Call-back function, signals the end of an extended SDO transfer
+RETURNS: Nothing
+**************************************************************************/
+static void SDORequestComplete
+  (
+  UNSIGNED8 Channel,                                       // SDO client channel
+  UNSIGNED32 Result                                        // SDOERR_xxx
+  )
+{
+  SdoResult = Result;
+  SdoCompleted = TRUE;
+}
+
+
+/**************************************************************************
+DOES:    Processes packets until the pending extended SDO transfer ended
+RETURNS: TRUE if the transfer succeeded, else FALSE
+**************************************************************************/
+static bool WaitForSDO
+  (
+  void
+  )
+{
+  uint64_t Timeout = Timer::GetMicroseconds() + MaxTime;
+
+  while (!SdoCompleted)
+  {
+    if (Timer::GetMicroseconds() >= Timeout) return FALSE;
+    COIADevice->Process();
+  }
+  return SdoResult == SDOERR_OK;
+}
+
+
+/**************************************************************************
+DOES:    Sends an NMT command through [5F0A,01]
+RETURNS: TRUE for success, FALSE for error
+**************************************************************************/
+static bool NMTCommand
+  (
+  UNSIGNED8 Command,                                       // NMT command
+  UNSIGNED8 NodeID                                         // node id, 0 for all nodes
+  )
+{
+  unsigned char Data[2];
+
+  Data[0] = Command;
+  Data[1] = NodeID;
+  return COIADevice->WriteLocalOD(0x5F0A, 0x01, 2, Data) == ERROR_NOERROR;
+}
+
+
+/**************************************************************************
+DOES:    Benchmark operations, each performs one request and waits for
+         its completion
+RETURNS: TRUE for success, FALSE for failure
+**************************************************************************/
+static bool ReadLocal
+  (
+  unsigned long *Bytes                                     // location to store bytes transferred
+  )
+{
+  unsigned char Data[MAX_PACKET_LENGTH];
+
+  return COIADevice->ReadLocalOD(0x5F00, 0x01, Bytes, Data) == ERROR_NOERROR;
+}
+
+static bool ReadRemote
+  (
+  unsigned long *Bytes                                     // location to store bytes transferred
+  )
+{
+  unsigned char Data[MAX_PACKET_LENGTH];
+
+  return COIADevice->ReadRemoteOD(SERVER_NODE, 0x1000, 0x00, Bytes, Data) == ERROR_NOERROR;
+}
+
+static bool WriteSegmented
+  (
+  unsigned long *Bytes                                     // location to store bytes transferred
+  )
+{
+  SdoCompleted = FALSE;
+  if (COIADevice->WriteRemoteODExtended(SERVER_NODE, 0x2001, 0x00, SEGMENTED_SIZE, WriteBuffer) != ERROR_NOERROR) return FALSE;
+  *Bytes = SEGMENTED_SIZE;
+  return WaitForSDO();
+}
+
+static bool ReadSegmented
+  (
+  unsigned long *Bytes                                     // location to store bytes transferred
+  )
+{
+  unsigned long Length = SEGMENTED_BUFFER;
+
+  SdoCompleted = FALSE;
+  if (COIADevice->ReadRemoteODExtended(SERVER_NODE, 0x2001, 0x00, &Length, ReadBuffer) != ERROR_NOERROR) return FALSE;
+  *Bytes = SEGMENTED_SIZE;
+  return WaitForSDO() && (memcmp(ReadBuffer, WriteBuffer, SEGMENTED_SIZE) == 0);
+}
+
+static bool WriteBlock
+  (
+  unsigned long *Bytes                                     // location to store bytes transferred
+  )
+{
+  SdoCompleted = FALSE;
+  if (COIADevice->WriteRemoteODExtended(SERVER_NODE, 0x2000, 0x00, BLOCK_SIZE, WriteBuffer) != ERROR_NOERROR) return FALSE;
+  *Bytes = BLOCK_SIZE;
+  return WaitForSDO();
+}
+
+static bool ReadBlock
+  (
+  unsigned long *Bytes                                     // location to store bytes transferred
+  )
+{
+  unsigned long Length = BLOCK_SIZE;
+
+  SdoCompleted = FALSE;
+  if (COIADevice->ReadRemoteODExtended(SERVER_NODE, 0x2000, 0x00, &Length, ReadBuffer) != ERROR_NOERROR) return FALSE;
+  *Bytes = BLOCK_SIZE;
+  return WaitForSDO() && (memcmp(ReadBuffer, WriteBuffer, BLOCK_SIZE) == 0);
+}
+
+
+static bool SendCan
+  (
+  unsigned long *Bytes                                     // location to store bytes transferred
+  )
+{
+  CAN_MSG Frames[CAN_BATCH];
+  unsigned long f;
+
+  for (f = 0; f < CAN_BATCH; f++)
+  {
+    Frames[f].ID = 0x100 + f;
+    Frames[f].LEN = 8;
+    memcpy(Frames[f].BUF, &WriteBuffer[f], 8);
+  }
+  if (COIADevice->SendCanFrames(Frames, CAN_BATCH) != ERROR_NOERROR) return FALSE;
+  *Bytes = CAN_BATCH * 8;
+  // the device echoes each message before confirming it
+  return COIADevice->ReceiveCanFrames(Frames, CAN_BATCH) == CAN_BATCH;
+}
+
+
+/**************************************************************************
+DOES:    Compares two latency samples for sorting
+RETURNS: <0, 0, >0 like strcmp
+**************************************************************************/
+static int CompareSamples
+  (
+  const void *a,                                           // first sample
+  const void *b                                            // second sample
+  )
+{
+  UNSIGNED32 x = *(const UNSIGNED32 *)a;
+  UNSIGNED32 y = *(const UNSIGNED32 *)b;
+
+  return (x < y) ? -1 : (x > y) ? 1 : 0;
+}
+
+
+/**************************************************************************
+DOES:    Gets a percentile of sorted samples by the nearest rank method
+RETURNS: Sample
+**************************************************************************/
+static UNSIGNED32 Percentile
+  (
+  unsigned long Count,                                     // number of samples, at least 1
+  unsigned long PerMille                                   // percentile * 10, e.g. 999
+  )
+{
+  unsigned long Rank = (Count * PerMille + 999) / 1000;
+
+  return Samples[(Rank > 0) ? Rank - 1 : 0];
+}
+
+
+/**************************************************************************
+DOES:    Prints the result line of a benchmark. Latencies of benchmarks
+         without samples are left empty.
+RETURNS: Nothing
+**************************************************************************/
+static void PrintResult
+  (
+  const char *Name,                                        // name of benchmark
+  unsigned long Ops,                                       // operations completed
+  unsigned long Errors,                                    // operations failed
+  uint64_t Duration,                                       // microseconds
+  uint64_t Bytes,                                          // payload bytes transferred
+  uint64_t Writes,                                         // writes to the serial port
+  unsigned long Count                                      // number of latency samples
+  )
+{
+  double Seconds = Duration / 1000000.0;
+
+  printf("%s,%lu,%lu,%.3f,%.1f,%.1f", Name, Ops, Errors, Seconds,
+    Seconds ? Ops / Seconds : 0.0, Seconds ? Bytes / Seconds : 0.0);
+  if (Count)
+  {
+    qsort(Samples, Count, sizeof(Samples[0]), CompareSamples);
+    printf(",%lu,%lu,%lu", (unsigned long)Percentile(Count, 500),
+      (unsigned long)Percentile(Count, 990), (unsigned long)Percentile(Count, 999));
+  }
+  else
+  {
+    printf(",,,");
+  }
+  printf(",%.2f\n", Ops ? (double)Writes / Ops : 0.0);
+  fflush(stdout);
+}
+
+
+/**************************************************************************
+DOES:    Runs a benchmark until MaxCount operations are done or MaxTime
+         passed, measures the latency of each operation
+RETURNS: Nothing
+**************************************************************************/
+static void RunBenchmark
+  (
+  const char *Name,                                        // name of benchmark
+  BENCH_OP Operation                                       // operation to measure
+  )
+{
+  unsigned long Count = 0;
+  unsigned long Errors = 0;
+  unsigned long Bytes;
+  uint64_t TotalBytes = 0;
+  uint64_t Start;
+  uint64_t End;
+  uint64_t Begin;
+  uint64_t Writes;
+  unsigned long w;
+
+  fprintf(stderr, "%s...\n", Name);
+  for (w = 0; w < WARMUP_COUNT; w++) Operation(&Bytes);
+
+  Writes = STATS_Get(&COIADevice->GetStatistics()->TxWrites);
+  Begin = Timer::GetMicroseconds();
+  End = Begin;
+  while ((Count + Errors < MaxCount) && (End - Begin < MaxTime))
+  {
+    Bytes = 0;
+    Start = Timer::GetMicroseconds();
+    if (Operation(&Bytes))
+    {
+      End = Timer::GetMicroseconds();
+      if (Count < MAX_SAMPLES) Samples[Count] = (UNSIGNED32)(End - Start);
+      TotalBytes += Bytes;
+      Count++;
+    }
+    else
+    {
+      End = Timer::GetMicroseconds();
+      Errors++;
+    }
+  }
+  Writes = STATS_Get(&COIADevice->GetStatistics()->TxWrites) - Writes;
+  PrintResult(Name, Count, Errors, End - Begin, TotalBytes, Writes, (Count < MAX_SAMPLES) ? Count : MAX_SAMPLES);
+}
+
+
+/**************************************************************************
+DOES:    Measures how many PDOs per second Process() takes from the
+         device while all producers are operational
+RETURNS: Nothing
+**************************************************************************/
+static void RunIngestBenchmark
+  (
+  void
+  )
+{
+  uint64_t Begin;
+  uint64_t End;
+  uint64_t Writes;
+  unsigned long Count;
+  unsigned long Errors = 0;
+
+  fprintf(stderr, "pdo_ingest...\n");
+  if (!NMTCommand(NMT_OPERATIONAL, 0)) Errors++;
+
+  // measurement starts with the first PDO
+  ProcessDataCount = 0;
+  End = Timer::GetMicroseconds() + MaxTime;
+  while ((ProcessDataCount == 0) && (Timer::GetMicroseconds() < End)) COIADevice->Process();
+
+  ProcessDataCount = 0;
+  Writes = STATS_Get(&COIADevice->GetStatistics()->TxWrites);
+  Begin = Timer::GetMicroseconds();
+  End = Begin;
+  while (End - Begin < IngestTime)
+  {
+    COIADevice->Process();
+    End = Timer::GetMicroseconds();
+  }
+  Count = ProcessDataCount;
+  Writes = STATS_Get(&COIADevice->GetStatistics()->TxWrites) - Writes;
+
+  if (!NMTCommand(NMT_STOP, 0)) Errors++;
+  PrintResult("pdo_ingest", Count, Errors, End - Begin, (uint64_t)Count * 4, Writes, 0);
+}
+
+
+/**************************************************************************
+DOES:    Call-back function of the device manager, counts the completed
+         read and sends the next one
+RETURNS: Nothing
+**************************************************************************/
+static void MultiComplete
+  (
+  DEVMGR_REQUEST *Request                                  // request completed
+  )
+{
+  MULTI_DEVICE *Device = (MULTI_DEVICE *)Request->Param;
+
+  if (Request->Result == ERROR_NOERROR) Device->Count++;
+  else Device->Errors++;
+
+  if ((Device->Count + Device->Errors < MaxCount) && (Timer::GetMicroseconds() < MultiEnd))
+  {
+    Request->DataLength = 0;
+    if (Manager->Submit(Request)) return;
+  }
+  Device->Done = TRUE;
+}
+
+
+/**************************************************************************
+DOES:    Body of a sequence of the sequence benchmark
+RETURNS: Nothing
+**************************************************************************/
+void BENCH_SEQUENCE::Run
+  (
+  void
+  )
+{
+  SEQUENCE_BEGIN();
+  Failed = TRUE;
+
+  SEQUENCE_READ(SERVER_NODE, 0x1000, 0x00);
+  if ((Request.Result != ERROR_NOERROR) || (Request.DataLength != 4)) SEQUENCE_EXIT();
+  if ((GET_U16(Request.Data)) != 401) SEQUENCE_EXIT();
+
+  SEQUENCE_READ(SERVER_NODE, 0x1017, 0x00);
+  if ((Request.Result != ERROR_NOERROR) || (Request.DataLength != 2)) SEQUENCE_EXIT();
+  memcpy(Heartbeat, Request.Data, 2);
+
+  SEQUENCE_WRITE(SERVER_NODE, 0x1017, 0x00, 2, Heartbeat);
+  if (Request.Result != ERROR_NOERROR) SEQUENCE_EXIT();
+
+  SEQUENCE_READ(SERVER_NODE, 0x6000, 0x00);
+  if (Request.Result != ERROR_NOERROR) SEQUENCE_EXIT();
+
+  Failed = FALSE;
+  SEQUENCE_END();
+}
+
+
+/**************************************************************************
+DOES:    Counts a sequence of the sequence benchmark and starts it again
+RETURNS: Nothing
+**************************************************************************/
+void BENCH_SEQUENCE::Finished
+  (
+  void
+  )
+{
+  if (Failed) Device->Errors++;
+  else Device->Count++;
+
+  if ((Device->Count + Device->Errors < MaxCount) && (Timer::GetMicroseconds() < MultiEnd))
+  {
+    Start(Manager, Request.Port);
+    return;
+  }
+  if (--Device->Sequences == 0) Device->Done = TRUE;
+}
+
+
+/**************************************************************************
+DOES:    Runs MULTI_SEQUENCES sequences on each device of the multi-device
+         benchmark at the same time, all in the thread calling Poll.
+         Requests of a device are sent one after the other.
+RETURNS: Nothing
+**************************************************************************/
+static void RunSequenceBenchmark
+  (
+  void
+  )
+{
+  char Name[64];
+  BENCH_SEQUENCE *Sequences;
+  MULTI_DEVICE *Device;
+  unsigned long Count = 0;
+  unsigned long Errors = 0;
+  uint64_t Begin;
+  uint64_t End;
+  uint64_t Writes = 0;
+  unsigned int d;
+  unsigned int q;
+  bool Done;
+
+  snprintf(Name, sizeof(Name), "multi_sequence_%ux%u", MultiDevices, MULTI_SEQUENCES);
+  fprintf(stderr, "%s...\n", Name);
+
+  Sequences = new BENCH_SEQUENCE[MultiDevices * MULTI_SEQUENCES];
+  for (d = 0; d < MultiDevices; d++)
+  {
+    Device = &Multi[d];
+    Device->Count = 0;
+    Device->Errors = 0;
+    Device->Sequences = MULTI_SEQUENCES;
+    Device->Done = FALSE;
+    Writes -= STATS_Get(&Manager->GetDevice(d)->GetStatistics()->TxWrites);
+  }
+
+  Begin = Timer::GetMicroseconds();
+  MultiEnd = Begin + MaxTime;
+  for (d = 0; d < MultiDevices; d++)
+  {
+    for (q = 0; q < MULTI_SEQUENCES; q++)
+    {
+      Sequences[d * MULTI_SEQUENCES + q].Device = &Multi[d];
+      Sequences[d * MULTI_SEQUENCES + q].Start(Manager, d);
+    }
+  }
+  do
+  {
+    Manager->Poll(DEVMGR_IDLE_WAIT);
+    Done = TRUE;
+    for (d = 0; d < MultiDevices; d++) if (!Multi[d].Done) Done = FALSE;
+  } while (!Done);
+  End = Timer::GetMicroseconds();
+
+  for (d = 0; d < MultiDevices; d++)
+  {
+    Count += Multi[d].Count;
+    Errors += Multi[d].Errors;
+    Writes += STATS_Get(&Manager->GetDevice(d)->GetStatistics()->TxWrites);
+  }
+  PrintResult(Name, Count, Errors, End - Begin, (uint64_t)Count * MULTI_SEQUENCE_DATA, Writes, 0);
+  delete[] Sequences;
+}
+
+
+#if defined(__cpp_impl_coroutine)
+
+/**************************************************************************
+DOES:    Coroutine of the coroutine benchmark, runs the commissioning
+         sequence of BENCH_SEQUENCE with co_await until the benchmark ends
+RETURNS: Nothing
+**************************************************************************/
+static SEQUENCE_TASK BenchCoroutine
+  (
+  MULTI_DEVICE *Device,                                    // device to run on
+  int Port                                                 // returned by AddDevice
+  )
+{
+  unsigned long Length;
+  unsigned char Data[MAX_PACKET_LENGTH];
+
+  while ((Device->Count + Device->Errors < MaxCount) && (Timer::GetMicroseconds() < MultiEnd))
+  {
+    if ((co_await ReadAsync(Manager, Port, SERVER_NODE, 0x1000, 0x00, &Length, Data) != ERROR_NOERROR) ||
+      (Length != 4) || ((GET_U16(Data)) != 401) ||
+      (co_await ReadAsync(Manager, Port, SERVER_NODE, 0x1017, 0x00, &Length, Data) != ERROR_NOERROR) ||
+      (Length != 2) ||
+      (co_await WriteAsync(Manager, Port, SERVER_NODE, 0x1017, 0x00, 2, Data) != ERROR_NOERROR) ||
+      (co_await ReadAsync(Manager, Port, SERVER_NODE, 0x6000, 0x00, &Length, Data) != ERROR_NOERROR))
+    {
+      Device->Errors++;
+    }
+    else
+    {
+      Device->Count++;
+    }
+  }
+  if (--Device->Sequences == 0) Device->Done = TRUE;
+}
+
+
+/**************************************************************************
+DOES:    Runs MULTI_SEQUENCES coroutines on each device of the multi-device
+         benchmark at the same time, like RunSequenceBenchmark
+RETURNS: Nothing
+**************************************************************************/
+static void RunCoroutineBenchmark
+  (
+  void
+  )
+{
+  char Name[64];
+  MULTI_DEVICE *Device;
+  unsigned long Count = 0;
+  unsigned long Errors = 0;
+  uint64_t Begin;
+  uint64_t End;
+  uint64_t Writes = 0;
+  unsigned int d;
+  unsigned int q;
+  bool Done;
+
+  snprintf(Name, sizeof(Name), "multi_coroutine_%ux%u", MultiDevices, MULTI_SEQUENCES);
+  fprintf(stderr, "%s...\n", Name);
+
+  for (d = 0; d < MultiDevices; d++)
+  {
+    Device = &Multi[d];
+    Device->Count = 0;
+    Device->Errors = 0;
+    Device->Sequences = MULTI_SEQUENCES;
+    Device->Done = FALSE;
+    Writes -= STATS_Get(&Manager->GetDevice(d)->GetStatistics()->TxWrites);
+  }
+
+  Begin = Timer::GetMicroseconds();
+  MultiEnd = Begin + MaxTime;
+  for (d = 0; d < MultiDevices; d++)
+  {
+    for (q = 0; q < MULTI_SEQUENCES; q++) BenchCoroutine(&Multi[d], d);
+  }
+  do
+  {
+    Manager->Poll(DEVMGR_IDLE_WAIT);
+    Done = TRUE;
+    for (d = 0; d < MultiDevices; d++) if (!Multi[d].Done) Done = FALSE;
+  } while (!Done);
+  End = Timer::GetMicroseconds();
+
+  for (d = 0; d < MultiDevices; d++)
+  {
+    Count += Multi[d].Count;
+    Errors += Multi[d].Errors;
+    Writes += STATS_Get(&Manager->GetDevice(d)->GetStatistics()->TxWrites);
+  }
+  PrintResult(Name, Count, Errors, End - Begin, (uint64_t)Count * MULTI_SEQUENCE_DATA, Writes, 0);
+}
+
+#endif // __cpp_impl_coroutine
+
+
+/**************************************************************************
+DOES:    Gets the processor time used by the benchmark so far
+RETURNS: Microseconds
+**************************************************************************/
+static uint64_t GetProcessorTime
+  (
+  void
+  )
+{
+  struct rusage Usage;
+
+  getrusage(RUSAGE_SELF, &Usage);
+  return (uint64_t)(Usage.ru_utime.tv_sec + Usage.ru_stime.tv_sec) * 1000000 +
+    Usage.ru_utime.tv_usec + Usage.ru_stime.tv_usec;
+}
+
+
+/**************************************************************************
+DOES:    Reads from the server node of further simulated devices, all
+         driven by one device manager. Every device has one read in
+         flight, the devices run in parallel. The processor time includes
+         the simulators.
+RETURNS: Nothing
+**************************************************************************/
+static void RunMultiBenchmark
+  (
+  void
+  )
+{
+  char Name[64];
+  SIMLINK Link;
+  MULTI_DEVICE *Device;
+  unsigned long Count = 0;
+  unsigned long Errors = 0;
+  unsigned long Length;
+  unsigned char Data[MAX_PACKET_LENGTH];
+  uint64_t Begin;
+  uint64_t End;
+  uint64_t Processor;
+  uint64_t Writes = 0;
+  unsigned int d;
+  bool Done;
+
+  snprintf(Name, sizeof(Name), "multi_remote_read_%ux%u", MultiDevices, MultiThreads);
+  fprintf(stderr, "%s...\n", Name);
+
+  // the devices, only the server node, without process data
+  memset(&Link, 0, sizeof(Link));
+  Manager = new DEVICEMANAGER();
+  Manager->SetLowLatency(LowLatency);
+  Manager->SetBackend(Backend);
+  for (d = 0; d < MultiDevices; d++)
+  {
+    Device = &Multi[d];
+    memset(Device, 0, sizeof(MULTI_DEVICE));
+    Device->Sim = new DEVICESIM();
+    Device->Sim->SetLocalNode(NULL, OWN_NODE);
+    Device->Sim->AddNode(&Dictionary, SERVER_NODE);
+    Device->Sim->ConfigureNode(SERVER_NODE, &Link, 0, 0);
+    if (!Device->Sim->Open(NULL)) break;
+    Device->Sim->Start();
+    if (pthread_create(&Device->Thread, NULL, MultiSimThread, Device->Sim) != 0) break;
+    if (Manager->AddDevice((char *)Device->Sim->GetPortName(), Baudrate) < 0) break;
+  }
+
+  if ((Manager->GetDeviceCount() == (int)MultiDevices) && Manager->Start(MultiThreads))
+  {
+    // let the nodes boot
+    for (d = 0; d < MultiDevices; d++) Manager->Read(d, 0, 0x5F00, 0x01, &Length, Data);
+    Timer::Sleep(100);
+    for (d = 0; d < MultiDevices; d++)
+    {
+      Manager->Read(d, SERVER_NODE, 0x1000, 0x00, &Length, Data);
+      Writes -= STATS_Get(&Manager->GetDevice(d)->GetStatistics()->TxWrites);
+    }
+
+    Processor = GetProcessorTime();
+    Begin = Timer::GetMicroseconds();
+    MultiEnd = Begin + MaxTime;
+    for (d = 0; d < MultiDevices; d++)
+    {
+      Device = &Multi[d];
+      Device->Request.Port = d;
+      Device->Request.NodeID = SERVER_NODE;
+      Device->Request.Index = 0x1000;
+      Device->Request.Subindex = 0x00;
+      Device->Request.Write = FALSE;
+      Device->Request.DataLength = 0;
+      Device->Request.Callback = MultiComplete;
+      Device->Request.Param = Device;
+      Manager->Submit(&Device->Request);
+    }
+    do
+    {
+      if (MultiThreads == 0) Manager->Poll(DEVMGR_IDLE_WAIT);
+      else Timer::Sleep(1);
+      Done = TRUE;
+      for (d = 0; d < MultiDevices; d++) if (!Multi[d].Done) Done = FALSE;
+    } while (!Done);
+    End = Timer::GetMicroseconds();
+    Processor = GetProcessorTime() - Processor;
+
+    for (d = 0; d < MultiDevices; d++)
+    {
+      Count += Multi[d].Count;
+      Errors += Multi[d].Errors;
+      Writes += STATS_Get(&Manager->GetDevice(d)->GetStatistics()->TxWrites);
+    }
+    fprintf(stderr, "%s: %.3f s processor time, %.1f us per op\n", Name, Processor / 1000000.0,
+      Count ? (double)Processor / Count : 0.0);
+    PrintResult(Name, Count, Errors, End - Begin, (uint64_t)Count * 4, Writes, 0);
+    if (MultiThreads == 0)
+    {
+      RunSequenceBenchmark();
+#if defined(__cpp_impl_coroutine)
+      RunCoroutineBenchmark();
+#endif
+    }
+  }
+  else
+  {
+    fprintf(stderr, "ERROR: starting the devices of %s\n", Name);
+  }
+
+  delete Manager;
+  SimStopRequested = TRUE;
+  for (d = 0; d < MultiDevices; d++)
+  {
+    if (Multi[d].Sim)
+    {
+      if (Multi[d].Thread) pthread_join(Multi[d].Thread, NULL);
+      delete Multi[d].Sim;
+    }
+  }
+}
+
+
+/**************************************************************************
+DOES:    Prints the command line syntax
+RETURNS: Nothing
+**************************************************************************/
+static void Usage
+  (
+  void
+  )
+{
+  printf("Usage: RA_Bench [options]\n");
+  printf("  -n <count>     operations per benchmark, default %lu\n", MaxCount);
+  printf("  -t <ms>        max time per benchmark, default %lu\n", MaxTime / 1000);
+  printf("  -b <ms>        background PDO interval of the SDO server, 0 for none\n");
+  printf("  -p <ms>        PDO interval of each producer for the ingest benchmark\n");
+  printf("  -i <ms>        duration of the ingest benchmark, default %lu\n", (unsigned long)(IngestTime / 1000));
+  printf("  -d <us>        bus latency of frames to and from the nodes\n");
+  printf("  -l             low latency mode of the serial port\n");
+  printf("  -r <bps>       baudrate of the serial port, default %lu\n", (unsigned long)BAUDRATE);
+  printf("  -u             io_uring backend of the serial port\n");
+  printf("  -k <segments>  SDO block download segments sent at once, default 16\n");
+  printf("  -w <frames>    CAN messages sent before waiting for responses, default 1\n");
+  printf("  -m <n>[,<t>]   read from n further devices through a device manager\n");
+  printf("                 with t threads, 0 to run it by Poll (default)\n");
+}
+
+
+/**************************************************************************
+DOES:    Main function, starts the simulated device, runs the benchmarks
+**************************************************************************/
+int main(int argc, char* argv[])
+{
+  char PortName[MAX_PATH];
+  pthread_t Thread;
+  SIMLINK Link;
+  unsigned long Length;
+  unsigned long b;
+  int NodeID;
+  int Option;
+  char *Next;
+
+  memset(&Link, 0, sizeof(Link));
+  while ((Option = getopt(argc, argv, "n:t:b:p:i:d:lr:uk:w:m:")) != -1)
+  {
+    switch (Option)
+    {
+      case 'n': MaxCount = strtoul(optarg, NULL, 0); break;
+      case 't': MaxTime = strtoul(optarg, NULL, 0) * 1000; break;
+      case 'b': BackgroundInterval = strtoul(optarg, NULL, 0); break;
+      case 'p': IngestInterval = strtoul(optarg, NULL, 0); break;
+      case 'i': IngestTime = strtoul(optarg, NULL, 0) * 1000; break;
+      case 'd': Link.Latency = strtoul(optarg, NULL, 0); break;
+      case 'l': LowLatency = TRUE; break;
+      case 'r': Baudrate = strtoul(optarg, NULL, 0); break;
+      case 'u': Backend = SERIAL_BACKEND_URING; break;
+      case 'k': BlockBurst = strtoul(optarg, NULL, 0); break;
+      case 'w': CanWindow = strtoul(optarg, NULL, 0); break;
+      case 'm':
+        MultiDevices = strtoul(optarg, &Next, 0);
+        if (*Next == ',') MultiThreads = strtoul(Next + 1, NULL, 0);
+        break;
+      default:
+        Usage();
+        return 1;
+    }
+  }
+  if ((MaxCount == 0) || (optind != argc) || (MultiDevices > DEVMGR_MAX_DEVICES))
+  {
+    Usage();
+    return 1;
+  }
+
+  // the simulated network
+  if (!Dictionary.Parse(BenchEDS, sizeof(BenchEDS) - 1)) return 1;
+  Sim->SetLocalNode(NULL, OWN_NODE);
+  for (NodeID = SERVER_NODE; NodeID <= DEVICESIM_MAX_NODES; NodeID++)
+  {
+    Sim->AddNode(&Dictionary, (UNSIGNED8)NodeID);
+    Sim->ConfigureNode((UNSIGNED8)NodeID, &Link, (NodeID == SERVER_NODE) ? BackgroundInterval : IngestInterval, 0);
+  }
+  if (!Sim->Open(NULL)) return 1;
+  strncpy(PortName, Sim->GetPortName(), sizeof(PortName) - 1);
+  PortName[sizeof(PortName) - 1] = 0;
+  Sim->Start();
+  if (pthread_create(&Thread, NULL, SimThread, NULL) != 0)
+  {
+    fprintf(stderr, "ERROR: creating simulator thread\n");
+    return 1;
+  }
+
+  COIADevice->SetLowLatency(LowLatency);
+  COIADevice->SetBackend(Backend);
+  if (BlockBurst) COIADevice->SetSdoBlockBurst((unsigned char)((BlockBurst > 127) ? 127 : BlockBurst));
+  COIADevice->SetCanTxWindow(CanWindow);
+  if (!COIADevice->Connect(PortName, Baudrate))
+  {
+    fprintf(stderr, "ERROR: connecting to %s\n", PortName);
+    SimStopRequested = TRUE;
+    pthread_join(Thread, NULL);
+    return 1;
+  }
+  COIADevice->RegisterDataCallback((DATACALLBACK *)NewData, NULL);
+  COIADevice->RegisterSDORequestCallbacks((SDOREQUESTCOMPLETECALLBACK *)SDORequestComplete);
+
+  // connect, let the nodes boot, then only the server node keeps sending
+  // process data. The host reads with a timeout and serves one SDO client
+  // per Process() call, background traffic keeps extended transfers going.
+  ReadLocal(&Length);
+  Timer::Sleep(100);
+  NMTCommand(NMT_STOP, 0);
+  NMTCommand(NMT_OPERATIONAL, SERVER_NODE);
+
+  for (b = 0; b < BLOCK_SIZE; b++) WriteBuffer[b] = (UNSIGNED8)(b * 7 + 3);
+
+  printf("benchmark,ops,errors,seconds,ops_per_s,bytes_per_s,p50_us,p99_us,p999_us,writes_per_op\n");
+  RunBenchmark("local_read", ReadLocal);
+  RunBenchmark("remote_read_expedited", ReadRemote);
+  RunBenchmark("remote_write_segmented", WriteSegmented);
+  RunBenchmark("remote_read_segmented", ReadSegmented);
+  RunBenchmark("remote_write_block", WriteBlock);
+  RunBenchmark("remote_read_block", ReadBlock);
+  if (COIADevice->EnableCanFrames(TRUE, TRUE) == ERROR_NOERROR) RunBenchmark("raw_can_send", SendCan);
+  COIADevice->EnableCanFrames(FALSE, FALSE);
+  RunIngestBenchmark();
+
+  COIADevice->RegisterDataCallback(NULL, NULL);
+  COIADevice->RegisterSDORequestCallbacks(NULL);
+  COIADevice->Disconnect();
+  if (MultiDevices) RunMultiBenchmark();
+  SimStopRequested = TRUE;
+  pthread_join(Thread, NULL);
+
+  delete COIADevice;
+  delete Sim;
+
+  return 0;
+}
+
+/*----------------------- END OF FILE ----------------------------------*/
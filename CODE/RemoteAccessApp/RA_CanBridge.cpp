@@ -0,0 +1,427 @@
+/**************************************************************************
+MODULE:    RA_CanBridge
+CONTAINS:  Bridge between the generic CAN messages [5F0Ch] of a CANopenIA
+           device and a Linux SocketCAN interface, so candump, cansend and
+           other SocketCAN applications can use the device, e.g.
+             ip link add dev vcan0 type vcan && ip link set up vcan0
+             RA_CanBridge /dev/ttyUSB0 vcan0
+           Frames written to the interface are read in batches with
+           recvmmsg and sent to the device with one serial write per
+           window. Frames the device received are collected while
+           Process runs and written with one sendmmsg, nothing waits for
+           more frames. Only 11-bit data frames are bridged, all others
+           are counted and dropped. -f passes only a range of CAN IDs
+           from the device, -w sets how many frames are sent to the
+           device before waiting for their responses, 1 by default, -l
+           and -u as RA_Daemon.
+COPYRIGHT: Embedded Systems Academy, Inc. 2008-2017.
+DISCLAIM:  Read and understand our disclaimer before using this code!
+           www.esacademy.com/disclaim.htm
+           This software was written in accordance to the guidelines at
+           www.esacademy.com/software/softwarestyleguide.pdf
+LICENSE:   Free to use with licensed CANopenIA chips, modules or devices
+           like CANgineBerry, CANgineXXX and 447izer
+VERSION:   1.10, EmSA 10-NOV-17
+           $LastChangedDate: 2014-01-11 17:30:59 +0100 (Sa, 11 Jan 2014) $
+           $LastChangedRevision: 1702 $
+***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include "SerialProtocol.h"
+
+/**************************************************************************
+LOCAL DEFINES
+***************************************************************************/
+
+// default baudrate to connect at
+#define BAUDRATE 921600
+
+// time to wait for socket or serial events in milliseconds
+#define POLL_TIMEOUT 100
+
+// frames moved with one recvmmsg or sendmmsg
+#define BRIDGE_BATCH (2 * CAN_TX_WINDOW)
+
+/**************************************************************************
+MODULE VARIABLES
+***************************************************************************/
+
+static SerialProtocol *COIADevice = new SerialProtocol();
+static int TerminationRequested = FALSE;   // termination flag
+static int CanSocket = -1;
+
+// frames received by the device, not yet written to the interface
+static struct can_frame TxFrames[BRIDGE_BATCH];
+static struct iovec TxVectors[BRIDGE_BATCH];
+static struct mmsghdr TxMessages[BRIDGE_BATCH];
+static unsigned int TxCount = 0;
+
+// frames read from the interface
+static struct can_frame RxFrames[BRIDGE_BATCH];
+static struct iovec RxVectors[BRIDGE_BATCH];
+static struct mmsghdr RxMessages[BRIDGE_BATCH];
+
+// counters
+static unsigned long long ToDevice = 0;    // frames sent to the device
+static unsigned long long FromDevice = 0;  // frames written to the interface
+static unsigned long long Unsupported = 0; // extended, remote, error and CAN FD frames dropped
+static unsigned long long Lost = 0;        // frames not sent to the device or the interface
+
+
+/*******************************************************************************
+DOES:    Called when user presses Ctrl-C or the bridge is stopped. Sets a flag
+RETURNS: Nothing
+*******************************************************************************/
+static void Terminate
+  (
+  int SignalNumber
+  )
+{
+  TerminationRequested = TRUE;
+}
+
+
+/**************************************************************************
+DOES:    Writes the frames received by the device to the interface. Frames
+         the interface does not take at once are lost, as on the bus.
+RETURNS: Nothing
+**************************************************************************/
+static void FlushToInterface
+  (
+  void
+  )
+{
+  unsigned int Done = 0;
+  int Sent;
+
+  while (Done < TxCount)
+  {
+    Sent = sendmmsg(CanSocket, &TxMessages[Done], TxCount - Done, MSG_DONTWAIT);
+    if (Sent < 0)
+    {
+      if (errno == EINTR) continue;
+      Lost += TxCount - Done;
+      break;
+    }
+    Done += Sent;
+    FromDevice += Sent;
+  }
+  TxCount = 0;
+}
+
+
+/**************************************************************************
+DOES:    Call-back for generic CAN messages received by the device,
+         queues them for the interface
+RETURNS: Nothing
+**************************************************************************/
+static void CanReceived
+  (
+  const CAN_MSG *Frame,                                    // message received
+  void *Param                                              // not used
+  )
+{
+  struct can_frame *Out = &TxFrames[TxCount];
+
+  memset(Out, 0, sizeof(*Out));
+  Out->can_id = Frame->ID & CAN_SFF_MASK;
+  Out->can_dlc = Frame->LEN;
+  memcpy(Out->data, Frame->BUF, Frame->LEN);
+  if (++TxCount == BRIDGE_BATCH) FlushToInterface();
+}
+
+
+/**************************************************************************
+DOES:    Reads a batch of frames from the interface and sends them to the
+         device
+RETURNS: Number of frames read, -1 if the device failed
+**************************************************************************/
+static int ForwardToDevice
+  (
+  void
+  )
+{
+  CAN_MSG Frames[BRIDGE_BATCH];
+  unsigned long Count = 0;
+  unsigned long result;
+  struct can_frame *In;
+  int Received;
+  int m;
+
+  Received = recvmmsg(CanSocket, RxMessages, BRIDGE_BATCH, MSG_DONTWAIT, NULL);
+  if (Received <= 0) return 0;
+
+  for (m = 0; m < Received; m++)
+  {
+    In = &RxFrames[m];
+    if ((RxMessages[m].msg_len != sizeof(struct can_frame)) || (In->can_id & (CAN_EFF_FLAG | CAN_RTR_FLAG | CAN_ERR_FLAG)))
+    {
+      Unsupported++;
+      continue;
+    }
+    Frames[Count].ID = In->can_id & CAN_SFF_MASK;
+    Frames[Count].LEN = (In->can_dlc > 8) ? 8 : In->can_dlc;
+    memcpy(Frames[Count].BUF, In->data, Frames[Count].LEN);
+    Count++;
+  }
+
+  result = COIADevice->SendCanFrames(Frames, Count);
+  if (result != ERROR_NOERROR)
+  {
+    Lost += Count;
+    if (result == ERROR_NODEERROR) fprintf(stderr, "ERROR: device rejected frames: 0x%4.4X\n", COIADevice->GetLastNodeError());
+    else fprintf(stderr, "ERROR: 0x%lX sending frames to the device\n", result);
+    return (result == ERROR_TX) ? -1 : Received;
+  }
+  ToDevice += Count;
+
+  // frames received while waiting for the device
+  FlushToInterface();
+  return Received;
+}
+
+
+/**************************************************************************
+DOES:    Opens a raw CAN socket bound to an interface
+RETURNS: Socket or -1 for error
+**************************************************************************/
+static int OpenCanSocket
+  (
+  const char *Interface                                    // name of interface, e.g. vcan0
+  )
+{
+  struct sockaddr_can Address;
+  struct ifreq Request;
+  int Socket;
+
+  if (strlen(Interface) >= sizeof(Request.ifr_name))
+  {
+    fprintf(stderr, "ERROR: interface name %s too long\n", Interface);
+    return -1;
+  }
+
+  Socket = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+  if (Socket < 0)
+  {
+    fprintf(stderr, "ERROR: %d creating CAN socket: %s\n", errno, strerror(errno));
+    return -1;
+  }
+
+  memset(&Request, 0, sizeof(Request));
+  strcpy(Request.ifr_name, Interface);
+  if (ioctl(Socket, SIOCGIFINDEX, &Request) < 0)
+  {
+    fprintf(stderr, "ERROR: %d finding %s: %s\n", errno, Interface, strerror(errno));
+    close(Socket);
+    return -1;
+  }
+
+  memset(&Address, 0, sizeof(Address));
+  Address.can_family = AF_CAN;
+  Address.can_ifindex = Request.ifr_ifindex;
+  if (bind(Socket, (struct sockaddr *)&Address, sizeof(Address)) < 0)
+  {
+    fprintf(stderr, "ERROR: %d opening %s: %s\n", errno, Interface, strerror(errno));
+    close(Socket);
+    return -1;
+  }
+
+  return Socket;
+}
+
+
+/**************************************************************************
+DOES:    Prints the command line syntax
+RETURNS: Nothing
+**************************************************************************/
+static void Usage
+  (
+  void
+  )
+{
+  printf("Usage: RA_CanBridge [-l] [-u] [-w <frames>] [-f <first>-<last>] <serialport> <interface> [<baudrate>]\n");
+}
+
+
+/**************************************************************************
+DOES:    Main function, open com port and CAN interface, move frames until
+         terminated
+**************************************************************************/
+int main(int argc, char* argv[])
+{
+  struct pollfd Fds[3];
+  unsigned long Baudrate = BAUDRATE;
+  unsigned long First;
+  unsigned long Last;
+  const char *PortName;
+  const char *Interface;
+  const SERIAL_STATISTICS *Stats;
+  bool Filtered = FALSE;
+  char *End;
+  int Option;
+  int Received;
+  int m;
+
+  printf("\nCANopenIA Remote Access CAN Bridge by www.esacademy.com\nV1.20 of 15-NOV-2017\n\n");
+
+  while ((Option = getopt(argc, argv, "luw:f:")) != -1)
+  {
+    switch (Option)
+    {
+      case 'l': COIADevice->SetLowLatency(TRUE); break;
+      case 'u': COIADevice->SetBackend(SERIAL_BACKEND_URING); break;
+      case 'w': COIADevice->SetCanTxWindow(strtoul(optarg, NULL, 0)); break;
+      case 'f':
+        First = strtoul(optarg, &End, 0);
+        Last = (*End == '-') ? strtoul(End + 1, &End, 0) : First;
+        if ((*End != 0) || (First > Last) || (Last >= CAN_ID_COUNT))
+        {
+          Usage();
+          return 1;
+        }
+        // the first range given replaces the default of all IDs
+        if (!Filtered) COIADevice->SetCanFilter(0, CAN_ID_COUNT - 1, FALSE);
+        COIADevice->SetCanFilter((unsigned short)First, (unsigned short)Last, TRUE);
+        Filtered = TRUE;
+        break;
+      default:
+        Usage();
+        return 1;
+    }
+  }
+  if ((argc - optind != 2) && (argc - optind != 3))
+  {
+    Usage();
+    return 1;
+  }
+  PortName = argv[optind];
+  Interface = argv[optind + 1];
+  if (argc - optind == 3) Baudrate = strtoul(argv[optind + 2], NULL, 0);
+
+  CanSocket = OpenCanSocket(Interface);
+  if (CanSocket < 0)
+  {
+    delete COIADevice;
+    return 1;
+  }
+
+  printf("Connecting to %s...\n", PortName);
+  if (!COIADevice->Connect((char *)PortName, Baudrate))
+  {
+    printf("Failed to connect to %s\n", PortName);
+    close(CanSocket);
+    delete COIADevice;
+    return 1;
+  }
+
+  for (m = 0; m < BRIDGE_BATCH; m++)
+  {
+    TxVectors[m].iov_base = &TxFrames[m];
+    TxVectors[m].iov_len = sizeof(TxFrames[m]);
+    memset(&TxMessages[m], 0, sizeof(TxMessages[m]));
+    TxMessages[m].msg_hdr.msg_iov = &TxVectors[m];
+    TxMessages[m].msg_hdr.msg_iovlen = 1;
+    RxVectors[m].iov_base = &RxFrames[m];
+    RxVectors[m].iov_len = sizeof(RxFrames[m]);
+    memset(&RxMessages[m], 0, sizeof(RxMessages[m]));
+    RxMessages[m].msg_hdr.msg_iov = &RxVectors[m];
+    RxMessages[m].msg_hdr.msg_iovlen = 1;
+  }
+
+  COIADevice->RegisterCanCallback(CanReceived, NULL);
+  if (COIADevice->EnableCanFrames(TRUE, TRUE) != ERROR_NOERROR)
+  {
+    fprintf(stderr, "ERROR: device does not support generic CAN messages\n");
+    COIADevice->Disconnect();
+    close(CanSocket);
+    delete COIADevice;
+    return 1;
+  }
+  printf("Bridging %s and %s\n", PortName, Interface);
+
+  TerminationRequested = FALSE;
+  signal(SIGINT, Terminate);
+  signal(SIGTERM, Terminate);
+
+  while (!TerminationRequested)
+  {
+    // a backend receiving into memory signals data on its own handle,
+    // the port still signals the hangup
+    Fds[0].fd = COIADevice->GetHandle();
+    Fds[0].events = POLLIN;
+    Fds[1].fd = (COIADevice->GetEventHandle() != Fds[0].fd) ? COIADevice->GetEventHandle() : -1;
+    Fds[1].events = POLLIN;
+    Fds[2].fd = CanSocket;
+    Fds[2].events = POLLIN;
+
+    if (poll(Fds, 3, POLL_TIMEOUT) <= 0) continue;
+
+    // handle everything the device sent, without waiting for more
+    if ((Fds[0].revents | Fds[1].revents) & POLLIN)
+    {
+      do
+      {
+        COIADevice->Process();
+        Fds[0].revents = 0;
+        Fds[1].revents = 0;
+      } while (!TerminationRequested && (poll(Fds, 2, 0) > 0) && ((Fds[0].revents | Fds[1].revents) & POLLIN) && !(Fds[0].revents & POLLHUP));
+      FlushToInterface();
+    }
+
+    // the device is gone, e.g. unplugged
+    if (Fds[0].revents & (POLLHUP | POLLERR | POLLNVAL))
+    {
+      fprintf(stderr, "ERROR: lost connection to the device\n");
+      break;
+    }
+
+    if (Fds[2].revents & (POLLERR | POLLNVAL))
+    {
+      fprintf(stderr, "ERROR: lost interface %s\n", Interface);
+      break;
+    }
+
+    // full batches mean more frames are waiting
+    if (Fds[2].revents & POLLIN)
+    {
+      do
+      {
+        Received = ForwardToDevice();
+      } while (!TerminationRequested && (Received == BRIDGE_BATCH));
+      if (Received < 0) break;
+    }
+  }
+
+  COIADevice->EnableCanFrames(FALSE, FALSE);
+  COIADevice->RegisterCanCallback(NULL, NULL);
+  Stats = COIADevice->GetStatistics();
+  printf("\nFrames to device:    %llu\n", ToDevice);
+  printf("Frames from device:  %llu, %llu filtered, %llu overruns, %llu malformed\n", FromDevice,
+    (unsigned long long)STATS_Get(&Stats->CanRxFiltered), (unsigned long long)STATS_Get(&Stats->CanRxOverruns),
+    (unsigned long long)STATS_Get(&Stats->CanRxMalformed));
+  printf("Frames unsupported:  %llu\n", Unsupported);
+  printf("Frames lost:         %llu\n", Lost);
+
+  COIADevice->Disconnect();
+  printf("\nDisconnected from %s...\n", PortName);
+  close(CanSocket);
+
+  // disconnect from COM port, finished with COIA device
+  delete COIADevice;
+
+  return 0;
+}
+
+/*----------------------- END OF FILE ----------------------------------*/
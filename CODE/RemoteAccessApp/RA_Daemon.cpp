@@ -0,0 +1,764 @@
+/**************************************************************************
+MODULE:    RA_Daemon
+CONTAINS:  Gateway daemon keeping a CANopenIA device connected and
+           executing coia style commands received on a Unix domain socket.
+           Each line received is one or more commands, e.g.
+           "--node-write 3,0x6200,1,1,0x55 --delay 25 -r 0x5F00,2", and
+           every command is answered with one line "OK [len,value]" or
+           "ERROR code". The commands of each client are queued and run
+           one at a time, requests to the device in turn with the other
+           clients and delays without blocking them. "monitor" subscribes
+           to process data written to the device
+           ("D node,idx,sub,len,value"), "stats" answers with the counters
+           of the protocol stack as "OK key=value ...", "quit" closes the
+           connection. Usage from shell scripts:
+           echo "--node-write 3,0x6200,1,1,0x55" | socat - UNIX-CONNECT:/tmp/coia
+           With -t all frames exchanged with the device are written to a
+           trace file for RA_Replay. -l selects the low latency mode of
+           the serial port, for USB adapters, -u the io_uring backend.
+COPYRIGHT: Embedded Systems Academy, Inc. 2008-2017.
+DISCLAIM:  Read and understand our disclaimer before using this code!
+           www.esacademy.com/disclaim.htm
+           This software was written in accordance to the guidelines at
+           www.esacademy.com/software/softwarestyleguide.pdf
+LICENSE:   Free to use with licensed CANopenIA chips, modules or devices
+           like CANgineBerry, CANgineXXX and 447izer
+VERSION:   1.10, EmSA 10-NOV-17
+           $LastChangedDate: 2014-01-11 17:30:59 +0100 (Sa, 11 Jan 2014) $
+           $LastChangedRevision: 1702 $
+***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "SerialProtocol.h"
+#include "Command.h"
+#include "Tracer.h"
+
+/**************************************************************************
+LOCAL DEFINES
+***************************************************************************/
+
+// default baudrate to connect at
+#define BAUDRATE 921600
+
+// max number of simultaneous client connections
+#define MAX_CLIENTS 16
+
+// max length of a command line from a client
+#define MAX_LINE_LENGTH 1024
+
+// time to wait for socket or serial events in milliseconds
+#define POLL_TIMEOUT 100
+
+// time to wait while a request is sent to the device in milliseconds, its
+// response timeout is checked in between
+#define REQUEST_POLL_TIMEOUT 1
+
+// state of the commands of a client
+#define CLIENT_IDLE    0 // no command queued
+#define CLIENT_WAITING 1 // Command waits for the device
+#define CLIENT_REQUEST 2 // Command sent to the device
+#define CLIENT_DELAY   3 // delay of Command running
+
+// client connection
+typedef struct
+{
+  int Socket;                                // -1 if not used
+  bool Monitor;                              // receives process data
+  int State;                                 // CLIENT_xxx
+  COMMAND Command;                           // command waiting or running
+  uint64_t DelayEnd;                         // end of the delay in microseconds
+  const char *Next;                          // next command in Current, NULL if none
+  char Current[MAX_LINE_LENGTH];             // line executed
+  unsigned long Received;                    // bytes in Line
+  char Line[MAX_LINE_LENGTH];                // lines received, not executed yet
+} CLIENT;
+
+/**************************************************************************
+MODULE VARIABLES
+***************************************************************************/
+
+static SerialProtocol *COIADevice = new SerialProtocol();
+static TRACER *Trace = NULL;               // frames exchanged, if -t given
+
+static CLIENT Clients[MAX_CLIENTS];
+static int LastClient = 0;                 // client that sent the last request
+static bool RequestRunning = FALSE;        // request sent to the device
+static CLIENT *RequestClient = NULL;       // client of the request, NULL if it disconnected
+static int TerminationRequested = FALSE;   // termination flag
+
+
+/*******************************************************************************
+DOES:    Called when user presses Ctrl-C or the daemon is stopped. Sets a flag
+RETURNS: Nothing
+*******************************************************************************/
+static void Terminate
+  (
+  int SignalNumber
+  )
+{
+  TerminationRequested = TRUE;
+}
+
+
+/**************************************************************************
+DOES:    Closes a client connection
+RETURNS: Nothing
+**************************************************************************/
+static void CloseClient
+  (
+  CLIENT *Client
+  )
+{
+  close(Client->Socket);
+  Client->Socket = -1;
+  Client->Monitor = FALSE;
+  Client->State = CLIENT_IDLE;
+  Client->Next = NULL;
+  Client->Received = 0;
+  // a request running completes without an answer
+  if (RequestClient == Client) RequestClient = NULL;
+}
+
+
+/**************************************************************************
+DOES:    Sends a line of text to a client. Clients that do not accept
+         data fast enough are disconnected, so a stuck client can never
+         stall the daemon.
+RETURNS: TRUE for success, FALSE if the client was disconnected
+**************************************************************************/
+static bool SendLine
+  (
+  CLIENT *Client,
+  const char *Text,                                        // line without newline
+  int Length                                               // length of text
+  )
+{
+  char Buffer[MAX_LINE_LENGTH];
+  ssize_t Sent;
+
+  if (Length > (int)sizeof(Buffer) - 1) Length = sizeof(Buffer) - 1;
+  memcpy(Buffer, Text, Length);
+  Buffer[Length++] = '\n';
+
+  Sent = send(Client->Socket, Buffer, Length, MSG_NOSIGNAL | MSG_DONTWAIT);
+  if (Sent != Length)
+  {
+    CloseClient(Client);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+
+/**************************************************************************
+DOES:    Call-back function, process data was written to the device.
+         Forwarded to all monitoring clients.
+RETURNS: Nothing
+**************************************************************************/
+static void NewData
+  (
+  unsigned char NodeID,                                    // node id
+  int Index,                                               // index
+  unsigned char Subindex,                                  // subindex
+  unsigned long DataLength,                                // length of data
+  unsigned char *Data,                                     // data
+  void *Param                                              // not used
+  )
+{
+  COMMAND Command;
+  char Value[CMD_MAX_RESULT_LENGTH + 1];
+  char Line[MAX_LINE_LENGTH];
+  int Length;
+  int c;
+
+  // format like the result of a read, without the leading "OK "
+  Command.Type = CMD_READ;
+  CMD_FormatResult(Value, sizeof(Value), &Command, ERROR_NOERROR, DataLength, Data, 0);
+  Length = snprintf(Line, sizeof(Line), "D %u,0x%4.4X,%u,%s", NodeID, Index, Subindex, &Value[3]);
+  for (c = 0; c < MAX_CLIENTS; c++)
+  {
+    if ((Clients[c].Socket >= 0) && Clients[c].Monitor)
+    {
+      SendLine(&Clients[c], Line, Length);
+    }
+  }
+}
+
+
+/**************************************************************************
+DOES:    Adds a latency histogram to a line of statistics as
+         "name=count/p50/p99/max" in microseconds
+RETURNS: New length of line
+**************************************************************************/
+static int FormatLatency
+  (
+  char *Line,                                              // line to add to
+  int Length,                                              // current length of line
+  const char *Name,                                        // name of request type
+  const STATS_HISTOGRAM *Latency                           // histogram
+  )
+{
+  Length += snprintf(Line + Length, MAX_LINE_LENGTH - Length, " %s=%llu/%llu/%llu/%llu", Name,
+    (unsigned long long)Latency->GetCount(), (unsigned long long)Latency->GetPercentile(500),
+    (unsigned long long)Latency->GetPercentile(990), (unsigned long long)Latency->GetMax());
+  return (Length < MAX_LINE_LENGTH) ? Length : MAX_LINE_LENGTH - 1;
+}
+
+
+/**************************************************************************
+DOES:    Formats the counters of the protocol stack as one line
+         "OK key=value ..." with the totals of all commands and nodes
+RETURNS: Length of line
+**************************************************************************/
+static int FormatStatistics
+  (
+  char *Line                                               // location to store line, MAX_LINE_LENGTH
+  )
+{
+  const SERIAL_STATISTICS *Serial = COIADevice->GetStatistics();
+  const SDOCLNT_STATISTICS *Sdo = COIADevice->GetSDOStatistics();
+  const SDOCLNT_CHANNELSTATS *Channel;
+  unsigned long long Totals[4] = { 0, 0, 0, 0 };
+  unsigned long long SdoTotals[6] = { 0, 0, 0, 0, 0, 0 };
+  int Length;
+  int c;
+
+  for (c = 0; c < STATS_COMMANDS; c++)
+  {
+    Totals[0] += STATS_Get(&Serial->RxPackets[c]);
+    Totals[1] += STATS_Get(&Serial->RxBytes[c]);
+    Totals[2] += STATS_Get(&Serial->TxPackets[c]);
+    Totals[3] += STATS_Get(&Serial->TxBytes[c]);
+  }
+  for (c = 1; c <= NR_OF_SDO_CLIENTS; c++)
+  {
+    Channel = &Sdo->Channels[c];
+    SdoTotals[0] += STATS_Get(&Channel->Completed);
+    SdoTotals[1] += STATS_Get(&Channel->Bytes);
+    SdoTotals[2] += STATS_Get(&Channel->Timeouts);
+    SdoTotals[3] += STATS_Get(&Channel->AbortsReceived) + STATS_Get(&Channel->AbortsSent);
+    SdoTotals[4] += STATS_Get(&Channel->ToggleErrors);
+    SdoTotals[5] += STATS_Get(&Channel->Errors);
+  }
+
+  Length = snprintf(Line, MAX_LINE_LENGTH,
+    "OK rx_packets=%llu rx_bytes=%llu tx_packets=%llu tx_bytes=%llu"
+    " skipped=%llu crc_errors=%llu resyncs=%llu packet_timeouts=%llu tx_errors=%llu tx_writes=%llu"
+    " response_timeouts=%llu wrong_responses=%llu retries=%llu stale_responses=%llu"
+    " sdo_active=%llu sdo_max_active=%llu sdo_completed=%llu sdo_bytes=%llu"
+    " sdo_timeouts=%llu sdo_aborts=%llu sdo_toggle_errors=%llu sdo_errors=%llu",
+    Totals[0], Totals[1], Totals[2], Totals[3],
+    (unsigned long long)STATS_Get(&Serial->RxSkipped), (unsigned long long)STATS_Get(&Serial->CRCErrors),
+    (unsigned long long)STATS_Get(&Serial->Resyncs), (unsigned long long)STATS_Get(&Serial->PacketTimeouts),
+    (unsigned long long)STATS_Get(&Serial->TxErrors), (unsigned long long)STATS_Get(&Serial->TxWrites),
+    (unsigned long long)STATS_Get(&Serial->ResponseTimeouts),
+    (unsigned long long)STATS_Get(&Serial->WrongResponses), (unsigned long long)STATS_Get(&Serial->Retries),
+    (unsigned long long)STATS_Get(&Serial->StaleResponses),
+    (unsigned long long)STATS_Get(&Sdo->Active), (unsigned long long)STATS_Get(&Sdo->MaxActive),
+    SdoTotals[0], SdoTotals[1], SdoTotals[2], SdoTotals[3], SdoTotals[4], SdoTotals[5]);
+  if (Length >= MAX_LINE_LENGTH) Length = MAX_LINE_LENGTH - 1;
+
+  Length = FormatLatency(Line, Length, "read_local_us", &Serial->Latency[REQUEST_READLOCAL]);
+  Length = FormatLatency(Line, Length, "write_local_us", &Serial->Latency[REQUEST_WRITELOCAL]);
+  Length = FormatLatency(Line, Length, "read_remote_us", &Serial->Latency[REQUEST_READREMOTE]);
+  Length = FormatLatency(Line, Length, "write_remote_us", &Serial->Latency[REQUEST_WRITEREMOTE]);
+  Length = FormatLatency(Line, Length, "sdo_read_us", &Sdo->Latency[SDOCLNT_STATS_READ]);
+  Length = FormatLatency(Line, Length, "sdo_write_us", &Sdo->Latency[SDOCLNT_STATS_WRITE]);
+  return Length;
+}
+
+
+/**************************************************************************
+DOES:    Sends the result of the command of a client, the client is ready
+         for its next command
+RETURNS: TRUE if the connection remains open, FALSE if it was closed
+**************************************************************************/
+static bool SendResult
+  (
+  CLIENT *Client,
+  unsigned long Result,                                    // result of the command
+  unsigned long DataLength,                                // length of data read
+  UNSIGNED8 *Data                                          // data read
+  )
+{
+  char Reply[CMD_MAX_RESULT_LENGTH + 1];
+  int Length;
+
+  Client->State = CLIENT_IDLE;
+  Length = CMD_FormatResult(Reply, sizeof(Reply), &Client->Command, Result, DataLength, Data, COIADevice->GetLastNodeError());
+  return SendLine(Client, Reply, Length);
+}
+
+
+/**************************************************************************
+DOES:    Takes the next complete line received from a client. Lines
+         without commands are answered at once.
+RETURNS: TRUE if a line of commands was taken, FALSE if there is none
+**************************************************************************/
+static bool NextLine
+  (
+  CLIENT *Client
+  )
+{
+  char Stats[MAX_LINE_LENGTH];
+  const char *Line;
+  unsigned long Pos;
+  int Length;
+
+  for (;;)
+  {
+    for (Pos = 0; (Pos < Client->Received) && (Client->Line[Pos] != '\n'); Pos++) {}
+    if (Pos == Client->Received) return FALSE;
+
+    memcpy(Client->Current, Client->Line, Pos);
+    Client->Current[Pos] = 0;
+    if ((Pos > 0) && (Client->Current[Pos - 1] == '\r')) Client->Current[Pos - 1] = 0;
+    Client->Received -= Pos + 1;
+    memmove(Client->Line, Client->Line + Pos + 1, Client->Received);
+
+    Line = Client->Current;
+    while ((*Line == ' ') || (*Line == '\t')) Line++;
+    if (strcmp(Line, "quit") == 0)
+    {
+      CloseClient(Client);
+      return FALSE;
+    }
+    if (strcmp(Line, "monitor") == 0)
+    {
+      Client->Monitor = TRUE;
+      if (!SendLine(Client, "OK", 2)) return FALSE;
+      continue;
+    }
+    if (strcmp(Line, "stats") == 0)
+    {
+      Length = FormatStatistics(Stats);
+      if (!SendLine(Client, Stats, Length)) return FALSE;
+      continue;
+    }
+    Client->Next = Line;
+    return TRUE;
+  }
+}
+
+
+/**************************************************************************
+DOES:    Queues the next command of an idle client, a request waits for
+         the device and a delay is started. Commands not supported by
+         the daemon are answered at once.
+RETURNS: Nothing
+**************************************************************************/
+static void NextCommand
+  (
+  CLIENT *Client
+  )
+{
+  while ((Client->Socket >= 0) && (Client->State == CLIENT_IDLE))
+  {
+    if (!Client->Next && !NextLine(Client)) return;
+
+    if (!CMD_Parse(&Client->Next, &Client->Command))
+    {
+      // remaining commands on this line are not executed
+      Client->Next = NULL;
+      SendLine(Client, "ERROR syntax", 12);
+      continue;
+    }
+
+    switch (Client->Command.Type)
+    {
+      case CMD_NONE:
+        Client->Next = NULL;
+        break;
+
+      case CMD_READ:
+      case CMD_WRITE:
+      case CMD_NODEREAD:
+      case CMD_NODEWRITE:
+        Client->State = CLIENT_WAITING;
+        break;
+
+      case CMD_DELAY:
+        Client->DelayEnd = Timer::GetMicroseconds() + Client->Command.Delay * 1000ULL;
+        Client->State = CLIENT_DELAY;
+        break;
+
+      default:
+        SendResult(Client, ERROR_NOTSUPPORTED, 0, NULL);
+        break;
+    }
+  }
+}
+
+
+/**************************************************************************
+DOES:    Runs the commands of the clients: completes the request of the
+         device and the delays that ended and sends the next request,
+         taking the clients in turn
+RETURNS: Time until the next delay ends in milliseconds, at most
+         POLL_TIMEOUT
+**************************************************************************/
+static int RunClients
+  (
+  void
+  )
+{
+  CLIENT *Client;
+  UNSIGNED8 Data[MAX_PACKET_LENGTH];
+  unsigned long DataLength = 0;
+  unsigned long Result;
+  uint64_t Now;
+  uint64_t Wait = POLL_TIMEOUT * 1000ULL;
+  int c;
+
+  if (RequestRunning)
+  {
+    Result = COIADevice->GetRequestResult(&DataLength, Data);
+    if (Result != ERROR_PENDING)
+    {
+      RequestRunning = FALSE;
+      if (RequestClient) SendResult(RequestClient, Result, DataLength, Data);
+      RequestClient = NULL;
+    }
+  }
+
+  Now = Timer::GetMicroseconds();
+  for (c = 0; c < MAX_CLIENTS; c++)
+  {
+    Client = &Clients[c];
+    if ((Client->State == CLIENT_DELAY) && (Now >= Client->DelayEnd)) SendResult(Client, ERROR_NOERROR, 0, NULL);
+    NextCommand(Client);
+  }
+
+  // next request, starting after the client that sent the last one
+  for (c = 1; !RequestRunning && (c <= MAX_CLIENTS); c++)
+  {
+    Client = &Clients[(LastClient + c) % MAX_CLIENTS];
+    if (Client->State != CLIENT_WAITING) continue;
+
+    LastClient = (LastClient + c) % MAX_CLIENTS;
+    Result = COIADevice->StartRequest(
+      ((Client->Command.Type == CMD_NODEREAD) || (Client->Command.Type == CMD_NODEWRITE)) ? Client->Command.NodeID : 0,
+      Client->Command.Index, Client->Command.Subindex,
+      (Client->Command.Type == CMD_WRITE) || (Client->Command.Type == CMD_NODEWRITE),
+      Client->Command.Length, Client->Command.Data);
+    if (Result == ERROR_NOERROR)
+    {
+      Client->State = CLIENT_REQUEST;
+      RequestRunning = TRUE;
+      RequestClient = Client;
+    }
+    else
+    {
+      SendResult(Client, Result, 0, NULL);
+      NextCommand(Client);
+      c = 0;
+    }
+  }
+
+  for (c = 0; c < MAX_CLIENTS; c++)
+  {
+    Client = &Clients[c];
+    if (Client->State != CLIENT_DELAY) continue;
+    if (Client->DelayEnd <= Now) Wait = 0;
+    else if (Client->DelayEnd - Now < Wait) Wait = Client->DelayEnd - Now;
+  }
+  return (int)((Wait + 999) / 1000);
+}
+
+
+/**************************************************************************
+DOES:    Reads from a client, complete lines are queued for RunClients
+RETURNS: Nothing
+**************************************************************************/
+static void HandleClient
+  (
+  CLIENT *Client
+  )
+{
+  ssize_t Read;
+  unsigned long Pos;
+
+  // lines queued fill the buffer, read again when they were executed
+  if (Client->Received == sizeof(Client->Line))
+  {
+    for (Pos = 0; (Pos < Client->Received) && (Client->Line[Pos] != '\n'); Pos++) {}
+    if (Pos < Client->Received) return;
+    SendLine(Client, "ERROR line too long", 19);
+    CloseClient(Client);
+    return;
+  }
+
+  Read = recv(Client->Socket, Client->Line + Client->Received, sizeof(Client->Line) - Client->Received, MSG_DONTWAIT);
+  if (Read <= 0)
+  {
+    if ((Read < 0) && ((errno == EAGAIN) || (errno == EINTR))) return;
+    CloseClient(Client);
+    return;
+  }
+  Client->Received += Read;
+
+  if (Client->Received == sizeof(Client->Line))
+  {
+    for (Pos = 0; (Pos < Client->Received) && (Client->Line[Pos] != '\n'); Pos++) {}
+    if (Pos < Client->Received) return;
+    SendLine(Client, "ERROR line too long", 19);
+    CloseClient(Client);
+  }
+}
+
+
+/**************************************************************************
+DOES:    Prints the command line syntax
+RETURNS: Nothing
+**************************************************************************/
+static void Usage
+  (
+  void
+  )
+{
+  printf("Usage: RA_Daemon [-l] [-u] [-t <tracefile>] <serialport> <socketpath> [<baudrate>]\n");
+}
+
+
+/**************************************************************************
+DOES:    Creates the listening socket
+RETURNS: Socket or -1 for error
+**************************************************************************/
+static int OpenSocket
+  (
+  const char *Path                                         // path of socket
+  )
+{
+  struct sockaddr_un Address;
+  int Socket;
+
+  if (strlen(Path) >= sizeof(Address.sun_path))
+  {
+    fprintf(stderr, "ERROR: socket path %s too long\n", Path);
+    return -1;
+  }
+
+  Socket = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (Socket < 0)
+  {
+    fprintf(stderr, "ERROR: %d creating socket: %s\n", errno, strerror(errno));
+    return -1;
+  }
+
+  memset(&Address, 0, sizeof(Address));
+  Address.sun_family = AF_UNIX;
+  strcpy(Address.sun_path, Path);
+  // remove socket left over from a previous run
+  unlink(Path);
+  if ((bind(Socket, (struct sockaddr *)&Address, sizeof(Address)) < 0) || (listen(Socket, MAX_CLIENTS) < 0))
+  {
+    fprintf(stderr, "ERROR: %d opening %s: %s\n", errno, Path, strerror(errno));
+    close(Socket);
+    return -1;
+  }
+  fcntl(Socket, F_SETFL, fcntl(Socket, F_GETFL) | O_NONBLOCK);
+
+  return Socket;
+}
+
+
+/**************************************************************************
+DOES:    Main function, open com port and socket, serve clients until
+         terminated
+**************************************************************************/
+int main(int argc, char* argv[])
+{
+  struct pollfd Fds[MAX_CLIENTS + 3];
+  int FdClient[MAX_CLIENTS + 3];
+  unsigned long Baudrate = BAUDRATE;
+  const char *TraceFile = NULL;
+  const char *PortName;
+  const char *SocketPath;
+  int Option;
+  int Listen;
+  int Socket;
+  int NumFds;
+  int Timeout;
+  int c;
+  int f;
+
+  printf("\nCANopenIA Remote Access Daemon by www.esacademy.com\nV1.20 of 15-NOV-2017\n\n");
+
+  while ((Option = getopt(argc, argv, "lut:")) != -1)
+  {
+    switch (Option)
+    {
+      case 'l': COIADevice->SetLowLatency(TRUE); break;
+      case 'u': COIADevice->SetBackend(SERIAL_BACKEND_URING); break;
+      case 't': TraceFile = optarg; break;
+      default:
+        Usage();
+        return 1;
+    }
+  }
+  if ((argc - optind != 2) && (argc - optind != 3))
+  {
+    Usage();
+    return 1;
+  }
+  PortName = argv[optind];
+  SocketPath = argv[optind + 1];
+  if (argc - optind == 3) Baudrate = strtoul(argv[optind + 2], NULL, 0);
+
+  if (TraceFile)
+  {
+    Trace = new TRACER();
+    if (!Trace->Open(TraceFile))
+    {
+      delete Trace;
+      delete COIADevice;
+      return 1;
+    }
+    COIADevice->SetTracer(Trace);
+    printf("Tracing to %s\n", TraceFile);
+  }
+
+  printf("Connecting to %s...\n", PortName);
+  if (!COIADevice->Connect((char *)PortName, Baudrate))
+  {
+    printf("Failed to connect to %s\n", PortName);
+    delete COIADevice;
+    delete Trace;
+    return 1;
+  }
+
+  Listen = OpenSocket(SocketPath);
+  if (Listen < 0)
+  {
+    delete COIADevice;
+    delete Trace;
+    return 1;
+  }
+  printf("Listening on %s\n", SocketPath);
+
+  for (c = 0; c < MAX_CLIENTS; c++)
+  {
+    Clients[c].Socket = -1;
+    Clients[c].Monitor = FALSE;
+    Clients[c].State = CLIENT_IDLE;
+    Clients[c].Next = NULL;
+    Clients[c].Received = 0;
+  }
+
+  COIADevice->RegisterDataCallback((DATACALLBACK *)NewData, NULL);
+
+  TerminationRequested = FALSE;
+  signal(SIGINT, Terminate);
+  signal(SIGTERM, Terminate);
+
+  while (!TerminationRequested)
+  {
+    Timeout = RunClients();
+
+    // wait for data from the device, new connections or commands. A
+    // backend receiving into memory signals data on its own handle, the
+    // port still signals the hangup.
+    Fds[0].fd = COIADevice->GetHandle();
+    Fds[0].events = POLLIN;
+    Fds[1].fd = (COIADevice->GetEventHandle() != Fds[0].fd) ? COIADevice->GetEventHandle() : -1;
+    Fds[1].events = POLLIN;
+    Fds[2].fd = Listen;
+    Fds[2].events = POLLIN;
+    NumFds = 3;
+    for (c = 0; c < MAX_CLIENTS; c++)
+    {
+      if (Clients[c].Socket >= 0)
+      {
+        Fds[NumFds].fd = Clients[c].Socket;
+        // a client with a full buffer is read when its lines were executed
+        Fds[NumFds].events = (Clients[c].Received < sizeof(Clients[c].Line)) ? POLLIN : 0;
+        FdClient[NumFds] = c;
+        NumFds++;
+      }
+    }
+
+    if (RequestRunning && (Timeout > REQUEST_POLL_TIMEOUT)) Timeout = REQUEST_POLL_TIMEOUT;
+    if (poll(Fds, NumFds, Timeout) <= 0) continue;
+
+    // handle everything the device sent, without waiting for more
+    if ((Fds[0].revents | Fds[1].revents) & POLLIN)
+    {
+      do
+      {
+        COIADevice->Process();
+        Fds[0].revents = 0;
+        Fds[1].revents = 0;
+      } while (!TerminationRequested && (poll(Fds, 2, 0) > 0) && ((Fds[0].revents | Fds[1].revents) & POLLIN) && !(Fds[0].revents & POLLHUP));
+    }
+
+    // the device is gone, e.g. unplugged
+    if (Fds[0].revents & (POLLHUP | POLLERR | POLLNVAL))
+    {
+      fprintf(stderr, "ERROR: lost connection to the device\n");
+      break;
+    }
+
+    if (Fds[2].revents & POLLIN)
+    {
+      Socket = accept(Listen, NULL, NULL);
+      if (Socket >= 0)
+      {
+        for (c = 0; c < MAX_CLIENTS; c++)
+        {
+          if (Clients[c].Socket < 0) break;
+        }
+        if (c < MAX_CLIENTS)
+        {
+          Clients[c].Socket = Socket;
+        }
+        else
+        {
+          close(Socket);
+        }
+      }
+    }
+
+    for (f = 3; f < NumFds; f++)
+    {
+      if ((Fds[f].revents != 0) && (Clients[FdClient[f]].Socket == Fds[f].fd))
+      {
+        HandleClient(&Clients[FdClient[f]]);
+      }
+    }
+  }
+
+  COIADevice->RegisterDataCallback(NULL, NULL);
+
+  for (c = 0; c < MAX_CLIENTS; c++)
+  {
+    if (Clients[c].Socket >= 0) CloseClient(&Clients[c]);
+  }
+  close(Listen);
+  unlink(SocketPath);
+
+  COIADevice->Disconnect();
+  printf("\nDisconnected from %s...\n", PortName);
+
+  // disconnect from COM port, finished with COIA device
+  delete COIADevice;
+
+  // write the remaining frames
+  if (Trace)
+  {
+    if (Trace->GetLost()) printf("%lu trace records lost\n", Trace->GetLost());
+    delete Trace;
+  }
+
+  return 0;
+}
+
+/*----------------------- END OF FILE ----------------------------------*/
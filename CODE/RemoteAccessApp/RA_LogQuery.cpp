@@ -0,0 +1,200 @@
+/**************************************************************************
+MODULE:    RA_LogQuery
+CONTAINS:  Queries a process data log written by RA_App with a log file.
+           Usage:
+             RA_LogQuery [-s <node>,<index>,<subindex>] [-f <from>]
+                         [-t <to>] [-b <buckets>] <logfile>
+           Without -s the series of the log are listed. With -s the
+           samples of the series are printed as CSV, with -b downsampled
+           to the number of buckets given with count, min, max and
+           average of each. -f and -t limit the time range, microseconds
+           since 1970 UTC, the whole series if not given. The time the
+           query took is shown on stderr.
+COPYRIGHT: Embedded Systems Academy, Inc. 2008-2017.
+DISCLAIM:  Read and understand our disclaimer before using this code!
+           www.esacademy.com/disclaim.htm
+           This software was written in accordance to the guidelines at
+           www.esacademy.com/software/softwarestyleguide.pdf
+LICENSE:   Free to use with licensed CANopenIA chips, modules or devices
+           like CANgineBerry, CANgineXXX and 447izer
+VERSION:   1.10, EmSA 10-NOV-17
+           $LastChangedDate: 2014-01-11 17:30:59 +0100 (Sa, 11 Jan 2014) $
+           $LastChangedRevision: 1702 $
+***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "LogReader.h"
+#include "Timer.h"
+
+/**************************************************************************
+LOCAL DEFINES
+***************************************************************************/
+
+// samples got with one query
+#define QUERY_SAMPLES 4096
+
+// max buckets of a downsampled series
+#define MAX_BUCKETS 100000
+
+/**************************************************************************
+MODULE VARIABLES
+***************************************************************************/
+
+static LOGREADER Log;
+static LOG_SAMPLE Samples[QUERY_SAMPLES];
+
+// names of the value types
+static const char *TypeNames[] = { "unsigned", "signed", "real" };
+
+
+/*******************************************************************************
+DOES:    Shows how to use the program
+RETURNS: Nothing
+*******************************************************************************/
+static void Usage
+  (
+  void
+  )
+{
+  printf("Usage: RA_LogQuery [-s <node>,<index>,<subindex>] [-f <from>] [-t <to>] [-b <buckets>] <logfile>\n");
+}
+
+
+/*******************************************************************************
+DOES:    Lists the series of the log
+RETURNS: Nothing
+*******************************************************************************/
+static void ListSeries
+  (
+  void
+  )
+{
+  LOG_SERIES_INFO Info;
+  unsigned int s;
+
+  printf("node,index,subindex,type,blocks,samples,first,last\n");
+  for (s = 0; Log.GetSeries(s, &Info); s++)
+  {
+    printf("%u,0x%04X,%u,%s,%lu,%llu,%llu,%llu\n", Info.NodeID, Info.Index, Info.Subindex,
+      (Info.Type <= DATALOG_TYPE_REAL) ? TypeNames[Info.Type] : "unknown", Info.Blocks,
+      (unsigned long long)Info.Samples, (unsigned long long)Info.FirstTime, (unsigned long long)Info.LastTime);
+  }
+}
+
+
+/*******************************************************************************
+DOES:    Main function, open the log and run the query
+*******************************************************************************/
+int main(int argc, char* argv[])
+{
+  LOG_SERIES_INFO Info;
+  LOG_ROLLUP *Results;
+  unsigned long NodeID = 0;
+  unsigned long Index = 0;
+  unsigned long Subindex = 0;
+  unsigned long Buckets = 0;
+  unsigned long Count;
+  unsigned long Total = 0;
+  unsigned long Skip = 0;
+  uint64_t From = 0;
+  uint64_t To = ~0ULL;
+  uint64_t Start;
+  bool Selected = FALSE;
+  char *End;
+  unsigned int s;
+  int Option;
+
+  while ((Option = getopt(argc, argv, "s:f:t:b:")) != -1)
+  {
+    switch (Option)
+    {
+      case 's':
+        NodeID = strtoul(optarg, &End, 0);
+        if (*End == ',') Index = strtoul(End + 1, &End, 0);
+        if (*End == ',') Subindex = strtoul(End + 1, &End, 0);
+        if ((*End != 0) || (NodeID > 0xFF) || (Index > 0xFFFF) || (Subindex > 0xFF))
+        {
+          Usage();
+          return 1;
+        }
+        Selected = TRUE;
+        break;
+      case 'f': From = strtoull(optarg, NULL, 0); break;
+      case 't': To = strtoull(optarg, NULL, 0); break;
+      case 'b':
+        Buckets = strtoul(optarg, NULL, 0);
+        if ((Buckets == 0) || (Buckets > MAX_BUCKETS))
+        {
+          Usage();
+          return 1;
+        }
+        break;
+      default:
+        Usage();
+        return 1;
+    }
+  }
+  if ((optind != argc - 1) || (!Selected && Buckets))
+  {
+    Usage();
+    return 1;
+  }
+
+  Start = Timer::GetMicroseconds();
+  if (!Log.Open(argv[optind])) return 1;
+  fprintf(stderr, "opened in %.3f ms\n", (Timer::GetMicroseconds() - Start) / 1000.0);
+
+  if (!Selected)
+  {
+    ListSeries();
+    return 0;
+  }
+
+  Start = Timer::GetMicroseconds();
+  if (Buckets)
+  {
+    // buckets over the samples of the series if no range is given
+    for (s = 0; Log.GetSeries(s, &Info); s++)
+    {
+      if ((Info.NodeID != NodeID) || (Info.Index != Index) || (Info.Subindex != Subindex)) continue;
+      if (From < Info.FirstTime) From = Info.FirstTime;
+      if (To > Info.LastTime) To = Info.LastTime;
+      break;
+    }
+    Results = new LOG_ROLLUP[Buckets];
+    Count = Log.Rollup((UNSIGNED8)NodeID, (UNSIGNED16)Index, (UNSIGNED8)Subindex, From, To, Buckets, Results);
+    fprintf(stderr, "%lu buckets in %.3f ms\n", Count, (Timer::GetMicroseconds() - Start) / 1000.0);
+    printf("start,count,min,max,avg\n");
+    for (s = 0; s < Count; s++)
+    {
+      if (Results[s].Count == 0) printf("%llu,0,,,\n", (unsigned long long)Results[s].Start);
+      else printf("%llu,%llu,%.17g,%.17g,%.17g\n", (unsigned long long)Results[s].Start,
+        (unsigned long long)Results[s].Count, Results[s].Min, Results[s].Max, Results[s].Avg);
+    }
+    delete[] Results;
+    return 0;
+  }
+
+  printf("time,value\n");
+  do
+  {
+    Count = Log.Query((UNSIGNED8)NodeID, (UNSIGNED16)Index, (UNSIGNED8)Subindex, From, Skip, To, Samples, QUERY_SAMPLES);
+    for (s = 0; s < Count; s++) printf("%llu,%.17g\n", (unsigned long long)Samples[s].Time, Samples[s].Value);
+    Total += Count;
+    // the next query starts at the time of the last sample and skips
+    // the samples of that time already printed
+    if (Count)
+    {
+      if (Samples[Count - 1].Time != From) Skip = 0;
+      From = Samples[Count - 1].Time;
+      for (s = Count; (s > 0) && (Samples[s - 1].Time == From); s--) Skip++;
+    }
+  } while (Count == QUERY_SAMPLES);
+  fprintf(stderr, "%lu samples in %.3f ms\n", Total, (Timer::GetMicroseconds() - Start) / 1000.0);
+  return 0;
+}
+
+/*----------------------- END OF FILE ----------------------------------*/
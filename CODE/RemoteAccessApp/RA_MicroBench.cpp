@@ -0,0 +1,447 @@
+/**************************************************************************
+MODULE:    RA_MicroBench
+CONTAINS:  Microbenchmarks of the protocol code without any I/O:
+             CRC of serial packets of different sizes
+             packet state machine fed from a byte stream in memory
+             SDO client handling the responses of block reads
+             extended SDO server handling requests of the device
+           Results are printed as comma separated values, one line per
+           benchmark with the time per operation and the bytes per second,
+           e.g. "make bench" or
+             RA_MicroBench -t 2000 > micro.csv
+COPYRIGHT: Embedded Systems Academy, Inc. 2008-2017.
+DISCLAIM:  Read and understand our disclaimer before using this code!
+           www.esacademy.com/disclaim.htm
+           This software was written in accordance to the guidelines at
+           www.esacademy.com/software/softwarestyleguide.pdf
+LICENSE:   Free to use with licensed CANopenIA chips, modules or devices
+           like CANgineBerry, CANgineXXX and 447izer
+VERSION:   1.10, EmSA 10-NOV-17
+           $LastChangedDate: 2014-01-11 17:30:59 +0100 (Sa, 11 Jan 2014) $
+           $LastChangedRevision: 1702 $
+***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "SerialProtocol.h"
+#include "CRC.h"
+#include "Timer.h"
+
+/**************************************************************************
+LOCAL DEFINES
+***************************************************************************/
+
+// start of a packet on the serial line
+#define SOH 0x11
+
+// operations between two looks at the clock
+#define BATCH_COUNT 1000
+
+// packets in the stream fed to the packet state machine
+#define STREAM_PACKETS 64
+
+// node and object read with block transfers
+#define SDO_NODE   2
+#define SDO_INDEX  0x2000
+#define BLOCK_SIZE 1024
+
+// segments per block, blksize requested by the SDO client
+#define BLOCK_SEGMENTS 127
+
+// a single operation of a benchmark, returns FALSE for failure
+typedef bool (*MICRO_OP)(unsigned long *Bytes);
+
+/**************************************************************************
+MODULE VARIABLES
+***************************************************************************/
+
+// settings
+static uint64_t MinTime = 500000;              // microseconds per benchmark
+
+// keeps results from being optimized away
+static volatile unsigned long Sink;
+
+// packet contents for the CRC benchmarks
+static unsigned char CRCData[MAX_PACKET_LENGTH];
+
+// framed packets for the packet state machine
+static unsigned char Stream[STREAM_PACKETS * (MAX_PACKET_LENGTH + 4)];
+static unsigned long StreamLength;
+static unsigned long StreamPosition;
+static SerialProtocol *Parser;
+
+// SDO client and its messages
+static Timer *Tim;
+static SDOCLNT *SdoClient;
+static unsigned long SdoMessages;
+static bool SdoCompleted;
+static UNSIGNED32 SdoResult;
+static UNSIGNED8 BlockBuffer[BLOCK_SIZE];
+static UNSIGNED8 BlockData[BLOCK_SIZE];
+
+// extended SDO server, static so the transfer states start cleared
+static XSDO XSdo;
+static const UNSIGNED8 UploadRequest[8] = { 0x40, 0x00, 0x20, 0x00, 0, 0, 0, 0 };
+static const UNSIGNED8 DownloadSegment[8] = { 0x00, 1, 2, 3, 4, 5, 6, 7 };
+
+
+/**************************************************************************
+DOES:    Calculates the CRC of a packet as sent on the serial line, the
+         length followed by the data
+RETURNS: Nothing
+**************************************************************************/
+static void PacketCRC
+  (
+  unsigned long Length,                                    // length of packet data
+  unsigned long *Bytes                                     // location to store bytes handled
+  )
+{
+  CRC crc;
+  unsigned long b;
+
+  crc.Add((unsigned char)Length);
+  for (b = 0; b < Length; b++) crc.Add(CRCData[b]);
+  Sink = crc.Finalize();
+  *Bytes = Length + 1;
+}
+
+
+/**************************************************************************
+DOES:    Benchmark operations, CRC of a read request, a process data
+         packet and the largest packet
+RETURNS: TRUE
+**************************************************************************/
+static bool CRCRead(unsigned long *Bytes) { PacketCRC(4, Bytes); return TRUE; }
+static bool CRCProcessData(unsigned long *Bytes) { PacketCRC(13, Bytes); return TRUE; }
+static bool CRCMax(unsigned long *Bytes) { PacketCRC(MAX_PACKET_LENGTH, Bytes); return TRUE; }
+
+
+/**************************************************************************
+DOES:    Appends a packet with its frame to the stream
+RETURNS: Nothing
+**************************************************************************/
+static void AddPacket
+  (
+  const unsigned char *Data,                               // packet data
+  unsigned long Length                                     // length of packet data
+  )
+{
+  CRC crc;
+  unsigned short CRCValue;
+  unsigned long b;
+
+  Stream[StreamLength++] = SOH;
+  Stream[StreamLength++] = (unsigned char)Length;
+  crc.Add((unsigned char)Length);
+  for (b = 0; b < Length; b++)
+  {
+    Stream[StreamLength++] = Data[b];
+    crc.Add(Data[b]);
+  }
+  CRCValue = crc.Finalize();
+  Stream[StreamLength++] = CRCValue & 0xFF;
+  Stream[StreamLength++] = (CRCValue >> 8) & 0xFF;
+}
+
+
+/**************************************************************************
+DOES:    Builds a stream of the packets a host mostly receives: process
+         data of different lengths and SDO responses of remote nodes
+RETURNS: Nothing
+**************************************************************************/
+static void BuildStream
+  (
+  void
+  )
+{
+  unsigned char Data[MAX_PACKET_LENGTH];
+  unsigned long p;
+  unsigned long b;
+
+  StreamLength = 0;
+  for (p = 0; p < STREAM_PACKETS; p++)
+  {
+    if (p % 4 == 3)
+    { // SDO response of a remote node
+      Data[0] = 'V';
+      Data[1] = SDO_NODE;
+      for (b = 2; b < 10; b++) Data[b] = (unsigned char)(p + b);
+      AddPacket(Data, 10);
+    }
+    else
+    { // process data with 1 to 8 bytes
+      Data[0] = 'D';
+      Data[1] = (unsigned char)(p % 127 + 1);
+      Data[2] = 0x00;
+      Data[3] = 0x60;
+      Data[4] = 0x00;
+      for (b = 5; b < 5 + p % 8 + 1; b++) Data[b] = (unsigned char)(p * b);
+      AddPacket(Data, 5 + p % 8 + 1);
+    }
+  }
+  StreamPosition = 0;
+}
+
+
+/**************************************************************************
+DOES:    Benchmark operation, feeds the bytes of the next packet of the
+         stream to the packet state machine
+RETURNS: TRUE if the packet was received, else FALSE
+**************************************************************************/
+static bool ParsePacket
+  (
+  unsigned long *Bytes                                     // location to store bytes handled
+  )
+{
+  PACKET Packet;
+  unsigned long Start = StreamPosition;
+  bool Received = FALSE;
+
+  while (!Received && (StreamPosition < StreamLength))
+  {
+    Received = Parser->ReceiveByte(Stream[StreamPosition++], &Packet);
+  }
+  *Bytes = StreamPosition - Start;
+  if (StreamPosition >= StreamLength) StreamPosition = 0;
+  if (Received) Sink = Packet.Length;
+  return Received;
+}
+
+
+/**************************************************************************
+DOES:    Call-back function of the SDO client, counts the messages sent
+RETURNS: Nothing
+**************************************************************************/
+static void SdoClientSend
+  (
+  UNSIGNED8 NodeID,                                        // node the request is for
+  UNSIGNED8 *pData,                                        // 8 bytes of SDO request
+  void *Param                                              // not used
+  )
+{
+  SdoMessages++;
+}
+
+
+/**************************************************************************
+DOES:    Call-back function, signals the end of an SDO transfer
+RETURNS: Nothing
+**************************************************************************/
+static void SDORequestComplete
+  (
+  UNSIGNED8 Channel,                                       // SDO client channel
+  UNSIGNED32 Result                                        // SDOERR_xxx
+  )
+{
+  SdoResult = Result;
+  SdoCompleted = TRUE;
+}
+
+
+/**************************************************************************
+DOES:    Lets the SDO client work on its channels until one of them did
+         something, it serves one channel per call
+RETURNS: Nothing
+**************************************************************************/
+static void RunSdoClient
+  (
+  void
+  )
+{
+  int c;
+
+  for (c = 0; c < NR_OF_SDO_CLIENTS; c++)
+  {
+    if (SdoClient->MGR_SDOHandleClient()) return;
+  }
+}
+
+
+/**************************************************************************
+DOES:    Benchmark operation, reads an object with a block transfer by
+         passing the responses of the server to the SDO client
+RETURNS: TRUE if the transfer completed, else FALSE
+**************************************************************************/
+static bool ReadBlock
+  (
+  unsigned long *Bytes                                     // location to store bytes handled
+  )
+{
+  SDOCLIENT *Client;
+  UNSIGNED8 Response[8];
+  unsigned long Offset = 0;
+  unsigned long Length;
+  unsigned long Segment;
+
+  *Bytes = 0;
+  SdoCompleted = FALSE;
+  SdoMessages = 0;
+  Client = SdoClient->SDOCLNT_Init(SDO_NODE, 0x600 + SDO_NODE, 0x580 + SDO_NODE, BlockBuffer, BLOCK_SIZE);
+  if (!SdoClient->SDOCLNT_Read(Client, SDO_INDEX, 0)) return FALSE;
+
+  // initiate response with size, the client requests the first block
+  memset(Response, 0, sizeof(Response));
+  Response[0] = 0xC2;
+  Response[1] = (UNSIGNED8)SDO_INDEX;
+  Response[2] = (UNSIGNED8)(SDO_INDEX >> 8);
+  Response[4] = (UNSIGNED8)BLOCK_SIZE;
+  Response[5] = (UNSIGNED8)(BLOCK_SIZE >> 8);
+  SdoClient->MGR_HandleSDOClientResponse(SDO_NODE, Response);
+  RunSdoClient();
+
+  // blocks of segments, each block is confirmed by the client
+  while (Offset < BLOCK_SIZE)
+  {
+    for (Segment = 1; (Segment <= BLOCK_SEGMENTS) && (Offset < BLOCK_SIZE); Segment++)
+    {
+      Length = (BLOCK_SIZE - Offset < 7) ? BLOCK_SIZE - Offset : 7;
+      Response[0] = (UNSIGNED8)Segment;
+      memcpy(&Response[1], &BlockData[Offset], Length);
+      Offset += Length;
+      if (Offset == BLOCK_SIZE) Response[0] |= 0x80;
+      SdoClient->MGR_HandleSDOClientResponse(SDO_NODE, Response);
+    }
+    RunSdoClient();
+  }
+
+  // end with the number of unused bytes in the last segment, the client
+  // sends the final confirmation and completes
+  memset(Response, 0, sizeof(Response));
+  Response[0] = 0xC1 | ((7 - (BLOCK_SIZE - 1) % 7 - 1) << 2);
+  SdoClient->MGR_HandleSDOClientResponse(SDO_NODE, Response);
+  RunSdoClient();
+
+  *Bytes = Client->curlen;
+  return SdoCompleted && (SdoResult == SDOERR_OK) && (Client->curlen == BLOCK_SIZE) && (SdoMessages > 2);
+}
+
+
+/**************************************************************************
+DOES:    Benchmark operations, the extended SDO server handling a read
+         request and a segment of a write from the device
+RETURNS: TRUE if the request was handled, else FALSE
+**************************************************************************/
+static bool XSDORequest
+  (
+  const UNSIGNED8 *Request,                                // 8 bytes of SDO request
+  unsigned long *Bytes                                     // location to store bytes handled
+  )
+{
+  UNSIGNED8 Data[8];
+  CAN_MSG Response;
+
+  memcpy(Data, Request, sizeof(Data));
+  Response.LEN = 0;
+  Sink = XSdo.XSDO_HandleExtended(Data, &Response, 1);
+  *Bytes = sizeof(Data);
+  return TRUE;
+}
+
+static bool XSDOUpload(unsigned long *Bytes) { return XSDORequest(UploadRequest, Bytes); }
+static bool XSDOSegment(unsigned long *Bytes) { return XSDORequest(DownloadSegment, Bytes); }
+
+
+/**************************************************************************
+DOES:    Runs a benchmark for at least MinTime and prints its result
+RETURNS: Nothing
+**************************************************************************/
+static void RunBenchmark
+  (
+  const char *Name,                                        // name of benchmark
+  MICRO_OP Operation                                       // operation to run
+  )
+{
+  uint64_t Start;
+  uint64_t Duration;
+  uint64_t TotalBytes = 0;
+  unsigned long Ops = 0;
+  unsigned long Errors = 0;
+  unsigned long Bytes;
+  unsigned long i;
+  double Seconds;
+
+  Start = Timer::GetMicroseconds();
+  do
+  {
+    for (i = 0; i < BATCH_COUNT; i++)
+    {
+      if (Operation(&Bytes)) TotalBytes += Bytes;
+      else Errors++;
+    }
+    Ops += BATCH_COUNT;
+    Duration = Timer::GetMicroseconds() - Start;
+  } while (Duration < MinTime);
+
+  Seconds = Duration / 1000000.0;
+  printf("%s,%lu,%lu,%.3f,%.1f,%.1f\n", Name, Ops, Errors, Seconds,
+    Duration * 1000.0 / Ops, TotalBytes / Seconds);
+  fflush(stdout);
+}
+
+
+/**************************************************************************
+DOES:    Prints the command line syntax
+RETURNS: Nothing
+**************************************************************************/
+static void Usage
+  (
+  void
+  )
+{
+  printf("Usage: RA_MicroBench [options]\n");
+  printf("  -t <ms>        min time per benchmark, default %lu\n", (unsigned long)(MinTime / 1000));
+}
+
+
+/**************************************************************************
+DOES:    Main function, runs the benchmarks
+**************************************************************************/
+int main(int argc, char* argv[])
+{
+  unsigned long b;
+  int Option;
+
+  while ((Option = getopt(argc, argv, "t:")) != -1)
+  {
+    switch (Option)
+    {
+      case 't': MinTime = strtoul(optarg, NULL, 0) * 1000; break;
+      default:
+        Usage();
+        return 1;
+    }
+  }
+  if ((MinTime == 0) || (optind != argc))
+  {
+    Usage();
+    return 1;
+  }
+
+  for (b = 0; b < sizeof(CRCData); b++) CRCData[b] = (unsigned char)(b * 13 + 5);
+  for (b = 0; b < BLOCK_SIZE; b++) BlockData[b] = (UNSIGNED8)(b * 7 + 3);
+  BuildStream();
+  Parser = new SerialProtocol();
+  Tim = new Timer();
+  // the client only sends with an instance, any pointer will do
+  SdoClient = new SDOCLNT(Tim, (SDOCLNTSENDCALLBACK *)SdoClientSend, (void *)&SdoMessages);
+  SdoClient->SdoRequestCompleteCallback = (SDOREQUESTCOMPLETECALLBACK *)SDORequestComplete;
+
+  printf("benchmark,ops,errors,seconds,ns_per_op,bytes_per_s\n");
+  RunBenchmark("crc_read_request", CRCRead);
+  RunBenchmark("crc_process_data", CRCProcessData);
+  RunBenchmark("crc_max_packet", CRCMax);
+  RunBenchmark("parse_packet", ParsePacket);
+  RunBenchmark("sdo_client_block_read", ReadBlock);
+  RunBenchmark("xsdo_upload_request", XSDOUpload);
+  RunBenchmark("xsdo_download_segment", XSDOSegment);
+
+  delete SdoClient;
+  delete Tim;
+  delete Parser;
+
+  return 0;
+}
+
+/*----------------------- END OF FILE ----------------------------------*/
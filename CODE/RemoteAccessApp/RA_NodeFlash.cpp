@@ -0,0 +1,157 @@
+/**************************************************************************
+MODULE:    RA_NodeFlash
+CONTAINS:  Flashes firmware and configuration to the CiA 302-3 bootloader
+           of a remote node through many CANopenIA devices at once, one
+           thread per serial port, e.g.
+             RA_NodeFlash -n 2 -f firmware.bin -c config.bin -v 1,0x1234
+                          /dev/ttyUSB0 /dev/ttyUSB1 /dev/ttyUSB2:3
+           The firmware of the CANgineBerry itself is updated with
+           coiaupdater, not with this program.
+           Each port is reported as it completes, the exit code is 0 only
+           if all ports were flashed.
+COPYRIGHT: Embedded Systems Academy, Inc. 2008-2017.
+DISCLAIM:  Read and understand our disclaimer before using this code!
+           www.esacademy.com/disclaim.htm
+           This software was written in accordance to the guidelines at
+           www.esacademy.com/software/softwarestyleguide.pdf
+LICENSE:   Free to use with licensed CANopenIA chips, modules or devices
+           like CANgineBerry, CANgineXXX and 447izer
+VERSION:   1.10, EmSA 10-NOV-17
+           $LastChangedDate: 2014-01-11 17:30:59 +0100 (Sa, 11 Jan 2014) $
+           $LastChangedRevision: 1702 $
+***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "NodeFlasher.h"
+#include "Timer.h"
+
+/**************************************************************************
+LOCAL DEFINES
+***************************************************************************/
+
+// default baudrate of the serial ports
+#define BAUDRATE 115200
+
+
+/**************************************************************************
+DOES:    Prints the command line syntax
+RETURNS: Nothing
+**************************************************************************/
+static void Usage
+  (
+  void
+  )
+{
+  printf("Usage: RA_NodeFlash [options] <port>[:<nodeid>] ...\n");
+  printf("  -f <file>            firmware image, program 1\n");
+  printf("  -c <file>            configuration image, program 2\n");
+  printf("  -i <program>,<file>  image of another program\n");
+  printf("  -n <nodeid>          node id of the bootloader for ports without own\n");
+  printf("  -r <bps>             baudrate of the serial ports, default %lu\n", (unsigned long)BAUDRATE);
+  printf("  -l                   low latency mode of the serial ports\n");
+  printf("  -u                   io_uring backend of the serial ports\n");
+  printf("  -k <segments>        SDO block download segments sent at once, default 16\n");
+  printf("  -v <program>,<ident>  software identification [1F56h] the program must have\n");
+  printf("  -s                   do not start the firmware when done\n");
+}
+
+
+/**************************************************************************
+DOES:    Main function, flashes all ports given
+**************************************************************************/
+int main(int argc, char* argv[])
+{
+  NODEFLASHER Flasher;
+  char PortName[MAX_PATH];
+  unsigned long NodeID = 0;
+  unsigned long PortNodeID;
+  unsigned long Program;
+  unsigned long Burst;
+  uint64_t StartTime;
+  const FLASH_PORT *Port;
+  unsigned long Bytes = 0;
+  int Failed = 0;
+  bool Images = FALSE;
+  bool Valid = TRUE;
+  char *Separator;
+  int Option;
+  int p;
+
+  Flasher.SetBaudrate(BAUDRATE);
+  while ((Option = getopt(argc, argv, "f:c:i:v:n:r:luk:s")) != -1)
+  {
+    switch (Option)
+    {
+      case 'f': Valid = Flasher.AddImage(FLASH_PROGRAM_FIRMWARE, optarg); Images = TRUE; break;
+      case 'c': Valid = Flasher.AddImage(FLASH_PROGRAM_CONFIG, optarg); Images = TRUE; break;
+      case 'i':
+        Program = strtoul(optarg, &Separator, 0);
+        if ((*Separator != ',') || (Program < 1) || (Program > 254))
+        {
+          Usage();
+          return 1;
+        }
+        Valid = Flasher.AddImage((UNSIGNED8)Program, Separator + 1);
+        Images = TRUE;
+        break;
+      case 'n': NodeID = strtoul(optarg, NULL, 0); break;
+      case 'r': Flasher.SetBaudrate(strtoul(optarg, NULL, 0)); break;
+      case 'l': Flasher.SetLowLatency(TRUE); break;
+      case 'u': Flasher.SetBackend(SERIAL_BACKEND_URING); break;
+      case 'k':
+        Burst = strtoul(optarg, NULL, 0);
+        Flasher.SetBlockBurst((UNSIGNED8)((Burst > 127) ? 127 : Burst));
+        break;
+      case 'v':
+        Program = strtoul(optarg, &Separator, 0);
+        if ((*Separator != ',') || (Program < 1) || (Program > 254))
+        {
+          Usage();
+          return 1;
+        }
+        Valid = Flasher.SetIdentification((UNSIGNED8)Program, strtoul(Separator + 1, NULL, 0));
+        break;
+      case 's': Flasher.SetStart(FALSE); break;
+      default:
+        Usage();
+        return 1;
+    }
+    if (!Valid) return 1;
+  }
+  if (!Images || (optind >= argc))
+  {
+    Usage();
+    return 1;
+  }
+
+  for (; optind < argc; optind++)
+  {
+    strncpy(PortName, argv[optind], sizeof(PortName) - 1);
+    PortName[sizeof(PortName) - 1] = 0;
+    PortNodeID = NodeID;
+    Separator = strrchr(PortName, ':');
+    if (Separator != NULL)
+    {
+      *Separator = 0;
+      PortNodeID = strtoul(Separator + 1, NULL, 0);
+    }
+    if (!Flasher.AddPort(PortName, (UNSIGNED8)((PortNodeID > 255) ? 0 : PortNodeID))) return 1;
+  }
+
+  StartTime = Timer::GetMicroseconds();
+  Flasher.Run();
+  for (p = 0; (Port = Flasher.GetPort(p)) != NULL; p++)
+  {
+    if (Port->Success) Bytes += Port->Bytes;
+    else Failed++;
+  }
+  printf("%d of %d ports flashed, %lu bytes in %.2f s\n", p - Failed, p, Bytes,
+    (Timer::GetMicroseconds() - StartTime) / 1000000.0);
+
+  return Failed ? 1 : 0;
+}
+
+/*----------------------- END OF FILE ----------------------------------*/
@@ -0,0 +1,358 @@
+/**************************************************************************
+MODULE:    RA_Replay
+CONTAINS:  Replays a trace file written by RA_Daemon -t. The bytes received
+           from the device are fed through the packet state machine and
+           the packet handling of the protocol again, without a device, so
+           a problem captured once can be reproduced and debugged any
+           number of times. Frames sent to the device are shown only.
+           Usage:
+             RA_Replay [-v] [-t] <tracefile>
+           -v prints every record, -t keeps the timing of the capture,
+           otherwise the trace is replayed as fast as possible and the
+           throughput is shown.
+COPYRIGHT: Embedded Systems Academy, Inc. 2008-2017.
+DISCLAIM:  Read and understand our disclaimer before using this code!
+           www.esacademy.com/disclaim.htm
+           This software was written in accordance to the guidelines at
+           www.esacademy.com/software/softwarestyleguide.pdf
+LICENSE:   Free to use with licensed CANopenIA chips, modules or devices
+           like CANgineBerry, CANgineXXX and 447izer
+VERSION:   1.10, EmSA 10-NOV-17
+           $LastChangedDate: 2014-01-11 17:30:59 +0100 (Sa, 11 Jan 2014) $
+           $LastChangedRevision: 1702 $
+***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "SerialProtocol.h"
+#include "Tracer.h"
+#include "Timer.h"
+
+/**************************************************************************
+MODULE VARIABLES
+***************************************************************************/
+
+// settings
+static bool Verbose = FALSE;                   // print every record
+static bool KeepTiming = FALSE;                // replay with the timing of the capture
+
+// totals of the replay
+static unsigned long Records;
+static unsigned long Transmitted;
+static unsigned long Packets;
+static unsigned long Captured;                 // packets received during the capture
+static unsigned long Dropped;
+static unsigned long Timeouts;
+static unsigned long Lost;
+static unsigned long Mismatches;
+static unsigned long ProcessData;
+
+
+/*******************************************************************************
+DOES:    Called when process data is received
+RETURNS: Nothing
+*******************************************************************************/
+static void NewData
+  (
+  unsigned char NodeID,                                    // node id of data
+  unsigned short Index,                                    // index of data
+  unsigned char Subindex,                                  // subindex of data
+  unsigned long Length,                                    // number of data bytes
+  unsigned char *pData,                                    // data
+  void *Param                                              // not used
+  )
+{
+  unsigned long b;
+
+  ProcessData++;
+  if (Verbose)
+  {
+    printf("                 data node %u %04X,%u:", NodeID, Index, Subindex);
+    for (b = 0; b < Length; b++) printf(" %02X", pData[b]);
+    printf("\n");
+  }
+}
+
+
+/**************************************************************************
+DOES:    Reads a little endian value from a record
+RETURNS: Value
+**************************************************************************/
+static uint64_t GetLE
+  (
+  const unsigned char *Data,                               // location of value
+  int Length                                               // bytes of value
+  )
+{
+  uint64_t Value = 0;
+
+  while (Length--) Value = (Value << 8) | Data[Length];
+  return Value;
+}
+
+
+/**************************************************************************
+DOES:    Prints a record
+RETURNS: Nothing
+**************************************************************************/
+static void PrintRecord
+  (
+  uint64_t Time,                                           // time relative to the first record
+  UNSIGNED8 Type,                                          // TRACE_xxx
+  UNSIGNED8 Flags,                                         // TRACE_FLAG_xxx
+  const unsigned char *Data,                               // data of record
+  unsigned long Length                                     // length of data
+  )
+{
+  unsigned long b;
+
+  printf("%12.6f ", Time / 1000000.0);
+  switch (Type)
+  {
+    case TRACE_TX: printf("TX  "); break;
+    case TRACE_RX: printf("RX  "); break;
+    default:       printf("?%02X ", Type); break;
+  }
+  for (b = 0; b < Length; b++) printf(" %02X", Data[b]);
+  if (Flags & TRACE_FLAG_ERROR)   printf("  (dropped)");
+  if (Flags & TRACE_FLAG_TIMEOUT) printf("  (timeout)");
+  printf("\n");
+}
+
+
+/**************************************************************************
+DOES:    Hands packets to the protocol, also those found in the bytes of
+         damaged packets
+RETURNS: Nothing
+**************************************************************************/
+static void HandlePackets
+  (
+  SerialProtocol *Protocol,                                // protocol to feed
+  PACKET *Packet                                           // first packet
+  )
+{
+  do
+  {
+    Packets++;
+    Protocol->HandlePacket(Packet);
+  } while (Protocol->NextPacket(Packet));
+}
+
+
+/**************************************************************************
+DOES:    Checks that the protocol received as many packets as during the
+         capture
+RETURNS: Nothing
+**************************************************************************/
+static void CheckPackets
+  (
+  void
+  )
+{
+  if (Packets != Captured)
+  {
+    Mismatches++;
+    if (Verbose) printf("                 mismatch, %lu packets instead of %lu\n", Packets, Captured);
+    Packets = Captured;
+  }
+}
+
+
+/**************************************************************************
+DOES:    Feeds received bytes through the protocol and checks that it ends
+         packets just where it did during the capture. Packets found in
+         the bytes of damaged packets are recorded without bytes, they
+         follow the record with the byte that revealed them.
+RETURNS: Nothing
+**************************************************************************/
+static void ReplayReceived
+  (
+  SerialProtocol *Protocol,                                // protocol to feed
+  UNSIGNED8 Flags,                                         // TRACE_FLAG_xxx of the capture
+  const unsigned char *Data,                               // bytes received
+  unsigned long Length                                     // number of bytes
+  )
+{
+  PACKET Packet;
+  unsigned long b;
+
+  // new bytes, all packets of the bytes before must have been found
+  if (Length) CheckPackets();
+  for (b = 0; b < Length; b++)
+  {
+    if (Protocol->ReceiveByte(Data[b], &Packet))
+    {
+      if (b != Length - 1) Mismatches++;
+      HandlePackets(Protocol, &Packet);
+    }
+  }
+
+  if (Flags & TRACE_FLAG_PACKET) Captured++;
+  if (Flags & TRACE_FLAG_ERROR) Dropped++;
+  if (Flags & TRACE_FLAG_TIMEOUT)
+  {
+    Timeouts++;
+    Protocol->AbortPacket();
+    if (Protocol->NextPacket(&Packet)) HandlePackets(Protocol, &Packet);
+  }
+}
+
+
+/**************************************************************************
+DOES:    Prints the command line syntax
+RETURNS: Nothing
+**************************************************************************/
+static void Usage
+  (
+  void
+  )
+{
+  printf("Usage: RA_Replay [options] <tracefile>\n");
+  printf("  -v             print every record\n");
+  printf("  -t             keep the timing of the capture\n");
+}
+
+
+/**************************************************************************
+DOES:    Main function, replays a trace file
+**************************************************************************/
+int main(int argc, char* argv[])
+{
+  SerialProtocol *Protocol;
+  const SERIAL_STATISTICS *Stats;
+  PACKET Packet;
+  unsigned char *Trace;
+  unsigned long TraceLength;
+  unsigned long Position;
+  unsigned long Length;
+  uint64_t FirstTime = 0;
+  uint64_t Time;
+  uint64_t Start;
+  uint64_t Elapsed;
+  uint64_t Now;
+  UNSIGNED8 Type;
+  UNSIGNED8 Flags;
+  FILE *File;
+  long Size;
+  int Option;
+  int c;
+
+  while ((Option = getopt(argc, argv, "vt")) != -1)
+  {
+    switch (Option)
+    {
+      case 'v': Verbose = TRUE; break;
+      case 't': KeepTiming = TRUE; break;
+      default:
+        Usage();
+        return 1;
+    }
+  }
+  if (optind != argc - 1)
+  {
+    Usage();
+    return 1;
+  }
+
+  // read the whole trace, replaying is not slowed down by the file
+  File = fopen(argv[optind], "rb");
+  if (File == NULL)
+  {
+    fprintf(stderr, "ERROR: can not open %s\n", argv[optind]);
+    return 1;
+  }
+  fseek(File, 0, SEEK_END);
+  Size = ftell(File);
+  fseek(File, 0, SEEK_SET);
+  if (Size < TRACE_MAGIC_LENGTH)
+  {
+    fprintf(stderr, "ERROR: %s is not a trace file\n", argv[optind]);
+    fclose(File);
+    return 1;
+  }
+  TraceLength = (unsigned long)Size;
+  Trace = (unsigned char *)malloc(TraceLength);
+  if ((Trace == NULL) || (fread(Trace, 1, TraceLength, File) != TraceLength) || memcmp(Trace, TRACE_MAGIC, TRACE_MAGIC_LENGTH))
+  {
+    fprintf(stderr, "ERROR: %s is not a trace file\n", argv[optind]);
+    free(Trace);
+    fclose(File);
+    return 1;
+  }
+  fclose(File);
+
+  // a protocol without a device, frames it sends are dropped
+  Protocol = new SerialProtocol();
+  Protocol->RegisterDataCallback((DATACALLBACK *)NewData, NULL);
+
+  Start = Timer::GetMicroseconds();
+  Position = TRACE_MAGIC_LENGTH;
+  while (Position + TRACE_HEADER_LENGTH <= TraceLength)
+  {
+    Time   = GetLE(&Trace[Position], 8);
+    Type   = Trace[Position + 8];
+    Flags  = Trace[Position + 9];
+    Length = (unsigned long)GetLE(&Trace[Position + 10], 2);
+    Position += TRACE_HEADER_LENGTH;
+    if ((Position + Length > TraceLength) || (Length > TRACE_MAX_DATA))
+    {
+      fprintf(stderr, "ERROR: trace ends in a record\n");
+      break;
+    }
+
+    if (Records == 0) FirstTime = Time;
+    Records++;
+    Time -= FirstTime;
+
+    if (KeepTiming)
+    {
+      Now = Timer::GetMicroseconds() - Start;
+      if (Time > Now) usleep((useconds_t)(Time - Now));
+    }
+
+    if (Verbose && (Type != TRACE_LOST)) PrintRecord(Time, Type, Flags, &Trace[Position], Length);
+
+    switch (Type)
+    {
+      case TRACE_TX:
+        Transmitted++;
+        break;
+      case TRACE_RX:
+        ReplayReceived(Protocol, Flags, &Trace[Position], Length);
+        break;
+      case TRACE_LOST:
+        // the capture is incomplete here, the packet may be cut
+        Lost += (unsigned long)GetLE(&Trace[Position], 4);
+        CheckPackets();
+        Protocol->AbortPacket();
+        if (Protocol->NextPacket(&Packet)) HandlePackets(Protocol, &Packet);
+        printf("%12.6f %lu records lost\n", Time / 1000000.0, (unsigned long)GetLE(&Trace[Position], 4));
+        break;
+    }
+    Position += Length;
+  }
+  Elapsed = Timer::GetMicroseconds() - Start;
+  CheckPackets();
+
+  printf("\nrecords %lu, frames sent %lu, packets received %lu, process data %lu\n", Records, Transmitted, Packets, ProcessData);
+  printf("dropped %lu, timeouts %lu, lost %lu, mismatches %lu\n", Dropped, Timeouts, Lost, Mismatches);
+  Stats = Protocol->GetStatistics();
+  printf("protocol: skipped %lu, resyncs %lu, crc errors %lu, received bytes",
+    (unsigned long)STATS_Get(&Stats->RxSkipped), (unsigned long)STATS_Get(&Stats->Resyncs), (unsigned long)STATS_Get(&Stats->CRCErrors));
+  Size = 0;
+  for (c = 0; c < STATS_COMMANDS; c++) Size += (long)STATS_Get(&Stats->RxBytes[c]);
+  printf(" %ld\n", Size);
+  if (!KeepTiming && Elapsed)
+  {
+    printf("replayed in %.3f s, %.0f packets/s\n", Elapsed / 1000000.0, Packets * 1000000.0 / Elapsed);
+  }
+
+  delete Protocol;
+  free(Trace);
+
+  return Mismatches ? 2 : 0;
+}
+
+/*----------------------- END OF FILE ----------------------------------*/
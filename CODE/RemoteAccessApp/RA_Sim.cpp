@@ -0,0 +1,376 @@
+/**************************************************************************
+MODULE:    RA_Sim
+CONTAINS:  CANopenIA device simulator for testing without hardware. Opens
+           a pseudo terminal that host applications use like the serial
+           port of a CANgineBerry, e.g.
+             RA_Sim -l /tmp/ttyCOIA -e CiA401_min_default.eds
+                    3:CiA401_IO_Node3.eds 8:CiA402_Stepper_Node8.eds
+             RA_Batch /tmp/ttyCOIA test.txt
+           Larger networks with lossy nodes, e.g. 126 encoders sending
+           PDOs every 10ms and heartbeats every 100ms on a 1MBit bus:
+             RA_Sim -l /tmp/ttyCOIA -c 1000 -p 10 -b 100
+                    2-127:CiA406_Encoder_Node4.eds@latency=0.5,drop=0.1
+           Nodes with a bootloader taking program downloads for RA_NodeFlash:
+             RA_Sim -l /tmp/ttyCOIA -f 2 2:CiA401_IO_Node3.eds
+COPYRIGHT: Embedded Systems Academy, Inc. 2008-2017.
+DISCLAIM:  Read and understand our disclaimer before using this code!
+           www.esacademy.com/disclaim.htm
+           This software was written in accordance to the guidelines at
+           www.esacademy.com/software/softwarestyleguide.pdf
+LICENSE:   Free to use with licensed CANopenIA chips, modules or devices
+           like CANgineBerry, CANgineXXX and 447izer
+VERSION:   1.10, EmSA 10-NOV-17
+           $LastChangedDate: 2014-01-11 17:30:59 +0100 (Sa, 11 Jan 2014) $
+           $LastChangedRevision: 1702 $
+***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include "DeviceSim.h"
+
+/**************************************************************************
+LOCAL DEFINES
+***************************************************************************/
+
+// max number of different EDS files
+#define MAX_DICTIONARIES 32
+
+// kbytes of each program of nodes with a bootloader
+#define PROGRAM_SIZE 256
+
+// behaviour of a group of nodes on the bus
+typedef struct
+{
+  SIMLINK Link;
+  UNSIGNED32 Interval;                        // milliseconds between PDOs
+  UNSIGNED16 Heartbeat;                       // milliseconds, 0 for EDS default
+} NODECONFIG;
+
+/**************************************************************************
+MODULE VARIABLES
+***************************************************************************/
+
+static DEVICESIM *Sim = new DEVICESIM();
+static volatile int TerminationRequested = FALSE;
+
+// loaded EDS files, nodes with the same file share the dictionary
+static EDS *Dictionaries[MAX_DICTIONARIES];
+static const char *DictionaryNames[MAX_DICTIONARIES];
+static int DictionaryCount = 0;
+
+// applies to all nodes without own settings
+static NODECONFIG Defaults;
+
+// nodes with a bootloader and their program size in bytes
+static UNSIGNED8 ProgramNodes[DEVICESIM_MAX_NODES];
+static unsigned long ProgramSizes[DEVICESIM_MAX_NODES];
+static int ProgramNodeCount = 0;
+
+
+/*******************************************************************************
+DOES:    Called when user presses Ctrl-C or the process is terminated
+RETURNS: Nothing
+*******************************************************************************/
+static void Terminate
+  (
+  int SignalNumber
+  )
+{
+  TerminationRequested = TRUE;
+}
+
+
+/**************************************************************************
+DOES:    Loads an EDS file unless it was loaded before
+RETURNS: Dictionary or NULL for error
+**************************************************************************/
+static EDS *LoadDictionary
+  (
+  const char *FileName                                     // EDS file
+  )
+{
+  int d;
+
+  for (d = 0; d < DictionaryCount; d++)
+  {
+    if (strcmp(DictionaryNames[d], FileName) == 0) return Dictionaries[d];
+  }
+  if (DictionaryCount == MAX_DICTIONARIES)
+  {
+    fprintf(stderr, "ERROR: more than %d EDS files\n", MAX_DICTIONARIES);
+    return NULL;
+  }
+
+  Dictionaries[DictionaryCount] = new EDS();
+  if (!Dictionaries[DictionaryCount]->Load(FileName))
+  {
+    delete Dictionaries[DictionaryCount];
+    return NULL;
+  }
+  DictionaryNames[DictionaryCount] = FileName;
+  return Dictionaries[DictionaryCount++];
+}
+
+
+/**************************************************************************
+DOES:    Converts a time in milliseconds with fraction to microseconds
+RETURNS: TRUE for success, FALSE for error
+**************************************************************************/
+static bool ParseTime
+  (
+  const char *Text,                                        // time in milliseconds, e.g. "0.25"
+  UNSIGNED32 *Microseconds                                 // location to store the time
+  )
+{
+  char *End;
+  double Value = strtod(Text, &End);
+
+  if ((End == Text) || ((*End != 0) && (*End != ',')) || (Value < 0) || (Value > 4000000)) return FALSE;
+  *Microseconds = (UNSIGNED32)(Value * 1000 + 0.5);
+  return TRUE;
+}
+
+
+/**************************************************************************
+DOES:    Converts a drop rate in percent with fraction
+RETURNS: TRUE for success, FALSE for error
+**************************************************************************/
+static bool ParseDropRate
+  (
+  const char *Text,                                        // frames lost in percent, e.g. "0.5"
+  UNSIGNED16 *DropRate                                     // location to store the drop rate
+  )
+{
+  char *End;
+  double Value = strtod(Text, &End);
+
+  if ((End == Text) || ((*End != 0) && (*End != ',')) || (Value < 0) || (Value > 100)) return FALSE;
+  *DropRate = (UNSIGNED16)(Value * SIMBUS_DROP_SCALE / 100 + 0.5);
+  return TRUE;
+}
+
+
+/**************************************************************************
+DOES:    Parses the settings of a group of nodes,
+         "<key>=<value>[,<key>=<value>...]" with the keys latency, jitter,
+         drop, pdo and hb
+RETURNS: TRUE for success, FALSE for error
+**************************************************************************/
+static bool ParseSettings
+  (
+  const char *Text,                                        // settings
+  NODECONFIG *Config                                       // location to store the settings
+  )
+{
+  UNSIGNED32 Value;
+  bool Valid;
+
+  while (*Text)
+  {
+    if (strncmp(Text, "latency=", 8) == 0) Valid = ParseTime(Text + 8, &Config->Link.Latency);
+    else if (strncmp(Text, "jitter=", 7) == 0) Valid = ParseTime(Text + 7, &Config->Link.Jitter);
+    else if (strncmp(Text, "drop=", 5) == 0) Valid = ParseDropRate(Text + 5, &Config->Link.DropRate);
+    else if (strncmp(Text, "pdo=", 4) == 0)
+    {
+      Valid = ParseTime(Text + 4, &Value);
+      Config->Interval = Value / 1000;
+    }
+    else if (strncmp(Text, "hb=", 3) == 0)
+    {
+      Valid = ParseTime(Text + 3, &Value) && (Value / 1000 <= 0xFFFF);
+      Config->Heartbeat = (UNSIGNED16)(Value / 1000);
+    }
+    else Valid = FALSE;
+    if (!Valid) return FALSE;
+
+    Text = strchr(Text, ',');
+    if (Text == NULL) break;
+    Text++;
+  }
+  return TRUE;
+}
+
+
+/**************************************************************************
+DOES:    Adds the nodes of an argument
+         "<nodeid>[-<nodeid>]:<edsfile>[@<settings>]"
+RETURNS: TRUE for success, FALSE for error
+**************************************************************************/
+static bool AddNodes
+  (
+  char *Arg                                                // command line argument
+  )
+{
+  char *FileName = strchr(Arg, ':');
+  char *Settings = strrchr(Arg, '@');
+  NODECONFIG Config = Defaults;
+  unsigned long First;
+  unsigned long Last;
+  unsigned long NodeID;
+  char *End;
+  EDS *Dictionary;
+
+  First = strtoul(Arg, &End, 0);
+  Last = First;
+  if (*End == '-') Last = strtoul(End + 1, &End, 0);
+  if ((FileName == NULL) || (End != FileName) || (First < 1) || (Last < First) || (Last > DEVICESIM_MAX_NODES))
+  {
+    fprintf(stderr, "ERROR: invalid node %s\n", Arg);
+    return FALSE;
+  }
+
+  if ((Settings != NULL) && (Settings > FileName))
+  {
+    *Settings++ = 0;
+    if (!ParseSettings(Settings, &Config))
+    {
+      fprintf(stderr, "ERROR: invalid settings %s\n", Settings);
+      return FALSE;
+    }
+  }
+
+  Dictionary = LoadDictionary(FileName + 1);
+  if (Dictionary == NULL) return FALSE;
+  for (NodeID = First; NodeID <= Last; NodeID++)
+  {
+    if (!Sim->AddNode(Dictionary, (UNSIGNED8)NodeID)) return FALSE;
+    Sim->ConfigureNode((UNSIGNED8)NodeID, &Config.Link, Config.Interval, Config.Heartbeat);
+  }
+  return TRUE;
+}
+
+
+/**************************************************************************
+DOES:    Prints the command line syntax
+RETURNS: Nothing
+**************************************************************************/
+static void Usage
+  (
+  void
+  )
+{
+  printf("Usage: RA_Sim [options] [<nodeid>[-<nodeid>]:<edsfile>[@<settings>] ...]\n");
+  printf("  -l <link>                  symbolic link to create for the port\n");
+  printf("  -n <nodeid>                own node id, default 1\n");
+  printf("  -e <edsfile>               own object dictionary\n");
+  printf("  -p <ms>                    process data interval of remote nodes\n");
+  printf("  -b <ms>                    heartbeat time of remote nodes, default from EDS\n");
+  printf("  -d <ms>                    latency of frames to and from remote nodes\n");
+  printf("  -j <ms>                    max random jitter added to the latency\n");
+  printf("  -r <percent>               frames lost\n");
+  printf("  -c <kbit/s>                CAN bit rate, default unlimited\n");
+  printf("  -s <seed>                  start value of random jitter and loss\n");
+  printf("  -x <server>,<index>,<sub>  read from the host with an extended SDO\n");
+  printf("  -f <nodeid>[,<kbytes>]     node takes program downloads [1F50h], default %u kbytes\n", PROGRAM_SIZE);
+  printf("  -v                         show packets received and status changes\n");
+  printf("Settings override the options for a group of nodes:\n");
+  printf("  latency=<ms>,jitter=<ms>,drop=<percent>,pdo=<ms>,hb=<ms>\n");
+}
+
+
+/**************************************************************************
+DOES:    Main function, creates the simulated device and runs it
+**************************************************************************/
+int main(int argc, char* argv[])
+{
+  const char *Link = NULL;
+  const char *OwnEDS = NULL;
+  unsigned long OwnNodeID = 1;
+  long Server;
+  long Index;
+  long Subindex;
+  unsigned long Size;
+  EDS *Dictionary = NULL;
+  bool Valid = TRUE;
+  int Option;
+  int d;
+
+  memset(&Defaults, 0, sizeof(Defaults));
+  while ((Option = getopt(argc, argv, "l:n:e:p:b:d:j:r:c:s:x:f:v")) != -1)
+  {
+    switch (Option)
+    {
+      case 'l': Link = optarg; break;
+      case 'n': OwnNodeID = strtoul(optarg, NULL, 0); break;
+      case 'e': OwnEDS = optarg; break;
+      case 'p': Defaults.Interval = strtoul(optarg, NULL, 0); break;
+      case 'b': Defaults.Heartbeat = (UNSIGNED16)strtoul(optarg, NULL, 0); break;
+      case 'd': Valid = ParseTime(optarg, &Defaults.Link.Latency); break;
+      case 'j': Valid = ParseTime(optarg, &Defaults.Link.Jitter); break;
+      case 'r': Valid = ParseDropRate(optarg, &Defaults.Link.DropRate); break;
+      case 'c': Sim->SetBitrate(strtoul(optarg, NULL, 0) * 1000); break;
+      case 's': Sim->SetSeed(strtoul(optarg, NULL, 0)); break;
+      case 'v': Sim->SetVerbose(TRUE); break;
+      case 'x':
+        if (sscanf(optarg, "%li,%li,%li", &Server, &Index, &Subindex) != 3)
+        {
+          Usage();
+          return 1;
+        }
+        Sim->RequestExtendedRead((UNSIGNED8)Server, (UNSIGNED16)Index, (UNSIGNED8)Subindex);
+        break;
+      case 'f':
+        Size = PROGRAM_SIZE;
+        if ((sscanf(optarg, "%li,%lu", &Index, &Size) < 1) || (ProgramNodeCount >= DEVICESIM_MAX_NODES))
+        {
+          Usage();
+          return 1;
+        }
+        ProgramNodes[ProgramNodeCount] = (UNSIGNED8)Index;
+        ProgramSizes[ProgramNodeCount++] = Size * 1024;
+        break;
+      default:
+        Usage();
+        return 1;
+    }
+    if (!Valid)
+    {
+      Usage();
+      return 1;
+    }
+  }
+
+  if (OwnEDS && ((Dictionary = LoadDictionary(OwnEDS)) == NULL)) return 1;
+  if (!Sim->SetLocalNode(Dictionary, (UNSIGNED8)OwnNodeID))
+  {
+    fprintf(stderr, "ERROR: invalid node id %lu\n", OwnNodeID);
+    return 1;
+  }
+  for (; optind < argc; optind++)
+  {
+    if (!AddNodes(argv[optind])) return 1;
+  }
+  for (d = 0; d < ProgramNodeCount; d++)
+  {
+    if (!Sim->EnableProgramDownload(ProgramNodes[d], ProgramSizes[d]))
+    {
+      fprintf(stderr, "ERROR: no node %u for program download\n", ProgramNodes[d]);
+      return 1;
+    }
+  }
+
+  if (!Sim->Open(Link)) return 1;
+  printf("Simulating CANopenIA device on %s\n", Link ? Link : Sim->GetPortName());
+  fflush(stdout);
+
+  signal(SIGINT, Terminate);
+  signal(SIGTERM, Terminate);
+
+  Sim->Start();
+  while (!TerminationRequested)
+  {
+    Sim->Process(100);
+    fflush(stdout);
+  }
+
+  Sim->PrintStatistics();
+  delete Sim;
+  for (d = 0; d < DictionaryCount; d++) delete Dictionaries[d];
+
+  return 0;
+}
+
+/*----------------------- END OF FILE ----------------------------------*/
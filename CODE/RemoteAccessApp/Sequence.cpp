@@ -0,0 +1,121 @@
+/**************************************************************************
+MODULE:    Sequence
+CONTAINS:  Sequences of object dictionary requests run by a DEVICEMANAGER
+COPYRIGHT: Embedded Systems Academy, Inc. 2008-2017.
+DISCLAIM:  Read and understand our disclaimer before using this code!
+           www.esacademy.com/disclaim.htm
+           This software was written in accordance to the guidelines at
+           www.esacademy.com/software/softwarestyleguide.pdf
+LICENSE:   Free to use with licensed CANopenIA chips, modules or devices
+           like CANgineBerry, CANgineXXX and 447izer
+VERSION:   1.10, EmSA 10-NOV-17
+           $LastChangedDate: 2014-01-11 17:30:59 +0100 (Sa, 11 Jan 2014) $
+           $LastChangedRevision: 1702 $
+***************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include "Sequence.h"
+
+
+/**************************************************************************
+DOES:    Constructor - creates a sequence not started
+**************************************************************************/
+SEQUENCE::SEQUENCE
+  (
+  void
+  )
+{
+  Manager = NULL;
+  memset(&Request, 0, sizeof(Request));
+  Position = SEQUENCE_START;
+}
+
+
+/**************************************************************************
+DOES:    Starts the sequence on a device, it runs up to its first request
+RETURNS: Nothing
+**************************************************************************/
+void SEQUENCE::Start
+  (
+  DEVICEMANAGER *NewManager,                               // manager of the device, started with 0 threads
+  int Port                                                 // returned by AddDevice
+  )
+{
+  Manager = NewManager;
+  Request.Port = Port;
+  Request.Callback = Resume;
+  Request.Param = this;
+  Position = SEQUENCE_START;
+  Step();
+}
+
+
+/**************************************************************************
+DOES:    Submits a request of SEQUENCE_READ or SEQUENCE_WRITE, Run
+         continues at the position given when it completed
+RETURNS: TRUE if submitted, FALSE if it failed at once with Request.Result
+         set
+**************************************************************************/
+bool SEQUENCE::Submit
+  (
+  unsigned char NodeID,                                    // node id of remote node, 0 for the device
+  unsigned short Index,                                    // index of od entry
+  unsigned char Subindex,                                  // subindex of od entry
+  bool Write,                                              // TRUE to write, FALSE to read
+  unsigned long DataLength,                                // length of data to write
+  const void *Data,                                        // data to write
+  int NextPosition                                         // where Run continues
+  )
+{
+  Position = NextPosition;
+  Request.NodeID = NodeID;
+  Request.Index = Index;
+  Request.Subindex = Subindex;
+  Request.Write = Write;
+  Request.DataLength = 0;
+  if (Write)
+  {
+    if (DataLength > MAX_PACKET_LENGTH)
+    {
+      Request.Result = ERROR_NORESOURCES;
+      return FALSE;
+    }
+    memcpy(Request.Data, Data, DataLength);
+    Request.DataLength = DataLength;
+  }
+  if (Manager->Submit(&Request)) return TRUE;
+  Request.Result = ERROR_TRANSFERABORTED;
+  return FALSE;
+}
+
+
+/**************************************************************************
+DOES:    Runs the sequence up to its next request or its end
+RETURNS: Nothing
+**************************************************************************/
+void SEQUENCE::Step
+  (
+  void
+  )
+{
+  Run();
+  // Finished may delete the sequence
+  if (Position == SEQUENCE_DONE) Finished();
+}
+
+
+/**************************************************************************
+DOES:    Call-back of the device manager, continues the sequence of the
+         request completed
+RETURNS: Nothing
+**************************************************************************/
+void SEQUENCE::Resume
+  (
+  DEVMGR_REQUEST *Completed                                // request completed
+  )
+{
+  ((SEQUENCE *)Completed->Param)->Step();
+}
+
+/*----------------------- END OF FILE ----------------------------------*/
@@ -0,0 +1,255 @@
+/**************************************************************************
+MODULE:    Sequence
+CONTAINS:  Sequences of object dictionary requests written as straight
+           code, e.g. read [1000h], check the profile, write the PDO
+           mapping and start the node, run by a DEVICEMANAGER. A
+           sequence waits for its request without blocking, so any
+           number of them run in the thread calling Poll, requests of a
+           device one after the other, devices in parallel.
+           With C++11 a sequence is a class derived from SEQUENCE whose
+           Run is written with the SEQUENCE_xxx macros:
+             void Run(void)
+             {
+               SEQUENCE_BEGIN();
+               SEQUENCE_READ(Node, 0x1000, 0x00);
+               if (Request.Result != ERROR_NOERROR) SEQUENCE_EXIT();
+               SEQUENCE_WRITE(Node, 0x1017, 0x00, 2, Heartbeat);
+               SEQUENCE_END();
+             }
+           Run is left at every request and entered again at the same
+           place, so local variables do not keep their values across
+           requests, members of the class are used instead, and
+           switch statements must not contain requests.
+           With a compiler supporting C++20 coroutines a coroutine
+           returning SEQUENCE_TASK can instead co_await ReadAsync and
+           WriteAsync and keep its state in local variables.
+           The manager must be started with 0 threads.
+COPYRIGHT: Embedded Systems Academy, Inc. 2008-2017.
+DISCLAIM:  Read and understand our disclaimer before using this code!
+           www.esacademy.com/disclaim.htm
+           This software was written in accordance to the guidelines at
+           www.esacademy.com/software/softwarestyleguide.pdf
+LICENSE:   Free to use with licensed CANopenIA chips, modules or devices
+           like CANgineBerry, CANgineXXX and 447izer
+VERSION:   1.10, EmSA 10-NOV-17
+           $LastChangedDate: 2014-01-11 17:30:59 +0100 (Sa, 11 Jan 2014) $
+           $LastChangedRevision: 1702 $
+***************************************************************************/
+#pragma once
+
+#ifndef _SEQUENCE_H
+#define _SEQUENCE_H
+
+#include <string.h>
+#include "global.h"
+#include "DeviceManager.h"
+#if defined(__cpp_impl_coroutine)
+#include <coroutine>
+#include <exception>
+#endif
+
+/**************************************************************************
+GLOBAL DEFINES
+***************************************************************************/
+
+// position of a sequence not started and of a finished one
+#define SEQUENCE_START 0
+#define SEQUENCE_DONE  -1
+
+// start and end of the body of Run
+#define SEQUENCE_BEGIN() switch (Position) { case SEQUENCE_START:
+#define SEQUENCE_END()   } Position = SEQUENCE_DONE; return
+
+// ends the sequence early
+#define SEQUENCE_EXIT() do { Position = SEQUENCE_DONE; return; } while (0)
+
+// sends a request and continues after it completed, with the result in
+// Request.Result and the data read in Request.Data and Request.DataLength.
+// Every request gets its own position from __COUNTER__, so requests may
+// share a line and be used in further macros.
+#define SEQUENCE_READ(NodeID, Index, Subindex) \
+  SEQUENCE_SUBMIT(NodeID, Index, Subindex, FALSE, 0, NULL, __COUNTER__ + 1)
+#define SEQUENCE_WRITE(NodeID, Index, Subindex, DataLength, Data) \
+  SEQUENCE_SUBMIT(NodeID, Index, Subindex, TRUE, DataLength, Data, __COUNTER__ + 1)
+#define SEQUENCE_SUBMIT(NodeID, Index, Subindex, Write, DataLength, Data, NextPosition) \
+  do { if (Submit(NodeID, Index, Subindex, Write, DataLength, Data, NextPosition)) return; } while (0); case NextPosition:
+
+/**************************************************************************
+GLOBAL TYPES AND FUNCTIONS
+***************************************************************************/
+
+class SEQUENCE
+{
+  public:
+    /**************************************************************************
+    DOES:    Constructor - creates a sequence not started
+    **************************************************************************/
+    SEQUENCE(void);
+    /**************************************************************************
+    DOES:    Destructor
+    **************************************************************************/
+    virtual ~SEQUENCE(void) {}
+    /**************************************************************************
+    DOES:    Starts the sequence on a device, it runs up to its first request.
+             Finished is called when it ended, maybe already by Start.
+    RETURNS: Nothing
+    **************************************************************************/
+    void Start(
+      DEVICEMANAGER *NewManager,  // manager of the device, started with 0 threads
+      int Port                    // returned by AddDevice
+      );
+    /**************************************************************************
+    DOES:    Checks whether the sequence was started and did not end yet
+    RETURNS: TRUE if running, else FALSE
+    **************************************************************************/
+    bool IsRunning(void) const { return (Position != SEQUENCE_START) && (Position != SEQUENCE_DONE); }
+
+  protected:
+    /**************************************************************************
+    DOES:    Body of the sequence, written with the SEQUENCE_xxx macros
+    RETURNS: Nothing
+    **************************************************************************/
+    virtual void Run(void) = 0;
+    /**************************************************************************
+    DOES:    Called when the sequence ended, the sequence may be started
+             again or deleted
+    RETURNS: Nothing
+    **************************************************************************/
+    virtual void Finished(void) {}
+    /**************************************************************************
+    DOES:    Submits a request of SEQUENCE_READ or SEQUENCE_WRITE
+    RETURNS: TRUE if submitted, FALSE if it failed at once with
+             Request.Result set
+    **************************************************************************/
+    bool Submit(
+      unsigned char NodeID,       // node id of remote node, 0 for the device
+      unsigned short Index,       // index of od entry
+      unsigned char Subindex,     // subindex of od entry
+      bool Write,                 // TRUE to write, FALSE to read
+      unsigned long DataLength,   // length of data to write
+      const void *Data,           // data to write
+      int NextPosition            // where Run continues
+      );
+
+    DEVICEMANAGER *Manager;
+    DEVMGR_REQUEST Request;                   // last request, completed when Run continues
+    int Position;                             // where Run continues, SEQUENCE_xxx or request
+
+  private:
+    void Step(void);
+    static void Resume(DEVMGR_REQUEST *Request);
+};
+
+#if defined(__cpp_impl_coroutine)
+
+// return type of a coroutine running requests. It runs at once up to its
+// first co_await, its frame is released when it returns.
+struct SEQUENCE_TASK
+{
+  struct promise_type
+  {
+    SEQUENCE_TASK get_return_object(void) { return SEQUENCE_TASK(); }
+    std::suspend_never initial_suspend(void) noexcept { return std::suspend_never(); }
+    std::suspend_never final_suspend(void) noexcept { return std::suspend_never(); }
+    void return_void(void) {}
+    void unhandled_exception(void) { std::terminate(); }
+  };
+};
+
+// a request co_awaited by a coroutine, the result of the co_await is the
+// ERROR_xxx of the request
+class DEVMGR_AWAITER
+{
+  public:
+    DEVMGR_AWAITER(DEVICEMANAGER *NewManager, int Port, unsigned char NodeID, unsigned short Index, unsigned char Subindex,
+      bool Write, unsigned long DataLength, const void *Data, unsigned long *ReadLength, unsigned char *ReadData)
+    {
+      Manager = NewManager;
+      memset(&Request, 0, sizeof(Request));
+      Request.Port = Port;
+      Request.NodeID = NodeID;
+      Request.Index = Index;
+      Request.Subindex = Subindex;
+      Request.Write = Write;
+      if (Write && (DataLength <= MAX_PACKET_LENGTH))
+      {
+        Request.DataLength = DataLength;
+        memcpy(Request.Data, Data, DataLength);
+      }
+      else if (Write) Request.Result = ERROR_NORESOURCES;
+      Request.Callback = Resume;
+      Length = ReadLength;
+      Buffer = ReadData;
+    }
+    bool await_ready(void) const { return Request.Result != ERROR_NOERROR; }
+    bool await_suspend(std::coroutine_handle<> NewHandle)
+    {
+      Handle = NewHandle;
+      Request.Param = this;
+      if (Manager->Submit(&Request)) return TRUE;
+      Request.Result = ERROR_TRANSFERABORTED;
+      return FALSE;
+    }
+    unsigned long await_resume(void)
+    {
+      if (!Request.Write && (Request.Result == ERROR_NOERROR))
+      {
+        if (Length) *Length = Request.DataLength;
+        if (Buffer) memcpy(Buffer, Request.Data, Request.DataLength);
+      }
+      return Request.Result;
+    }
+
+  private:
+    // completion call-back of the manager, the coroutine may end and
+    // release the request
+    static void Resume(DEVMGR_REQUEST *Completed) { ((DEVMGR_AWAITER *)Completed->Param)->Handle.resume(); }
+
+    DEVICEMANAGER *Manager;
+    DEVMGR_REQUEST Request;
+    std::coroutine_handle<> Handle;
+    unsigned long *Length;
+    unsigned char *Buffer;
+};
+
+/**************************************************************************
+DOES:    Reads an object dictionary entry of a device or a remote node
+         from a coroutine, co_await the result
+RETURNS: Request to co_await for ERROR_NOERROR or the error code
+**************************************************************************/
+inline DEVMGR_AWAITER ReadAsync(
+  DEVICEMANAGER *Manager,     // manager of the device, started with 0 threads
+  int Port,                   // returned by AddDevice
+  unsigned char NodeID,       // node id of remote node, 0 for the device
+  unsigned short Index,       // index of od entry to read
+  unsigned char Subindex,     // subindex of od entry to read
+  unsigned long *DataLength,  // location to store length of data read
+  unsigned char *Data         // location to store data read (must hold at least MAX_PACKET_LENGTH bytes)
+  )
+{
+  return DEVMGR_AWAITER(Manager, Port, NodeID, Index, Subindex, FALSE, 0, NULL, DataLength, Data);
+}
+
+/**************************************************************************
+DOES:    Writes an object dictionary entry of a device or a remote node
+         from a coroutine, co_await the result
+RETURNS: Request to co_await for ERROR_NOERROR or the error code
+**************************************************************************/
+inline DEVMGR_AWAITER WriteAsync(
+  DEVICEMANAGER *Manager,     // manager of the device, started with 0 threads
+  int Port,                   // returned by AddDevice
+  unsigned char NodeID,       // node id of remote node, 0 for the device
+  unsigned short Index,       // index of od entry to write
+  unsigned char Subindex,     // subindex of od entry to write
+  unsigned long DataLength,   // length of data to write
+  const void *Data            // location of data to write
+  )
+{
+  return DEVMGR_AWAITER(Manager, Port, NodeID, Index, Subindex, TRUE, DataLength, Data, NULL, NULL);
+}
+
+#endif // __cpp_impl_coroutine
+
+#endif // _SEQUENCE_H
+
+/*----------------------- END OF FILE ----------------------------------*/
@@ -15,12 +15,47 @@ $LastChangedRevision: 4117 $
 
 #include "global.h"
 
+// I/O backends of the serial port
+#define SERIAL_BACKEND_SYSCALL 0 // read, write and poll
+#define SERIAL_BACKEND_URING   1 // io_uring, Linux only, falls back to read and write
+
+class SerialUring;
+
 class SerialPort
 {
 public:
   SerialPort();
   ~SerialPort();
 
+  // selects the low latency mode for the next Connect, on Linux the driver
+  // is told to pass on received bytes at once and reads return at once so
+  // that they can be driven by WaitForData
+  void SetLowLatency
+  (
+    bool On                                                  // TRUE for low latency
+  )
+  {
+    LowLatency = On;
+  }
+
+  // gets the low latency mode of the next or current connection
+  bool GetLowLatency
+  (
+    void
+  ) const
+  {
+    return LowLatency;
+  }
+
+  // selects the I/O backend for the next Connect
+  void SetBackend
+  (
+    int NewBackend                                           // SERIAL_BACKEND_xxx
+  )
+  {
+    Backend = NewBackend;
+  }
+
   // Connects to a serial port
   // returns handle for success, INVALID_HANDLE_VALUE for error
   HANDLE Connect
@@ -54,4 +89,35 @@ public:
     unsigned long Length,                                    // max number of bytes to read
     unsigned long *BytesRead                                 // on return filled with number of bytes read
   );
+
+  // waits until bytes can be read from the port
+  // returns true if bytes can be read or the port reads without blocking,
+  // false if nothing was received in time
+  bool WaitForData
+  (
+    HANDLE PortHandle,                                       // handle of port to wait for
+    unsigned long Microseconds                               // max time to wait
+  );
+
+  // gets the handle to wait for with poll() before reading, the port
+  // itself or the completion queue of the backend
+  HANDLE GetEventHandle
+  (
+    HANDLE PortHandle                                        // handle of port
+  );
+
+private:
+  bool LowLatency;                                           // mode of the next Connect
+  int Backend;                                               // SERIAL_BACKEND_xxx of the next Connect
+  SerialUring *Uring;                                        // backend of the port, NULL for read and write
 };
+
+#ifndef WIN32
+// sets any baudrate on an open port, the other settings are kept
+// returns true for success, false for error
+bool SerialPort_SetAnyBaudrate
+(
+  HANDLE PortHandle,                                         // handle of open port
+  unsigned long Baudrate                                     // baudrate in bps
+);
+#endif
@@ -3,18 +3,26 @@
 
 #include <errno.h>
 #include <fcntl.h> 
+#include <poll.h>
 #include <string.h>
 #include <termios.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <sys/ioctl.h>
+#include <linux/serial.h>
 #include "SerialPort.h"
+#include "SerialPort_Uring.h"
 
 SerialPort::SerialPort()
 {
+  LowLatency = FALSE;
+  Backend = SERIAL_BACKEND_SYSCALL;
+  Uring = NULL;
 }
 
 SerialPort::~SerialPort()
 {
+  delete Uring;
 }
 
 // Connects to a serial port
@@ -25,7 +33,9 @@ HANDLE SerialPort::Connect
   unsigned long Baudrate                                   // baudrate in bps
   )
 {
-  HANDLE fd = open(PortName, O_RDWR | O_NOCTTY | O_SYNC);
+  // writes to a tty are not cached, O_SYNC only slows them down
+  HANDLE fd = open(PortName, LowLatency ? (O_RDWR | O_NOCTTY) : (O_RDWR | O_NOCTTY | O_SYNC));
+  bool AnyBaudrate = FALSE;
   speed_t speed;
   
   if (fd < 0)
@@ -145,8 +155,10 @@ HANDLE SerialPort::Connect
       break;
 #endif
     default:
-      fprintf(stderr, "ERROR: Baudrate %ld is not supported\n", Baudrate);
-      return INVALID_HANDLE_VALUE;
+      // set with termios2 after the other settings
+      AnyBaudrate = TRUE;
+      speed = B38400;
+      break;
   }
   
   cfsetospeed(&tty, speed);
@@ -170,6 +182,11 @@ HANDLE SerialPort::Connect
   tty.c_oflag = 0;                // no remapping, no delays
   tty.c_cc[VMIN] = 0;            // read doesn't block
   tty.c_cc[VTIME] = 5;            // 0.5 seconds read timeout
+  if (LowLatency)
+  {
+    tty.c_cc[VTIME] = 0;          // read returns what is there, the
+                                  // waiting is done by WaitForData
+  }
 
   tty.c_cflag |= (CLOCAL | CREAD);// ignore modem controls,
                                   // enable reading
@@ -184,6 +201,38 @@ HANDLE SerialPort::Connect
     return INVALID_HANDLE_VALUE;
   }
 
+  if (AnyBaudrate && !SerialPort_SetAnyBaudrate(fd, Baudrate))
+  {
+    close(fd);
+    return INVALID_HANDLE_VALUE;
+  }
+
+  if (LowLatency)
+  {
+    // USB adapters otherwise hold received bytes for their latency timer,
+    // up to 16ms. Ports without serial driver like ptys don't need it.
+    struct serial_struct serial;
+    if ((ioctl(fd, TIOCGSERIAL, &serial) == 0) && !(serial.flags & ASYNC_LOW_LATENCY))
+    {
+      serial.flags |= ASYNC_LOW_LATENCY;
+      if (ioctl(fd, TIOCSSERIAL, &serial) != 0)
+      {
+        fprintf(stderr, "WARNING: %d setting low latency of %s\n", errno, PortName);
+      }
+    }
+  }
+
+  if (Backend == SERIAL_BACKEND_URING)
+  {
+    Uring = new SerialUring();
+    if (!Uring->Open(fd))
+    {
+      fprintf(stderr, "WARNING: io_uring not available, using read and write\n");
+      delete Uring;
+      Uring = NULL;
+    }
+  }
+
   return fd;
 }
 
@@ -196,6 +245,9 @@ void SerialPort::Disconnect
   // if not a valid handle then nothing we can do
   if (PortHandle == INVALID_HANDLE_VALUE) return;
 
+  // ends the requests on the port before it is closed
+  delete Uring;
+  Uring = NULL;
   close(PortHandle);
 }
 
@@ -209,6 +261,8 @@ bool SerialPort::WriteBytes
   unsigned long *BytesWritten                              // on return filled with number of bytes written
 )
 {
+  if (Uring) return Uring->Write(Bytes, Length, BytesWritten);
+
   ssize_t Result = write(PortHandle, Bytes, Length);
   if (Result == -1)
   {
@@ -233,6 +287,8 @@ bool SerialPort::ReadBytes
   unsigned long *BytesRead                                 // on return filled with number of bytes read
   )
 {
+  if (Uring) return Uring->Read(Bytes, Length, BytesRead);
+
   ssize_t Result = read(PortHandle, Bytes, Length);
   if (Result == -1)
   {
@@ -243,4 +299,38 @@ bool SerialPort::ReadBytes
   return TRUE;
 }
 
+// waits until bytes can be read from the port
+// returns true if bytes can be read or the port reads without blocking,
+// false if nothing was received in time
+bool SerialPort::WaitForData
+  (
+  HANDLE PortHandle,                                       // handle of port to wait for
+  unsigned long Microseconds                               // max time to wait
+  )
+{
+  struct pollfd Fd;
+
+  if (Uring) return Uring->Wait(Microseconds);
+
+  Fd.fd = PortHandle;
+  Fd.events = POLLIN;
+  Fd.revents = 0;
+  // poll counts milliseconds, round up so short waits do not spin
+  if (poll(&Fd, 1, (int)((Microseconds + 999) / 1000)) <= 0) return FALSE;
+
+  // errors and hangups are reported by the read
+  return TRUE;
+}
+
+// gets the handle to wait for with poll() before reading, the port
+// itself or the completion queue of the backend
+HANDLE SerialPort::GetEventHandle
+  (
+  HANDLE PortHandle                                        // handle of port
+  )
+{
+  if (Uring) return Uring->GetHandle();
+  return PortHandle;
+}
+
 #endif // !WIN32
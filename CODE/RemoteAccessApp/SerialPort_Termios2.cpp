@@ -0,0 +1,62 @@
+/**************************************************************************
+MODULE:    SerialPort_Termios2
+CONTAINS:  Baudrates without a Bxxxx constant for the Linux serial handler.
+           The kernel's struct termios2 clashes with the struct termios of
+           the C library, so it is used in this file of its own.
+COPYRIGHT: Embedded Systems Academy, Inc. 2017.
+DISCLAIM:  Read and understand our disclaimer before using this code!
+www.esacademy.com/disclaim.htm
+This software was written in accordance to the guidelines at
+www.esacademy.com/software/softwarestyleguide.pdf
+LICENSE:   Free to use with licensed CANopenIA chips, modules or devices
+like CANgineBerry, CANgineXXX and 447izer
+VERSION:   1.10, EmSA 10-NOV-17
+$LastChangedDate: 2017-11-15 11:48:10 +0000 (Wed, 15 Nov 2017) $
+$LastChangedRevision: 4117 $
+***************************************************************************/
+
+#ifndef WIN32
+
+#include <errno.h>
+#include <stdio.h>
+#include <asm/termbits.h>
+#include <sys/ioctl.h>
+#include "SerialPort.h"
+
+// sets any baudrate on an open port, the other settings are kept
+// returns true for success, false for error
+bool SerialPort_SetAnyBaudrate
+  (
+  HANDLE PortHandle,                                       // handle of open port
+  unsigned long Baudrate                                   // baudrate in bps
+  )
+{
+#if defined(BOTHER) && defined(TCGETS2)
+  struct termios2 tty;
+
+  if (ioctl(PortHandle, TCGETS2, &tty) != 0)
+  {
+    fprintf(stderr, "ERROR: %d from TCGETS2\n", errno);
+    return FALSE;
+  }
+
+  // BOTHER takes the rate from the speed fields instead of the Bxxxx code,
+  // the input follows the output with a speed of 0
+  tty.c_cflag = (tty.c_cflag & ~(CBAUD | (CBAUD << IBSHIFT))) | BOTHER;
+  tty.c_ospeed = (speed_t)Baudrate;
+  tty.c_ispeed = 0;
+
+  if (ioctl(PortHandle, TCSETS2, &tty) != 0)
+  {
+    fprintf(stderr, "ERROR: %d from TCSETS2, baudrate %lu\n", errno, Baudrate);
+    return FALSE;
+  }
+
+  return TRUE;
+#else
+  fprintf(stderr, "ERROR: Baudrate %lu is not supported\n", Baudrate);
+  return FALSE;
+#endif
+}
+
+#endif // !WIN32
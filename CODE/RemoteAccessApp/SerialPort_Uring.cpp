@@ -0,0 +1,439 @@
+/**************************************************************************
+MODULE:    SerialPort_Uring
+CONTAINS:  io_uring backend of the Linux serial handler, set up with the
+           system calls directly so that no library is needed
+COPYRIGHT: Embedded Systems Academy, Inc. 2017.
+DISCLAIM:  Read and understand our disclaimer before using this code!
+www.esacademy.com/disclaim.htm
+This software was written in accordance to the guidelines at
+www.esacademy.com/software/softwarestyleguide.pdf
+LICENSE:   Free to use with licensed CANopenIA chips, modules or devices
+like CANgineBerry, CANgineXXX and 447izer
+VERSION:   1.10, EmSA 10-NOV-17
+$LastChangedDate: 2017-11-15 11:48:10 +0000 (Wed, 15 Nov 2017) $
+$LastChangedRevision: 4117 $
+***************************************************************************/
+
+#ifndef WIN32
+
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "SerialPort_Uring.h"
+#include "Timer.h"
+
+// user data of the requests
+#define URING_WRITE  0
+#define URING_READ   1
+#define URING_CANCEL 2
+
+// max time Close and Write wait for a write to end in microseconds
+#define URING_WAIT_TIME 100000
+
+// the rings are shared with the kernel, its updates of the tails must be
+// seen before the entries and our updates of the heads after them
+static inline unsigned int LoadAcquire(unsigned int *Value)
+{
+  return __atomic_load_n(Value, __ATOMIC_ACQUIRE);
+}
+
+static inline void StoreRelease(unsigned int *Value, unsigned int NewValue)
+{
+  __atomic_store_n(Value, NewValue, __ATOMIC_RELEASE);
+}
+
+SerialUring::SerialUring()
+{
+  RingHandle = INVALID_HANDLE_VALUE;
+  Port = INVALID_HANDLE_VALUE;
+  SqRing = MAP_FAILED;
+  CqRing = MAP_FAILED;
+  Entries = MAP_FAILED;
+  ToSubmit = 0;
+  RxBuffer = new UNSIGNED8[URING_RX_SIZE];
+  RxLength = 0;
+  RxPosition = 0;
+  ReadPending = FALSE;
+  Failed = FALSE;
+  TxBuffer[0] = new UNSIGNED8[URING_TX_SIZE];
+  TxBuffer[1] = new UNSIGNED8[URING_TX_SIZE];
+  TxLength[0] = 0;
+  TxLength[1] = 0;
+  TxWritten = 0;
+  TxActive = 0;
+  WritePending = FALSE;
+  WriteFailed = FALSE;
+}
+
+SerialUring::~SerialUring()
+{
+  Close();
+  // the kernel may still use the buffers of requests that did not end
+  if (!ReadPending) delete[] RxBuffer;
+  if (!WritePending)
+  {
+    delete[] TxBuffer[0];
+    delete[] TxBuffer[1];
+  }
+}
+
+// sets up the rings for an open port and posts the first read
+// returns true for success, false if io_uring is not available
+bool SerialUring::Open
+  (
+  HANDLE PortHandle                                        // handle of open port
+  )
+{
+  struct io_uring_params Params;
+  struct termios tty;
+  UNSIGNED8 *Sq;
+  UNSIGNED8 *Cq;
+  long Result;
+
+  memset(&Params, 0, sizeof(Params));
+  Result = syscall(__NR_io_uring_setup, URING_ENTRIES, &Params);
+  if (Result < 0) return FALSE;
+  RingHandle = (HANDLE)Result;
+
+#ifdef IORING_FEAT_EXT_ARG
+  // waiting with a timeout needs the extended arguments of kernel 5.11
+  if (Params.features & IORING_FEAT_EXT_ARG)
+  {
+    SqRingSize = Params.sq_off.array + Params.sq_entries * sizeof(unsigned int);
+    CqRingSize = Params.cq_off.cqes + Params.cq_entries * sizeof(struct io_uring_cqe);
+    if (Params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+      if (CqRingSize > SqRingSize) SqRingSize = CqRingSize;
+      CqRingSize = SqRingSize;
+    }
+    SqRing = mmap(NULL, SqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, RingHandle, IORING_OFF_SQ_RING);
+    if (SqRing != MAP_FAILED)
+    {
+      if (Params.features & IORING_FEAT_SINGLE_MMAP) CqRing = SqRing;
+      else CqRing = mmap(NULL, CqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, RingHandle, IORING_OFF_CQ_RING);
+    }
+    EntriesSize = Params.sq_entries * sizeof(struct io_uring_sqe);
+    if (CqRing != MAP_FAILED)
+    {
+      Entries = mmap(NULL, EntriesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, RingHandle, IORING_OFF_SQES);
+    }
+  }
+#endif
+  if (Entries == MAP_FAILED)
+  {
+    Close();
+    return FALSE;
+  }
+
+  Sq = (UNSIGNED8 *)SqRing;
+  SqTail = (unsigned int *)(Sq + Params.sq_off.tail);
+  SqMask = *(unsigned int *)(Sq + Params.sq_off.ring_mask);
+  SqArray = (unsigned int *)(Sq + Params.sq_off.array);
+  Cq = (UNSIGNED8 *)CqRing;
+  CqHead = (unsigned int *)(Cq + Params.cq_off.head);
+  CqTail = (unsigned int *)(Cq + Params.cq_off.tail);
+  CqMask = *(unsigned int *)(Cq + Params.cq_off.ring_mask);
+  Completions = Cq + Params.cq_off.cqes;
+
+  // the posted read ends with the first byte, not after a read timeout
+  if (tcgetattr(PortHandle, &tty) == 0)
+  {
+    tty.c_cc[VMIN] = 1;
+    tty.c_cc[VTIME] = 0;
+    tcsetattr(PortHandle, TCSANOW, &tty);
+  }
+
+  Port = PortHandle;
+  PostRead();
+  if (!Enter(0, 0))
+  {
+    Close();
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+// cancels the read, waits for the writes and releases the rings
+void SerialUring::Close()
+{
+  struct io_uring_sqe *Entry;
+  uint64_t Deadline;
+
+  if (RingHandle == INVALID_HANDLE_VALUE) return;
+
+  if (Port != INVALID_HANDLE_VALUE)
+  {
+    Reap();
+    if (ReadPending)
+    {
+      Entry = (struct io_uring_sqe *)GetEntry();
+      Entry->opcode = IORING_OP_ASYNC_CANCEL;
+      Entry->addr = URING_READ;
+      Entry->user_data = URING_CANCEL;
+    }
+    // no new read, but the collected write is still written
+    Failed = TRUE;
+    Deadline = Timer::GetMicroseconds() + URING_WAIT_TIME;
+    while ((ReadPending || WritePending) && (Timer::GetMicroseconds() < Deadline))
+    {
+      Enter(1, URING_WAIT_TIME);
+      Reap();
+    }
+    Port = INVALID_HANDLE_VALUE;
+  }
+
+  if (Entries != MAP_FAILED) munmap(Entries, EntriesSize);
+  if ((CqRing != MAP_FAILED) && (CqRing != SqRing)) munmap(CqRing, CqRingSize);
+  if (SqRing != MAP_FAILED) munmap(SqRing, SqRingSize);
+  Entries = MAP_FAILED;
+  CqRing = MAP_FAILED;
+  SqRing = MAP_FAILED;
+  close(RingHandle);
+  RingHandle = INVALID_HANDLE_VALUE;
+}
+
+// gets a cleared submission queue entry, it is submitted by the next Enter
+void *SerialUring::GetEntry()
+{
+  unsigned int Tail = *SqTail;
+  struct io_uring_sqe *Entry;
+
+  // never more than a read, a write and a cancel are prepared, so the
+  // queue can not be full
+  Entry = &((struct io_uring_sqe *)Entries)[Tail & SqMask];
+  memset(Entry, 0, sizeof(*Entry));
+  SqArray[Tail & SqMask] = Tail & SqMask;
+  StoreRelease(SqTail, Tail + 1);
+  ToSubmit++;
+
+  return Entry;
+}
+
+// submits the prepared entries and waits for completions
+// returns true for success, false for error
+bool SerialUring::Enter
+  (
+  unsigned int MinComplete,                                // completions to wait for, 0 to only submit
+  unsigned long Microseconds                               // max time to wait
+  )
+{
+  unsigned int Flags = 0;
+  void *Argument = NULL;
+  size_t ArgumentSize = 0;
+  long Result;
+#ifdef IORING_FEAT_EXT_ARG
+  struct io_uring_getevents_arg Wait;
+  struct __kernel_timespec Timeout;
+
+  if (MinComplete)
+  {
+    Timeout.tv_sec = Microseconds / 1000000UL;
+    Timeout.tv_nsec = (Microseconds % 1000000UL) * 1000;
+    memset(&Wait, 0, sizeof(Wait));
+    Wait.sigmask_sz = _NSIG / 8;
+    Wait.ts = (uint64_t)(uintptr_t)&Timeout;
+    Argument = &Wait;
+    ArgumentSize = sizeof(Wait);
+    Flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+  }
+#endif
+  if (!MinComplete && !ToSubmit) return TRUE;
+
+  Result = syscall(__NR_io_uring_enter, RingHandle, ToSubmit, MinComplete, Flags, Argument, ArgumentSize);
+  if (Result >= 0)
+  {
+    ToSubmit -= (unsigned int)Result;
+    return TRUE;
+  }
+
+  // nothing completed in time, or the completion queue is to be reaped
+  return (errno == ETIME) || (errno == EINTR) || (errno == EAGAIN) || (errno == EBUSY);
+}
+
+// posts a read, unless one is posted or bytes are waiting to be read
+void SerialUring::PostRead()
+{
+  struct io_uring_sqe *Entry;
+
+  if (ReadPending || Failed || (RxPosition < RxLength)) return;
+
+  Entry = (struct io_uring_sqe *)GetEntry();
+  Entry->opcode = IORING_OP_READ;
+  Entry->fd = Port;
+  Entry->addr = (uint64_t)(uintptr_t)RxBuffer;
+  Entry->len = URING_RX_SIZE;
+  Entry->off = (uint64_t)-1;
+  Entry->user_data = URING_READ;
+  RxLength = 0;
+  RxPosition = 0;
+  ReadPending = TRUE;
+}
+
+// posts the rest of the active write buffer, or the collected buffer
+void SerialUring::PostWrite()
+{
+  struct io_uring_sqe *Entry;
+
+  if (WritePending) return;
+  if (TxWritten == TxLength[TxActive])
+  {
+    // active buffer done, continue with the collected one
+    TxLength[TxActive] = 0;
+    TxWritten = 0;
+    TxActive ^= 1;
+    if (TxLength[TxActive] == 0) return;
+  }
+
+  // one write at a time keeps the bytes in order
+  Entry = (struct io_uring_sqe *)GetEntry();
+  Entry->opcode = IORING_OP_WRITE;
+  Entry->fd = Port;
+  Entry->addr = (uint64_t)(uintptr_t)(TxBuffer[TxActive] + TxWritten);
+  Entry->len = TxLength[TxActive] - TxWritten;
+  Entry->off = (uint64_t)-1;
+  Entry->user_data = URING_WRITE;
+  WritePending = TRUE;
+}
+
+// handles all completions
+void SerialUring::Reap()
+{
+  unsigned int Head = *CqHead;
+  unsigned int Tail = LoadAcquire(CqTail);
+  struct io_uring_cqe *Completion;
+
+  while (Head != Tail)
+  {
+    Completion = &((struct io_uring_cqe *)Completions)[Head & CqMask];
+    switch (Completion->user_data)
+    {
+      case URING_READ:
+        ReadPending = FALSE;
+        if (Completion->res > 0)
+        {
+          RxLength = (unsigned long)Completion->res;
+        }
+        else if ((Completion->res != -EINTR) && (Completion->res != -EAGAIN))
+        {
+          // hangup or error, posting again would fail at once
+          Failed = TRUE;
+        }
+        break;
+
+      case URING_WRITE:
+        WritePending = FALSE;
+        if (Completion->res > 0)
+        {
+          TxWritten += (unsigned long)Completion->res;
+        }
+        else if ((Completion->res != -EINTR) && (Completion->res != -EAGAIN))
+        {
+          // drop the bytes of the failed write
+          WriteFailed = TRUE;
+          TxWritten = TxLength[TxActive];
+        }
+        break;
+    }
+    Head++;
+  }
+  StoreRelease(CqHead, Head);
+
+  PostRead();
+  if (Port != INVALID_HANDLE_VALUE) PostWrite();
+}
+
+// waits until bytes were received
+// returns true if bytes can be read or the port failed, false if
+// nothing was received in time
+bool SerialUring::Wait
+  (
+  unsigned long Microseconds                               // max time to wait
+  )
+{
+  Reap();
+  if ((RxPosition == RxLength) && !Failed)
+  {
+    // submit the read and writes posted meanwhile with the wait
+    if (!Enter(Microseconds ? 1 : 0, Microseconds)) Failed = TRUE;
+    Reap();
+  }
+
+  return (RxPosition < RxLength) || Failed;
+}
+
+// reads received bytes, never blocks
+// returns true for success, false if the port failed
+bool SerialUring::Read
+  (
+  UNSIGNED8 *Bytes,                                        // location to store read bytes
+  unsigned long Length,                                    // max number of bytes to read
+  unsigned long *BytesRead                                 // on return filled with number of bytes read
+  )
+{
+  unsigned long Available;
+
+  Reap();
+  Available = RxLength - RxPosition;
+  if ((Available == 0) && Failed) return FALSE;
+
+  if (Available > Length) Available = Length;
+  memcpy(Bytes, RxBuffer + RxPosition, Available);
+  RxPosition += Available;
+  *BytesRead = Available;
+
+  // the next read is submitted with the next wait
+  PostRead();
+  return TRUE;
+}
+
+// submits a write, blocks only while both write buffers are full
+// returns true for success, false if this or an earlier write failed
+bool SerialUring::Write
+  (
+  UNSIGNED8 *Bytes,                                        // bytes to write
+  unsigned long Length,                                    // number of bytes to write
+  unsigned long *BytesWritten                              // on return filled with number of bytes written
+  )
+{
+  unsigned int Collect;
+  unsigned long Part;
+  unsigned long Done = 0;
+  uint64_t Deadline = Timer::GetMicroseconds() + URING_WAIT_TIME;
+
+  Reap();
+  while (Done < Length)
+  {
+    // collect in the buffer not being written
+    Collect = WritePending ? (TxActive ^ 1) : TxActive;
+    Part = URING_TX_SIZE - TxLength[Collect];
+    if (Part == 0)
+    {
+      if (!Enter(1, URING_WAIT_TIME) || (Timer::GetMicroseconds() >= Deadline)) break;
+      Reap();
+      continue;
+    }
+    if (Part > Length - Done) Part = Length - Done;
+    memcpy(TxBuffer[Collect] + TxLength[Collect], Bytes + Done, Part);
+    TxLength[Collect] += Part;
+    Done += Part;
+    PostWrite();
+  }
+  Enter(0, 0);
+  *BytesWritten = Done;
+
+  if (WriteFailed)
+  {
+    WriteFailed = FALSE;
+    return FALSE;
+  }
+  return Done == Length;
+}
+
+#endif // !WIN32
@@ -0,0 +1,126 @@
+/**************************************************************************
+MODULE:    SerialPort_Uring
+CONTAINS:  io_uring backend of the Linux serial handler. A read is kept
+           posted on the port so that received bytes are waiting in memory,
+           writes are submitted without waiting for them. Waiting for data
+           and submitting share one system call.
+COPYRIGHT: Embedded Systems Academy, Inc. 2017.
+DISCLAIM:  Read and understand our disclaimer before using this code!
+www.esacademy.com/disclaim.htm
+This software was written in accordance to the guidelines at
+www.esacademy.com/software/softwarestyleguide.pdf
+LICENSE:   Free to use with licensed CANopenIA chips, modules or devices
+like CANgineBerry, CANgineXXX and 447izer
+VERSION:   1.10, EmSA 10-NOV-17
+$LastChangedDate: 2017-11-15 11:48:10 +0000 (Wed, 15 Nov 2017) $
+$LastChangedRevision: 4117 $
+***************************************************************************/
+#pragma once
+
+#ifndef _SERIALPORT_URING_H
+#define _SERIALPORT_URING_H
+
+#include "global.h"
+
+// entries of the submission queue
+#define URING_ENTRIES 16
+
+// bytes of the posted read
+#define URING_RX_SIZE 4096
+
+// bytes of a write buffer, writes are collected in one buffer while the
+// other one is written
+#define URING_TX_SIZE 4096
+
+class SerialUring
+{
+public:
+  SerialUring();
+  ~SerialUring();
+
+  // sets up the rings for an open port and posts the first read
+  // returns true for success, false if io_uring is not available
+  bool Open
+  (
+    HANDLE PortHandle                                        // handle of open port
+  );
+
+  // cancels the read, waits for the writes and releases the rings
+  void Close();
+
+  // gets the handle of the completion queue, it can be read when bytes
+  // were received or the port failed
+  HANDLE GetHandle()
+  {
+    return RingHandle;
+  }
+
+  // waits until bytes were received
+  // returns true if bytes can be read or the port failed, false if
+  // nothing was received in time
+  bool Wait
+  (
+    unsigned long Microseconds                               // max time to wait
+  );
+
+  // reads received bytes, never blocks
+  // returns true for success, false if the port failed
+  bool Read
+  (
+    UNSIGNED8 *Bytes,                                        // location to store read bytes
+    unsigned long Length,                                    // max number of bytes to read
+    unsigned long *BytesRead                                 // on return filled with number of bytes read
+  );
+
+  // submits a write, blocks only while both write buffers are full
+  // returns true for success, false if this or an earlier write failed
+  bool Write
+  (
+    UNSIGNED8 *Bytes,                                        // bytes to write
+    unsigned long Length,                                    // number of bytes to write
+    unsigned long *BytesWritten                              // on return filled with number of bytes written
+  );
+
+private:
+  bool Enter(unsigned int MinComplete, unsigned long Microseconds);
+  void Reap();
+  void PostRead();
+  void PostWrite();
+  void *GetEntry();
+
+  HANDLE RingHandle;
+  HANDLE Port;
+
+  // rings shared with the kernel
+  void *SqRing;
+  unsigned long SqRingSize;
+  void *CqRing;
+  unsigned long CqRingSize;
+  void *Entries;
+  unsigned long EntriesSize;
+  unsigned int *SqTail;
+  unsigned int SqMask;
+  unsigned int *SqArray;
+  unsigned int *CqHead;
+  unsigned int *CqTail;
+  unsigned int CqMask;
+  void *Completions;
+  unsigned int ToSubmit;                                     // entries not yet submitted
+
+  // posted read, bytes from RxPosition to RxLength not yet read
+  UNSIGNED8 *RxBuffer;
+  unsigned long RxLength;
+  unsigned long RxPosition;
+  bool ReadPending;
+  bool Failed;
+
+  // write being written and write being collected
+  UNSIGNED8 *TxBuffer[2];
+  unsigned long TxLength[2];
+  unsigned long TxWritten;                                   // bytes of the write being written
+  unsigned int TxActive;                                     // buffer being written
+  bool WritePending;
+  bool WriteFailed;
+};
+
+#endif // _SERIALPORT_URING_H
@@ -20,6 +20,11 @@ $LastChangedRevision: 4117 $
 
 SerialPort::SerialPort()
 {
+  // the low latency mode is not used on Windows, reads never block
+  LowLatency = FALSE;
+  // there is only one backend on Windows
+  Backend = SERIAL_BACKEND_SYSCALL;
+  Uring = NULL;
 }
 
 SerialPort::~SerialPort()
@@ -139,4 +144,27 @@ bool SerialPort::ReadBytes
   return ReadFile(PortHandle, Bytes, Length, BytesRead, NULL);
 }
 
+// waits until bytes can be read from the port
+// returns true if bytes can be read or the port reads without blocking,
+// false if nothing was received in time
+bool SerialPort::WaitForData
+  (
+  HANDLE PortHandle,                                       // handle of port to wait for
+  unsigned long Microseconds                               // max time to wait
+  )
+{
+  // reads never block, see Connect
+  return TRUE;
+}
+
+// gets the handle to wait for with poll() before reading, the port
+// itself or the completion queue of the backend
+HANDLE SerialPort::GetEventHandle
+  (
+  HANDLE PortHandle                                        // handle of port
+  )
+{
+  return PortHandle;
+}
+
 #endif // WIN32
@@ -19,6 +19,7 @@ VERSION:   1.10, EmSA 10-NOV-17
 #include <string.h>
 #include "SerialProtocol.h"
 #include "CRC.h"
+#include "Tracer.h"
 
 
 /**************************************************************************
@@ -27,10 +28,33 @@ LOCAL DEFINES
 
 // com port timeout in milliseconds
 #define COM_TIMEOUT 200
-// time to wait for command responses in seconds
-#define RESPONSE_TIMEOUT 6
-// max delay between bytes inside a packet in seconds
-#define INTRAPACKET_TIMEOUT 2
+// default time the device may take to respond to requests in microseconds,
+// in addition to the transfer time of request and response at the
+// baudrate. Local requests are answered from the object dictionary of the
+// device. Remote requests include an SDO transfer on the CAN bus and must
+// allow for the SDO timeout of the device.
+#define LOCAL_ALLOWANCE  3000
+#define REMOTE_ALLOWANCE 1000000
+// latency timer of USB serial adapters, received bytes may be held this
+// long unless the port is in low latency mode
+#define USB_LATENCY 16000
+// default times a local read is sent again after a timeout. Writes are not
+// repeated, the device may have executed them although the response was
+// lost, e.g. NMT commands. Remote requests are not repeated, the device
+// reports SDO timeouts itself.
+#define READ_RETRIES 2
+// default microseconds before the first retry
+#define RETRY_BACKOFF 1000
+// default max delay between bytes inside a packet in microseconds, in
+// addition to their transfer time
+#define INTRAPACKET_ALLOWANCE 20000
+// bits per byte on the serial line, start bit, 8 data bits and stop bit
+#define BITS_PER_BYTE 10
+// baudrate assumed while not connected
+#define DEFAULT_BAUDRATE 921600
+// max microseconds to wait for data while extended SDO transfers are in
+// progress, the SDO client has timers in milliseconds
+#define SDO_POLL_TIME 1000
 // start of packet header byte, must match implementation on device
 #define SOH 0x11
 
@@ -73,6 +97,42 @@ SerialProtocol::SerialProtocol(
   PortHandle = INVALID_HANDLE_VALUE;
   // reset state machine
   ReceiveState = STATE_START;
+  RxFrameLength = 0;
+  RescanLength = 0;
+  RescanPosition = 0;
+  RescanUntraced = 0;
+  // no tracing
+  Tracer = NULL;
+  // nothing to transmit
+  TxQueueLength = 0;
+  TxQueueDeadline = 0;
+  TxHold = 0;
+  // no generic CAN messages until enabled, all IDs accepted
+  memset(CanFilter, 0xFF, sizeof(CanFilter));
+  CanRxHead = 0;
+  CanRxTail = 0;
+  CanReceive = FALSE;
+  CanCallback = NULL;
+  CanCallbackParam = NULL;
+  CanTxPending = 0;
+  CanTxError = 0;
+  CanTxWindow = 1;
+
+  // default timeouts
+  ByteTime = (BITS_PER_BYTE * 1000000UL + DEFAULT_BAUDRATE - 1) / DEFAULT_BAUDRATE;
+  AdapterLatency = USB_LATENCY;
+  PacketAllowance = INTRAPACKET_ALLOWANCE;
+  ResponseDeadline = 0;
+  ActiveRequest = REQUESTS;
+  StartedRequest = REQUESTS;
+  ProcessWait = COM_TIMEOUT * 1000UL;
+  for (unsigned int r = 0; r < REQUESTS; r++)
+  {
+    bool Remote = (r == REQUEST_READREMOTE) || (r == REQUEST_WRITEREMOTE);
+    Timeouts[r].Allowance = Remote ? REMOTE_ALLOWANCE : LOCAL_ALLOWANCE;
+    Timeouts[r].Retries = (r == REQUEST_READLOCAL) ? READ_RETRIES : 0;
+    Timeouts[r].Backoff = RETRY_BACKOFF;
+  }
 
   // create a timer
   Tim = new Timer();
@@ -85,6 +145,9 @@ SerialProtocol::SerialProtocol(
 
   // create new sdo client handler, register 'send' function to be called on this class instance
   SdoClient = new SDOCLNT(Tim, (SDOCLNTSENDCALLBACK *)&SerialProtocol::SdoClientSendCallback, this);
+
+  // nothing counted yet
+  ResetStatistics();
 }
 
 
@@ -131,6 +194,9 @@ bool SerialProtocol::Connect(
   )
 {
   PortHandle = Port->Connect(PortName, Baudrate);
+  // timeouts follow the transfer time of packets
+  if (Baudrate) ByteTime = (BITS_PER_BYTE * 1000000UL + Baudrate - 1) / Baudrate;
+  AdapterLatency = Port->GetLowLatency() ? 0 : USB_LATENCY;
   if (PortHandle == INVALID_HANDLE_VALUE)
   {
     return FALSE;
@@ -148,8 +214,16 @@ void SerialProtocol::Disconnect(
   void
   )
 {
+  // held packets are still sent
+  if (PortHandle != INVALID_HANDLE_VALUE) FlushTransmit();
+  TxQueueLength = 0;
   Port->Disconnect(PortHandle);
   PortHandle = INVALID_HANDLE_VALUE;
+  // no response will come for a started request
+  ActiveRequest = REQUESTS;
+  StartedRequest = REQUESTS;
+  ResponseDeadline = 0;
+  CanTxPending = 0;
 }
 
 
@@ -189,65 +263,99 @@ void SerialProtocol::Process(
   )
 {
   PACKET Packet;
-  unsigned long DataLength;
-  CAN_MSG tx_sdo;
+  unsigned int c;
 
+  // packets sent while handling the received packets and by the sdo
+  // clients go out with one write
+  HoldTransmit();
   if (GetPacket(&Packet))
   {
-    if (Packet.Length > 0)
+    // a damaged packet may have hidden further packets
+    do
     {
-      switch (Packet.Data[0])
-      {
-        // new process data
-        case 'D':
-          if (DataCallback)
-          {
-            DataLength = Packet.Length - 5;
-            ((DATACALLBACK)DataCallback)(Packet.Data[1], GET_U16(Packet.Data + 2), Packet.Data[4], DataLength, &Packet.Data[5], DataCallbackParam);
-          }
-          break;
+      HandlePacket(&Packet);
+    } while (NextPacket(&Packet));
+  }
 
-        // SDO segment
-        case 'F':
-          tx_sdo.LEN = 0;
-          XSdo->XSDO_HandleExtended((UNSIGNED8 *)(&Packet.Data[2]), &tx_sdo, Packet.Data[1]);
-          if (tx_sdo.LEN == 8)
-          { // construct and send response packet
-            Packet.Data[0] = 'G';
-            // Packet.Data[1], leave at received value
-            // set value last to 1, if this was last segment
-            if ((tx_sdo.BUF[0] == 0x80) || (tx_sdo.BUF[0] & 1))
-              Packet.Data[2] = 1; // last segment
-            else
-              Packet.Data[2] = 0; // more segments to come
-            memcpy(&(Packet.Data[3]), &(tx_sdo.BUF[0]), 8);
-            Packet.Length = 11;
-            SendPacket(&Packet);
-          }
-          break;
+  // work on sdo clients, one channel per call
+  for (c = 0; c < NR_OF_SDO_CLIENTS; c++) SdoClient->MGR_SDOHandleClient();
+  ReleaseTransmit();
+}
 
-        // custom sdo request response
-        case 'V':
-          SdoClient->MGR_HandleSDOClientResponse(Packet.Data[1],(UNSIGNED8 *)(&Packet.Data[2]));
-          break;
 
-        // all other packets
-        default:
-          // must be a command response
-          // store and signal
-          ResponsePacket   = Packet;
-          ResponseReceived = TRUE;
-          break;
-      }
-    }
-    else
+/**************************************************************************
+DOES:    Handles a packet received from the device
+RETURNS: Nothing
+**************************************************************************/
+void SerialProtocol::HandlePacket(
+  PACKET *Packet                                           // location of packet received
+  )
+{
+  unsigned long DataLength;
+  CAN_MSG tx_sdo;
+
+  if (Packet->Length > 0)
+  {
+    switch (Packet->Data[0])
     {
-      printf("Packet with no data! ");
+      // new process data
+      case 'D':
+        // generic CAN message, not an od entry of the application
+        if (CanReceive && (Packet->Length >= 7) && ((GET_U16(Packet->Data + 2)) == 0x5F0C))
+        {
+          ReceiveCanFrame(Packet);
+        }
+        else if (DataCallback)
+        {
+          DataLength = Packet->Length - 5;
+          ((DATACALLBACK)DataCallback)(Packet->Data[1], GET_U16(Packet->Data + 2), Packet->Data[4], DataLength, &Packet->Data[5], DataCallbackParam);
+        }
+        break;
+
+      // SDO segment
+      case 'F':
+        tx_sdo.LEN = 0;
+        XSdo->XSDO_HandleExtended((UNSIGNED8 *)(&Packet->Data[2]), &tx_sdo, Packet->Data[1]);
+        if (tx_sdo.LEN == 8)
+        { // construct and send response packet
+          Packet->Data[0] = 'G';
+          // Packet->Data[1], leave at received value
+          // set value last to 1, if this was last segment
+          if ((tx_sdo.BUF[0] == 0x80) || (tx_sdo.BUF[0] & 1))
+            Packet->Data[2] = 1; // last segment
+          else
+            Packet->Data[2] = 0; // more segments to come
+          memcpy(&(Packet->Data[3]), &(tx_sdo.BUF[0]), 8);
+          Packet->Length = 11;
+          SendPacket(Packet);
+        }
+        break;
+
+      // custom sdo request response
+      case 'V':
+        SdoClient->MGR_HandleSDOClientResponse(Packet->Data[1],(UNSIGNED8 *)(&Packet->Data[2]));
+        break;
+
+      // all other packets
+      default:
+        // responses to generic CAN messages are counted by SendCanFrames
+        if (CanTxPending && (Packet->Data[0] == 'W') && (Packet->Length >= 6) && ((GET_U16(Packet->Data + 1)) == 0x5F0C))
+        {
+          CanTxPending--;
+          if (!CanTxError) CanTxError = Packet->Data[4] | ((unsigned short)Packet->Data[5] << 8);
+          break;
+        }
+        // must be a command response
+        // store and signal
+        ResponsePacket   = *Packet;
+        ResponseReceived = TRUE;
+        break;
     }
   }
-
-  // work on sdo clients
-  SdoClient->MGR_SDOHandleClient();
+  else
+  {
+    printf("Packet with no data! ");
+  }
 }
 
 
@@ -325,7 +433,7 @@ unsigned long SerialProtocol::ReadLocalOD(
   )
 {
   PACKET Packet;
-  time_t endtime;
+  unsigned long result;
   unsigned long b;
   unsigned short errorcode;
 
@@ -335,30 +443,11 @@ unsigned long SerialProtocol::ReadLocalOD(
   Packet.Data[3] = Subindex;
   Packet.Length = 4;
 
-  // clear received flag
-  ResponseReceived = FALSE;
-  // send
-  if (!SendPacket(&Packet))
+  // send and wait for the response
+  result = Transfer(REQUEST_READLOCAL, &Packet, 4);
+  if (result != ERROR_NOERROR)
   {
-    return ERROR_TX;
-  }
-
-  endtime = time(NULL) + RESPONSE_TIMEOUT;
-  // wait for response
-  do
-  {
-    if (time(NULL) >= endtime)
-    {
-      return ERROR_NORESPONSE;
-    }
-    // process packet receive
-    Process();
-  } while (!ResponseReceived);
-
-  // if wrong response received then something went wrong
-  if (ResponsePacket.Data[0] != Packet.Data[0])
-  {
-    return ERROR_WRONGRESPONSE;
+    return result;
   }
 
   // check for an error
@@ -418,7 +507,7 @@ unsigned long SerialProtocol::ReadRemoteOD(
   )
 {
   PACKET Packet;
-  time_t endtime;
+  unsigned long result;
   unsigned long b;
   unsigned short errorcode;
 
@@ -429,30 +518,11 @@ unsigned long SerialProtocol::ReadRemoteOD(
   Packet.Data[4] = Subindex;
   Packet.Length = 5;
 
-  // clear received flag
-  ResponseReceived = FALSE;
-  // send
-  if (!SendPacket(&Packet))
-  {
-    return ERROR_TX;
-  }
-
-  endtime = time(NULL) + RESPONSE_TIMEOUT;
-  // wait for response
-  do
-  {
-    if (time(NULL) >= endtime)
-    {
-      return ERROR_NORESPONSE;
-    }
-    // process packet receive
-    Process();
-  } while (!ResponseReceived);
-
-  // if wrong response received then something went wrong
-  if (ResponsePacket.Data[0] != Packet.Data[0])
+  // send and wait for the response
+  result = Transfer(REQUEST_READREMOTE, &Packet, 5);
+  if (result != ERROR_NOERROR)
   {
-    return ERROR_WRONGRESPONSE;
+    return result;
   }
 
   // check for an error
@@ -486,7 +556,7 @@ unsigned long SerialProtocol::WriteLocalOD(
   )
 {
   PACKET Packet;
-  time_t endtime;
+  unsigned long result;
   unsigned short errorcode;
 
   // don't allow write of too much data
@@ -502,30 +572,11 @@ unsigned long SerialProtocol::WriteLocalOD(
   memcpy(&Packet.Data[4], Data, DataLength);
   Packet.Length = 4 + DataLength;
 
-  // clear received flag
-  ResponseReceived = FALSE;
-  // send
-  if (!SendPacket(&Packet))
+  // send and wait for the response
+  result = Transfer(REQUEST_WRITELOCAL, &Packet, 4);
+  if (result != ERROR_NOERROR)
   {
-    return ERROR_TX;
-  }
-
-  endtime = time(NULL) + RESPONSE_TIMEOUT;
-  // wait for response
-  do
-  {
-    if (time(NULL) >= endtime)
-    {
-      return ERROR_NORESPONSE;
-    }
-    // process packet receive
-    Process();
-  } while (!ResponseReceived);
-
-  // if wrong response received then something went wrong
-  if (ResponsePacket.Data[0] != Packet.Data[0])
-  {
-    return ERROR_WRONGRESPONSE;
+    return result;
   }
 
   // check for an error
@@ -580,7 +631,7 @@ unsigned long SerialProtocol::WriteRemoteOD(
   )
 {
   PACKET Packet;
-  time_t endtime;
+  unsigned long result;
   unsigned short errorcode;
 
   // don't allow write of too much data
@@ -597,43 +648,337 @@ unsigned long SerialProtocol::WriteRemoteOD(
   memcpy(&Packet.Data[5], Data, DataLength);
   Packet.Length = 5 + DataLength;
 
+  // send and wait for the response
+  result = Transfer(REQUEST_WRITEREMOTE, &Packet, 5);
+  if (result != ERROR_NOERROR)
+  {
+    return result;
+  }
+
+  // check for an error
+  errorcode = ResponsePacket.Data[5] | ((unsigned short)ResponsePacket.Data[6] << 8);
+  if (errorcode)
+  {
+    LastNodeError = errorcode;
+    return ERROR_NODEERROR;
+  }
+
+  return ResponsePacket.Data[5];
+}
+
+/**************************************************************************
+DOES:    Sends a request and waits for its response, sends it again after
+         timeouts as set by SetTimeout. Packets received meanwhile are
+         handled as usual.
+RETURNS: ERROR_NOERROR if the response is in ResponsePacket, else
+         ERROR_TX, ERROR_NORESPONSE or ERROR_WRONGRESPONSE
+**************************************************************************/
+unsigned long SerialProtocol::Transfer(
+  unsigned int Request,                                    // REQUEST_xxx
+  PACKET *Packet,                                          // request to send
+  unsigned long EchoLength                                 // bytes of the request repeated by the response
+  )
+{
+  unsigned long result;
+
+  result = BeginTransfer(Request, Packet, EchoLength);
+  while (result == ERROR_PENDING)
+  {
+    // process packet receive
+    Process();
+    result = ContinueTransfer();
+  }
+
+  return result;
+}
+
+
+/**************************************************************************
+DOES:    Sends a request, ContinueTransfer waits for the response
+RETURNS: ERROR_PENDING if sent, ERROR_COIABUSY if another request is
+         waiting for its response or ERROR_TX
+**************************************************************************/
+unsigned long SerialProtocol::BeginTransfer(
+  unsigned int Request,                                    // REQUEST_xxx
+  PACKET *Packet,                                          // request to send
+  unsigned long EchoLength                                 // bytes of the request repeated by the response
+  )
+{
+  if (ActiveRequest != REQUESTS)
+  {
+    return ERROR_COIABUSY;
+  }
+
+  ActiveRequest = Request;
+  ActivePacket = *Packet;
+  ActiveEcho = EchoLength;
+  ActiveAttempt = 0;
+  ActiveBackoff = Timeouts[Request].Backoff;
+  return SendTransfer();
+}
+
+
+/**************************************************************************
+DOES:    Sends the active request for the next attempt
+RETURNS: ERROR_PENDING if sent, else ERROR_TX
+**************************************************************************/
+unsigned long SerialProtocol::SendTransfer(
+  void
+  )
+{
   // clear received flag
   ResponseReceived = FALSE;
+  ActiveBackingOff = FALSE;
   // send
-  if (!SendPacket(&Packet))
+  ActiveStart = Timer::GetMicroseconds();
+  if (!SendPacket(&ActivePacket))
   {
+    ActiveRequest = REQUESTS;
     return ERROR_TX;
   }
 
-  endtime = time(NULL) + RESPONSE_TIMEOUT;
   // wait for response
-  do
+  ResponseDeadline = ActiveStart + GetResponseTimeout(ActiveRequest, ActivePacket.Length);
+  return ERROR_PENDING;
+}
+
+
+/**************************************************************************
+DOES:    Checks the packets processed since the request was sent for its
+         response. Sends the request again after timeouts as set by
+         SetTimeout.
+RETURNS: ERROR_PENDING while waiting, else as Transfer
+**************************************************************************/
+unsigned long SerialProtocol::ContinueTransfer(
+  void
+  )
+{
+  unsigned int Request = ActiveRequest;
+
+  if (Request == REQUESTS)
+  {
+    return ERROR_UNKNOWN;
+  }
+
+  // give the device some time before the next attempt
+  if (ActiveBackingOff)
+  {
+    if (Timer::GetMicroseconds() < ResponseDeadline) return ERROR_PENDING;
+    ActiveBackoff *= 2;
+    return SendTransfer();
+  }
+
+  if (ResponseReceived && (ResponsePacket.Data[0] == ActivePacket.Data[0]) &&
+      ((ResponsePacket.Length < ActiveEcho) || memcmp(ResponsePacket.Data, ActivePacket.Data, ActiveEcho)))
+  { // response to an earlier request that timed out, keep waiting
+    STATS_Add(&Stats.StaleResponses, 1);
+    ResponseReceived = FALSE;
+  }
+  if (!ResponseReceived)
   {
-    if (time(NULL) >= endtime)
+    if (Timer::GetMicroseconds() < ResponseDeadline) return ERROR_PENDING;
+
+    STATS_Add(&Stats.ResponseTimeouts, 1);
+    if (ActiveAttempt >= Timeouts[Request].Retries)
     {
+      ResponseDeadline = 0;
+      ActiveRequest = REQUESTS;
       return ERROR_NORESPONSE;
     }
-    // process packet receive
-    Process();
-  } while (!ResponseReceived);
+
+    STATS_Add(&Stats.Retries, 1);
+    ActiveAttempt++;
+    ActiveBackingOff = TRUE;
+    ResponseDeadline = Timer::GetMicroseconds() + ActiveBackoff;
+    return ERROR_PENDING;
+  }
+  ResponseDeadline = 0;
+  ActiveRequest = REQUESTS;
+  Stats.Latency[Request].Add(Timer::GetMicroseconds() - ActiveStart);
 
   // if wrong response received then something went wrong
-  if (ResponsePacket.Data[0] != Packet.Data[0])
+  if (ResponsePacket.Data[0] != ActivePacket.Data[0])
   {
+    STATS_Add(&Stats.WrongResponses, 1);
     return ERROR_WRONGRESPONSE;
   }
 
+  return ERROR_NOERROR;
+}
+
+
+/**************************************************************************
+DOES:    Sends a read or write request without waiting for its response,
+         to the device itself for NodeID 0 or else to a remote node.
+         Process must be called until GetRequestResult returns something
+         else than ERROR_PENDING.
+RETURNS: ERROR_NOERROR if the request was sent or error code for failure
+**************************************************************************/
+unsigned long SerialProtocol::StartRequest(
+  unsigned char NodeID,                                    // node id of remote node, 0 for the device
+  unsigned short Index,                                    // index of od entry
+  unsigned char Subindex,                                  // subindex of od entry
+  bool Write,                                              // TRUE to write, FALSE to read
+  unsigned long DataLength,                                // length of data to write
+  unsigned char *Data                                      // location of data to write
+  )
+{
+  PACKET Packet;
+  unsigned long Offset;                                    // position of the index
+  unsigned int Request;
+  unsigned long result;
+
+  if (StartedRequest != REQUESTS)
+  {
+    return ERROR_COIABUSY;
+  }
+
+  // construct packet as the blocking functions do
+  if (NodeID == 0)
+  {
+    Packet.Data[0] = Write ? 'W' : 'R';
+    Request = Write ? REQUEST_WRITELOCAL : REQUEST_READLOCAL;
+    Offset = 1;
+  }
+  else
+  {
+    Packet.Data[0] = Write ? 'S' : 'U';
+    Packet.Data[1] = NodeID;
+    Request = Write ? REQUEST_WRITEREMOTE : REQUEST_READREMOTE;
+    Offset = 2;
+  }
+  STORE_U16(Index, Packet.Data + Offset);
+  Packet.Data[Offset + 2] = Subindex;
+  Packet.Length = Offset + 3;
+  if (Write)
+  {
+    // don't allow write of too much data
+    if (DataLength > MAX_PACKET_LENGTH - Packet.Length)
+    {
+      return ERROR_NORESOURCES;
+    }
+    memcpy(&Packet.Data[Packet.Length], Data, DataLength);
+    Packet.Length += DataLength;
+  }
+
+  // send, the response repeats command, node id, index and subindex
+  result = BeginTransfer(Request, &Packet, Offset + 3);
+  if (result != ERROR_PENDING)
+  {
+    return result;
+  }
+  StartedRequest = Request;
+
+  return ERROR_NOERROR;
+}
+
+
+/**************************************************************************
+DOES:    Checks for the response to StartRequest, sends the request again
+         after timeouts as set by SetTimeout
+RETURNS: ERROR_PENDING while waiting, else as the blocking functions
+**************************************************************************/
+unsigned long SerialProtocol::GetRequestResult(
+  unsigned long *DataLength,                               // location to store length of data read
+  unsigned char *Data                                      // location to store data read (must hold at least MAX_PACKET_LENGTH bytes)
+  )
+{
+  unsigned int Request = StartedRequest;
+  unsigned long Offset;                                    // position of the error code
+  unsigned long result;
+  unsigned short errorcode;
+
+  if (Request == REQUESTS)
+  {
+    return ERROR_UNKNOWN;
+  }
+
+  result = ContinueTransfer();
+  if (result == ERROR_PENDING)
+  {
+    return result;
+  }
+  StartedRequest = REQUESTS;
+  if (result != ERROR_NOERROR)
+  {
+    return result;
+  }
+
   // check for an error
-  errorcode = ResponsePacket.Data[5] | ((unsigned short)ResponsePacket.Data[6] << 8);
+  Offset = ((Request == REQUEST_READREMOTE) || (Request == REQUEST_WRITEREMOTE)) ? 5 : 4;
+  errorcode = ResponsePacket.Data[Offset] | ((unsigned short)ResponsePacket.Data[Offset + 1] << 8);
   if (errorcode)
   {
     LastNodeError = errorcode;
     return ERROR_NODEERROR;
   }
 
-  return ResponsePacket.Data[5];
+  // get data read
+  if ((Request == REQUEST_READLOCAL) || (Request == REQUEST_READREMOTE))
+  {
+    *DataLength = ResponsePacket.Length - (Offset + 2);
+    memcpy(Data, &ResponsePacket.Data[Offset + 2], *DataLength);
+  }
+
+  return ERROR_NOERROR;
+}
+
+
+/**************************************************************************
+DOES:    Gets the time a request may take before it times out, the
+         transfer time of the request and of the longest response plus
+         the allowance for the device and the latency timer of the
+         adapter
+RETURNS: Timeout in microseconds
+**************************************************************************/
+unsigned long SerialProtocol::GetResponseTimeout(
+  unsigned int Request,                                    // REQUEST_xxx
+  unsigned long Length                                     // data length of the request packet
+  )
+{
+  return (Length + 4 + MAX_PACKET_LENGTH + 4) * ByteTime + AdapterLatency + Timeouts[Request].Allowance;
+}
+
+
+/**************************************************************************
+DOES:    Sets the timeout and retries of a request type
+RETURNS: Nothing
+**************************************************************************/
+void SerialProtocol::SetTimeout(
+  unsigned int Request,                                    // REQUEST_xxx
+  const SERIAL_TIMEOUT *Timeout                            // new timeout
+  )
+{
+  if (Request < REQUESTS) Timeouts[Request] = *Timeout;
 }
 
+
+/**************************************************************************
+DOES:    Gets the timeout and retries of a request type
+RETURNS: Nothing
+**************************************************************************/
+void SerialProtocol::GetTimeout(
+  unsigned int Request,                                    // REQUEST_xxx
+  SERIAL_TIMEOUT *Timeout                                  // location to store timeout
+  )
+{
+  if (Request < REQUESTS) *Timeout = Timeouts[Request];
+}
+
+
+/**************************************************************************
+DOES:    Sets the time allowed between two bytes of a packet in addition to
+         their transfer time
+RETURNS: Nothing
+**************************************************************************/
+void SerialProtocol::SetPacketTimeout(
+  unsigned long Allowance                                  // microseconds
+  )
+{
+  PacketAllowance = Allowance;
+}
+
+
 /**************************************************************************
 DOES:    Transmits a data packet to the device
 RETURNS: TRUE for success, FALSE for error
@@ -642,38 +987,99 @@ bool SerialProtocol::SendPacket(
   PACKET *Packet                                           // location of packet to transmit
   )
 {
-  unsigned long byteswritten;
+  unsigned char *TxPacketData;
   unsigned short CRCValue;
-  CRC *crc = new CRC();
-  bool WriteResult;
+  CRC crc;
 
   // if com port is not open, then nothing to do
   if (PortHandle == INVALID_HANDLE_VALUE)
   {
+    STATS_Add(&Stats.TxErrors, 1);
     return FALSE;
   }
 
-  // assemble packet
+  // make room in the queue
+  if ((TxQueueLength + Packet->Length + 4 > sizeof(TxQueue)) && !FlushTransmit())
+  {
+    STATS_Add(&Stats.TxErrors, 1);
+    return FALSE;
+  }
+
+  // assemble packet at the end of the queue
+  TxPacketData = &TxQueue[TxQueueLength];
   TxPacketData[0] = SOH;
   TxPacketData[1] = (unsigned char)Packet->Length;
-  crc->Add(TxPacketData[1]);
+  crc.Add(TxPacketData[1]);
   for (unsigned long b = 0; b < Packet->Length; b++)
   {
     TxPacketData[2 + b] = Packet->Data[b];
-    crc->Add(TxPacketData[2 + b]);
+    crc.Add(TxPacketData[2 + b]);
   }
-  CRCValue = crc->Finalize();
+  CRCValue = crc.Finalize();
   TxPacketData[2 + Packet->Length]     = CRCValue & 0xFF;
   TxPacketData[2 + Packet->Length + 1] = (CRCValue >> 8) & 0xFF;
+  TxQueueLength += Packet->Length + 4;
 
-  // transmit packet
-  WriteResult = Port->WriteBytes(PortHandle, TxPacketData, Packet->Length + 4, &byteswritten);
-  if (!WriteResult)
+  // transmit packet, unless held for more packets
+  if (TxHold)
   {
-    return FALSE;
+    if (TxQueueLength == Packet->Length + 4) TxQueueDeadline = Timer::GetMicroseconds() + TX_COALESCE_TIME;
+    else if (Timer::GetMicroseconds() >= TxQueueDeadline) return FlushTransmit();
+    return TRUE;
   }
+  return FlushTransmit();
+}
 
-  return TRUE;
+
+/**************************************************************************
+DOES:    Writes the queued packets to the device
+RETURNS: TRUE for success, FALSE for error
+**************************************************************************/
+bool SerialProtocol::FlushTransmit(
+  void
+  )
+{
+  unsigned long byteswritten;
+  unsigned long Position;
+  unsigned long Length;
+  bool WriteResult;
+
+  if (TxQueueLength == 0) return TRUE;
+
+  // transmit all packets at once
+  WriteResult = Port->WriteBytes(PortHandle, TxQueue, TxQueueLength, &byteswritten);
+  STATS_Add(&Stats.TxWrites, 1);
+
+  for (Position = 0; Position < TxQueueLength; Position += Length)
+  {
+    Length = TxQueue[Position + 1] + 4;
+    if (!WriteResult)
+    {
+      STATS_Add(&Stats.TxErrors, 1);
+      continue;
+    }
+    if (Tracer) Tracer->Transmitted(&TxQueue[Position], Length);
+    STATS_Add(&Stats.TxPackets[STATS_COMMAND(TxQueue[Position + 2])], 1);
+    STATS_Add(&Stats.TxBytes[STATS_COMMAND(TxQueue[Position + 2])], Length);
+  }
+  TxQueueLength = 0;
+
+  return WriteResult;
+}
+
+
+/**************************************************************************
+DOES:    Ends a HoldTransmit, the last one sends the queued packets
+RETURNS: TRUE for success, FALSE if packets could not be sent
+**************************************************************************/
+bool SerialProtocol::ReleaseTransmit(
+  void
+  )
+{
+  if (TxHold) TxHold--;
+  if (TxHold || (PortHandle == INVALID_HANDLE_VALUE)) return TRUE;
+
+  return FlushTransmit();
 }
 
 
@@ -685,10 +1091,10 @@ bool SerialProtocol::GetPacket(
   PACKET *Packet                                           // location to store packet
   )
 {
-  unsigned char rxbyte[1];
   unsigned long bytesread;
-  unsigned long b;
-  unsigned short CRCValue;
+  unsigned long Wait = ProcessWait;
+  uint64_t Deadline;
+  uint64_t Now;
   bool ReadResult;
 
   // if com port is not open, then nothing to do
@@ -698,50 +1104,161 @@ bool SerialProtocol::GetPacket(
      return FALSE;
   }
 
-  // read next byte from com port
-  ReadResult = Port->ReadBytes(PortHandle, rxbyte, 1, &bytesread);
-  if (!ReadResult)
+  // held packets may be what the device is to answer
+  if (TxQueueLength) FlushTransmit();
+
+  // wait for the next byte, but not beyond the end of the packet or the
+  // response waited for, and shortly while the SDO client is busy
+  if (SdoClient->SDOCLNT_GetActiveTransfers() && (Wait > SDO_POLL_TIME)) Wait = SDO_POLL_TIME;
+  Deadline = (ReceiveState != STATE_START) ? ReceiveTimeout : 0;
+  if (ResponseDeadline && (!Deadline || (ResponseDeadline < Deadline))) Deadline = ResponseDeadline;
+  if (Deadline)
+  {
+    Now = Timer::GetMicroseconds();
+    if (Deadline <= Now) Wait = 0;
+    else if (Deadline - Now < Wait) Wait = (unsigned long)(Deadline - Now);
+  }
+
+  // read all bytes available from com port, as many as fit. The bytes of
+  // the packet being received may have to be scanned again with them.
+  ReadResult = Port->WaitForData(PortHandle, Wait);
+  if (ReadResult) ReadResult = Port->ReadBytes(PortHandle, &Rescan[RescanLength], sizeof(Rescan) - RescanLength - RxFrameLength, &bytesread);
+  else bytesread = 0;
+  if (!ReadResult || (bytesread == 0))
   {
     // failed to receive, check for timeout and reset state machine if needed
-    if ((time(NULL) >= ReceiveTimeout) && (ReceiveState != STATE_LENGTH) && (ReceiveState != STATE_START))
+    if ((Timer::GetMicroseconds() >= ReceiveTimeout) && (ReceiveState != STATE_START))
     {
-      printf("\nERROR GetPacket: Read in state %d\n",ReceiveState);
-      printf("MSG: 0x%2X 0x%2X 0x%2X 0x%2X\n",IncomingPacket.Data[0],IncomingPacket.Data[1],IncomingPacket.Data[2],IncomingPacket.Data[3]);
-      ReceiveState = STATE_START;
+      STATS_Add(&Stats.PacketTimeouts, 1);
+      if (Tracer) Tracer->EndReceived(TRACE_FLAG_TIMEOUT);
+      // a packet may start inside the bytes received so far
+      Resync();
+      return NextPacket(Packet);
     }
+    // nothing read so allow other threads to run
+    System_Sleep(0);
     return FALSE;
   }
-  
-  // nothing read so allow other threads to run
-  if (bytesread == 0)
+
+  RescanLength += bytesread;
+  RescanUntraced += bytesread;
+  // reset timer for receiving bytes inside a packet
+  ReceiveTimeout = Timer::GetMicroseconds() + ByteTime + PacketAllowance;
+  return NextPacket(Packet);
+}
+
+
+/**************************************************************************
+DOES:    Runs a received byte through the packet state machine, e.g. bytes
+         from another transport or a benchmark. If TRUE is returned
+         NextPacket must be called until it returns FALSE, more packets
+         may have been found in the bytes received.
+RETURNS: TRUE if the byte completed a packet, else FALSE
+**************************************************************************/
+bool SerialProtocol::ReceiveByte(
+  unsigned char Byte,                                      // byte received
+  PACKET *Packet                                           // location to store packet
+  )
+{
+  // usually there is nothing to scan again
+  if (RescanPosition == RescanLength)
   {
-    System_Sleep(0);
+    if (Tracer) Tracer->Received(Byte);
+    return ParseByte(Byte, Packet);
+  }
+
+  if (RescanLength + RxFrameLength >= sizeof(Rescan))
+  { // NextPacket was not called after the last packet
+    STATS_Add(&Stats.RxSkipped, 1);
     return FALSE;
   }
+  Rescan[RescanLength++] = Byte;
+  RescanUntraced++;
+  return NextPacket(Packet);
+}
+
 
-  if (bytesread != 1)
+/**************************************************************************
+DOES:    Gets the next packet from bytes already received, e.g. when a
+         damaged packet contained the start of further packets
+RETURNS: TRUE if a packet was found, else FALSE
+**************************************************************************/
+bool SerialProtocol::NextPacket(
+  PACKET *Packet                                           // location to store packet
+  )
+{
+  while (RescanPosition < RescanLength)
   {
-    // failed to receive, check for timeout and reset state machine if needed
-    if ((time(NULL) >= ReceiveTimeout) && (ReceiveState != STATE_LENGTH) && (ReceiveState != STATE_START))
+    // the tracer gets the bytes in the order received, not again when
+    // scanned again
+    if (RescanLength - RescanPosition <= RescanUntraced)
     {
-      printf("\nERROR GetPacket: bytesread \n");
-      printf("MSG: 0x%2X 0x%2X 0x%2X 0x%2X\n",IncomingPacket.Data[0],IncomingPacket.Data[1],IncomingPacket.Data[2],IncomingPacket.Data[3]);
-      ReceiveState = STATE_START;
+      if (Tracer) Tracer->Received(Rescan[RescanPosition]);
+      RescanUntraced--;
     }
-    return FALSE;
+    if (ParseByte(Rescan[RescanPosition++], Packet)) return TRUE;
+  }
+  RescanPosition = 0;
+  RescanLength = 0;
+  return FALSE;
+}
+
+
+/**************************************************************************
+DOES:    Drops the packet being received. Its bytes after the start of
+         header are scanned again by NextPacket, they may hold the start
+         of the next packet.
+RETURNS: Nothing
+**************************************************************************/
+void SerialProtocol::Resync(
+  void
+  )
+{
+  unsigned long Remaining = RescanLength - RescanPosition;
+  unsigned long Again = RxFrameLength ? RxFrameLength - 1 : 0;
+
+  // bytes to scan again go before the bytes not scanned yet
+  memmove(&Rescan[Again], &Rescan[RescanPosition], Remaining);
+  memcpy(Rescan, &RxFrame[1], Again);
+  RescanPosition = 0;
+  RescanLength = Again + Remaining;
+
+  RxFrameLength = 0;
+  ReceiveState = STATE_START;
+}
+
+
+/**************************************************************************
+DOES:    Runs a byte through the packet state machine
+RETURNS: TRUE if the byte completed a packet, else FALSE
+**************************************************************************/
+bool SerialProtocol::ParseByte(
+  unsigned char Byte,                                      // byte received
+  PACKET *Packet                                           // location to store packet
+  )
+{
+  unsigned long b;
+  CRC crc;
+
+  if (ReceiveState == STATE_START)
+  {
+    if (Byte != SOH)
+    {
+      STATS_Add(&Stats.RxSkipped, 1);
+      return FALSE;
+    }
+    RxFrameLength = 0;
   }
+  RxFrame[RxFrameLength++] = Byte;
 
   switch (ReceiveState)
   {
     case STATE_START:
-      if (rxbyte[0] == SOH)
-      {
-        ReceiveState = STATE_LENGTH;
-      }
+      ReceiveState = STATE_LENGTH;
       break;
     case STATE_LENGTH:
-      IncomingPacket.Length = rxbyte[0];
-      BytesRemaining = rxbyte[0];
+      IncomingPacket.Length = Byte;
+      BytesRemaining = Byte;
       // if no data then skip to checksum
       if (IncomingPacket.Length == 0)
       {
@@ -749,8 +1266,11 @@ bool SerialProtocol::GetPacket(
         IncomingCRC = 0x0000;
       }
       else if (IncomingPacket.Length > MAX_PACKET_LENGTH)
-      { // packet is too large for us, start over, wait for next
-        ReceiveState = STATE_START;
+      { // packet is too large for us, look for the next start
+        STATS_Add(&Stats.Resyncs, 1);
+        if (Tracer) Tracer->EndReceived(TRACE_FLAG_ERROR);
+        Resync();
+        return FALSE;
       }
       else
       {
@@ -760,12 +1280,15 @@ bool SerialProtocol::GetPacket(
     case STATE_DATA:
       if (IncomingPacket.Length == BytesRemaining)
       { // first byte, sanity check, is it a supported command byte
-        if ( (rxbyte[0] != 'D') && (rxbyte[0] != 'R') && (rxbyte[0] != 'W') && (rxbyte[0] != 'U') && (rxbyte[0] != 'S') && (rxbyte[0] != 'F') && (rxbyte[0] != 'V'))
-        { // unkown command, start over
-          ReceiveState = STATE_START;
+        if ( (Byte != 'D') && (Byte != 'R') && (Byte != 'W') && (Byte != 'U') && (Byte != 'S') && (Byte != 'F') && (Byte != 'V'))
+        { // unkown command, look for the next start
+          STATS_Add(&Stats.Resyncs, 1);
+          if (Tracer) Tracer->EndReceived(TRACE_FLAG_ERROR);
+          Resync();
+          return FALSE;
         }
       }
-      IncomingPacket.Data[IncomingPacket.Length - BytesRemaining] = rxbyte[0];
+      IncomingPacket.Data[IncomingPacket.Length - BytesRemaining] = Byte;
       BytesRemaining--;
       if (!BytesRemaining)
       {
@@ -774,41 +1297,92 @@ bool SerialProtocol::GetPacket(
       }
       break;
     case STATE_CHECKL:
-      IncomingCRC |= rxbyte[0];
+      IncomingCRC |= Byte;
       ReceiveState = STATE_CHECKH;
       break;
     case STATE_CHECKH:
-      IncomingCRC |= ((unsigned short)(rxbyte[0]) << 8);
+      IncomingCRC |= ((unsigned short)Byte << 8);
 
       // calculate CRC
-      CRC *crc = new CRC();
-      crc->Add((unsigned char)IncomingPacket.Length);
-      for (b = 0; b < IncomingPacket.Length; b++) crc->Add(IncomingPacket.Data[b]);
-      CRCValue = crc->Finalize();
+      crc.Add((unsigned char)IncomingPacket.Length);
+      for (b = 0; b < IncomingPacket.Length; b++) crc.Add(IncomingPacket.Data[b]);
       // check CRC matches
-      if (CRCValue == IncomingCRC)
+      if (crc.Finalize() == IncomingCRC)
       {
         // we have received a complete packet - copy and done
+        STATS_Add(&Stats.RxPackets[STATS_COMMAND(IncomingPacket.Data[0])], 1);
+        STATS_Add(&Stats.RxBytes[STATS_COMMAND(IncomingPacket.Data[0])], IncomingPacket.Length + 4);
+        if (Tracer) Tracer->EndReceived(TRACE_FLAG_PACKET);
         *Packet = IncomingPacket;
+        RxFrameLength = 0;
         ReceiveState = STATE_START;
         return TRUE;
       }
       else
       {
-        printf("\nERROR GetPacket: CRC fail \n");
-        printf("MSG: 0x%2X 0x%2X 0x%2X 0x%2X\n",IncomingPacket.Data[0],IncomingPacket.Data[1],IncomingPacket.Data[2],IncomingPacket.Data[3]);
-        ReceiveState = STATE_START;
+        STATS_Add(&Stats.CRCErrors, 1);
+        if (Tracer) Tracer->EndReceived(TRACE_FLAG_ERROR);
+        // the start of header may have been noise, look for the next
+        Resync();
         return FALSE;
       }
       break;
   }
 
-  // reset timer for receiving bytes inside a packet
-  ReceiveTimeout = time(NULL) + INTRAPACKET_TIMEOUT;
-
   return FALSE;
 }
 
+
+/**************************************************************************
+DOES:    Drops a partly received packet, as when its bytes time out.
+         Packets in its bytes are returned by NextPacket.
+RETURNS: Nothing
+**************************************************************************/
+void SerialProtocol::AbortPacket(
+  void
+  )
+{
+  Resync();
+}
+
+/**************************************************************************
+DOES:    Sets the counters of the serial protocol and the SDO client to
+         0, SDO transfers in progress remain counted as active
+RETURNS: Nothing
+**************************************************************************/
+void SerialProtocol::ResetStatistics
+  (
+  void
+  )
+{
+  unsigned long c;
+
+  for (c = 0; c < STATS_COMMANDS; c++)
+  {
+    STATS_Set(&Stats.RxPackets[c], 0);
+    STATS_Set(&Stats.RxBytes[c], 0);
+    STATS_Set(&Stats.TxPackets[c], 0);
+    STATS_Set(&Stats.TxBytes[c], 0);
+  }
+  STATS_Set(&Stats.RxSkipped, 0);
+  STATS_Set(&Stats.CRCErrors, 0);
+  STATS_Set(&Stats.Resyncs, 0);
+  STATS_Set(&Stats.PacketTimeouts, 0);
+  STATS_Set(&Stats.TxErrors, 0);
+  STATS_Set(&Stats.TxWrites, 0);
+  STATS_Set(&Stats.ResponseTimeouts, 0);
+  STATS_Set(&Stats.WrongResponses, 0);
+  STATS_Set(&Stats.Retries, 0);
+  STATS_Set(&Stats.StaleResponses, 0);
+  STATS_Set(&Stats.CanTxFrames, 0);
+  STATS_Set(&Stats.CanRxFrames, 0);
+  STATS_Set(&Stats.CanRxFiltered, 0);
+  STATS_Set(&Stats.CanRxOverruns, 0);
+  STATS_Set(&Stats.CanRxMalformed, 0);
+  for (c = 0; c < REQUESTS; c++) Stats.Latency[c].Reset();
+  SdoClient->SDOCLNT_ResetStatistics();
+}
+
 /**************************************************************************
 DOES:    Gets the last node error
 RETURNS: Returns error code from node
@@ -821,4 +1395,264 @@ unsigned short SerialProtocol::GetLastNodeError
   return LastNodeError;
 }
 
+/**************************************************************************
+DOES:    Gets the handle of the serial port, e.g. to wait for data
+RETURNS: Handle or INVALID_HANDLE_VALUE if not connected
+**************************************************************************/
+HANDLE SerialProtocol::GetHandle
+  (
+  void
+  )
+{
+  return PortHandle;
+}
+
+
+/**************************************************************************
+DOES:    Gets the handle that becomes readable when the device sent data,
+         to wait for with poll() before calling Process. It is the serial
+         port unless the backend receives into memory.
+RETURNS: Handle or INVALID_HANDLE_VALUE if not connected
+**************************************************************************/
+HANDLE SerialProtocol::GetEventHandle
+  (
+  void
+  )
+{
+  if (PortHandle == INVALID_HANDLE_VALUE) return INVALID_HANDLE_VALUE;
+  return Port->GetEventHandle(PortHandle);
+}
+
+
+/**************************************************************************
+DOES:    Checks without waiting whether the device sent data that Process
+         has not handled yet
+RETURNS: TRUE if data is waiting or the port failed, else FALSE
+**************************************************************************/
+bool SerialProtocol::IsDataAvailable
+  (
+  void
+  )
+{
+  if (PortHandle == INVALID_HANDLE_VALUE) return FALSE;
+  return Port->WaitForData(PortHandle, 0);
+}
+
+
+/**************************************************************************
+DOES:    Selects generic CAN messages for transmit and receive in
+         [5F01h,0Bh]. Received messages are only passed on after this.
+RETURNS: ERROR_NOERROR for success or error code for failure
+**************************************************************************/
+unsigned long SerialProtocol::EnableCanFrames
+  (
+  bool Transmit,                                           // TRUE to send messages with SendCanFrames
+  bool Receive                                             // TRUE to receive messages
+  )
+{
+  unsigned char Value = (Transmit ? GENERIC_CAN_TX : 0) | (Receive ? GENERIC_CAN_RX : 0);
+  bool WasReceiving = CanReceive;
+  unsigned long result;
+
+  // messages may follow the response at once
+  CanReceive = Receive;
+  result = WriteLocalOD(0x5F01, 0x0B, 1, &Value);
+  if (result != ERROR_NOERROR) CanReceive = WasReceiving;
+  return result;
+}
+
+
+/**************************************************************************
+DOES:    Sends generic CAN messages, one write request to [5F0Ch] per
+         message. The requests of a window of CanTxWindow go out with a
+         single write, the window is filled again when half of them are
+         confirmed. A message is never sent again, a timeout fails the
+         call.
+RETURNS: ERROR_NOERROR for success or error code for failure,
+         ERROR_COIABUSY if a request is still pending
+**************************************************************************/
+unsigned long SerialProtocol::SendCanFrames
+  (
+  const CAN_MSG *Frames,                                   // messages to send
+  unsigned long Count                                      // number of messages
+  )
+{
+  PACKET Packet;
+  unsigned long Sent = 0;
+  unsigned long Pending;
+  unsigned long n;
+
+  if (ActiveRequest != REQUESTS)
+  {
+    return ERROR_COIABUSY;
+  }
+  for (n = 0; n < Count; n++)
+  {
+    if (Frames[n].LEN > 8) return ERROR_INVALIDCOMMANDLENGTH;
+  }
+
+  CanTxPending = 0;
+  CanTxError = 0;
+  Packet.Data[0] = 'W';
+  STORE_U16(0x5F0C, Packet.Data + 1);
+  while (CanTxPending || ((Sent < Count) && !CanTxError))
+  {
+    if ((CanTxPending <= CanTxWindow / 2) && (Sent < Count) && !CanTxError)
+    {
+      HoldTransmit();
+      while ((CanTxPending < CanTxWindow) && (Sent < Count))
+      {
+        Packet.Data[3] = Frames[Sent].LEN;
+        STORE_U16(Frames[Sent].ID, Packet.Data + 4);
+        memcpy(&Packet.Data[6], Frames[Sent].BUF, Frames[Sent].LEN);
+        Packet.Length = 6 + Frames[Sent].LEN;
+        if (!SendPacket(&Packet)) break;
+        CanTxPending++;
+        Sent++;
+      }
+      if (!ReleaseTransmit() || !CanTxPending)
+      {
+        CanTxPending = 0;
+        ResponseDeadline = 0;
+        return ERROR_TX;
+      }
+      ResponseDeadline = Timer::GetMicroseconds() + GetResponseTimeout(REQUEST_WRITELOCAL, CanTxPending * (MAX_PACKET_LENGTH + 4));
+    }
+
+    Pending = CanTxPending;
+    Process();
+    STATS_Add(&Stats.CanTxFrames, Pending - CanTxPending);
+    if (CanTxPending != Pending)
+    { // the device keeps up, the remaining responses get a full timeout
+      ResponseDeadline = Timer::GetMicroseconds() + GetResponseTimeout(REQUEST_WRITELOCAL, CanTxPending * (MAX_PACKET_LENGTH + 4));
+    }
+    else if (Timer::GetMicroseconds() >= ResponseDeadline)
+    {
+      STATS_Add(&Stats.ResponseTimeouts, 1);
+      CanTxPending = 0;
+      ResponseDeadline = 0;
+      return ERROR_NORESPONSE;
+    }
+  }
+  ResponseDeadline = 0;
+
+  if (CanTxError)
+  {
+    LastNodeError = CanTxError;
+    return ERROR_NODEERROR;
+  }
+  return ERROR_NOERROR;
+}
+
+
+/**************************************************************************
+DOES:    Takes received generic CAN messages out of the queue, oldest
+         first. May be called by one thread other than the one calling
+         Process.
+RETURNS: Number of messages stored
+**************************************************************************/
+unsigned long SerialProtocol::ReceiveCanFrames
+  (
+  CAN_MSG *Frames,                                         // location to store the messages
+  unsigned long MaxFrames                                  // max messages to store
+  )
+{
+  uint32_t Head = CanRxHead.load(std::memory_order_acquire);
+  uint32_t Tail = CanRxTail.load(std::memory_order_relaxed);
+  unsigned long Count = 0;
+
+  while ((Tail != Head) && (Count < MaxFrames))
+  {
+    Frames[Count++] = CanRx[Tail++ & (CAN_RX_FRAMES - 1)];
+  }
+  CanRxTail.store(Tail, std::memory_order_release);
+  return Count;
+}
+
+
+/**************************************************************************
+DOES:    Registers a call-back getting received generic CAN messages in
+         the thread calling Process, instead of the queue. NULL to queue
+         them again.
+RETURNS: Nothing
+**************************************************************************/
+void SerialProtocol::RegisterCanCallback
+  (
+  CANFRAMECALLBACK Callback,                               // new callback function or NULL to disable
+  void *Param                                              // arbitrary callback parameter
+  )
+{
+  CanCallback = Callback;
+  CanCallbackParam = Param;
+}
+
+
+/**************************************************************************
+DOES:    Accepts or drops received generic CAN messages of a range of CAN
+         IDs. All IDs are accepted by default.
+RETURNS: Nothing
+**************************************************************************/
+void SerialProtocol::SetCanFilter
+  (
+  unsigned short FirstID,                                  // first CAN ID of the range
+  unsigned short LastID,                                   // last CAN ID of the range
+  bool Accept                                              // TRUE to pass on, FALSE to drop
+  )
+{
+  unsigned long ID;
+
+  if (LastID >= CAN_ID_COUNT) LastID = CAN_ID_COUNT - 1;
+  for (ID = FirstID; ID <= LastID; ID++)
+  {
+    if (Accept) CanFilter[ID >> 6] |= (uint64_t)1 << (ID & 63);
+    else CanFilter[ID >> 6] &= ~((uint64_t)1 << (ID & 63));
+  }
+}
+
+
+/**************************************************************************
+DOES:    Passes on a generic CAN message received in [5F0Ch], the CAN
+         length is the subindex, the CAN ID comes before the data
+RETURNS: Nothing
+**************************************************************************/
+void SerialProtocol::ReceiveCanFrame
+  (
+  PACKET *Packet                                           // data indication of [5F0Ch]
+  )
+{
+  CAN_MSG Frame;
+  uint32_t Head;
+
+  Frame.LEN = Packet->Data[4];
+  if ((Frame.LEN > 8) || (Packet->Length < 7UL + Frame.LEN))
+  {
+    STATS_Add(&Stats.CanRxMalformed, 1);
+    return;
+  }
+  Frame.ID = GET_U16(Packet->Data + 5);
+  if ((CanFilter[(Frame.ID & (CAN_ID_COUNT - 1)) >> 6] & ((uint64_t)1 << (Frame.ID & 63))) == 0)
+  {
+    STATS_Add(&Stats.CanRxFiltered, 1);
+    return;
+  }
+  memcpy(Frame.BUF, &Packet->Data[7], Frame.LEN);
+  memset(&Frame.BUF[Frame.LEN], 0, 8 - Frame.LEN);
+
+  if (CanCallback)
+  {
+    STATS_Add(&Stats.CanRxFrames, 1);
+    CanCallback(&Frame, CanCallbackParam);
+    return;
+  }
+  Head = CanRxHead.load(std::memory_order_relaxed);
+  if (Head - CanRxTail.load(std::memory_order_acquire) >= CAN_RX_FRAMES)
+  {
+    STATS_Add(&Stats.CanRxOverruns, 1);
+    return;
+  }
+  CanRx[Head & (CAN_RX_FRAMES - 1)] = Frame;
+  CanRxHead.store(Head + 1, std::memory_order_release);
+  STATS_Add(&Stats.CanRxFrames, 1);
+}
+
 /*----------------------- END OF FILE ----------------------------------*/
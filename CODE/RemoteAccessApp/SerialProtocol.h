@@ -19,11 +19,15 @@ VERSION:   1.10, EmSA 10-NOV-17
 
 #include <stdint.h>
 #include <time.h>
+#include <atomic>
 #include "global.h"
 #include "xsdo.h"
 #include "sdoclnt.h"
 #include "Timer.h"
 #include "SerialPort.h"
+#include "Statistics.h"
+
+class TRACER;
 
 /**************************************************************************
 GLOBAL DEFINES
@@ -44,6 +48,7 @@ GLOBAL DEFINES
 #define ERROR_UNKNOWN              (1UL << 10)
 #define ERROR_NOTSUPPORTED         (1UL << 11)
 #define ERROR_NODEERROR            (1UL << 12)
+#define ERROR_PENDING              (1UL << 28)
 #define ERROR_TX                   (1UL << 29)
 #define ERROR_NORESPONSE           (1UL << 30)
 #define ERROR_WRONGRESPONSE        (1UL << 31)
@@ -89,6 +94,34 @@ GLOBAL DEFINES
 // max data that can be written to local OD in one go
 #define MAX_WRITE_LENGTH (MAX_PACKET_LENGTH - 4)
 
+// packets held by HoldTransmit for a single write, and the max
+// microseconds the first of them waits for more
+#define TX_QUEUE_PACKETS 32
+#define TX_COALESCE_TIME 1000
+
+// packets are counted by their command, the first data byte 'A' to 'Z',
+// all other packets are counted as STATS_COMMAND_OTHER
+#define STATS_COMMAND_OTHER 26
+#define STATS_COMMANDS      27
+#define STATS_COMMAND(c) ((((c) >= 'A') && ((c) <= 'Z')) ? (c) - 'A' : STATS_COMMAND_OTHER)
+
+// requests waiting for a response, each with own timeouts and latency
+// histogram
+#define REQUEST_READLOCAL   0 // ReadLocalOD
+#define REQUEST_WRITELOCAL  1 // WriteLocalOD
+#define REQUEST_READREMOTE  2 // ReadRemoteOD
+#define REQUEST_WRITEREMOTE 3 // WriteRemoteOD
+#define REQUESTS            4
+
+// generic CAN messages, written to and received from [5F0Ch] with the
+// CAN length as subindex and the CAN ID before the data. [5F01h,0Bh]
+// selects them for transmit and receive.
+#define GENERIC_CAN_TX   0x01
+#define GENERIC_CAN_RX   0x10
+#define CAN_RX_FRAMES    1024       // frames queued for ReceiveCanFrames, a power of 2
+#define CAN_TX_WINDOW    16         // max frames sent before waiting for their responses
+#define CAN_ID_COUNT     2048       // 11-bit CAN IDs known to the filter
+
 /**************************************************************************
 GLOBAL TYPES AND FUNCTIONS
 ***************************************************************************/ 
@@ -100,6 +133,45 @@ typedef struct _Packet
   unsigned char Data[MAX_PACKET_LENGTH];
 } PACKET;
 
+// call-back for generic CAN messages received, instead of the queue
+typedef void (*CANFRAMECALLBACK)(const CAN_MSG *Frame, void *Param);
+
+// timeout of a request type. A request times out after the transfer time
+// of the request and of the longest response at the baudrate plus the
+// allowance.
+typedef struct
+{
+  unsigned long Allowance;                  // microseconds the device may take to respond
+  unsigned long Retries;                    // times a request is sent again after a timeout
+  unsigned long Backoff;                    // microseconds before the first retry, doubled for each further one
+} SERIAL_TIMEOUT;
+
+// counters of the serial protocol, extended SDO transfers are counted by
+// the SDO client
+typedef struct
+{
+  STATS_COUNTER RxPackets[STATS_COMMANDS];  // packets received by command
+  STATS_COUNTER RxBytes[STATS_COMMANDS];    // bytes of packets incl. header and CRC
+  STATS_COUNTER TxPackets[STATS_COMMANDS];  // packets sent by command
+  STATS_COUNTER TxBytes[STATS_COMMANDS];    // bytes of packets incl. header and CRC
+  STATS_COUNTER RxSkipped;                  // bytes received outside of packets
+  STATS_COUNTER CRCErrors;                  // packets with wrong checksum
+  STATS_COUNTER Resyncs;                    // packets dropped for a wrong length or command
+  STATS_COUNTER PacketTimeouts;             // packets not completed in time
+  STATS_COUNTER TxErrors;                   // packets that could not be sent
+  STATS_COUNTER TxWrites;                   // writes to the serial port, one or more packets each
+  STATS_COUNTER ResponseTimeouts;           // requests without response
+  STATS_COUNTER WrongResponses;             // requests answered with another command
+  STATS_COUNTER Retries;                    // requests sent again after a timeout
+  STATS_COUNTER StaleResponses;             // late responses to an earlier request, ignored
+  STATS_COUNTER CanTxFrames;                // generic CAN messages sent
+  STATS_COUNTER CanRxFrames;                // generic CAN messages received and passed on
+  STATS_COUNTER CanRxFiltered;              // generic CAN messages dropped by the ID filter
+  STATS_COUNTER CanRxOverruns;              // generic CAN messages lost, queue full
+  STATS_COUNTER CanRxMalformed;             // generic CAN messages with a wrong length, dropped
+  STATS_HISTOGRAM Latency[REQUESTS];        // request to response in microseconds
+} SERIAL_STATISTICS;
+
 class SerialProtocol
 {
   // Parsing states for packet protocol reception
@@ -128,6 +200,11 @@ class SerialProtocol
     **************************************************************************/
     void Process(void);
     /**************************************************************************
+    DOES:    Handles a packet received from the device
+    RETURNS: Nothing
+    **************************************************************************/
+    void HandlePacket(PACKET *Packet);
+    /**************************************************************************
     DOES:    Register a callback for process data written to COIA device
     RETURNS: Nothing
     **************************************************************************/
@@ -143,6 +220,19 @@ class SerialProtocol
     **************************************************************************/
     bool Connect(char *PortName, unsigned long Baudrate);
     /**************************************************************************
+    DOES:    Selects the low latency mode of the serial port for the next
+             Connect. Received bytes are passed on by the driver at once,
+             which saves the latency timer of USB adapters.
+    RETURNS: Nothing
+    **************************************************************************/
+    void SetLowLatency(bool On) { Port->SetLowLatency(On); }
+    /**************************************************************************
+    DOES:    Selects the I/O backend of the serial port for the next Connect,
+             SERIAL_BACKEND_xxx
+    RETURNS: Nothing
+    **************************************************************************/
+    void SetBackend(int Backend) { Port->SetBackend(Backend); }
+    /**************************************************************************
     DOES:    Disconnects from the serial port
     RETURNS: Nothing
     **************************************************************************/
@@ -229,6 +319,212 @@ class SerialProtocol
     RETURNS: Returns error code from node
     **************************************************************************/
     unsigned short GetLastNodeError(void);
+    /**************************************************************************
+    DOES:    Gets the handle of the serial port, e.g. to wait for data
+    RETURNS: Handle or INVALID_HANDLE_VALUE if not connected
+    **************************************************************************/
+    HANDLE GetHandle(void);
+    /**************************************************************************
+    DOES:    Gets the handle that becomes readable when the device sent
+             data, to wait for with poll() before calling Process. It is the
+             serial port unless the backend receives into memory.
+    RETURNS: Handle or INVALID_HANDLE_VALUE if not connected
+    **************************************************************************/
+    HANDLE GetEventHandle(void);
+    /**************************************************************************
+    DOES:    Checks without waiting whether the device sent data that
+             Process has not handled yet. Data already received from the
+             port may not make the handles readable again.
+    RETURNS: TRUE if data is waiting or the port failed, else FALSE
+    **************************************************************************/
+    bool IsDataAvailable(void);
+    /**************************************************************************
+    DOES:    Runs a received byte through the packet state machine, e.g.
+             bytes from another transport or a benchmark. If TRUE is
+             returned NextPacket must be called until it returns FALSE.
+    RETURNS: TRUE if the byte completed a packet, else FALSE
+    **************************************************************************/
+    bool ReceiveByte(unsigned char Byte, PACKET *Packet);
+    /**************************************************************************
+    DOES:    Gets the next packet from bytes already received, e.g. when a
+             damaged packet contained the start of further packets
+    RETURNS: TRUE if a packet was found, else FALSE
+    **************************************************************************/
+    bool NextPacket(PACKET *Packet);
+    /**************************************************************************
+    DOES:    Drops a partly received packet, as when its bytes time out.
+             Packets in its bytes are returned by NextPacket.
+    RETURNS: Nothing
+    **************************************************************************/
+    void AbortPacket(void);
+    /**************************************************************************
+    DOES:    Holds the packets sent from now on in a queue, ReleaseTransmit
+             sends them with a single write. Calls may be nested. Held
+             packets are sent anyway before waiting for data from the
+             device and when the first of them waited TX_COALESCE_TIME.
+    RETURNS: Nothing
+    **************************************************************************/
+    void HoldTransmit(void) { TxHold++; }
+    /**************************************************************************
+    DOES:    Ends a HoldTransmit, the last one sends the queued packets
+    RETURNS: TRUE for success, FALSE if packets could not be sent
+    **************************************************************************/
+    bool ReleaseTransmit(void);
+    /**************************************************************************
+    DOES:    Sets a tracer getting all frames sent and received, NULL to stop
+             tracing. The tracer must stay until it is replaced.
+    RETURNS: Nothing
+    **************************************************************************/
+    void SetTracer(TRACER *NewTracer) { Tracer = NewTracer; }
+    /**************************************************************************
+    DOES:    Gets the counters of the serial protocol. They can be read by
+             other threads at any time, e.g. for monitoring.
+    RETURNS: Counters
+    **************************************************************************/
+    const SERIAL_STATISTICS *GetStatistics(void) const { return &Stats; }
+    /**************************************************************************
+    DOES:    Gets the counters of extended SDO transfers by node id
+    RETURNS: Counters
+    **************************************************************************/
+    const SDOCLNT_STATISTICS *GetSDOStatistics(void) const { return SdoClient->SDOCLNT_GetStatistics(); }
+    /**************************************************************************
+    DOES:    Sets how many segments of an SDO block download are sent at
+             once, 16 by default. 1 for devices whose CAN transmit queue
+             takes one 'C' packet at a time.
+    RETURNS: Nothing
+    **************************************************************************/
+    void SetSdoBlockBurst(unsigned char Segments) { SdoClient->SDOCLNT_SetBlockBurst(Segments); }
+    unsigned char GetSdoBlockBurst(void) const { return SdoClient->SDOCLNT_GetBlockBurst(); }
+    /**************************************************************************
+    DOES:    Sets the counters of the serial protocol and the SDO client to
+             0, SDO transfers in progress remain counted as active
+    RETURNS: Nothing
+    **************************************************************************/
+    void ResetStatistics(void);
+    /**************************************************************************
+    DOES:    Sets the timeout and retries of a request type. Only local
+             reads are retried by default: a write whose response was lost
+             may have been executed and is executed again by each retry,
+             so retries of writes must only be set for writes that may be
+             repeated.
+    RETURNS: Nothing
+    **************************************************************************/
+    void SetTimeout(
+      unsigned int Request,             // REQUEST_xxx
+      const SERIAL_TIMEOUT *Timeout     // new timeout
+      );
+    /**************************************************************************
+    DOES:    Gets the timeout and retries of a request type
+    RETURNS: Nothing
+    **************************************************************************/
+    void GetTimeout(
+      unsigned int Request,             // REQUEST_xxx
+      SERIAL_TIMEOUT *Timeout           // location to store timeout
+      );
+    /**************************************************************************
+    DOES:    Sets the time allowed between two bytes of a packet in addition
+             to their transfer time, e.g. for the latency timer of USB
+             serial adapters
+    RETURNS: Nothing
+    **************************************************************************/
+    void SetPacketTimeout(unsigned long Allowance);
+    /**************************************************************************
+    DOES:    Gets the time a request may take before it times out
+    RETURNS: Timeout in microseconds
+    **************************************************************************/
+    unsigned long GetResponseTimeout(
+      unsigned int Request,             // REQUEST_xxx
+      unsigned long Length              // data length of the request packet
+      );
+    /**************************************************************************
+    DOES:    Sends a read or write request without waiting for its response,
+             to the device itself for NodeID 0 or else to a remote node.
+             Process must be called until GetRequestResult returns
+             something else than ERROR_PENDING. One request at a time.
+    RETURNS: ERROR_NOERROR if the request was sent or error code for failure,
+             ERROR_COIABUSY if a request is still pending
+    **************************************************************************/
+    unsigned long StartRequest(
+      unsigned char NodeID,             // node id of remote node, 0 for the device
+      unsigned short Index,             // index of od entry
+      unsigned char Subindex,           // subindex of od entry
+      bool Write,                       // TRUE to write, FALSE to read
+      unsigned long DataLength,         // length of data to write
+      unsigned char *Data               // location of data to write
+      );
+    /**************************************************************************
+    DOES:    Checks for the response to StartRequest, sends the request again
+             after timeouts as set by SetTimeout
+    RETURNS: ERROR_PENDING while waiting, else as the blocking functions
+    **************************************************************************/
+    unsigned long GetRequestResult(
+      unsigned long *DataLength,        // location to store length of data read
+      unsigned char *Data               // location to store data read (must hold at least MAX_PACKET_LENGTH bytes)
+      );
+    /**************************************************************************
+    DOES:    Sets how long Process waits for data from the device, 0 to only
+             handle what was already received, e.g. when waiting with poll()
+             on GetEventHandle
+    RETURNS: Nothing
+    **************************************************************************/
+    void SetProcessWait(unsigned long Microseconds) { ProcessWait = Microseconds; }
+    /**************************************************************************
+    DOES:    Selects generic CAN messages for transmit and receive in
+             [5F01h,0Bh]. Received messages are only passed on after this.
+    RETURNS: ERROR_NOERROR for success or error code for failure
+    **************************************************************************/
+    unsigned long EnableCanFrames(
+      bool Transmit,                    // TRUE to send messages with SendCanFrames
+      bool Receive                      // TRUE to receive messages
+      );
+    /**************************************************************************
+    DOES:    Sends generic CAN messages, one write request per message.
+             As many requests as set by SetCanTxWindow go out with a
+             single write before their responses are waited for, one by
+             default. Blocks until all are confirmed, packets received
+             meanwhile are handled as usual.
+    RETURNS: ERROR_NOERROR for success or error code for failure,
+             ERROR_COIABUSY if a request is still pending
+    **************************************************************************/
+    unsigned long SendCanFrames(
+      const CAN_MSG *Frames,            // messages to send
+      unsigned long Count               // number of messages
+      );
+    /**************************************************************************
+    DOES:    Sets how many write requests of SendCanFrames may wait for
+             their responses at once, 1 to CAN_TX_WINDOW. Default 1, more
+             only for devices known to accept several outstanding
+             requests.
+    RETURNS: Nothing
+    **************************************************************************/
+    void SetCanTxWindow(unsigned long Frames) { CanTxWindow = (Frames < 1) ? 1 : ((Frames > CAN_TX_WINDOW) ? CAN_TX_WINDOW : Frames); }
+    /**************************************************************************
+    DOES:    Takes received generic CAN messages out of the queue, oldest
+             first. May be called by one thread other than the one calling
+             Process.
+    RETURNS: Number of messages stored
+    **************************************************************************/
+    unsigned long ReceiveCanFrames(
+      CAN_MSG *Frames,                  // location to store the messages
+      unsigned long MaxFrames           // max messages to store
+      );
+    /**************************************************************************
+    DOES:    Registers a call-back getting received generic CAN messages in
+             the thread calling Process, instead of the queue. NULL to queue
+             them again.
+    RETURNS: Nothing
+    **************************************************************************/
+    void RegisterCanCallback(CANFRAMECALLBACK Callback, void *Param);
+    /**************************************************************************
+    DOES:    Accepts or drops received generic CAN messages of a range of
+             CAN IDs. All IDs are accepted by default.
+    RETURNS: Nothing
+    **************************************************************************/
+    void SetCanFilter(
+      unsigned short FirstID,           // first CAN ID of the range
+      unsigned short LastID,            // last CAN ID of the range
+      bool Accept                       // TRUE to pass on, FALSE to drop
+      );
 
   private:
     /**************************************************************************
@@ -237,11 +533,63 @@ class SerialProtocol
     **************************************************************************/
     bool SendPacket(PACKET *Packet);
     /**************************************************************************
+    DOES:    Writes the queued packets to the device
+    RETURNS: TRUE for success, FALSE for error
+    **************************************************************************/
+    bool FlushTransmit(void);
+    /**************************************************************************
     DOES:    Attempts to get the next message packet from the device
     RETURNS: TRUE if packet obtained, else FALSE
     **************************************************************************/
     bool GetPacket(PACKET *Packet);
     /**************************************************************************
+    DOES:    Sends a request and waits for its response, sends it again
+             after timeouts as set by SetTimeout
+    RETURNS: ERROR_NOERROR if the response is in ResponsePacket, else
+             ERROR_TX, ERROR_NORESPONSE or ERROR_WRONGRESPONSE
+    **************************************************************************/
+    unsigned long Transfer(
+      unsigned int Request,             // REQUEST_xxx
+      PACKET *Packet,                   // request to send
+      unsigned long EchoLength          // bytes of the request repeated by the response
+      );
+    /**************************************************************************
+    DOES:    Sends a request, ContinueTransfer waits for the response
+    RETURNS: ERROR_PENDING if sent, ERROR_COIABUSY or ERROR_TX
+    **************************************************************************/
+    unsigned long BeginTransfer(
+      unsigned int Request,             // REQUEST_xxx
+      PACKET *Packet,                   // request to send
+      unsigned long EchoLength          // bytes of the request repeated by the response
+      );
+    /**************************************************************************
+    DOES:    Checks the packets processed for the response of the request
+             sent, sends it again after timeouts
+    RETURNS: ERROR_PENDING while waiting, else as Transfer
+    **************************************************************************/
+    unsigned long ContinueTransfer(void);
+    /**************************************************************************
+    DOES:    Sends the active request for the next attempt
+    RETURNS: ERROR_PENDING if sent, else ERROR_TX
+    **************************************************************************/
+    unsigned long SendTransfer(void);
+    /**************************************************************************
+    DOES:    Runs a byte through the packet state machine
+    RETURNS: TRUE if the byte completed a packet, else FALSE
+    **************************************************************************/
+    bool ParseByte(unsigned char Byte, PACKET *Packet);
+    /**************************************************************************
+    DOES:    Drops the packet being received, its bytes after the start of
+             header are scanned again
+    RETURNS: Nothing
+    **************************************************************************/
+    void Resync(void);
+    /**************************************************************************
+    DOES:    Passes on a generic CAN message received in [5F0Ch]
+    RETURNS: Nothing
+    **************************************************************************/
+    void ReceiveCanFrame(PACKET *Packet);
+    /**************************************************************************
     DOES:    Called when sdo client wants to send an SDO to a node
     RETURNS: nothing
     **************************************************************************/
@@ -265,13 +613,48 @@ class SerialProtocol
     STATE ReceiveState;
     unsigned long BytesRemaining;
     unsigned short IncomingCRC;
-    time_t ReceiveTimeout;
+    uint64_t ReceiveTimeout;                        // microseconds, end of the packet being received
+    unsigned long PacketAllowance;                  // microseconds allowed between bytes
+    uint64_t ResponseDeadline;                      // microseconds, 0 if not waiting for a response
+    SERIAL_TIMEOUT Timeouts[REQUESTS];
+    unsigned int ActiveRequest;                     // REQUEST_xxx waiting for a response, REQUESTS if none
+    PACKET ActivePacket;                            // request waiting for a response
+    unsigned long ActiveEcho;                       // bytes of the request repeated by the response
+    unsigned long ActiveAttempt;
+    unsigned long ActiveBackoff;                    // microseconds before the next attempt
+    bool ActiveBackingOff;                          // ResponseDeadline is the end of the backoff
+    uint64_t ActiveStart;                           // microseconds, sending of the attempt
+    unsigned int StartedRequest;                    // REQUEST_xxx of StartRequest, REQUESTS if none
+    unsigned long ProcessWait;                      // microseconds Process waits for data
+    unsigned long ByteTime;                         // microseconds to transfer a byte
+    unsigned long AdapterLatency;                   // microseconds a USB adapter may hold received bytes
+    unsigned char RxFrame[MAX_PACKET_LENGTH + 4];   // packet being received, from start of header
+    unsigned long RxFrameLength;
+    unsigned char Rescan[2 * (MAX_PACKET_LENGTH + 4)]; // bytes read or received, not yet scanned
+    unsigned long RescanLength;
+    unsigned long RescanPosition;
+    unsigned long RescanUntraced;                   // bytes at the end of Rescan not yet traced
     XSDO *XSdo;
     SDOCLNT *SdoClient;
     Timer *Tim;
-    unsigned char TxPacketData[MAX_PACKET_LENGTH + 4];
+    unsigned char TxQueue[TX_QUEUE_PACKETS * (MAX_PACKET_LENGTH + 4)]; // packets not yet written, from start of header
+    unsigned long TxQueueLength;
+    uint64_t TxQueueDeadline;                       // microseconds, latest write of the queued packets
+    unsigned int TxHold;                            // nesting of HoldTransmit
     SerialPort *Port;
     unsigned short LastNodeError;
+    SERIAL_STATISTICS Stats;
+    TRACER *Tracer;
+    uint64_t CanFilter[CAN_ID_COUNT / 64];          // bit per CAN ID, set to accept
+    CAN_MSG CanRx[CAN_RX_FRAMES];                   // received messages not yet taken
+    std::atomic<uint32_t> CanRxHead;                // next message stored by Process
+    std::atomic<uint32_t> CanRxTail;                // next message taken by ReceiveCanFrames
+    bool CanReceive;                                // messages in [5F0Ch] are passed on
+    CANFRAMECALLBACK CanCallback;
+    void *CanCallbackParam;
+    unsigned long CanTxPending;                     // messages sent, response not yet received
+    unsigned long CanTxWindow;                      // max messages sent and not yet confirmed
+    unsigned short CanTxError;                      // first error code of their responses
 };
 
 
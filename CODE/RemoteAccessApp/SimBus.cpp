@@ -0,0 +1,323 @@
+/**************************************************************************
+MODULE:    SimBus
+CONTAINS:  Virtual CAN bus between a simulated CANopenIA device and the
+           simulated remote nodes
+COPYRIGHT: Embedded Systems Academy, Inc. 2008-2017.
+DISCLAIM:  Read and understand our disclaimer before using this code!
+           www.esacademy.com/disclaim.htm
+           This software was written in accordance to the guidelines at
+           www.esacademy.com/software/softwarestyleguide.pdf
+LICENSE:   Free to use with licensed CANopenIA chips, modules or devices
+           like CANgineBerry, CANgineXXX and 447izer
+VERSION:   1.10, EmSA 10-NOV-17
+           $LastChangedDate: 2014-01-11 17:30:59 +0100 (Sa, 11 Jan 2014) $
+           $LastChangedRevision: 1702 $
+***************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "SimBus.h"
+
+/**************************************************************************
+LOCAL DEFINES
+***************************************************************************/
+
+// start value of the random numbers if no seed is set
+#define DEFAULT_SEED 0x2F6B4A1DUL
+
+
+/**************************************************************************
+DOES:    Constructor - creates a bus without bit rate limit, all nodes
+         transmit without delay or loss
+**************************************************************************/
+SIMBUS::SIMBUS
+  (
+  void
+  )
+{
+  memset(Links, 0, sizeof(Links));
+  memset(LastArrival, 0, sizeof(LastArrival));
+  memset(&Stats, 0, sizeof(Stats));
+  Bitrate = 0;
+  BusFree = 0;
+  RandomState = DEFAULT_SEED;
+  Events = new SIMBUS_EVENT[SIMBUS_MAX_EVENTS];
+  EventCount = 0;
+  Sequence = 0;
+}
+
+
+/**************************************************************************
+DOES:    Destructor - releases the event queue
+**************************************************************************/
+SIMBUS::~SIMBUS
+  (
+  void
+  )
+{
+  delete[] Events;
+}
+
+
+/**************************************************************************
+DOES:    Sets the bit rate, 0 for no limit
+RETURNS: Nothing
+**************************************************************************/
+void SIMBUS::SetBitrate
+  (
+  UNSIGNED32 Rate                                          // bits per second, 0 for no limit
+  )
+{
+  Bitrate = Rate;
+}
+
+
+/**************************************************************************
+DOES:    Sets the start value of the random numbers for jitter and loss
+RETURNS: Nothing
+**************************************************************************/
+void SIMBUS::SetSeed
+  (
+  UNSIGNED32 Seed                                          // start value, 0 for default
+  )
+{
+  // the generator must not start at 0
+  RandomState = Seed ? Seed : DEFAULT_SEED;
+}
+
+
+/**************************************************************************
+DOES:    Sets the transmission behaviour of a node
+RETURNS: Nothing
+**************************************************************************/
+void SIMBUS::SetLink
+  (
+  UNSIGNED8 NodeID,                                        // node id, 1 to SIMBUS_MAX_NODES
+  const SIMLINK *Link                                      // behaviour of the node
+  )
+{
+  if ((NodeID < 1) || (NodeID > SIMBUS_MAX_NODES)) return;
+  Links[NodeID] = *Link;
+  if (Links[NodeID].DropRate > SIMBUS_DROP_SCALE) Links[NodeID].DropRate = SIMBUS_DROP_SCALE;
+}
+
+
+/**************************************************************************
+DOES:    Generates the next random number (xorshift)
+RETURNS: Random number
+**************************************************************************/
+UNSIGNED32 SIMBUS::Random
+  (
+  void
+  )
+{
+  RandomState ^= RandomState << 13;
+  RandomState ^= RandomState >> 17;
+  RandomState ^= RandomState << 5;
+  return RandomState;
+}
+
+
+/**************************************************************************
+DOES:    Transmits a frame between the device and a node. The frame waits
+         until the bus is free, is then lost with the drop rate of the
+         node or arrives after its latency and a random jitter.
+RETURNS: TRUE with the arrival time, FALSE if the frame was lost
+**************************************************************************/
+bool SIMBUS::Transmit
+  (
+  UNSIGNED8 NodeID,                                        // node sending or receiving the frame
+  UNSIGNED8 DLC,                                           // data bytes of the frame
+  uint64_t Time,                                           // monotonic time the frame is sent in us
+  uint64_t *Arrival                                        // location to store the arrival time
+  )
+{
+  const SIMLINK *Link;
+
+  if ((NodeID < 1) || (NodeID > SIMBUS_MAX_NODES)) return FALSE;
+  Link = &Links[NodeID];
+  Stats.Frames++;
+
+  if (Bitrate)
+  { // lost frames occupy the bus as well
+    if (BusFree > Time)
+    {
+      if (BusFree - Time > Stats.MaxDelay) Stats.MaxDelay = (UNSIGNED32)(BusFree - Time);
+      Time = BusFree;
+    }
+    Time += ((uint64_t)SIMBUS_FRAME_BITS(DLC) * 1000000 + Bitrate - 1) / Bitrate;
+    BusFree = Time;
+  }
+
+  if (Link->DropRate && ((Random() % SIMBUS_DROP_SCALE) < Link->DropRate))
+  {
+    Stats.Lost++;
+    return FALSE;
+  }
+
+  Time += Link->Latency;
+  if (Link->Jitter) Time += Random() % (Link->Jitter + 1);
+  if (Time < LastArrival[NodeID]) Time = LastArrival[NodeID];
+  LastArrival[NodeID] = Time;
+  *Arrival = Time;
+  return TRUE;
+}
+
+
+/**************************************************************************
+DOES:    Compares the arrival of two queued events
+RETURNS: TRUE if event a arrives before event b
+**************************************************************************/
+bool SIMBUS::IsEarlier
+  (
+  unsigned long a,                                         // position of first event
+  unsigned long b                                          // position of second event
+  ) const
+{
+  if (Events[a].Due != Events[b].Due) return Events[a].Due < Events[b].Due;
+  // sequence numbers wrap, compare the difference
+  return (int)(Events[a].Sequence - Events[b].Sequence) < 0;
+}
+
+
+/**************************************************************************
+DOES:    Moves an event towards the top of the heap
+RETURNS: Nothing
+**************************************************************************/
+void SIMBUS::SiftUp
+  (
+  unsigned long Position                                   // position of event
+  )
+{
+  SIMBUS_EVENT Swap;
+  unsigned long Parent;
+
+  while (Position > 0)
+  {
+    Parent = (Position - 1) / 2;
+    if (!IsEarlier(Position, Parent)) break;
+    Swap = Events[Parent];
+    Events[Parent] = Events[Position];
+    Events[Position] = Swap;
+    Position = Parent;
+  }
+}
+
+
+/**************************************************************************
+DOES:    Moves an event towards the bottom of the heap
+RETURNS: Nothing
+**************************************************************************/
+void SIMBUS::SiftDown
+  (
+  unsigned long Position                                   // position of event
+  )
+{
+  SIMBUS_EVENT Swap;
+  unsigned long Child;
+
+  while ((Child = 2 * Position + 1) < EventCount)
+  {
+    if ((Child + 1 < EventCount) && IsEarlier(Child + 1, Child)) Child++;
+    if (!IsEarlier(Child, Position)) break;
+    Swap = Events[Child];
+    Events[Child] = Events[Position];
+    Events[Position] = Swap;
+    Position = Child;
+  }
+}
+
+
+/**************************************************************************
+DOES:    Queues an event until its arrival time
+RETURNS: TRUE for success, FALSE if the queue is full
+**************************************************************************/
+bool SIMBUS::Schedule
+  (
+  uint64_t Due,                                            // monotonic arrival time in us
+  UNSIGNED8 Type,                                          // SIMBUS_EVENT_xxx
+  UNSIGNED8 NodeID,                                        // node the event is from
+  const UNSIGNED8 *Data,                                   // data of the event
+  unsigned long Length                                     // length of data, up to MAX_PACKET_LENGTH
+  )
+{
+  SIMBUS_EVENT *Event;
+
+  if ((EventCount == SIMBUS_MAX_EVENTS) || (Length > MAX_PACKET_LENGTH))
+  {
+    Stats.Overruns++;
+    return FALSE;
+  }
+
+  Event = &Events[EventCount];
+  Event->Due = Due;
+  Event->Sequence = Sequence++;
+  Event->Type = Type;
+  Event->NodeID = NodeID;
+  Event->Length = (UNSIGNED8)Length;
+  memcpy(Event->Data, Data, Length);
+  SiftUp(EventCount++);
+  return TRUE;
+}
+
+
+/**************************************************************************
+DOES:    Gets the arrival time of the next event
+RETURNS: TRUE if an event is queued, else FALSE
+**************************************************************************/
+bool SIMBUS::GetNextTime
+  (
+  uint64_t *Due                                            // location to store the arrival time
+  ) const
+{
+  if (EventCount == 0) return FALSE;
+  *Due = Events[0].Due;
+  return TRUE;
+}
+
+
+/**************************************************************************
+DOES:    Removes the next event from the queue if it has arrived
+RETURNS: TRUE if an event was stored, else FALSE
+**************************************************************************/
+bool SIMBUS::GetEvent
+  (
+  uint64_t Now,                                            // monotonic time in us
+  SIMBUS_EVENT *Event                                      // location to store the event
+  )
+{
+  if ((EventCount == 0) || (Events[0].Due > Now)) return FALSE;
+
+  *Event = Events[0];
+  Events[0] = Events[--EventCount];
+  SiftDown(0);
+  Stats.Events++;
+  return TRUE;
+}
+
+
+/**************************************************************************
+DOES:    Drops all queued events of a node
+RETURNS: Nothing
+**************************************************************************/
+void SIMBUS::Flush
+  (
+  UNSIGNED8 NodeID                                         // node id
+  )
+{
+  unsigned long Source;
+  unsigned long Count = 0;
+  unsigned long Position;
+
+  for (Source = 0; Source < EventCount; Source++)
+  {
+    if (Events[Source].NodeID != NodeID) Events[Count++] = Events[Source];
+  }
+  if (Count == EventCount) return;
+
+  // rebuild the heap from the remaining events
+  EventCount = Count;
+  for (Position = EventCount / 2; Position-- > 0; ) SiftDown(Position);
+}
+
+/*----------------------- END OF FILE ----------------------------------*/
@@ -0,0 +1,187 @@
+/**************************************************************************
+MODULE:    SimBus
+CONTAINS:  Virtual CAN bus between a simulated CANopenIA device and the
+           simulated remote nodes. Frames are delayed by the bus load and
+           by the latency and jitter of the node, or lost. Events that
+           arrive later are queued in order of their arrival time.
+COPYRIGHT: Embedded Systems Academy, Inc. 2008-2017.
+DISCLAIM:  Read and understand our disclaimer before using this code!
+           www.esacademy.com/disclaim.htm
+           This software was written in accordance to the guidelines at
+           www.esacademy.com/software/softwarestyleguide.pdf
+LICENSE:   Free to use with licensed CANopenIA chips, modules or devices
+           like CANgineBerry, CANgineXXX and 447izer
+VERSION:   1.10, EmSA 10-NOV-17
+           $LastChangedDate: 2014-01-11 17:30:59 +0100 (Sa, 11 Jan 2014) $
+           $LastChangedRevision: 1702 $
+***************************************************************************/
+#pragma once
+
+#ifndef _SIMBUS_H
+#define _SIMBUS_H
+
+#include <stdint.h>
+#include "global.h"
+#include "SerialProtocol.h"
+
+/**************************************************************************
+GLOBAL DEFINES
+***************************************************************************/
+
+// highest node id on the bus
+#define SIMBUS_MAX_NODES 127
+
+// max number of events waiting for their arrival time
+#define SIMBUS_MAX_EVENTS 8192
+
+// drop rates are given in frames lost per SIMBUS_DROP_SCALE frames
+#define SIMBUS_DROP_SCALE 10000
+
+// bits of a base frame without stuffing
+#define SIMBUS_FRAME_BITS(dlc) (47 + 8 * (dlc))
+
+// event types
+#define SIMBUS_EVENT_PACKET    0 // packet for the host
+#define SIMBUS_EVENT_HEARTBEAT 1 // heartbeat received by the device
+
+/**************************************************************************
+GLOBAL TYPES AND FUNCTIONS
+***************************************************************************/
+
+// transmission behaviour of a node
+typedef struct
+{
+  UNSIGNED32 Latency;                         // microseconds until a frame arrives
+  UNSIGNED32 Jitter;                          // max random microseconds added
+  UNSIGNED16 DropRate;                        // frames lost per SIMBUS_DROP_SCALE
+} SIMLINK;
+
+// event arriving at the device
+typedef struct
+{
+  uint64_t Due;                               // monotonic arrival time in us
+  UNSIGNED32 Sequence;                        // keeps events of the same time in order
+  UNSIGNED8 Type;                             // SIMBUS_EVENT_xxx
+  UNSIGNED8 NodeID;                           // node the event is from
+  UNSIGNED8 Length;                           // length of data
+  UNSIGNED8 Data[MAX_PACKET_LENGTH];
+} SIMBUS_EVENT;
+
+// counters of the bus
+typedef struct
+{
+  unsigned long Frames;                       // frames transmitted
+  unsigned long Lost;                         // frames lost
+  unsigned long Events;                       // events delivered
+  unsigned long Overruns;                     // events discarded, queue full
+  UNSIGNED32 MaxDelay;                        // longest time a frame waited for the bus in us
+} SIMBUS_STATISTICS;
+
+class SIMBUS
+{
+  public:
+    /**************************************************************************
+    DOES:    Constructor - creates a bus without bit rate limit, all nodes
+             transmit without delay or loss
+    **************************************************************************/
+    SIMBUS(void);
+    /**************************************************************************
+    DOES:    Destructor - releases the event queue
+    **************************************************************************/
+    ~SIMBUS(void);
+    /**************************************************************************
+    DOES:    Sets the bit rate. Frames wait while the bus is busy with
+             earlier frames, so the delay grows with the bus load.
+    RETURNS: Nothing
+    **************************************************************************/
+    void SetBitrate(
+      UNSIGNED32 Bitrate          // bits per second, 0 for no limit
+      );
+    /**************************************************************************
+    DOES:    Sets the start value of the random numbers for jitter and loss,
+             the same value repeats the same simulation
+    RETURNS: Nothing
+    **************************************************************************/
+    void SetSeed(UNSIGNED32 Seed);
+    /**************************************************************************
+    DOES:    Sets the transmission behaviour of a node, applying to frames
+             in both directions
+    RETURNS: Nothing
+    **************************************************************************/
+    void SetLink(
+      UNSIGNED8 NodeID,           // node id, 1 to SIMBUS_MAX_NODES
+      const SIMLINK *Link         // behaviour of the node
+      );
+    /**************************************************************************
+    DOES:    Gets the transmission behaviour of a node
+    RETURNS: Behaviour of the node
+    **************************************************************************/
+    const SIMLINK *GetLink(UNSIGNED8 NodeID) const { return &Links[NodeID]; }
+    /**************************************************************************
+    DOES:    Transmits a frame between the device and a node. Frames of a
+             node arrive in the order they were sent.
+    RETURNS: TRUE with the arrival time, FALSE if the frame was lost
+    **************************************************************************/
+    bool Transmit(
+      UNSIGNED8 NodeID,           // node sending or receiving the frame
+      UNSIGNED8 DLC,              // data bytes of the frame
+      uint64_t Time,              // monotonic time the frame is sent in us
+      uint64_t *Arrival           // location to store the arrival time
+      );
+    /**************************************************************************
+    DOES:    Queues an event until its arrival time
+    RETURNS: TRUE for success, FALSE if the queue is full
+    **************************************************************************/
+    bool Schedule(
+      uint64_t Due,               // monotonic arrival time in us
+      UNSIGNED8 Type,             // SIMBUS_EVENT_xxx
+      UNSIGNED8 NodeID,           // node the event is from
+      const UNSIGNED8 *Data,      // data of the event
+      unsigned long Length        // length of data, up to MAX_PACKET_LENGTH
+      );
+    /**************************************************************************
+    DOES:    Gets the arrival time of the next event
+    RETURNS: TRUE if an event is queued, else FALSE
+    **************************************************************************/
+    bool GetNextTime(uint64_t *Due) const;
+    /**************************************************************************
+    DOES:    Removes the next event from the queue if it has arrived
+    RETURNS: TRUE if an event was stored, else FALSE
+    **************************************************************************/
+    bool GetEvent(
+      uint64_t Now,               // monotonic time in us
+      SIMBUS_EVENT *Event         // location to store the event
+      );
+    /**************************************************************************
+    DOES:    Drops all queued events of a node, e.g. when it resets
+    RETURNS: Nothing
+    **************************************************************************/
+    void Flush(UNSIGNED8 NodeID);
+    /**************************************************************************
+    DOES:    Gets the counters of the bus
+    RETURNS: Counters
+    **************************************************************************/
+    const SIMBUS_STATISTICS *GetStatistics(void) const { return &Stats; }
+
+  private:
+    UNSIGNED32 Random(void);
+    bool IsEarlier(unsigned long a, unsigned long b) const;
+    void SiftUp(unsigned long Position);
+    void SiftDown(unsigned long Position);
+
+    SIMLINK Links[SIMBUS_MAX_NODES + 1];
+    uint64_t LastArrival[SIMBUS_MAX_NODES + 1]; // keeps frames of a node in order
+    UNSIGNED32 Bitrate;
+    uint64_t BusFree;                         // time the last frame on the bus ends
+    UNSIGNED32 RandomState;
+    SIMBUS_STATISTICS Stats;
+
+    // binary heap, earliest event first
+    SIMBUS_EVENT *Events;
+    unsigned long EventCount;
+    UNSIGNED32 Sequence;
+};
+
+#endif // _SIMBUS_H
+
+/*----------------------- END OF FILE ----------------------------------*/
@@ -0,0 +1,855 @@
+/**************************************************************************
+MODULE:    SimNode
+CONTAINS:  Simulated CANopen node, an object dictionary with values built
+           from an EDS and an SDO server supporting expedited, segmented
+           and block transfers. Optionally the program download of a
+           bootloader as in CiA 302-3.
+COPYRIGHT: Embedded Systems Academy, Inc. 2008-2017.
+DISCLAIM:  Read and understand our disclaimer before using this code!
+           www.esacademy.com/disclaim.htm
+           This software was written in accordance to the guidelines at
+           www.esacademy.com/software/softwarestyleguide.pdf
+LICENSE:   Free to use with licensed CANopenIA chips, modules or devices
+           like CANgineBerry, CANgineXXX and 447izer
+VERSION:   1.10, EmSA 10-NOV-17
+           $LastChangedDate: 2014-01-11 17:30:59 +0100 (Sa, 11 Jan 2014) $
+           $LastChangedRevision: 1702 $
+***************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "SimNode.h"
+#include "CRC.h"
+
+/**************************************************************************
+LOCAL DEFINES
+***************************************************************************/
+
+// abort code for block sizes out of range
+#define SDO_ABORT_BLOCKSIZE 0x05040002UL
+
+// SDO command specifiers, bits 5 to 7 of the first byte
+#define CS_DOWNLOAD_SEGMENT  0
+#define CS_DOWNLOAD_INIT     1
+#define CS_UPLOAD_INIT       2
+#define CS_UPLOAD_SEGMENT    3
+#define CS_BLOCK_UPLOAD      5
+#define CS_BLOCK_DOWNLOAD    6
+
+// server command specifiers of block transfer responses
+#define SCS_BLOCK_DOWNLOAD   5
+#define SCS_BLOCK_UPLOAD     6
+
+
+/**************************************************************************
+DOES:    Constructor - creates a node without object dictionary
+**************************************************************************/
+SIMNODE::SIMNODE
+  (
+  void
+  )
+{
+  Dictionary = NULL;
+  NodeID = 0;
+  Values = NULL;
+  Offsets = NULL;
+  Lengths = NULL;
+  SdoState = SIMSDO_IDLE;
+  SdoData = SdoBuffer;
+  SdoCapacity = SIMNODE_DOMAIN_SIZE;
+  memset(Programs, 0, sizeof(Programs));
+  ProgramCapacity = 0;
+}
+
+
+/**************************************************************************
+DOES:    Destructor - releases the values
+**************************************************************************/
+SIMNODE::~SIMNODE
+  (
+  void
+  )
+{
+  unsigned int p;
+
+  free(Values);
+  free(Offsets);
+  free(Lengths);
+  for (p = 0; p < SIMNODE_PROGRAMS; p++) free(Programs[p]);
+}
+
+
+/**************************************************************************
+DOES:    Sets the value of an entry to its default
+RETURNS: Nothing
+**************************************************************************/
+void SIMNODE::SetDefault
+  (
+  unsigned long Position                                   // position of entry
+  )
+{
+  const EDS_ENTRY *Entry = Dictionary->GetEntry(Position);
+  UNSIGNED8 *Value = &Values[Offsets[Position]];
+  uint64_t Default;
+  unsigned long Length;
+  unsigned int b;
+
+  if (Entry->Flags & EDS_FLAG_STRING)
+  {
+    Length = strlen(Dictionary->GetString((UNSIGNED32)Entry->Default));
+    if (Length > Offsets[Position + 1] - Offsets[Position]) Length = Offsets[Position + 1] - Offsets[Position];
+    memcpy(Value, Dictionary->GetString((UNSIGNED32)Entry->Default), Length);
+    Lengths[Position] = (UNSIGNED16)Length;
+  }
+  else if (EDS::GetTypeSize(Entry->DataType) != 0)
+  {
+    Default = EDS::GetDefault(Entry, NodeID);
+    for (b = 0; b < Entry->Size; b++)
+    {
+      Value[b] = (UNSIGNED8)(Default >> (8 * b));
+    }
+    Lengths[Position] = Entry->Size;
+  }
+  else
+  { // domains start empty
+    Lengths[Position] = 0;
+  }
+}
+
+
+/**************************************************************************
+DOES:    Initializes all values from the defaults of an object
+         dictionary. The dictionary must stay valid while the node is
+         used and may be shared by several nodes.
+RETURNS: TRUE for success, FALSE for error
+**************************************************************************/
+bool SIMNODE::Init
+  (
+  const EDS *Dict,                                         // object dictionary of the node
+  UNSIGNED8 ID                                             // node id, used for $NODEID defaults
+  )
+{
+  const EDS_ENTRY *Entry;
+  unsigned long Count = Dict->GetEntryCount();
+  unsigned long Size = 0;
+  unsigned long Position;
+
+  free(Values);
+  free(Offsets);
+  free(Lengths);
+  Dictionary = Dict;
+  NodeID = ID;
+  SdoState = SIMSDO_IDLE;
+
+  // one more offset marks the end of the last value
+  Offsets = (unsigned long *)malloc((Count + 1) * sizeof(unsigned long));
+  Lengths = (UNSIGNED16 *)malloc((Count + 1) * sizeof(UNSIGNED16));
+  if ((Offsets == NULL) || (Lengths == NULL))
+  {
+    Values = NULL;
+    return FALSE;
+  }
+
+  for (Position = 0; Position < Count; Position++)
+  {
+    Entry = Dictionary->GetEntry(Position);
+    Offsets[Position] = Size;
+    if (EDS::GetTypeSize(Entry->DataType) != 0)
+    {
+      Size += Entry->Size;
+    }
+    else
+    { // strings and domains may grow up to a fixed size
+      Size += (Entry->Size > SIMNODE_DOMAIN_SIZE) ? Entry->Size : SIMNODE_DOMAIN_SIZE;
+    }
+  }
+  Offsets[Count] = Size;
+
+  Values = (UNSIGNED8 *)calloc(Size ? Size : 1, 1);
+  if (Values == NULL) return FALSE;
+
+  Reset(FALSE);
+  return TRUE;
+}
+
+
+/**************************************************************************
+DOES:    Restores the default values, either of all entries or of the
+         communication entries 1000h to 1FFFh only
+RETURNS: Nothing
+**************************************************************************/
+void SIMNODE::Reset
+  (
+  bool Communication                                       // TRUE for communication entries only
+  )
+{
+  const EDS_ENTRY *Entry;
+  unsigned long Position;
+
+  for (Position = 0; Position < Dictionary->GetEntryCount(); Position++)
+  {
+    Entry = Dictionary->GetEntry(Position);
+    if (!Communication || ((Entry->Index >= 0x1000) && (Entry->Index <= 0x1FFF)))
+    {
+      SetDefault(Position);
+    }
+  }
+  SdoState = SIMSDO_IDLE;
+}
+
+
+/**************************************************************************
+DOES:    Gets the current value of an entry without access checks
+RETURNS: 0 for success, else SDO abort code
+**************************************************************************/
+UNSIGNED32 SIMNODE::Read
+  (
+  UNSIGNED16 Index,                                        // index of od entry
+  UNSIGNED8 Subindex,                                      // subindex of od entry
+  unsigned long *Length,                                   // location to store length of value
+  const UNSIGNED8 **Data                                   // location to store pointer to value
+  ) const
+{
+  const EDS_ENTRY *Entry = Dictionary->Find(Index, Subindex);
+  unsigned long Position;
+
+  if (IsProgramEntry(Index))
+  {
+    return ReadProgram(Index, Subindex, Length, Data);
+  }
+  if (Entry == NULL)
+  {
+    return Dictionary->CheckAccess(Index, Subindex, 0, FALSE);
+  }
+  Position = Entry - Dictionary->GetEntry(0);
+  *Length = Lengths[Position];
+  *Data = &Values[Offsets[Position]];
+  return 0;
+}
+
+
+/**************************************************************************
+DOES:    Checks a numeric value against the limits of an entry
+RETURNS: 0 if the value is within the limits, else SDO abort code
+**************************************************************************/
+UNSIGNED32 SIMNODE::CheckLimits
+  (
+  const EDS_ENTRY *Entry,                                  // entry written to
+  unsigned long Length,                                    // length of data
+  const UNSIGNED8 *Data                                    // data to write
+  ) const
+{
+  uint64_t Value = 0;
+  uint64_t Low = Entry->LowLimit;
+  uint64_t High = Entry->HighLimit;
+  unsigned int Shift;
+  unsigned long b;
+
+  if (!(Entry->Flags & (EDS_FLAG_LOWLIMIT | EDS_FLAG_HIGHLIMIT)) || (Length == 0) || (Length > 8))
+  {
+    return 0;
+  }
+
+  for (b = 0; b < Length; b++)
+  {
+    Value |= (uint64_t)Data[b] << (8 * b);
+  }
+
+  if (Entry->Flags & EDS_FLAG_SIGNED)
+  { // sign extend all values, limits may be given as hex values
+    Shift = (unsigned int)(64 - 8 * Length);
+    if ((Entry->Flags & EDS_FLAG_LOWLIMIT) && ((int64_t)(Value << Shift) >> Shift) < ((int64_t)(Low << Shift) >> Shift))
+    {
+      return SDO_ABORT_VALUE_LOW;
+    }
+    if ((Entry->Flags & EDS_FLAG_HIGHLIMIT) && ((int64_t)(Value << Shift) >> Shift) > ((int64_t)(High << Shift) >> Shift))
+    {
+      return SDO_ABORT_VALUE_HIGH;
+    }
+    return 0;
+  }
+
+  if ((Entry->Flags & EDS_FLAG_LOWLIMIT) && (Value < Low)) return SDO_ABORT_VALUE_LOW;
+  if ((Entry->Flags & EDS_FLAG_HIGHLIMIT) && (Value > High)) return SDO_ABORT_VALUE_HIGH;
+  return 0;
+}
+
+
+/**************************************************************************
+DOES:    Sets the value of an entry. With checks the access type, the
+         length and the limits are verified as a device would for an
+         SDO write, without checks only const entries are refused.
+RETURNS: 0 for success, else SDO abort code
+**************************************************************************/
+UNSIGNED32 SIMNODE::Write
+  (
+  UNSIGNED16 Index,                                        // index of od entry
+  UNSIGNED8 Subindex,                                      // subindex of od entry
+  unsigned long Length,                                    // length of data
+  const UNSIGNED8 *Data,                                   // data to write
+  bool Check                                               // TRUE to check like an SDO write
+  )
+{
+  const EDS_ENTRY *Entry = Dictionary->Find(Index, Subindex);
+  unsigned long Position;
+  UNSIGNED32 Result;
+
+  if (IsProgramEntry(Index))
+  {
+    return WriteProgram(Index, Subindex, Length, Data);
+  }
+  if (Entry == NULL)
+  {
+    return Dictionary->CheckAccess(Index, Subindex, Length, TRUE);
+  }
+  if (Entry->Flags & EDS_FLAG_CONST)
+  {
+    return SDO_ABORT_READONLY;
+  }
+  if (Check)
+  {
+    Result = Dictionary->CheckAccess(Index, Subindex, Length, TRUE);
+    if (Result == 0) Result = CheckLimits(Entry, Length, Data);
+    if (Result != 0) return Result;
+  }
+
+  Position = Entry - Dictionary->GetEntry(0);
+  if (EDS::GetTypeSize(Entry->DataType) != 0)
+  {
+    if (Length != Entry->Size) return SDO_ABORT_TYPEMISMATCH;
+  }
+  else if (Length > Offsets[Position + 1] - Offsets[Position])
+  {
+    return SDO_ABORT_DATATOBIG;
+  }
+
+  memcpy(&Values[Offsets[Position]], Data, Length);
+  Lengths[Position] = (UNSIGNED16)Length;
+  return 0;
+}
+
+
+/**************************************************************************
+DOES:    Checks whether an SDO may read or write an entry, including the
+         entries of the program download
+RETURNS: 0 if allowed, else SDO abort code
+**************************************************************************/
+UNSIGNED32 SIMNODE::CheckAccess
+  (
+  UNSIGNED16 Index,                                        // index of od entry
+  UNSIGNED8 Subindex,                                      // subindex of od entry
+  unsigned long Length,                                    // length of data written, 0 for reads
+  bool Write                                               // TRUE to check for writing
+  ) const
+{
+  if (!IsProgramEntry(Index))
+  {
+    return Dictionary->CheckAccess(Index, Subindex, Length, Write);
+  }
+
+  // subindex 0 holds the number of programs
+  if (Subindex == 0) return Write ? SDO_ABORT_READONLY : 0;
+  if (Subindex > SIMNODE_PROGRAMS) return SDO_ABORT_UNKNOWNSUB;
+  switch (Index)
+  {
+    case 0x1F50:
+      if (!Write) return SDO_ABORT_WRITEONLY;
+      if (Length > ProgramCapacity) return SDO_ABORT_DATATOBIG;
+      return 0;
+
+    case 0x1F51:
+      if (Write && (Length != 1)) return SDO_ABORT_TYPEMISMATCH;
+      return 0;
+  }
+  return Write ? SDO_ABORT_READONLY : 0;
+}
+
+
+/**************************************************************************
+DOES:    Adds the program download of a bootloader, all programs start
+         cleared
+RETURNS: TRUE for success, FALSE for error
+**************************************************************************/
+bool SIMNODE::EnableProgramDownload
+  (
+  unsigned long Capacity                                   // max bytes of each program
+  )
+{
+  unsigned int p;
+
+  for (p = 0; p < SIMNODE_PROGRAMS; p++)
+  {
+    free(Programs[p]);
+    Programs[p] = (UNSIGNED8 *)malloc(Capacity + 7);
+    if (Programs[p] == NULL)
+    {
+      while (p > 0) free(Programs[--p]);
+      memset(Programs, 0, sizeof(Programs));
+      return FALSE;
+    }
+    ProgramLength[p] = 0;
+    ProgramControl[p] = SIMPROG_STOP;
+    ProgramCleared[p] = TRUE;
+    ProgramIdent[p] = 0;
+    FlashStatus[p] = SIMPROG_STATUS_NODATA;
+  }
+  ProgramCapacity = Capacity;
+  return TRUE;
+}
+
+
+/**************************************************************************
+DOES:    Checks for an entry of the program download
+RETURNS: TRUE if the program download is enabled and handles the entry
+**************************************************************************/
+bool SIMNODE::IsProgramEntry
+  (
+  UNSIGNED16 Index                                         // index of od entry
+  ) const
+{
+  if (Programs[0] == NULL) return FALSE;
+  return (Index == 0x1F50) || (Index == 0x1F51) || (Index == 0x1F56) || (Index == 0x1F57);
+}
+
+
+/**************************************************************************
+DOES:    Gets the value of an entry of the program download
+RETURNS: 0 for success, else SDO abort code
+**************************************************************************/
+UNSIGNED32 SIMNODE::ReadProgram
+  (
+  UNSIGNED16 Index,                                        // index of od entry
+  UNSIGNED8 Subindex,                                      // subindex of od entry
+  unsigned long *Length,                                   // location to store length of value
+  const UNSIGNED8 **Data                                   // location to store pointer to value
+  ) const
+{
+  UNSIGNED32 Code = CheckAccess(Index, Subindex, 0, FALSE);
+
+  if (Code != 0) return Code;
+
+  *Data = ProgramValue;
+  if (Subindex == 0)
+  {
+    ProgramValue[0] = SIMNODE_PROGRAMS;
+    *Length = 1;
+  }
+  else if (Index == 0x1F51)
+  {
+    ProgramValue[0] = ProgramControl[Subindex - 1];
+    *Length = 1;
+  }
+  else
+  {
+    STORE_U32((Index == 0x1F56) ? ProgramIdent[Subindex - 1] : FlashStatus[Subindex - 1], ProgramValue);
+    *Length = 4;
+  }
+  return 0;
+}
+
+
+/**************************************************************************
+DOES:    Writes program data or a program control command. Data is taken
+         only after the program was cleared, a program is started only if
+         it is valid.
+RETURNS: 0 for success, else SDO abort code
+**************************************************************************/
+UNSIGNED32 SIMNODE::WriteProgram
+  (
+  UNSIGNED16 Index,                                        // index of od entry
+  UNSIGNED8 Subindex,                                      // subindex of od entry
+  unsigned long Length,                                    // length of data
+  const UNSIGNED8 *Data                                    // data to write
+  )
+{
+  UNSIGNED32 Code = CheckAccess(Index, Subindex, Length, TRUE);
+  unsigned int p = Subindex - 1;
+  unsigned long b;
+  CRC Crc;
+
+  if (Code != 0) return Code;
+
+  if (Index == 0x1F50)
+  {
+    if (!ProgramCleared[p]) return SDO_ABORT_NOTRANSFERCTRL;
+    // SDO downloads receive into program memory directly
+    if (Data != Programs[p]) memcpy(Programs[p], Data, Length);
+    for (b = 0; b < Length; b++) Crc.Add(Programs[p][b]);
+    ProgramLength[p] = Length;
+    ProgramIdent[p] = Crc.Finalize();
+    FlashStatus[p] = SIMPROG_STATUS_OK;
+    ProgramCleared[p] = FALSE;
+    return 0;
+  }
+
+  switch (Data[0])
+  {
+    case SIMPROG_STOP:
+      break;
+
+    case SIMPROG_START:
+    case SIMPROG_RESET:
+      if ((FlashStatus[p] != SIMPROG_STATUS_OK) || (ProgramLength[p] == 0)) return SDO_ABORT_NOTRANSFERCTRL;
+      break;
+
+    case SIMPROG_CLEAR:
+      if (ProgramControl[p] == SIMPROG_START) return SDO_ABORT_NOTRANSFERCTRL;
+      ProgramLength[p] = 0;
+      ProgramIdent[p] = 0;
+      FlashStatus[p] = SIMPROG_STATUS_NODATA;
+      ProgramCleared[p] = TRUE;
+      break;
+
+    default:
+      return SDO_ABORT_VALUE_RANGE;
+  }
+  ProgramControl[p] = (Data[0] == SIMPROG_RESET) ? SIMPROG_START : Data[0];
+  return 0;
+}
+
+
+/**************************************************************************
+DOES:    Starts a segmented or block download, selects where the data is
+         received. Program data goes to program memory directly.
+RETURNS: 0 for success, else SDO abort code
+**************************************************************************/
+UNSIGNED32 SIMNODE::StartDownload
+  (
+  void
+  )
+{
+  UNSIGNED32 Code;
+
+  SdoData = SdoBuffer;
+  SdoCapacity = SIMNODE_DOMAIN_SIZE;
+  if (IsProgramEntry(SdoIndex) && (SdoIndex == 0x1F50) && (SdoSubindex >= 1) && (SdoSubindex <= SIMNODE_PROGRAMS))
+  {
+    if (!ProgramCleared[SdoSubindex - 1]) return SDO_ABORT_NOTRANSFERCTRL;
+    SdoData = Programs[SdoSubindex - 1];
+    SdoCapacity = ProgramCapacity;
+    FlashStatus[SdoSubindex - 1] = SIMPROG_STATUS_BUSY;
+  }
+
+  if (!SdoSizeIndicated) SdoLength = SdoCapacity;
+  if (SdoLength > SdoCapacity) return SDO_ABORT_DATATOBIG;
+  Code = CheckAccess(SdoIndex, SdoSubindex, SdoLength, TRUE);
+  if ((Code != 0) && (SdoSizeIndicated || (Code != SDO_ABORT_TYPEMISMATCH))) return Code;
+  return 0;
+}
+
+
+/**************************************************************************
+DOES:    Builds an abort response and ends the current transfer
+RETURNS: Number of responses, always 1
+**************************************************************************/
+unsigned int SIMNODE::Abort
+  (
+  UNSIGNED8 *Response,                                     // location for response
+  UNSIGNED32 Code                                          // SDO abort code
+  )
+{
+  Response[0] = 0x80;
+  STORE_U16(SdoIndex, &Response[1]);
+  Response[3] = SdoSubindex;
+  STORE_U32(Code, &Response[4]);
+  SdoState = SIMSDO_IDLE;
+  return 1;
+}
+
+
+/**************************************************************************
+DOES:    Starts an upload, copies the value to the transfer buffer and
+         builds the initiate response. Values of up to 4 bytes are sent
+         expedited unless a block transfer is requested.
+RETURNS: Number of responses, always 1
+**************************************************************************/
+unsigned int SIMNODE::StartUpload
+  (
+  const UNSIGNED8 *Request,                                // upload or block upload initiate
+  UNSIGNED8 *Response,                                     // location for response
+  bool Block                                               // TRUE for block upload
+  )
+{
+  const UNSIGNED8 *Data;
+  unsigned long Length;
+  UNSIGNED32 Code;
+
+  Code = CheckAccess(SdoIndex, SdoSubindex, 0, FALSE);
+  if (Code == 0) Code = Read(SdoIndex, SdoSubindex, &Length, &Data);
+  if (Code != 0) return Abort(Response, Code);
+
+  memcpy(SdoBuffer, Data, Length);
+  SdoLength = Length;
+  SdoPos = 0;
+  STORE_U16(SdoIndex, &Response[1]);
+  Response[3] = SdoSubindex;
+
+  // block upload falls back to expedited if the value does not exceed the
+  // protocol switch threshold
+  if (Block && ((Request[5] == 0) || (Length > Request[5])))
+  {
+    if ((Request[4] == 0) || (Request[4] > SIMNODE_BLOCK_SIZE)) return Abort(Response, SDO_ABORT_BLOCKSIZE);
+    SdoBlockSize = Request[4];
+    Response[0] = (SCS_BLOCK_UPLOAD << 5) | 0x02; // size indicated, no CRC
+    STORE_U32(Length, &Response[4]);
+    SdoState = SIMSDO_BLKUPINIT;
+  }
+  else if ((Length > 0) && (Length <= 4))
+  {
+    Response[0] = (CS_UPLOAD_INIT << 5) | ((4 - Length) << 2) | 0x03;
+    memcpy(&Response[4], Data, Length);
+    SdoState = SIMSDO_IDLE;
+  }
+  else
+  {
+    Response[0] = (CS_UPLOAD_INIT << 5) | 0x01;
+    STORE_U32(Length, &Response[4]);
+    SdoToggle = 0;
+    SdoState = SIMSDO_UPLOAD;
+  }
+  return 1;
+}
+
+
+/**************************************************************************
+DOES:    Builds the segments of the next block of a block upload
+RETURNS: Number of segments
+**************************************************************************/
+unsigned int SIMNODE::SendBlock
+  (
+  UNSIGNED8 (*Responses)[8]                                // location for segments
+  )
+{
+  unsigned long Length;
+
+  SdoBlockStart = SdoPos;
+  for (SdoSequence = 1; SdoSequence <= SdoBlockSize; SdoSequence++)
+  {
+    Length = SdoLength - SdoPos;
+    if (Length > 7) Length = 7;
+    memset(Responses[SdoSequence - 1], 0, 8);
+    Responses[SdoSequence - 1][0] = SdoSequence;
+    memcpy(&Responses[SdoSequence - 1][1], &SdoBuffer[SdoPos], Length);
+    SdoPos += Length;
+    if (SdoPos == SdoLength)
+    {
+      Responses[SdoSequence - 1][0] |= 0x80;
+      SdoUnused = (UNSIGNED8)(7 - Length);
+      break;
+    }
+  }
+  if (SdoSequence > SdoBlockSize) SdoSequence = SdoBlockSize;
+
+  SdoState = SIMSDO_BLKUPLOAD;
+  return SdoSequence;
+}
+
+
+/**************************************************************************
+DOES:    Handles a segment of a block download. The host SDO client can
+         not repeat segments, so a sequence error aborts the transfer.
+RETURNS: Number of responses, 0 or 1
+**************************************************************************/
+unsigned int SIMNODE::ReceiveBlockSegment
+  (
+  const UNSIGNED8 *Request,                                // segment received
+  UNSIGNED8 *Response                                      // location for response
+  )
+{
+  UNSIGNED8 Sequence = Request[0] & 0x7F;
+
+  if (Sequence != SdoSequence + 1)
+  {
+    return Abort(Response, SDO_ABORT_INVALID_SEQ);
+  }
+  if ((SdoPos > 0) && (SdoPos >= SdoLength))
+  {
+    return Abort(Response, SDO_ABORT_DATATOBIG);
+  }
+  memcpy(&SdoData[SdoPos], &Request[1], 7);
+  SdoPos += 7;
+  SdoSequence = Sequence;
+
+  if ((Request[0] & 0x80) || (Sequence == SIMNODE_BLOCK_SIZE))
+  { // end of block, confirm. The host SDO client reads the size of the
+    // next block from byte 5 instead of byte 2, so both are set.
+    Response[0] = (SCS_BLOCK_DOWNLOAD << 5) | 0x02;
+    Response[1] = SdoSequence;
+    Response[2] = SIMNODE_BLOCK_SIZE;
+    Response[5] = SIMNODE_BLOCK_SIZE;
+    SdoSequence = 0;
+    if (Request[0] & 0x80) SdoState = SIMSDO_BLKDOWNEND;
+    return 1;
+  }
+  return 0;
+}
+
+
+/**************************************************************************
+DOES:    Handles an SDO request received by the SDO server of the node
+RETURNS: Number of 8 byte responses stored, up to SIMNODE_MAX_RESPONSES
+**************************************************************************/
+unsigned int SIMNODE::HandleSDO
+  (
+  const UNSIGNED8 *Request,                                // 8 bytes of the request
+  UNSIGNED8 (*Responses)[8]                                // location for SIMNODE_MAX_RESPONSES responses
+  )
+{
+  UNSIGNED8 *Response = Responses[0];
+  UNSIGNED8 Command = Request[0];
+  unsigned long Length;
+  UNSIGNED32 Code;
+
+  memset(Response, 0, 8);
+
+  // aborts end any transfer and are not confirmed
+  if (Command == 0x80)
+  {
+    SdoState = SIMSDO_IDLE;
+    return 0;
+  }
+
+  // segments of a block download carry a sequence number only
+  if (SdoState == SIMSDO_BLKDOWNLOAD)
+  {
+    return ReceiveBlockSegment(Request, Response);
+  }
+
+  // requests that start a transfer carry index and subindex, any
+  // previous transfer is dropped
+  if (((Command >> 5) == CS_DOWNLOAD_INIT) || ((Command >> 5) == CS_UPLOAD_INIT) ||
+      (((Command >> 5) == CS_BLOCK_UPLOAD) && ((Command & 0x03) == 0)) ||
+      (((Command >> 5) == CS_BLOCK_DOWNLOAD) && ((Command & 0x01) == 0)))
+  {
+    SdoIndex = GET_U16(&Request[1]);
+    SdoSubindex = Request[3];
+    SdoState = SIMSDO_IDLE;
+  }
+
+  switch (Command >> 5)
+  {
+    case CS_DOWNLOAD_INIT:
+      if (Command & 0x02)
+      { // expedited, size in bits 2 and 3 if indicated
+        Length = (Command & 0x01) ? 4 - ((Command >> 2) & 0x03) : 4;
+        Code = Write(SdoIndex, SdoSubindex, Length, &Request[4], TRUE);
+        if (Code != 0) return Abort(Response, Code);
+        SdoState = SIMSDO_IDLE;
+      }
+      else
+      {
+        SdoSizeIndicated = Command & 0x01;
+        SdoLength = SdoSizeIndicated ? (unsigned long)GET_U32(&Request[4]) : 0;
+        Code = StartDownload();
+        if (Code != 0) return Abort(Response, Code);
+        SdoPos = 0;
+        SdoToggle = 0;
+        SdoState = SIMSDO_DOWNLOAD;
+      }
+      Response[0] = 0x60;
+      STORE_U16(SdoIndex, &Response[1]);
+      Response[3] = SdoSubindex;
+      return 1;
+
+    case CS_DOWNLOAD_SEGMENT:
+      if (SdoState != SIMSDO_DOWNLOAD) return Abort(Response, SDO_ABORT_UNKNOWN_COMMAND);
+      if ((Command & 0x10) != SdoToggle) return Abort(Response, SDO_ABORT_TOGGLE);
+      Length = 7 - ((Command >> 1) & 0x07);
+      if (SdoPos + Length > SdoLength) return Abort(Response, SDO_ABORT_DATATOBIG);
+      memcpy(&SdoData[SdoPos], &Request[1], Length);
+      SdoPos += Length;
+      Response[0] = 0x20 | SdoToggle;
+      SdoToggle ^= 0x10;
+      if (Command & 0x01)
+      { // last segment
+        if (SdoSizeIndicated && (SdoPos != SdoLength)) return Abort(Response, SDO_ABORT_TYPEMISMATCH);
+        Code = Write(SdoIndex, SdoSubindex, SdoPos, SdoData, TRUE);
+        if (Code != 0) return Abort(Response, Code);
+        SdoState = SIMSDO_IDLE;
+      }
+      return 1;
+
+    case CS_UPLOAD_INIT:
+      return StartUpload(Request, Response, FALSE);
+
+    case CS_UPLOAD_SEGMENT:
+      if (SdoState != SIMSDO_UPLOAD) return Abort(Response, SDO_ABORT_UNKNOWN_COMMAND);
+      if ((Command & 0x10) != SdoToggle) return Abort(Response, SDO_ABORT_TOGGLE);
+      Length = SdoLength - SdoPos;
+      if (Length > 7) Length = 7;
+      Response[0] = SdoToggle | (UNSIGNED8)((7 - Length) << 1);
+      memcpy(&Response[1], &SdoBuffer[SdoPos], Length);
+      SdoPos += Length;
+      SdoToggle ^= 0x10;
+      if (SdoPos == SdoLength)
+      {
+        Response[0] |= 0x01;
+        SdoState = SIMSDO_IDLE;
+      }
+      return 1;
+
+    case CS_BLOCK_UPLOAD:
+      switch (Command & 0x03)
+      {
+        case 0: // initiate
+          return StartUpload(Request, Response, TRUE);
+
+        case 3: // start
+          if (SdoState != SIMSDO_BLKUPINIT) return Abort(Response, SDO_ABORT_UNKNOWN_COMMAND);
+          return SendBlock(Responses);
+
+        case 2: // block confirmed, repeat segments not acknowledged
+          if (SdoState != SIMSDO_BLKUPLOAD) return Abort(Response, SDO_ABORT_UNKNOWN_COMMAND);
+          if (Request[1] > SdoSequence) return Abort(Response, SDO_ABORT_INVALID_SEQ);
+          if ((Request[2] == 0) || (Request[2] > SIMNODE_BLOCK_SIZE)) return Abort(Response, SDO_ABORT_BLOCKSIZE);
+          SdoPos = SdoBlockStart + 7 * (unsigned long)Request[1];
+          if (SdoPos > SdoLength) SdoPos = SdoLength;
+          SdoBlockSize = Request[2];
+          if ((SdoPos < SdoLength) || ((SdoLength == 0) && (Request[1] == 0)))
+          {
+            return SendBlock(Responses);
+          }
+          Response[0] = (SCS_BLOCK_UPLOAD << 5) | (SdoUnused << 2) | 0x01;
+          SdoState = SIMSDO_BLKUPEND;
+          return 1;
+
+        case 1: // end confirmed
+          if (SdoState != SIMSDO_BLKUPEND) return Abort(Response, SDO_ABORT_UNKNOWN_COMMAND);
+          SdoState = SIMSDO_IDLE;
+          return 0;
+      }
+      break;
+
+    case CS_BLOCK_DOWNLOAD:
+      if ((Command & 0x01) == 0)
+      { // initiate
+        SdoSizeIndicated = (Command & 0x02) ? 1 : 0;
+        SdoLength = SdoSizeIndicated ? (unsigned long)GET_U32(&Request[4]) : 0;
+        Code = StartDownload();
+        if (Code != 0) return Abort(Response, Code);
+        Response[0] = SCS_BLOCK_DOWNLOAD << 5; // no CRC
+        STORE_U16(SdoIndex, &Response[1]);
+        Response[3] = SdoSubindex;
+        Response[4] = SIMNODE_BLOCK_SIZE;
+        SdoPos = 0;
+        SdoSequence = 0;
+        SdoState = SIMSDO_BLKDOWNLOAD;
+        return 1;
+      }
+      // end, bytes without data in last segment in bits 2 to 4
+      if (SdoState != SIMSDO_BLKDOWNEND) return Abort(Response, SDO_ABORT_UNKNOWN_COMMAND);
+      Length = (Command >> 2) & 0x07;
+      if (Length > SdoPos) return Abort(Response, SDO_ABORT_TYPEMISMATCH);
+      SdoPos -= Length;
+      if (SdoSizeIndicated && (SdoPos != SdoLength)) return Abort(Response, SDO_ABORT_TYPEMISMATCH);
+      Code = Write(SdoIndex, SdoSubindex, SdoPos, SdoData, TRUE);
+      if (Code != 0) return Abort(Response, Code);
+      Response[0] = (SCS_BLOCK_DOWNLOAD << 5) | 0x01;
+      SdoState = SIMSDO_IDLE;
+      return 1;
+  }
+
+  return Abort(Response, SDO_ABORT_UNKNOWN_COMMAND);
+}
+
+/*----------------------- END OF FILE ----------------------------------*/
@@ -0,0 +1,204 @@
+/**************************************************************************
+MODULE:    SimNode
+CONTAINS:  Simulated CANopen node, an object dictionary with values built
+           from an EDS and an SDO server supporting expedited, segmented
+           and block transfers. Optionally the program download of a
+           bootloader as in CiA 302-3.
+COPYRIGHT: Embedded Systems Academy, Inc. 2008-2017.
+DISCLAIM:  Read and understand our disclaimer before using this code!
+           www.esacademy.com/disclaim.htm
+           This software was written in accordance to the guidelines at
+           www.esacademy.com/software/softwarestyleguide.pdf
+LICENSE:   Free to use with licensed CANopenIA chips, modules or devices
+           like CANgineBerry, CANgineXXX and 447izer
+VERSION:   1.10, EmSA 10-NOV-17
+           $LastChangedDate: 2014-01-11 17:30:59 +0100 (Sa, 11 Jan 2014) $
+           $LastChangedRevision: 1702 $
+***************************************************************************/
+#pragma once
+
+#ifndef _SIMNODE_H
+#define _SIMNODE_H
+
+#include "global.h"
+#include "EDS.h"
+
+/**************************************************************************
+GLOBAL DEFINES
+***************************************************************************/
+
+// storage for each string and domain entry in bytes
+#define SIMNODE_DOMAIN_SIZE 1024
+
+// segments per block accepted by the SDO server
+#define SIMNODE_BLOCK_SIZE 127
+
+// max number of responses to a single SDO request, a complete block
+#define SIMNODE_MAX_RESPONSES SIMNODE_BLOCK_SIZE
+
+// programs of the program download, subindexes 1 up to this of [1F50h],
+// [1F51h], [1F56h] and [1F57h]
+#define SIMNODE_PROGRAMS 2
+
+// program control commands [1F51h]
+#define SIMPROG_STOP  0
+#define SIMPROG_START 1
+#define SIMPROG_RESET 2
+#define SIMPROG_CLEAR 3
+
+// flash status [1F57h]
+#define SIMPROG_STATUS_OK      0x00000000UL
+#define SIMPROG_STATUS_BUSY    0x00000001UL // program data being received
+#define SIMPROG_STATUS_NODATA  0x00000006UL // no valid program
+
+// SDO server states
+#define SIMSDO_IDLE        0
+#define SIMSDO_UPLOAD      1 // segmented upload, waiting for segment request
+#define SIMSDO_DOWNLOAD    2 // segmented download, waiting for segment
+#define SIMSDO_BLKUPINIT   3 // block upload, waiting for start
+#define SIMSDO_BLKUPLOAD   4 // block upload, waiting for block confirmation
+#define SIMSDO_BLKUPEND    5 // block upload, waiting for end confirmation
+#define SIMSDO_BLKDOWNLOAD 6 // block download, receiving segments
+#define SIMSDO_BLKDOWNEND  7 // block download, waiting for end
+
+/**************************************************************************
+GLOBAL TYPES AND FUNCTIONS
+***************************************************************************/
+
+class SIMNODE
+{
+  public:
+    /**************************************************************************
+    DOES:    Constructor - creates a node without object dictionary
+    **************************************************************************/
+    SIMNODE(void);
+    /**************************************************************************
+    DOES:    Destructor - releases the values
+    **************************************************************************/
+    ~SIMNODE(void);
+    /**************************************************************************
+    DOES:    Initializes all values from the defaults of an object
+             dictionary. The dictionary must stay valid while the node is
+             used and may be shared by several nodes.
+    RETURNS: TRUE for success, FALSE for error
+    **************************************************************************/
+    bool Init(
+      const EDS *Dictionary,      // object dictionary of the node
+      UNSIGNED8 NodeID            // node id, used for $NODEID defaults
+      );
+    /**************************************************************************
+    DOES:    Restores the default values, either of all entries or of the
+             communication entries 1000h to 1FFFh only
+    RETURNS: Nothing
+    **************************************************************************/
+    void Reset(bool Communication);
+    /**************************************************************************
+    DOES:    Gets the current value of an entry without access checks
+    RETURNS: 0 for success, else SDO abort code
+    **************************************************************************/
+    UNSIGNED32 Read(
+      UNSIGNED16 Index,           // index of od entry
+      UNSIGNED8 Subindex,         // subindex of od entry
+      unsigned long *Length,      // location to store length of value
+      const UNSIGNED8 **Data      // location to store pointer to value
+      ) const;
+    /**************************************************************************
+    DOES:    Sets the value of an entry. With checks the access type, the
+             length and the limits are verified as a device would for an
+             SDO write, without checks only const entries are refused.
+    RETURNS: 0 for success, else SDO abort code
+    **************************************************************************/
+    UNSIGNED32 Write(
+      UNSIGNED16 Index,           // index of od entry
+      UNSIGNED8 Subindex,         // subindex of od entry
+      unsigned long Length,       // length of data
+      const UNSIGNED8 *Data,      // data to write
+      bool Check                  // TRUE to check like an SDO write
+      );
+    /**************************************************************************
+    DOES:    Checks whether an SDO may read or write an entry, including
+             the entries of the program download
+    RETURNS: 0 if allowed, else SDO abort code
+    **************************************************************************/
+    UNSIGNED32 CheckAccess(
+      UNSIGNED16 Index,           // index of od entry
+      UNSIGNED8 Subindex,         // subindex of od entry
+      unsigned long Length,       // length of data written, 0 for reads
+      bool Write                  // TRUE to check for writing
+      ) const;
+    /**************************************************************************
+    DOES:    Adds the program download of a bootloader, whether in the
+             object dictionary or not: program data [1F50h] is taken after
+             the program was cleared through program control [1F51h].
+             Software identification [1F56h] is the CRC of the program data
+             as calculated by class CRC, as the simulator chooses it,
+             [1F57h] the flash status.
+    RETURNS: TRUE for success, FALSE for error
+    **************************************************************************/
+    bool EnableProgramDownload(
+      unsigned long Capacity      // max bytes of each program
+      );
+    /**************************************************************************
+    DOES:    Handles an SDO request received by the SDO server of the node
+    RETURNS: Number of 8 byte responses stored, up to SIMNODE_MAX_RESPONSES
+    **************************************************************************/
+    unsigned int HandleSDO(
+      const UNSIGNED8 *Request,   // 8 bytes of the request
+      UNSIGNED8 (*Responses)[8]   // location for SIMNODE_MAX_RESPONSES responses
+      );
+    /**************************************************************************
+    DOES:    Gets the node id and object dictionary
+    RETURNS: Node id / object dictionary
+    **************************************************************************/
+    UNSIGNED8 GetNodeID(void) const { return NodeID; }
+    const EDS *GetDictionary(void) const { return Dictionary; }
+
+  private:
+    void SetDefault(unsigned long Position);
+    UNSIGNED32 CheckLimits(const EDS_ENTRY *Entry, unsigned long Length, const UNSIGNED8 *Data) const;
+    unsigned int Abort(UNSIGNED8 *Response, UNSIGNED32 Code);
+    unsigned int StartUpload(const UNSIGNED8 *Request, UNSIGNED8 *Response, bool Block);
+    unsigned int SendBlock(UNSIGNED8 (*Responses)[8]);
+    unsigned int ReceiveBlockSegment(const UNSIGNED8 *Request, UNSIGNED8 *Response);
+    UNSIGNED32 StartDownload(void);
+    bool IsProgramEntry(UNSIGNED16 Index) const;
+    UNSIGNED32 ReadProgram(UNSIGNED16 Index, UNSIGNED8 Subindex, unsigned long *Length, const UNSIGNED8 **Data) const;
+    UNSIGNED32 WriteProgram(UNSIGNED16 Index, UNSIGNED8 Subindex, unsigned long Length, const UNSIGNED8 *Data);
+
+    const EDS *Dictionary;
+    UNSIGNED8 NodeID;
+    UNSIGNED8 *Values;                        // values of all entries
+    unsigned long *Offsets;                   // offset of value, per entry
+    UNSIGNED16 *Lengths;                      // current length of value, per entry
+
+    // SDO server
+    UNSIGNED8 SdoState;                       // SIMSDO_xxx
+    UNSIGNED16 SdoIndex;
+    UNSIGNED8 SdoSubindex;
+    UNSIGNED8 SdoToggle;                      // segmented transfers
+    UNSIGNED8 SdoSizeIndicated;               // downloads
+    UNSIGNED8 SdoSequence;                    // block transfers, last segment sent or received
+    UNSIGNED8 SdoBlockSize;                   // block uploads, segments per block
+    UNSIGNED8 SdoUnused;                      // block uploads, bytes without data in last segment
+    unsigned long SdoLength;                  // total length of data
+    unsigned long SdoPos;                     // bytes transferred
+    unsigned long SdoBlockStart;              // block uploads, first byte of current block
+    UNSIGNED8 SdoBuffer[SIMNODE_DOMAIN_SIZE + 7];
+    UNSIGNED8 *SdoData;                       // downloads, SdoBuffer or program memory
+    unsigned long SdoCapacity;                // downloads, max length of data
+
+    // program download, NULL if not enabled. Memory has 7 bytes more for
+    // the last segment of block downloads.
+    UNSIGNED8 *Programs[SIMNODE_PROGRAMS];
+    unsigned long ProgramCapacity;
+    unsigned long ProgramLength[SIMNODE_PROGRAMS];
+    UNSIGNED8 ProgramControl[SIMNODE_PROGRAMS];    // last SIMPROG_xxx command
+    bool ProgramCleared[SIMNODE_PROGRAMS];         // program data may be written
+    UNSIGNED32 ProgramIdent[SIMNODE_PROGRAMS];
+    UNSIGNED32 FlashStatus[SIMNODE_PROGRAMS];      // SIMPROG_STATUS_xxx
+    mutable UNSIGNED8 ProgramValue[4];             // value read last
+};
+
+#endif // _SIMNODE_H
+
+/*----------------------- END OF FILE ----------------------------------*/
@@ -0,0 +1,144 @@
+/**************************************************************************
+MODULE:    Statistics
+CONTAINS:  Counters and latency histograms of the protocol stack
+COPYRIGHT: Embedded Systems Academy, Inc. 2008-2017.
+DISCLAIM:  Read and understand our disclaimer before using this code!
+           www.esacademy.com/disclaim.htm
+           This software was written in accordance to the guidelines at
+           www.esacademy.com/software/softwarestyleguide.pdf
+LICENSE:   Free to use with licensed CANopenIA chips, modules or devices
+           like CANgineBerry, CANgineXXX and 447izer
+VERSION:   1.10, EmSA 10-NOV-17
+           $LastChangedDate: 2014-01-11 17:30:59 +0100 (Sa, 11 Jan 2014) $
+           $LastChangedRevision: 1702 $
+***************************************************************************/
+
+#include "Statistics.h"
+
+
+/**************************************************************************
+DOES:    Raises a counter holding a maximum to a new value
+RETURNS: Nothing
+**************************************************************************/
+void STATS_Max
+  (
+  STATS_COUNTER *Counter,                                  // maximum
+  uint64_t Value                                           // new value
+  )
+{
+  uint64_t Current = Counter->load(std::memory_order_relaxed);
+
+  // retry if another thread changed the maximum in between
+  while ((Value > Current) && !Counter->compare_exchange_weak(Current, Value, std::memory_order_relaxed))
+  {
+  }
+}
+
+
+/**************************************************************************
+DOES:    Constructor - creates an empty histogram
+**************************************************************************/
+STATS_HISTOGRAM::STATS_HISTOGRAM
+  (
+  void
+  )
+{
+  Reset();
+}
+
+
+/**************************************************************************
+DOES:    Counts a latency
+RETURNS: Nothing
+**************************************************************************/
+void STATS_HISTOGRAM::Add
+  (
+  uint64_t Microseconds                                    // latency
+  )
+{
+  uint64_t Value = Microseconds;
+  unsigned int Bucket = 0;
+
+  // the bucket is the number of significant bits
+  while (Value && (Bucket < STATS_BUCKETS - 1))
+  {
+    Value >>= 1;
+    Bucket++;
+  }
+
+  STATS_Add(&Buckets[Bucket], 1);
+  STATS_Add(&Sum, Microseconds);
+  STATS_Max(&Max, Microseconds);
+  STATS_Add(&Count, 1);
+}
+
+
+/**************************************************************************
+DOES:    Empties the histogram
+RETURNS: Nothing
+**************************************************************************/
+void STATS_HISTOGRAM::Reset
+  (
+  void
+  )
+{
+  unsigned int Bucket;
+
+  for (Bucket = 0; Bucket < STATS_BUCKETS; Bucket++) STATS_Set(&Buckets[Bucket], 0);
+  STATS_Set(&Count, 0);
+  STATS_Set(&Sum, 0);
+  STATS_Set(&Max, 0);
+}
+
+
+/**************************************************************************
+DOES:    Gets the average latency
+RETURNS: Latency in microseconds, 0 if nothing was counted
+**************************************************************************/
+uint64_t STATS_HISTOGRAM::GetMean
+  (
+  void
+  ) const
+{
+  uint64_t Latencies = GetCount();
+
+  return Latencies ? STATS_Get(&Sum) / Latencies : 0;
+}
+
+
+/**************************************************************************
+DOES:    Gets a percentile of the latencies by the nearest rank method,
+         exact to the bucket
+RETURNS: Upper limit of the bucket in microseconds, 0 if nothing was
+         counted
+**************************************************************************/
+uint64_t STATS_HISTOGRAM::GetPercentile
+  (
+  unsigned long PerMille                                   // percentile * 10, e.g. 999
+  ) const
+{
+  uint64_t Latencies = 0;
+  uint64_t Rank;
+  uint64_t Limit;
+  unsigned int Bucket;
+
+  // the buckets are read one by one, so sum them up instead of using
+  // Count which may already include later latencies
+  for (Bucket = 0; Bucket < STATS_BUCKETS; Bucket++) Latencies += GetBucket(Bucket);
+  if (Latencies == 0) return 0;
+
+  Rank = (Latencies * PerMille + 999) / 1000;
+  if (Rank == 0) Rank = 1;
+  for (Bucket = 0; Bucket < STATS_BUCKETS - 1; Bucket++)
+  {
+    if (GetBucket(Bucket) >= Rank) break;
+    Rank -= GetBucket(Bucket);
+  }
+
+  // the longest latency is a closer limit for the last buckets
+  Limit = Bucket ? ((uint64_t)1 << Bucket) - 1 : 0;
+  if ((Bucket == STATS_BUCKETS - 1) || (Limit > GetMax())) Limit = GetMax();
+  return Limit;
+}
+
+/*----------------------- END OF FILE ----------------------------------*/
@@ -0,0 +1,142 @@
+/**************************************************************************
+MODULE:    Statistics
+CONTAINS:  Counters and latency histograms of the protocol stack. They are
+           updated by the thread running the protocol and can be read by
+           other threads at any time without locks.
+COPYRIGHT: Embedded Systems Academy, Inc. 2008-2017.
+DISCLAIM:  Read and understand our disclaimer before using this code!
+           www.esacademy.com/disclaim.htm
+           This software was written in accordance to the guidelines at
+           www.esacademy.com/software/softwarestyleguide.pdf
+LICENSE:   Free to use with licensed CANopenIA chips, modules or devices
+           like CANgineBerry, CANgineXXX and 447izer
+VERSION:   1.10, EmSA 10-NOV-17
+           $LastChangedDate: 2014-01-11 17:30:59 +0100 (Sa, 11 Jan 2014) $
+           $LastChangedRevision: 1702 $
+***************************************************************************/
+#pragma once
+
+#ifndef _STATISTICS_H
+#define _STATISTICS_H
+
+#include <stdint.h>
+#include <atomic>
+#include "global.h"
+
+/**************************************************************************
+GLOBAL DEFINES
+***************************************************************************/
+
+// buckets of a latency histogram. Bucket 0 counts latencies below 1us,
+// bucket b counts latencies from 2^(b-1) to 2^b - 1 us, the last bucket
+// counts all longer latencies.
+#define STATS_BUCKETS 32
+
+/**************************************************************************
+GLOBAL TYPES AND FUNCTIONS
+***************************************************************************/
+
+// counter without locks, a reader sees each counter consistent but not
+// all counters of a structure at the same instant
+typedef std::atomic<uint64_t> STATS_COUNTER;
+
+/**************************************************************************
+DOES:    Adds to a counter
+RETURNS: Nothing
+**************************************************************************/
+inline void STATS_Add(STATS_COUNTER *Counter, uint64_t Value)
+{
+  Counter->fetch_add(Value, std::memory_order_relaxed);
+}
+
+/**************************************************************************
+DOES:    Subtracts from a counter holding a current value, e.g. active
+         transfers
+RETURNS: Nothing
+**************************************************************************/
+inline void STATS_Subtract(STATS_COUNTER *Counter, uint64_t Value)
+{
+  Counter->fetch_sub(Value, std::memory_order_relaxed);
+}
+
+/**************************************************************************
+DOES:    Reads a counter
+RETURNS: Value of counter
+**************************************************************************/
+inline uint64_t STATS_Get(const STATS_COUNTER *Counter)
+{
+  return Counter->load(std::memory_order_relaxed);
+}
+
+/**************************************************************************
+DOES:    Sets a counter, e.g. to 0 for a reset
+RETURNS: Nothing
+**************************************************************************/
+inline void STATS_Set(STATS_COUNTER *Counter, uint64_t Value)
+{
+  Counter->store(Value, std::memory_order_relaxed);
+}
+
+/**************************************************************************
+DOES:    Raises a counter holding a maximum to a new value
+RETURNS: Nothing
+**************************************************************************/
+void STATS_Max(STATS_COUNTER *Counter, uint64_t Value);
+
+// distribution of the latency of a request type
+class STATS_HISTOGRAM
+{
+  public:
+    /**************************************************************************
+    DOES:    Constructor - creates an empty histogram
+    **************************************************************************/
+    STATS_HISTOGRAM(void);
+    /**************************************************************************
+    DOES:    Counts a latency
+    RETURNS: Nothing
+    **************************************************************************/
+    void Add(uint64_t Microseconds);
+    /**************************************************************************
+    DOES:    Empties the histogram
+    RETURNS: Nothing
+    **************************************************************************/
+    void Reset(void);
+    /**************************************************************************
+    DOES:    Gets the number of latencies counted
+    RETURNS: Number of latencies
+    **************************************************************************/
+    uint64_t GetCount(void) const { return STATS_Get(&Count); }
+    /**************************************************************************
+    DOES:    Gets the number of latencies in a bucket
+    RETURNS: Number of latencies
+    **************************************************************************/
+    uint64_t GetBucket(unsigned int Bucket) const { return STATS_Get(&Buckets[Bucket]); }
+    /**************************************************************************
+    DOES:    Gets the longest latency
+    RETURNS: Latency in microseconds
+    **************************************************************************/
+    uint64_t GetMax(void) const { return STATS_Get(&Max); }
+    /**************************************************************************
+    DOES:    Gets the average latency
+    RETURNS: Latency in microseconds, 0 if nothing was counted
+    **************************************************************************/
+    uint64_t GetMean(void) const;
+    /**************************************************************************
+    DOES:    Gets a percentile of the latencies, exact to the bucket
+    RETURNS: Upper limit of the bucket in microseconds, 0 if nothing was
+             counted
+    **************************************************************************/
+    uint64_t GetPercentile(
+      unsigned long PerMille      // percentile * 10, e.g. 999
+      ) const;
+
+  private:
+    STATS_COUNTER Buckets[STATS_BUCKETS];
+    STATS_COUNTER Count;
+    STATS_COUNTER Sum;                        // microseconds
+    STATS_COUNTER Max;                        // microseconds
+};
+
+#endif // _STATISTICS_H
+
+/*----------------------- END OF FILE ----------------------------------*/
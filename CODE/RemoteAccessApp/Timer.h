@@ -3,6 +3,7 @@
 #ifndef _TIMER_H
 #define _TIMER_H
 
+#include <stdint.h>
 #include "global.h"
 
 class Timer
@@ -27,6 +28,12 @@ class Timer
     UNSIGNED8 IsTimeExpired(UNSIGNED16 timestamp);
 
     static void Sleep(unsigned long milliseconds);
+    /**************************************************************************
+    DOES:    Reads a monotonic microsecond clock that is not affected by
+             changes of the system time
+    RETURNS: Microseconds since an arbitrary starting point
+    **************************************************************************/
+    static uint64_t GetMicroseconds(void);
 
   private:
 #ifdef WIN32
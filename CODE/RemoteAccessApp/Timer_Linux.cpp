@@ -41,6 +41,21 @@ void Timer::Sleep
   nanosleep(&timeOut, &remains);
 }
 
+/**************************************************************************
+DOES:    Reads a monotonic microsecond clock that is not affected by
+         changes of the system time
+RETURNS: Microseconds since an arbitrary starting point
+**************************************************************************/
+uint64_t Timer::GetMicroseconds (
+  void
+  )
+{
+  struct timespec ts;
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0) return 0;
+
+  return ((uint64_t)ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+}
+
 /**************************************************************************
 DOES:    This function reads a 1 millisecond timer tick. The timer tick
          must be a UNSIGNED16 and must be incremented once per millisecond.
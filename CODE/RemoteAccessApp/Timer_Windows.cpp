@@ -46,6 +46,26 @@ void Timer::Sleep
   ::Sleep(milliseconds);
 }
 
+/**************************************************************************
+DOES:    Reads a monotonic microsecond clock that is not affected by
+         changes of the system time
+RETURNS: Microseconds since an arbitrary starting point
+**************************************************************************/
+uint64_t Timer::GetMicroseconds (
+  void
+  )
+{
+  static LARGE_INTEGER Frequency;
+  LARGE_INTEGER Counter;
+
+  if (Frequency.QuadPart == 0) QueryPerformanceFrequency(&Frequency);
+  QueryPerformanceCounter(&Counter);
+
+  // split to avoid overflowing 64 bits with high counter frequencies
+  return ((uint64_t)(Counter.QuadPart / Frequency.QuadPart) * 1000000) +
+         ((uint64_t)(Counter.QuadPart % Frequency.QuadPart) * 1000000 / Frequency.QuadPart);
+}
+
 /**************************************************************************
 DOES:    This function reads a 1 millisecond timer tick. The timer tick
          must be a UNSIGNED16 and must be incremented once per millisecond.
@@ -0,0 +1,292 @@
+/**************************************************************************
+MODULE:    Tracer
+CONTAINS:  Capture of the frames exchanged with a CANopenIA device
+COPYRIGHT: Embedded Systems Academy, Inc. 2008-2017.
+DISCLAIM:  Read and understand our disclaimer before using this code!
+           www.esacademy.com/disclaim.htm
+           This software was written in accordance to the guidelines at
+           www.esacademy.com/software/softwarestyleguide.pdf
+LICENSE:   Free to use with licensed CANopenIA chips, modules or devices
+           like CANgineBerry, CANgineXXX and 447izer
+VERSION:   1.10, EmSA 10-NOV-17
+           $LastChangedDate: 2014-01-11 17:30:59 +0100 (Sa, 11 Jan 2014) $
+           $LastChangedRevision: 1702 $
+***************************************************************************/
+
+#include <string.h>
+#include "Tracer.h"
+#include "Timer.h"
+
+/**************************************************************************
+LOCAL DEFINES
+***************************************************************************/
+
+// milliseconds the writer thread waits between two looks at the ring
+#define WRITER_INTERVAL 10
+
+// buffer of the trace file
+#define FILE_BUFFER_SIZE 65536
+
+
+/**************************************************************************
+DOES:    Constructor - creates a tracer without a file
+**************************************************************************/
+TRACER::TRACER
+  (
+  void
+  )
+{
+  Ring = new TRACE_RECORD[TRACE_RING_SIZE];
+  Head = 0;
+  Tail = 0;
+  Lost = 0;
+  GapLost = 0;
+  GapTime = 0;
+  PendingLength = 0;
+  File = NULL;
+  StopRequested = FALSE;
+}
+
+
+/**************************************************************************
+DOES:    Destructor - writes the remaining records and closes the file
+**************************************************************************/
+TRACER::~TRACER
+  (
+  void
+  )
+{
+  Close();
+  delete[] Ring;
+}
+
+
+/**************************************************************************
+DOES:    Creates the trace file and starts the thread writing to it
+RETURNS: TRUE for success, FALSE for error
+**************************************************************************/
+bool TRACER::Open
+  (
+  const char *FileName                                     // trace file to create
+  )
+{
+  Close();
+
+  File = fopen(FileName, "wb");
+  if (File == NULL)
+  {
+    fprintf(stderr, "ERROR: can not create %s\n", FileName);
+    return FALSE;
+  }
+  setvbuf(File, NULL, _IOFBF, FILE_BUFFER_SIZE);
+  fwrite(TRACE_MAGIC, 1, TRACE_MAGIC_LENGTH, File);
+
+  StopRequested = FALSE;
+  Writer = std::thread(&TRACER::Run, this);
+  return TRUE;
+}
+
+
+/**************************************************************************
+DOES:    Stops the thread, writes the remaining records and closes the
+         file
+RETURNS: Nothing
+**************************************************************************/
+void TRACER::Close
+  (
+  void
+  )
+{
+  TRACE_RECORD Gap;
+
+  if (File == NULL) return;
+
+  StopRequested = TRUE;
+  if (Writer.joinable()) Writer.join();
+  if (PendingLength) EndReceived(TRACE_FLAG_NONE);
+  Drain();
+  // records lost after the last one added
+  if (GapLost)
+  {
+    FillGap(&Gap);
+    WriteRecord(&Gap);
+  }
+  fclose(File);
+  File = NULL;
+}
+
+
+/**************************************************************************
+DOES:    Adds a record to the ring. Records are lost if the ring is full,
+         the protocol never waits for the file. The records lost are noted
+         before the next record added, so the file stays in the order of
+         capture.
+RETURNS: Nothing
+**************************************************************************/
+void TRACER::Add
+  (
+  UNSIGNED8 Type,                                          // TRACE_TX or TRACE_RX
+  UNSIGNED8 Flags,                                         // TRACE_FLAG_xxx
+  const unsigned char *Data,                               // data of record
+  unsigned long Length                                     // length of data, up to TRACE_MAX_DATA
+  )
+{
+  unsigned long Position = Head.load(std::memory_order_relaxed);
+  unsigned long Needed = GapLost ? 2 : 1;
+  TRACE_RECORD *Record;
+
+  if (Position - Tail.load(std::memory_order_acquire) + Needed > TRACE_RING_SIZE)
+  {
+    if (GapLost == 0) GapTime = Timer::GetMicroseconds();
+    GapLost++;
+    Lost.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  if (GapLost) FillGap(&Ring[(Position++) & (TRACE_RING_SIZE - 1)]);
+
+  Record = &Ring[Position & (TRACE_RING_SIZE - 1)];
+  Record->Time = Timer::GetMicroseconds();
+  Record->Type = Type;
+  Record->Flags = Flags;
+  Record->Length = (UNSIGNED16)Length;
+  memcpy(Record->Data, Data, Length);
+
+  // the record becomes visible to the writer with the new head
+  Head.store(Position + 1, std::memory_order_release);
+}
+
+
+/**************************************************************************
+DOES:    Fills a TRACE_LOST record with the records lost since the last one
+RETURNS: Nothing
+**************************************************************************/
+void TRACER::FillGap
+  (
+  TRACE_RECORD *Record                                     // record to fill
+  )
+{
+  Record->Time = GapTime;
+  Record->Type = TRACE_LOST;
+  Record->Flags = TRACE_FLAG_NONE;
+  Record->Length = 4;
+  Record->Data[0] = (UNSIGNED8)GapLost;
+  Record->Data[1] = (UNSIGNED8)(GapLost >> 8);
+  Record->Data[2] = (UNSIGNED8)(GapLost >> 16);
+  Record->Data[3] = (UNSIGNED8)(GapLost >> 24);
+  GapLost = 0;
+}
+
+
+/**************************************************************************
+DOES:    Adds a frame sent to the device
+RETURNS: Nothing
+**************************************************************************/
+void TRACER::Transmitted
+  (
+  const unsigned char *Frame,                              // frame as sent
+  unsigned long Length                                     // length of frame
+  )
+{
+  if (File == NULL) return;
+  if (Length > TRACE_MAX_DATA) Length = TRACE_MAX_DATA;
+  Add(TRACE_TX, TRACE_FLAG_NONE, Frame, Length);
+}
+
+
+/**************************************************************************
+DOES:    Adds a byte received from the device. The bytes are collected
+         until the protocol ends the packet.
+RETURNS: Nothing
+**************************************************************************/
+void TRACER::Received
+  (
+  unsigned char Byte                                       // byte received
+  )
+{
+  if (File == NULL) return;
+  if (PendingLength == TRACE_MAX_DATA) EndReceived(TRACE_FLAG_NONE);
+  Pending[PendingLength++] = Byte;
+}
+
+
+/**************************************************************************
+DOES:    Adds the bytes received since the last packet as one record
+RETURNS: Nothing
+**************************************************************************/
+void TRACER::EndReceived
+  (
+  UNSIGNED8 Flags                                          // TRACE_FLAG_xxx
+  )
+{
+  if (File == NULL) return;
+  Add(TRACE_RX, Flags, Pending, PendingLength);
+  PendingLength = 0;
+}
+
+
+/**************************************************************************
+DOES:    Writes a record to the file, little endian
+RETURNS: Nothing
+**************************************************************************/
+void TRACER::WriteRecord
+  (
+  const TRACE_RECORD *Record                               // record to write
+  )
+{
+  unsigned char Header[TRACE_HEADER_LENGTH];
+  int b;
+
+  for (b = 0; b < 8; b++) Header[b] = (unsigned char)(Record->Time >> (8 * b));
+  Header[8] = Record->Type;
+  Header[9] = Record->Flags;
+  Header[10] = (unsigned char)Record->Length;
+  Header[11] = (unsigned char)(Record->Length >> 8);
+  fwrite(Header, 1, sizeof(Header), File);
+  fwrite(Record->Data, 1, Record->Length, File);
+}
+
+
+/**************************************************************************
+DOES:    Writes all records of the ring to the file
+RETURNS: Nothing
+**************************************************************************/
+void TRACER::Drain
+  (
+  void
+  )
+{
+  unsigned long Position = Tail.load(std::memory_order_relaxed);
+  unsigned long End = Head.load(std::memory_order_acquire);
+
+  while (Position != End)
+  {
+    WriteRecord(&Ring[Position & (TRACE_RING_SIZE - 1)]);
+    Position++;
+    // make the record free for the protocol
+    Tail.store(Position, std::memory_order_release);
+  }
+}
+
+
+/**************************************************************************
+DOES:    Writer thread, drains the ring until stopped
+RETURNS: Nothing
+**************************************************************************/
+void TRACER::Run
+  (
+  void
+  )
+{
+  while (!StopRequested)
+  {
+    Drain();
+    if (Head.load(std::memory_order_relaxed) == Tail.load(std::memory_order_relaxed))
+    {
+      fflush(File);
+      Timer::Sleep(WRITER_INTERVAL);
+    }
+  }
+}
+
+/*----------------------- END OF FILE ----------------------------------*/
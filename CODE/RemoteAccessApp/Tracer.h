@@ -0,0 +1,160 @@
+/**************************************************************************
+MODULE:    Tracer
+CONTAINS:  Capture of the frames exchanged with a CANopenIA device. The
+           protocol adds frames to a ring buffer without locks or I/O, a
+           thread writes them to a binary trace file that RA_Replay feeds
+           back through the protocol.
+           File format, all values little endian:
+             header  "COIATRC1"
+             record  8 bytes  monotonic time in microseconds
+                     1 byte   TRACE_TX, TRACE_RX or TRACE_LOST
+                     1 byte   TRACE_FLAG_xxx
+                     2 bytes  length of data
+                     data     frame bytes as sent or received, for
+                              TRACE_LOST the 4 byte number of records lost
+                              from the time of the record on
+COPYRIGHT: Embedded Systems Academy, Inc. 2008-2017.
+DISCLAIM:  Read and understand our disclaimer before using this code!
+           www.esacademy.com/disclaim.htm
+           This software was written in accordance to the guidelines at
+           www.esacademy.com/software/softwarestyleguide.pdf
+LICENSE:   Free to use with licensed CANopenIA chips, modules or devices
+           like CANgineBerry, CANgineXXX and 447izer
+VERSION:   1.10, EmSA 10-NOV-17
+           $LastChangedDate: 2014-01-11 17:30:59 +0100 (Sa, 11 Jan 2014) $
+           $LastChangedRevision: 1702 $
+***************************************************************************/
+#pragma once
+
+#ifndef _TRACER_H
+#define _TRACER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+#include "global.h"
+#include "SerialProtocol.h"
+
+/**************************************************************************
+GLOBAL DEFINES
+***************************************************************************/
+
+// start of a trace file
+#define TRACE_MAGIC        "COIATRC1"
+#define TRACE_MAGIC_LENGTH 8
+
+// bytes of a record before the data
+#define TRACE_HEADER_LENGTH 12
+
+// max data of a record, a frame of the largest packet. Received bytes
+// outside of packets are split into records of this size.
+#define TRACE_MAX_DATA (MAX_PACKET_LENGTH + 4)
+
+// records waiting to be written, power of 2
+#define TRACE_RING_SIZE 4096
+
+// record types
+#define TRACE_TX   0 // frame sent to the device
+#define TRACE_RX   1 // bytes received from the device
+#define TRACE_LOST 2 // records lost, the ring was full
+
+// flags of received bytes
+#define TRACE_FLAG_NONE    0x00 // bytes of a packet not yet complete
+#define TRACE_FLAG_PACKET  0x01 // ends with a complete packet
+#define TRACE_FLAG_ERROR   0x02 // packet dropped, wrong length, command or CRC
+#define TRACE_FLAG_TIMEOUT 0x04 // packet dropped, not completed in time
+
+/**************************************************************************
+GLOBAL TYPES AND FUNCTIONS
+***************************************************************************/
+
+// record of the trace
+typedef struct
+{
+  uint64_t Time;                              // monotonic time in microseconds
+  UNSIGNED8 Type;                             // TRACE_TX, TRACE_RX or TRACE_LOST
+  UNSIGNED8 Flags;                            // TRACE_FLAG_xxx
+  UNSIGNED16 Length;                          // length of data
+  UNSIGNED8 Data[TRACE_MAX_DATA];
+} TRACE_RECORD;
+
+class TRACER
+{
+  public:
+    /**************************************************************************
+    DOES:    Constructor - creates a tracer without a file
+    **************************************************************************/
+    TRACER(void);
+    /**************************************************************************
+    DOES:    Destructor - writes the remaining records and closes the file
+    **************************************************************************/
+    ~TRACER(void);
+    /**************************************************************************
+    DOES:    Creates the trace file and starts the thread writing to it
+    RETURNS: TRUE for success, FALSE for error
+    **************************************************************************/
+    bool Open(const char *FileName);
+    /**************************************************************************
+    DOES:    Stops the thread, writes the remaining records and closes the
+             file
+    RETURNS: Nothing
+    **************************************************************************/
+    void Close(void);
+    /**************************************************************************
+    DOES:    Adds a frame sent to the device. Must be called from the thread
+             running the protocol, never blocks.
+    RETURNS: Nothing
+    **************************************************************************/
+    void Transmitted(
+      const unsigned char *Frame, // frame as sent
+      unsigned long Length        // length of frame
+      );
+    /**************************************************************************
+    DOES:    Adds a byte received from the device. The bytes are collected
+             until the protocol ends the packet.
+    RETURNS: Nothing
+    **************************************************************************/
+    void Received(unsigned char Byte);
+    /**************************************************************************
+    DOES:    Adds the bytes received since the last packet as one record
+    RETURNS: Nothing
+    **************************************************************************/
+    void EndReceived(
+      UNSIGNED8 Flags             // TRACE_FLAG_xxx
+      );
+    /**************************************************************************
+    DOES:    Gets the number of records lost because the ring was full
+    RETURNS: Number of records
+    **************************************************************************/
+    unsigned long GetLost(void) const { return Lost.load(std::memory_order_relaxed); }
+
+  private:
+    void Add(UNSIGNED8 Type, UNSIGNED8 Flags, const unsigned char *Data, unsigned long Length);
+    void FillGap(TRACE_RECORD *Record);
+    void WriteRecord(const TRACE_RECORD *Record);
+    void Drain(void);
+    void Run(void);
+
+    // single producer, single consumer ring
+    TRACE_RECORD *Ring;
+    std::atomic<unsigned long> Head;          // next record to fill, by the protocol
+    std::atomic<unsigned long> Tail;          // next record to write, by the thread
+    std::atomic<unsigned long> Lost;
+
+    // records lost since the last TRACE_LOST record, by the protocol
+    unsigned long GapLost;
+    uint64_t GapTime;                         // time of the first one
+
+    // bytes received since the last packet
+    unsigned char Pending[TRACE_MAX_DATA];
+    unsigned long PendingLength;
+
+    FILE *File;
+    std::thread Writer;
+    std::atomic<bool> StopRequested;
+};
+
+#endif // _TRACER_H
+
+/*----------------------- END OF FILE ----------------------------------*/
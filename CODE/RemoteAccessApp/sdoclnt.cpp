@@ -17,14 +17,17 @@ VERSION:   1.10, EmSA 10-NOV-17
 #include <stdio.h>
 #include <string.h>
 
-// SDO client back-to-back transmit timeout in milliseconds
-#define SDO_BACK2BACK_TIMEOUT 3
 // Default SDO client timeout in milliseconds
 #define SDO_REQUEST_TIMEOUT 150
 
 // SDO block transfer max number of blocks (4 to 127)
 #define SDO_BLK_MAX_SIZE 127
 
+// SDO block download segments transmitted back-to-back by default, the
+// device queues them for the bus and the serial protocol writes them at
+// once. A segment the queue does not take is sent again later.
+#define SDO_BLK_BURST 16
+
 /**************************************************************************
 DOES:    Constructor - resets all SDO Client channels
 RETURNS: nothing
@@ -48,9 +51,91 @@ SDOCLNT::SDOCLNT (
   // store pointer to timer
   this->Tim = Tim;
 
+  // block download segments sent per back-to-back timeout
+  mBlockBurst = SDO_BLK_BURST;
+
   // store details of how to send
   this->SendCallback   = SendCallback;
   this->SenderInstance = SenderInstance;
+
+  // no transfers yet
+  for (mCurrentChannel = 0; mCurrentChannel < NR_OF_SDO_CLIENTS; mCurrentChannel++)
+  {
+    mStartTime[mCurrentChannel] = 0;
+  }
+  mActiveTransfers = 0;
+  STATS_Set(&mStats.Active, 0);
+  SDOCLNT_ResetStatistics();
+}
+
+
+/**************************************************************************
+Description in sdoclnt.h
+***************************************************************************/ 
+void SDOCLNT::SDOCLNT_SetBlockBurst (
+  UNSIGNED8 segments // segments sent back-to-back, 1 to SDO_BLK_MAX_SIZE
+  )
+{
+  if (segments < 1)
+  {
+    segments = 1;
+  }
+  if (segments > SDO_BLK_MAX_SIZE)
+  {
+    segments = SDO_BLK_MAX_SIZE;
+  }
+  mBlockBurst = segments;
+}
+
+
+/**************************************************************************
+Description in sdoclnt.h
+***************************************************************************/ 
+void SDOCLNT::SDOCLNT_ResetStatistics (
+  void
+  )
+{
+SDOCLNT_CHANNELSTATS *pStats;
+UNSIGNED8 loop;
+
+  for (loop = 0; loop <= NR_OF_SDO_CLIENTS; loop++)
+  {
+    pStats = &(mStats.Channels[loop]);
+    STATS_Set(&pStats->Requests, 0);
+    STATS_Set(&pStats->Completed, 0);
+    STATS_Set(&pStats->Bytes, 0);
+    STATS_Set(&pStats->Timeouts, 0);
+    STATS_Set(&pStats->AbortsReceived, 0);
+    STATS_Set(&pStats->AbortsSent, 0);
+    STATS_Set(&pStats->ToggleErrors, 0);
+    STATS_Set(&pStats->Errors, 0);
+  }
+  STATS_Set(&mStats.MaxActive, STATS_Get(&mStats.Active));
+  for (loop = 0; loop < SDOCLNT_STATS_TYPES; loop++)
+  {
+    mStats.Latency[loop].Reset();
+  }
+}
+
+
+/**************************************************************************
+DOES:    Counts a transfer that was started
+RETURNS: nothing
+**************************************************************************/
+void SDOCLNT::SDOCLNT_CountStart (
+  UNSIGNED8 channel, // SDO channel number in range of 1 to NR_OF_SDO_CLIENTS
+  UNSIGNED8 type // SDOCLNT_STATS_READ or SDOCLNT_STATS_WRITE
+  )
+{
+  STATS_Add(&(mStats.Channels[channel].Requests), 1);
+  if (mStartTime[channel-1] == 0)
+  { // not a restart of a transfer still running
+    mActiveTransfers++;
+    STATS_Add(&mStats.Active, 1);
+    STATS_Max(&mStats.MaxActive, STATS_Get(&mStats.Active));
+  }
+  mStartTime[channel-1] = Timer::GetMicroseconds();
+  mTransferType[channel-1] = type;
 }
 
 
@@ -103,6 +188,10 @@ UNSIGNED8 retval = FALSE;;
 
     // Transmit SDO Abort message
     retval = MCOHW_PushMessage(p_client->channel, &(p_client->sdomsg));
+    if (retval)
+    {
+      STATS_Add(&(mStats.Channels[p_client->channel].AbortsSent), 1);
+    }
   }
 
   return retval;
@@ -117,13 +206,38 @@ void SDOCLNT::SDOCLNT_SDOComplete (
   UNSIGNED32 abort_code // status, error, abort code
   )
 {
+SDOCLIENT *p_client = &(mSDOClientList[channel-1]);
+SDOCLNT_CHANNELSTATS *pStats = &(mStats.Channels[channel]);
+
   if (abort_code == SDOERR_OK)
   {
-    mSDOClientList[channel-1].last_abort = 0;
+    p_client->last_abort = 0;
+    STATS_Add(&pStats->Completed, 1);
+    if ((mStartTime[channel-1] != 0) && (mTransferType[channel-1] == SDOCLNT_STATS_WRITE))
+    { // writes do not count the bytes of expedited transfers
+      STATS_Add(&pStats->Bytes, p_client->buflen);
+    }
+    else
+    {
+      STATS_Add(&pStats->Bytes, p_client->curlen);
+    }
   }
   else
   {
-    mSDOClientList[channel-1].last_abort = abort_code;
+    p_client->last_abort = abort_code;
+    if (abort_code == SDOERR_TIMEOUT) STATS_Add(&pStats->Timeouts, 1);
+    else if (abort_code == SDOERR_ABORT) STATS_Add(&pStats->AbortsReceived, 1);
+    else if (abort_code == SDOERR_TOGGLE) STATS_Add(&pStats->ToggleErrors, 1);
+    else STATS_Add(&pStats->Errors, 1);
+  }
+
+  // measure the duration of the transfer
+  if (mStartTime[channel-1] != 0)
+  {
+    mStats.Latency[mTransferType[channel-1]].Add(Timer::GetMicroseconds() - mStartTime[channel-1]);
+    mStartTime[channel-1] = 0;
+    mActiveTransfers--;
+    STATS_Subtract(&mStats.Active, 1);
   }
 
   // Execute call-back
@@ -259,6 +373,7 @@ UNSIGNED16 loop; // Loop counter
       // set timeout for SDO request
       p_client->timeout = Tim->GetTime() + p_client->timeout_reload;
       p_client->status = p_client->status + SDOCL_WAIT_RES;
+      SDOCLNT_CountStart(p_client->channel, SDOCLNT_STATS_WRITE);
       return TRUE;
     }
   }
@@ -286,6 +401,7 @@ UNSIGNED16 loop; // Loop counter
     // set timeout for SDO request
     p_client->timeout = Tim->GetTime() + p_client->timeout_reload;
     p_client->status = p_client->status + SDOCL_WAIT_RES; 
+    SDOCLNT_CountStart(p_client->channel, SDOCLNT_STATS_WRITE);
     return TRUE;
   }
 
@@ -352,6 +468,7 @@ UNSIGNED8 *pDest;
     p_client->status = SDOCL_READY + SDOCL_WAIT_RES;
 #endif
     p_client->curlen = 0;
+    SDOCLNT_CountStart(p_client->channel, SDOCLNT_STATS_READ);
     return TRUE;
   }
   p_client->status = SDOCL_READY;
@@ -844,6 +961,12 @@ UNSIGNED8 SDOCLNT::MGR_SDOHandleClient (
 {
 #if USE_BLOCKED_SDO_CLIENT
 UNSIGNED8 loop;
+UNSIGNED8 burst;
+UNSIGNED8 pushed;
+UNSIGNED8 *p_buf;
+UNSIGNED32 curlen;
+UNSIGNED8 toggle;
+UNSIGNED8 blksize;
 #endif
 
   mCurrentChannel++; // working on next channel
@@ -889,8 +1012,16 @@ UNSIGNED8 loop;
     { // wait for timeout to avoid back-to-back traffic
       return FALSE;
     }
-    if (mSDOClientList[mCurrentChannel].curlen < mSDOClientList[mCurrentChannel].buflen)
+    pushed = TRUE;
+    for (burst = 0; (burst < mBlockBurst) &&
+                    (mSDOClientList[mCurrentChannel].status == SDOCL_BLOCK_WRITE) &&
+                    (mSDOClientList[mCurrentChannel].curlen < mSDOClientList[mCurrentChannel].buflen); burst++)
     { // Buffer not yet empty, more to transmit
+      // keep the state to send the segment again if it can not be pushed
+      p_buf = mSDOClientList[mCurrentChannel].pBuf;
+      curlen = mSDOClientList[mCurrentChannel].curlen;
+      toggle = mSDOClientList[mCurrentChannel].toggle;
+      blksize = mSDOClientList[mCurrentChannel].blksize;
       mSDOClientList[mCurrentChannel].toggle++;  
       mSDOClientList[mCurrentChannel].sdomsg.BUF[0] = mSDOClientList[mCurrentChannel].toggle;
       loop = 1;
@@ -912,12 +1043,27 @@ UNSIGNED8 loop;
         mSDOClientList[mCurrentChannel].status = SDOCL_BLOCK_WRCONF + SDOCL_WAIT_RES;
       }
       if (!MCOHW_PushMessage(mCurrentChannel + 1, &(mSDOClientList[mCurrentChannel].sdomsg)))
-      { // Error: transmit queue overrun
-        return FALSE;
+      { // Error: transmit queue overrun, segment is sent again next time
+        mSDOClientList[mCurrentChannel].pBuf = p_buf;
+        mSDOClientList[mCurrentChannel].curlen = curlen;
+        mSDOClientList[mCurrentChannel].toggle = toggle;
+        mSDOClientList[mCurrentChannel].blksize = blksize;
+        mSDOClientList[mCurrentChannel].status = SDOCL_BLOCK_WRITE;
+        pushed = FALSE;
+        break;
       }
-      // message transmitted, set new timeouts
+    }
+    if (burst)
+    { // messages transmitted, set new timeouts
       mSDOClientList[mCurrentChannel].b2btimeout = Tim->GetTime() + SDO_BACK2BACK_TIMEOUT;
       mSDOClientList[mCurrentChannel].timeout = Tim->GetTime() + mSDOClientList[mCurrentChannel].timeout_reload;
+    }
+    if (!pushed)
+    { // Error: transmit queue overrun
+      return FALSE;
+    }
+    if (burst)
+    {
       return TRUE;
     }
   }
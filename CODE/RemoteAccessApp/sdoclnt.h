@@ -18,12 +18,15 @@ VERSION:   1.10, EmSA 10-NOV-17
 
 #include "global.h"
 #include "Timer.h"
+#include "Statistics.h"
 
 
 // Number of SDO channels implemented
 #define NR_OF_SDO_CLIENTS 32
 // define to 1 to enable block transfers
 #define USE_BLOCKED_SDO_CLIENT 1
+// SDO client back-to-back transmit timeout in milliseconds
+#define SDO_BACK2BACK_TIMEOUT 3
 
 
 /**************************************************************************
@@ -102,6 +105,34 @@ typedef struct
 // callbacks
 typedef void (*SDOCLNTSENDCALLBACK)(UNSIGNED8 nodeid, UNSIGNED8 *pData, void *param);
 
+// transfer types with latency histograms
+#define SDOCLNT_STATS_READ  0
+#define SDOCLNT_STATS_WRITE 1
+#define SDOCLNT_STATS_TYPES 2
+
+// counters of an SDO client channel, the channel is the node id if
+// used through SerialProtocol
+typedef struct
+{
+  STATS_COUNTER Requests;         // transfers started
+  STATS_COUNTER Completed;        // transfers completed successfully
+  STATS_COUNTER Bytes;            // data bytes of completed transfers
+  STATS_COUNTER Timeouts;         // no response from the server
+  STATS_COUNTER AbortsReceived;   // transfers aborted by the server
+  STATS_COUNTER AbortsSent;       // aborts sent by the client
+  STATS_COUNTER ToggleErrors;     // segments with wrong toggle bit
+  STATS_COUNTER Errors;           // other failures, e.g. buffer too small
+} SDOCLNT_CHANNELSTATS;
+
+// counters of the SDO client
+typedef struct
+{
+  SDOCLNT_CHANNELSTATS Channels[NR_OF_SDO_CLIENTS + 1]; // by channel, 0 not used
+  STATS_COUNTER Active;           // transfers in progress
+  STATS_COUNTER MaxActive;        // most transfers in progress at once
+  STATS_HISTOGRAM Latency[SDOCLNT_STATS_TYPES]; // duration of transfers
+} SDOCLNT_STATISTICS;
+
 
 class SDOCLNT
 {
@@ -260,6 +291,46 @@ class SDOCLNT
       void
       );
     /**************************************************************************
+    DOES:    Gets the counters of the SDO client, they can be read by other
+             threads while transfers are running
+    RETURNS: Counters
+    ***************************************************************************/ 
+    const SDOCLNT_STATISTICS *SDOCLNT_GetStatistics (
+      void
+      ) const { return &mStats; }
+    /**************************************************************************
+    DOES:    Sets how many block download segments are sent back-to-back
+             before waiting for the back-to-back timeout. Default 16, 1 for
+             devices whose CAN transmit queue takes one segment at a time.
+    RETURNS: nothing
+    ***************************************************************************/ 
+    void SDOCLNT_SetBlockBurst (
+      UNSIGNED8 segments // segments sent back-to-back, 1 to 127
+      );
+    /**************************************************************************
+    DOES:    Gets how many block download segments are sent back-to-back
+    RETURNS: Number of segments
+    ***************************************************************************/ 
+    UNSIGNED8 SDOCLNT_GetBlockBurst (
+      void
+      ) const { return mBlockBurst; }
+    /**************************************************************************
+    DOES:    Gets the number of transfers in progress, for the thread
+             running the SDO client
+    RETURNS: Number of transfers
+    ***************************************************************************/ 
+    UNSIGNED8 SDOCLNT_GetActiveTransfers (
+      void
+      ) const { return mActiveTransfers; }
+    /**************************************************************************
+    DOES:    Sets the counters of the SDO client to 0, transfers in progress
+             remain counted as active
+    RETURNS: nothing
+    ***************************************************************************/ 
+    void SDOCLNT_ResetStatistics (
+      void
+      );
+    /**************************************************************************
     DOES:    Gets executed if a CAN message was received that is the response
              to a SDO request
     RETURNS: Nothing
@@ -297,6 +368,14 @@ class SDOCLNT
       UNSIGNED8 node_id,
       CAN_MSG *pTx
       );
+    /**************************************************************************
+    DOES:    Counts a transfer that was started
+    RETURNS: nothing
+    **************************************************************************/
+    void SDOCLNT_CountStart (
+      UNSIGNED8 channel, // SDO channel number in range of 1 to NR_OF_SDO_CLIENTS
+      UNSIGNED8 type // SDOCLNT_STATS_READ or SDOCLNT_STATS_WRITE
+      );
 
     // data records for each client
     SDOCLIENT mSDOClientList[NR_OF_SDO_CLIENTS];
@@ -304,10 +383,20 @@ class SDOCLNT
     UNSIGNED8 mCurrentChannel;
     // timer
     Timer *Tim;
+    // block download segments sent back-to-back
+    UNSIGNED8 mBlockBurst;
     // callback function to send an SDO
     SDOCLNTSENDCALLBACK *SendCallback;
     // instance of class that performs the SDO send
     void *SenderInstance;
+    // counters
+    SDOCLNT_STATISTICS mStats;
+    // transfers in progress
+    UNSIGNED8 mActiveTransfers;
+    // start time of transfers in microseconds, 0 if none is running
+    uint64_t mStartTime[NR_OF_SDO_CLIENTS];
+    // SDOCLNT_STATS_xxx of running transfers
+    UNSIGNED8 mTransferType[NR_OF_SDO_CLIENTS];
 };
 
 